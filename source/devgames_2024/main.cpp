@@ -28,6 +28,7 @@
 #include "kernel/assert.hpp"
 #include "kernel/string_view.hpp"
 #include "kernel/utf.hpp"
+#include "kernel/cpu_features.hpp"
 #include "kernel/string.hpp"
 #include "kernel/allocator.hpp"
 #include "kernel/memory.hpp"
@@ -44,6 +45,7 @@
 #include "application/window.hpp"
 #include "application/application.hpp"
 
+#include "gpu/draw_stream.hpp"
 #include "gpu/gpu_device.hpp"
 #include "gpu/idra_imgui.hpp"
 
@@ -465,6 +467,8 @@ void DevGames2024Demo::create_resources( AssetManager* asset_manager, AssetCreat
         setup_earth_atmosphere( atmosphere_parameters, 1000.f );
 
         ShaderAssetLoader* shader_loader = asset_manager->get_loader<ShaderAssetLoader>();
+        // Shaders are compiled in parallel at the end of the startup block.
+        shader_loader->begin_batch();
 
         transmittance_lut_shader = shader_loader->compile_compute( {},
                                                                    { "platform.h", "atmospheric_scattering/definitions.glsl",
@@ -692,34 +696,36 @@ void DevGames2024Demo::create_resources( AssetManager* asset_manager, AssetCreat
             .dynamic_buffer_bindings = {{.binding = 0, .size = sizeof( SkymapConstants )}},
             .layout = skymap_dsl,
             .debug_name = "skymap_ds" } );
+
+        shader_loader->end_batch();
     }
 
     // Update dependent assets/resources
     // NOTE: shaders are already reloaded, and just the shader handle is modified.
-    // Just need to create the pipelines.
+    // Just need to create the pipelines, on reload they replace the previous ones once compiled.
 
     // Atmospheric scattering
-    transmittance_lut_pso = gpu->create_compute_pipeline( {
+    transmittance_lut_pso = gpu->create_compute_pipeline_async( {
         .shader = transmittance_lut_shader->shader,
         .descriptor_set_layouts = { gpu->bindless_descriptor_set_layout, shared_dsl },
-        .debug_name = "transmittance_lut_pso" } );
+        .debug_name = "transmittance_lut_pso" }, transmittance_lut_pso );
 
-    multiscattering_lut_pso = gpu->create_compute_pipeline( {
+    multiscattering_lut_pso = gpu->create_compute_pipeline_async( {
         .shader = multiscattering_lut_shader->shader,
         .descriptor_set_layouts = { gpu->bindless_descriptor_set_layout, shared_dsl },
-        .debug_name = "transmittance_lut_pso" } );
+        .debug_name = "transmittance_lut_pso" }, multiscattering_lut_pso );
 
-    aerial_perspective_pso = gpu->create_compute_pipeline( {
+    aerial_perspective_pso = gpu->create_compute_pipeline_async( {
         .shader = aerial_perspective_shader->shader,
         .descriptor_set_layouts = { gpu->bindless_descriptor_set_layout, shared_dsl },
-        .debug_name = "aerial_perspective_pso" } );
+        .debug_name = "aerial_perspective_pso" }, aerial_perspective_pso );
 
-    sky_lut_pso = gpu->create_compute_pipeline( {
+    sky_lut_pso = gpu->create_compute_pipeline_async( {
         .shader = sky_lut_shader->shader,
         .descriptor_set_layouts = { gpu->bindless_descriptor_set_layout, shared_dsl },
-        .debug_name = "sky_lut_pso" } );
+        .debug_name = "sky_lut_pso" }, sky_lut_pso );
 
-    sky_apply_pso = gpu->create_graphics_pipeline( {
+    sky_apply_pso = gpu->create_graphics_pipeline_async( {
             .rasterization = {},
             .depth_stencil = {},
             .blend_state = {.blend_states = {{.source_color = Blend::SrcAlpha,
@@ -732,10 +738,10 @@ void DevGames2024Demo::create_resources( AssetManager* asset_manager, AssetCreat
             .viewport = {},
             .color_formats = { gpu->swapchain_format },
             .depth_format = TextureFormat::D32_FLOAT,
-            .debug_name = "sky_apply_pso" } );
+            .debug_name = "sky_apply_pso" }, sky_apply_pso );
 
     // Ocean
-    ocean_bruneton_render_pso = gpu->create_graphics_pipeline( {
+    ocean_bruneton_render_pso = gpu->create_graphics_pipeline_async( {
             .rasterization = { .fill = FillMode::Solid },
             .depth_stencil = { .depth_comparison = ComparisonFunction::Less,
                                 .depth_enable = 1, .depth_write_enable = 1 },
@@ -749,18 +755,21 @@ void DevGames2024Demo::create_resources( AssetManager* asset_manager, AssetCreat
             .viewport = {},
             .color_formats = { gpu->swapchain_format },
             .depth_format = TextureFormat::D32_FLOAT,
-            .debug_name = "ocean_bruneton_render_pso" } );
+            .debug_name = "ocean_bruneton_render_pso" }, ocean_bruneton_render_pso );
 
-    skymap_pso = gpu->create_compute_pipeline( {
+    skymap_pso = gpu->create_compute_pipeline_async( {
         .shader = skymap_shader->shader,
         .descriptor_set_layouts = { gpu->bindless_descriptor_set_layout, skymap_dsl },
-        .debug_name = "skymap_pso" } );
+        .debug_name = "skymap_pso" }, skymap_pso );
 }
 
 void DevGames2024Demo::destroy_resources( AssetManager* asset_manager, AssetDestructionPhase::Enum phase ) {
 
-    // Atmospheric scattering
-    // Destroy only the psos and return.
+    // Pipelines are replaced by the reloaded ones.
+    if ( phase == AssetDestructionPhase::Reload ) {
+        return;
+    }
+
     gpu->destroy_pipeline( transmittance_lut_pso );
     gpu->destroy_pipeline( multiscattering_lut_pso );
     gpu->destroy_pipeline( aerial_perspective_pso );
@@ -769,10 +778,6 @@ void DevGames2024Demo::destroy_resources( AssetManager* asset_manager, AssetDest
     gpu->destroy_pipeline( ocean_bruneton_render_pso );
     gpu->destroy_pipeline( skymap_pso );
 
-    if ( phase == AssetDestructionPhase::Reload ) {
-        return;
-    }
-
     ShaderAssetLoader* shader_loader = asset_manager->get_loader<ShaderAssetLoader>();
 
     shader_loader->unload( transmittance_lut_shader );
@@ -827,6 +832,8 @@ void DevGames2024Demo::main() {
     g_time->init();
     g_log->init( g_memory->get_resident_allocator() );
 
+    cpu_features_log();
+
     // Asset compiler test
     asset_compiler_main( "../data", "data" );
 
@@ -859,7 +866,11 @@ void DevGames2024Demo::main() {
     idra::AssetManager* asset_manager = idra::AssetManager::init_system();
     // Asset loaders
     idra::ShaderAssetLoader shader_loader;
-    shader_loader.init( app_allocator, 32, asset_manager, gpu );
+    shader_loader.init( app_allocator, 128, asset_manager, gpu );
+    // Variants requested in the last run are compiled when their shader is declared.
+    shader_loader.load_used_variants( "shader_cache/used_shader_variants.txt" );
+    // Built offline by shader_compiler_cli from data/shaders/shader_pack.json, missing shaders are compiled.
+    shader_loader.load_shader_pack( "data/shader_pack.bhsp" );
 
     idra::TextureAssetLoader texture_loader;
     texture_loader.init( app_allocator, 128, asset_manager, gpu );
@@ -867,10 +878,15 @@ void DevGames2024Demo::main() {
     idra::TextureAtlasLoader atlas_loader;
     atlas_loader.init( app_allocator, 128, asset_manager, gpu );
 
+    // Effects (.bhfx) built by the asset compiler.
+    idra::PipelineAssetLoader pipeline_loader;
+    pipeline_loader.init( app_allocator, 32, asset_manager, gpu );
+
     // Assign loaders
     asset_manager->set_loader( idra::ShaderAssetLoader::k_loader_index, &shader_loader );
     asset_manager->set_loader( idra::TextureAssetLoader::k_loader_index, &texture_loader );
     asset_manager->set_loader( idra::TextureAtlasLoader::k_loader_index, &atlas_loader );
+    asset_manager->set_loader( idra::PipelineAssetLoader::k_loader_index, &pipeline_loader );
 
     // Load assets!
 
@@ -896,6 +912,10 @@ void DevGames2024Demo::main() {
     }
 
     create_resources( asset_manager, idra::AssetCreationPhase::Startup );
+    // Startup pipelines are compiled in parallel, the first frame needs them all.
+    gpu->wait_pipeline_compilations();
+    // Report how many startup shaders came from the SPIR-V cache.
+    shader_compiler_log_statistics();
 
     // Render targets
     idra::TextureHandle game_rt = gpu->create_texture( {
@@ -937,6 +957,44 @@ void DevGames2024Demo::main() {
     // Sun
     float sun_pitch = 0.45f, sun_yaw = 0;
 
+    // Worst frame from a shader reload until its pipelines are ready.
+    // Compare with GpuDeviceCreation::pipeline_compilation_threads set to 0.
+    bool measuring_reload = false;
+    u32 reload_frames = 0;
+    f32 reload_worst_frame_ms = 0.f;
+
+    // Records the same draws directly and through a DrawStream, timing the CPU side.
+    // Draws have zero instances so the GPU does no work.
+    bool benchmark_draw_stream = false;
+    u32 benchmark_draw_count = 10000;
+    f32 direct_draws_per_ms = 0.f;
+    f32 stream_draws_per_ms = 0.f;
+    idra::DrawStream benchmark_stream;
+    benchmark_stream.init( app_allocator, 1024 );
+
+    // Records a synthetic scene of zero-instance draws split across jobs into
+    // secondary command buffers. The job count cycles from 1 to the max every frame.
+    // Workers are created once, their thread ids are the recording thread indices,
+    // so there can't be more workers than the device has secondary command pools for.
+    static const u32 k_max_benchmark_threads = 8;
+    const u32 max_benchmark_threads = idra::min( k_max_benchmark_threads, gpu->command_buffer_manager->recording_threads );
+    bool benchmark_parallel_recording = false;
+    u32 parallel_benchmark_draws = 100000;
+    u32 parallel_benchmark_threads = 1;
+    f32 parallel_recording_ms[ k_max_benchmark_threads ] = {};
+    idra::TaskManager recording_task_manager;
+    recording_task_manager.init( max_benchmark_threads );
+
+    // Uploads a buffer bigger than the staging ring, that must be split over frames.
+    // The source is a mapped buffer, as the application allocator is smaller than the ring.
+    BufferHandle overflow_source_buffer;
+    BufferHandle overflow_target_buffer;
+    bool overflow_test_running = false;
+    u32 overflow_test_size = 0;
+    u32 overflow_test_frames = 0;
+    u64 overflow_test_start_bytes = 0;
+    u64 overflow_test_staged_bytes = 0;
+
     // Main loop!
     while ( window.is_running && !quit_application ) {
         // Frame begin
@@ -960,6 +1018,9 @@ void DevGames2024Demo::main() {
         gpu->new_frame();
         g_imgui->new_frame();
 
+        // Pick up shader variants compiled in the background.
+        shader_loader.update();
+
         // Check for game window resize
         game_render_view.check_resize( gpu, input );
 
@@ -969,6 +1030,16 @@ void DevGames2024Demo::main() {
 
         elapsed_time += delta_time;
 
+        if ( measuring_reload ) {
+            reload_worst_frame_ms = idra::max( reload_worst_frame_ms, delta_time * 1000.f );
+            ++reload_frames;
+
+            if ( gpu->get_pipeline_compilation_count() == 0 ) {
+                ilog( "Shader reload: pipelines ready after %u frames, worst frame %.2f ms.\n", reload_frames, reload_worst_frame_ms );
+                measuring_reload = false;
+            }
+        }
+
         // Re-center mouse
         if ( game_render_view.focus ) {
             game_camera.update( input, window.width, window.height, delta_time );
@@ -1014,6 +1085,85 @@ void DevGames2024Demo::main() {
                 }
 
                 create_resources( asset_manager, idra::AssetCreationPhase::Reload );
+
+                measuring_reload = true;
+                reload_frames = 0;
+                reload_worst_frame_ms = 0.f;
+            }
+
+            const idra::CommandStateStatistics& command_statistics = gpu->command_state_statistics;
+            u32 recorded_commands = 0, skipped_commands = 0;
+            for ( u32 i = 0; i < idra::CommandStateStatistics::Count; ++i ) {
+                recorded_commands += command_statistics.recorded[ i ];
+                skipped_commands += command_statistics.skipped[ i ];
+            }
+            ImGui::Text( "State commands %u, redundant skipped %u (pipelines %u, descriptor sets %u)", recorded_commands, skipped_commands,
+                         command_statistics.skipped[ idra::CommandStateStatistics::Pipelines ],
+                         command_statistics.skipped[ idra::CommandStateStatistics::DescriptorSets ] );
+
+            const idra::UploadStatistics& upload_statistics = gpu->upload_statistics;
+            ImGui::Text( "Uploads %.2f MB/s, %u KB, %u copy commands, %u completed, %u pending, staging %u/%u KB",
+                         delta_time > 0.f ? upload_statistics.bytes / ( 1024.f * 1024.f ) / delta_time : 0.f,
+                         upload_statistics.bytes / 1024, upload_statistics.copy_commands, upload_statistics.completed_uploads,
+                         upload_statistics.pending_uploads, upload_statistics.staging_used / 1024, gpu->staging_ring.size / 1024 );
+
+            if ( ImGui::Button( "Staging overflow test" ) && !overflow_test_running ) {
+                overflow_test_size = gpu->staging_ring.size + gpu->staging_ring.size / 2 + 4099;
+
+                overflow_source_buffer = gpu->create_buffer( {
+                    .type = BufferUsage::Staging_mask, .usage = ResourceUsageType::Dynamic,
+                    .size = overflow_test_size, .persistent = 1, .device_only = 0, .initial_data = nullptr,
+                    .debug_name = "overflow_test_source" } );
+                overflow_target_buffer = gpu->create_buffer( {
+                    .type = BufferUsage::Structured_mask, .usage = ResourceUsageType::Immutable,
+                    .size = overflow_test_size, .persistent = 0, .device_only = 1, .initial_data = nullptr,
+                    .debug_name = "overflow_test_target" } );
+
+                u8* source_data = gpu->buffers.get_cold( overflow_source_buffer )->mapped_data;
+                for ( u32 i = 0; i < overflow_test_size; ++i ) {
+                    source_data[ i ] = ( u8 )i;
+                }
+
+                gpu->upload_buffer_data( overflow_target_buffer, source_data, overflow_test_size, 0 );
+
+                overflow_test_running = true;
+                overflow_test_frames = 0;
+                overflow_test_start_bytes = upload_statistics.total_bytes;
+            }
+
+            if ( overflow_test_running ) {
+                ++overflow_test_frames;
+
+                if ( gpu->buffers.get_cold( overflow_target_buffer )->ready ) {
+                    overflow_test_running = false;
+                    overflow_test_staged_bytes = upload_statistics.total_bytes - overflow_test_start_bytes;
+
+                    gpu->destroy_buffer( overflow_source_buffer );
+                    gpu->destroy_buffer( overflow_target_buffer );
+                }
+            }
+
+            if ( overflow_test_size ) {
+                // The upload must be complete, staged once, and span more than one frame.
+                const bool passed = !overflow_test_running && overflow_test_staged_bytes == overflow_test_size && overflow_test_frames > 1;
+                ImGui::Text( "Overflow test %s: %u KB in %u frames", overflow_test_running ? "running" : ( passed ? "passed" : "FAILED" ),
+                             overflow_test_size / 1024, overflow_test_frames );
+            }
+
+            ImGui::Checkbox( "Benchmark DrawStream", &benchmark_draw_stream );
+            if ( benchmark_draw_stream ) {
+                ImGui::SliderUint( "Benchmark draws", &benchmark_draw_count, 1000, 100000 );
+                ImGui::Text( "Draws per ms: direct %.0f, stream %.0f (%u bytes)", direct_draws_per_ms, stream_draws_per_ms,
+                             benchmark_stream.data.size_in_bytes() );
+            }
+
+            ImGui::Checkbox( "Benchmark parallel recording", &benchmark_parallel_recording );
+            if ( benchmark_parallel_recording ) {
+                ImGui::SliderUint( "Synthetic scene draws", &parallel_benchmark_draws, 10000, 200000 );
+                for ( u32 t = 0; t < max_benchmark_threads; ++t ) {
+                    ImGui::Text( "%u threads: %.3f ms, speedup %.2fx", t + 1, parallel_recording_ms[ t ],
+                                 parallel_recording_ms[ t ] > 0.f ? parallel_recording_ms[ 0 ] / parallel_recording_ms[ t ] : 0.f );
+                }
             }
 
             ImGui::Checkbox( "Show Ocean", &show_ocean );
@@ -1238,9 +1388,10 @@ void DevGames2024Demo::main() {
             cb->push_marker( "transmittance lut" );
             cb->submit_barriers( { {transmittance_lut, ResourceState::UnorderedAccess, 0, 1} },
                                  {  } );
-            cb->bind_pipeline( transmittance_lut_pso );
-            cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { atmosphere_cb_offset } );
-            cb->dispatch_2d( 256, 64, 32, 32 );
+            if ( cb->bind_pipeline( transmittance_lut_pso ) ) {
+                cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { atmosphere_cb_offset } );
+                cb->dispatch_2d( 256, 64, 32, 32 );
+            }
 
             cb->submit_barriers( { {transmittance_lut, ResourceState::ShaderResource, 0, 1} }, {} );
             cb->pop_marker();
@@ -1249,9 +1400,10 @@ void DevGames2024Demo::main() {
             cb->push_marker( "multiscattering lut" );
             cb->submit_barriers( { {multiscattering_lut, ResourceState::UnorderedAccess, 0, 1} },
                                  {  } );
-            cb->bind_pipeline( multiscattering_lut_pso );
-            cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { atmosphere_cb_offset } );
-            cb->dispatch_2d( 32, 32, 1, 1 );
+            if ( cb->bind_pipeline( multiscattering_lut_pso ) ) {
+                cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { atmosphere_cb_offset } );
+                cb->dispatch_2d( 32, 32, 1, 1 );
+            }
 
             cb->submit_barriers( { {multiscattering_lut, ResourceState::ShaderResource, 0, 1} }, {} );
 
@@ -1262,9 +1414,10 @@ void DevGames2024Demo::main() {
             cb->submit_barriers( { {aerial_perspective_texture, ResourceState::UnorderedAccess, 0, 1},
                                  {aerial_perspective_texture_debug, ResourceState::UnorderedAccess, 0, 1} },
                                  {  } );
-            cb->bind_pipeline( aerial_perspective_pso );
-            cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { atmosphere_cb_offset } );
-            cb->dispatch_3d( 32, 32, 32, 8, 8, 1 );
+            if ( cb->bind_pipeline( aerial_perspective_pso ) ) {
+                cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { atmosphere_cb_offset } );
+                cb->dispatch_3d( 32, 32, 32, 8, 8, 1 );
+            }
 
             cb->submit_barriers( { {aerial_perspective_texture, ResourceState::ShaderResource, 0, 1},
                                  {aerial_perspective_texture_debug, ResourceState::UnorderedAccess, 0, 1} }, {} );
@@ -1274,10 +1427,10 @@ void DevGames2024Demo::main() {
             cb->push_marker( "sky view" );
             cb->submit_barriers( { {sky_view_lut, ResourceState::UnorderedAccess, 0, 1} },
                                  {  } );
-            cb->bind_pipeline( sky_lut_pso );
-            cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { atmosphere_cb_offset } );
-
-            cb->dispatch_2d( 192, 108, 32, 32 );
+            if ( cb->bind_pipeline( sky_lut_pso ) ) {
+                cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { atmosphere_cb_offset } );
+                cb->dispatch_2d( 192, 108, 32, 32 );
+            }
 
             cb->submit_barriers( { {sky_view_lut, ResourceState::ShaderResource, 0, 1} }, {} );
             cb->pop_marker();
@@ -1297,9 +1450,39 @@ void DevGames2024Demo::main() {
         if ( apply_atmospheric_scattering ) {
             cb->push_marker( "sky apply" );
 
-            cb->bind_pipeline( sky_apply_pso );
-            cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { atmosphere_cb_offset } );
-            cb->draw( TopologyType::Triangle, 0, 3, 0, 1 );
+            if ( cb->bind_pipeline( sky_apply_pso ) ) {
+                cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { atmosphere_cb_offset } );
+                cb->draw( TopologyType::Triangle, 0, 3, 0, 1 );
+            }
+
+            cb->pop_marker();
+        }
+
+        if ( benchmark_draw_stream ) {
+            cb->push_marker( "draw stream benchmark" );
+
+            TimeTick start_tick = g_time->now();
+            for ( u32 i = 0; i < benchmark_draw_count; ++i ) {
+                if ( cb->bind_pipeline( sky_apply_pso ) ) {
+                    cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { atmosphere_cb_offset } );
+                    cb->draw( TopologyType::Triangle, 0, 3, i, 0 );
+                }
+            }
+            f64 elapsed_ms = g_time->convert_milliseconds( g_time->delta( g_time->now(), start_tick ) );
+            direct_draws_per_ms = ( f32 )( benchmark_draw_count / elapsed_ms );
+
+            // Encoding is included, as render systems would record the stream every frame.
+            start_tick = g_time->now();
+            benchmark_stream.reset();
+            benchmark_stream.set_pipeline( sky_apply_pso );
+            benchmark_stream.set_descriptor_sets( { cb->gpu_device->bindless_descriptor_set, shared_ds } );
+            benchmark_stream.set_dynamic_offsets( { atmosphere_cb_offset } );
+            for ( u32 i = 0; i < benchmark_draw_count; ++i ) {
+                benchmark_stream.draw( 0, 3, i, 0 );
+            }
+            cb->draw_stream( benchmark_stream );
+            elapsed_ms = g_time->convert_milliseconds( g_time->delta( g_time->now(), start_tick ) );
+            stream_draws_per_ms = ( f32 )( benchmark_draw_count / elapsed_ms );
 
             cb->pop_marker();
         }
@@ -1311,6 +1494,65 @@ void DevGames2024Demo::main() {
 
         cb->end_render_pass();
 
+        if ( benchmark_parallel_recording ) {
+            cb->push_marker( "parallel recording benchmark" );
+            cb->begin_pass( { game_rt }, { LoadOperation::Load }, { {0,0,0,0} }, game_depth_rt, LoadOperation::Load, {}, true );
+
+            const u32 thread_count = parallel_benchmark_threads;
+            const u32 draws_per_job = ( parallel_benchmark_draws + thread_count - 1 ) / thread_count;
+
+            // Each job records a range of draws into its own secondary, taken from the pools
+            // of the worker running it.
+            struct RecordJob {
+                u32             first_draw;
+                u32             last_draw;
+                CommandBuffer*  secondary;
+            };
+            RecordJob record_jobs[ k_max_benchmark_threads ];
+            CommandBuffer* secondary_command_buffers[ k_max_benchmark_threads ];
+
+            idra::TaskManager::Callback record_job = [ & ]( void* data, i32 thread_id ) {
+                RecordJob* job = ( RecordJob* )data;
+
+                CommandBuffer* secondary = gpu->acquire_secondary_command_buffer( ( u32 )thread_id, cb );
+                secondary->set_framebuffer_scissor();
+                secondary->set_framebuffer_viewport();
+
+                for ( u32 d = job->first_draw; d < job->last_draw; ++d ) {
+                    if ( secondary->bind_pipeline( sky_apply_pso ) ) {
+                        secondary->bind_descriptor_set( { gpu->bindless_descriptor_set, shared_ds }, { atmosphere_cb_offset } );
+                        secondary->draw( TopologyType::Triangle, 0, 3, d, 0 );
+                    }
+                }
+
+                job->secondary = secondary;
+            };
+
+            const TimeTick start_tick = g_time->now();
+
+            for ( u32 j = 0; j < thread_count; ++j ) {
+                RecordJob& job = record_jobs[ j ];
+                job.first_draw = j * draws_per_job;
+                job.last_draw = job.first_draw + draws_per_job < parallel_benchmark_draws ? job.first_draw + draws_per_job : parallel_benchmark_draws;
+                job.secondary = nullptr;
+                recording_task_manager.add_task( record_job, &job );
+            }
+            recording_task_manager.start_tasks();
+            recording_task_manager.wait_for_completion();
+
+            // Submit order is the job order, whatever worker ran them and in which order they finished.
+            for ( u32 j = 0; j < thread_count; ++j ) {
+                secondary_command_buffers[ j ] = record_jobs[ j ].secondary;
+            }
+            cb->execute_secondary( Span<CommandBuffer* const>( secondary_command_buffers, thread_count ) );
+
+            parallel_recording_ms[ thread_count - 1 ] = ( f32 )g_time->convert_milliseconds( g_time->delta( g_time->now(), start_tick ) );
+            parallel_benchmark_threads = thread_count % max_benchmark_threads + 1;
+
+            cb->end_render_pass();
+            cb->pop_marker();
+        }
+
         cb->submit_barriers( { {game_rt, ResourceState::ShaderResource, 0, 1},
                              { game_depth_rt, ResourceState::ShaderResource, 0, 1 } }, {} );
         cb->pop_marker();
@@ -1340,6 +1582,9 @@ void DevGames2024Demo::main() {
         gpu->present();
     }
 
+    benchmark_stream.shutdown();
+    recording_task_manager.shutdown();
+
     gpu->destroy_texture( game_rt );
     gpu->destroy_texture( game_depth_rt );
 
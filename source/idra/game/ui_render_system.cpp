@@ -8,6 +8,7 @@
 #include "kernel/asset.hpp"
 #include "kernel/blob.hpp"
 #include "kernel/numerics.hpp"
+#include "kernel/utf.hpp"
 
 #include "gpu/gpu_device.hpp"
 
@@ -37,7 +38,8 @@ void UIRenderSystem::create_resources( AssetManager* asset_manager, AssetCreatio
         return;
     }
 
-    font = asset_manager->get_loader<FontAssetLoader>()->load( "../data/fonts/PixelFont.ttf" );
+    static constexpr char k_font_path[] = "../data/fonts/PixelFont.ttf";
+    font = asset_manager->get_loader<FontAssetLoader>()->load( StringId( k_font_path ), k_font_path );
 
     // TODO:
     Allocator* allocator = g_memory->get_resident_allocator();
@@ -48,9 +50,24 @@ void UIRenderSystem::create_resources( AssetManager* asset_manager, AssetCreatio
         return;
     }
 
+    if ( ui_blueprint_file.size < sizeof( UIBlueprint ) || !blob_validate( ui_blueprint_file ) ) {
+        ilog_error( "Invalid ui blueprint %s\n", "data/ui.bui" );
+        ifree( ui_blueprint_file.data, allocator );
+        return;
+    }
+
     BlobReader blob_reader;
-    // TODO: allocation when versions are different ?
-    ui_blueprint = blob_reader.read<UIBlueprint>( nullptr, UIBlueprint::k_version, ui_blueprint_file, false );
+    ui_blueprint = blob_reader.read<UIBlueprint>( allocator, UIBlueprint::k_version, ui_blueprint_file, false );
+
+    // Upgraded blueprints live in the reader memory.
+    if ( ( char* )ui_blueprint != ui_blueprint_file.data ) {
+        ifree( ui_blueprint_file.data, allocator );
+    }
+
+    if ( !ui_blueprint ) {
+        ilog_error( "Failed reading ui blueprint %s\n", "data/ui.bui" );
+        return;
+    }
 
     ui_texture = asset_manager->get_loader<TextureAssetLoader>()->load( ui_blueprint->texture_name.c_str() );
 
@@ -77,10 +94,13 @@ void UIRenderSystem::destroy_resources( AssetManager* asset_manager, AssetDestru
 
     // TODO:
     Allocator* allocator = g_memory->get_resident_allocator();
-    ifree( ui_blueprint, allocator );
-
     asset_manager->get_loader<FontAssetLoader>()->unload( font );
-    asset_manager->get_loader<TextureAssetLoader>()->unload( ui_blueprint->texture_name.c_str() );
+
+    if ( ui_blueprint ) {
+        asset_manager->get_loader<TextureAssetLoader>()->unload( ui_blueprint->texture_name.c_str() );
+
+        ifree( ui_blueprint, allocator );
+    }
 }
 
 
@@ -201,9 +221,10 @@ void UIRenderSystem::add_text( SpriteBatch& sprite_batch, cstring text, const ve
     const f32 pixel_font_height = font_get_height( font_info );
     s.size.y = pixel_font_height;
 
-    const char* char_ptr = text;
-    while ( *char_ptr ) {
-        const char c = *char_ptr++;
+    const StringView text_view( text );
+    u32 text_offset = 0;
+    while ( text_offset < text_view.size ) {
+        i32 c = utf8_decode( text_view, text_offset );
 
         if ( ( c == '\n' ) || ( c == '\r' ) ) {
             s.position.x = position.x;
@@ -211,6 +232,11 @@ void UIRenderSystem::add_text( SpriteBatch& sprite_batch, cstring text, const ve
             continue;
         }
 
+        // Glyphs outside the baked range, and invalid sequences, are drawn as '?'.
+        if ( c < FontInfo::k_first_char || c >= FontInfo::k_last_char ) {
+            c = '?';
+        }
+
         const u16 start_x = font_info.char_start_x[ c - FontInfo::k_first_char ];
         const u16 next_start_x = font_info.char_start_x[ c + 1 - FontInfo::k_first_char ];
         s.size.x = ( f32 )( next_start_x - start_x ) * font_global_scale;
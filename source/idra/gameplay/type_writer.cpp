@@ -4,6 +4,7 @@
 #include "kernel/allocator.hpp"
 #include "kernel/numerics.hpp"
 #include "kernel/log.hpp"
+#include "kernel/utf.hpp"
 
 #include <float.h>
 #include <string>
@@ -41,6 +42,10 @@ void TypeWriter::start_writing( StringView text ) {
 
     source_text = text.data;
 
+    if ( !utf8_validate( text ) ) {
+        ilog_warn( "TypeWriter text is not valid UTF8, invalid bytes are written as single characters.\n" );
+    }
+
     // Scan for max number of chars
     // Cache max lines found in pages and use the max of all pages.
     max_lines_in_page = 1;
@@ -67,7 +72,10 @@ void TypeWriter::start_writing( StringView text ) {
                 ++text_to_scan;
         }
 
-        ++current_chars;
+        // Count code points, not bytes.
+        if ( ( c & 0xC0 ) != 0x80 ) {
+            ++current_chars;
+        }
         if ( ( c == '\n' ) || ( c == '\r' ) ) {
             max_chars_per_line = idra::max( max_chars_per_line, current_chars );
             current_chars = 0;
@@ -115,10 +123,16 @@ void TypeWriter::update( f32 dt ) {
         }
 
         if ( current_command == Commands::CommandType_Write ) {
-            output_text[ output_position++ ] = *parser.position;
-            output_text[ output_position ] = 0;
+            // Write a whole UTF8 sequence, so partial characters are never displayed.
+            u32 sequence_length = idra::max( utf8_sequence_length( *parser.position ), 1u );
+            if ( output_position + sequence_length >= k_max_chars ) {
+                return;
+            }
 
-            parser.position++;
+            for ( ; sequence_length && *parser.position; --sequence_length ) {
+                output_text[ output_position++ ] = *parser.position++;
+            }
+            output_text[ output_position ] = 0;
         }
 
         command_time = 0.f;
@@ -1,4 +1,5 @@
 #include "gpu/command_buffer.hpp"
+#include "gpu/draw_stream.hpp"
 #include "gpu/gpu_device.hpp"
 
 #include "kernel/memory.hpp"
@@ -17,7 +18,10 @@ void CommandBuffer::reset() {
     is_recording = false;
 
     current_pipeline = nullptr;
+    bound_state = {};
+    state_statistics = {};
     inside_pass = false;
+    pass_secondary_contents = false;
     frame_buffer_width = 0;
     frame_buffer_height = 0;
 
@@ -55,7 +59,8 @@ void CommandBuffer::begin_pass( Span<const TextureHandle> render_targets,
                                 Span<const ClearColor> clear_values,
                                 TextureHandle depth,
                                 LoadOperation::Enum depth_load_operation,
-                                ClearDepthStencil depth_stencil_clear ) {
+                                ClearDepthStencil depth_stencil_clear,
+                                bool secondary_contents ) {
 
     Array<VkRenderingAttachmentInfoKHR> color_attachments_info;
 
@@ -68,6 +73,9 @@ void CommandBuffer::begin_pass( Span<const TextureHandle> render_targets,
     frame_buffer_height = 0;
 
     inside_pass = true;
+    pass_secondary_contents = secondary_contents;
+    pass_color_format_count = ( u32 )render_targets.size;
+    pass_depth_format = VK_FORMAT_UNDEFINED;
 
     for ( u32 a = 0; a < ( u32 )render_targets.size; ++a ) {
         Texture* texture = gpu_device->textures.get_cold( render_targets[a] );
@@ -84,6 +92,8 @@ void CommandBuffer::begin_pass( Span<const TextureHandle> render_targets,
             iassert( frame_buffer_height == texture->height );
         }
 
+        pass_color_formats[ a ] = ( VkFormat )vk_texture->vk_format;
+
         VkAttachmentLoadOp load_op;
         switch ( load_operations[ a ] ) {
             case LoadOperation::Load:
@@ -125,6 +135,8 @@ void CommandBuffer::begin_pass( Span<const TextureHandle> render_targets,
         iassert( frame_buffer_width == texture->width );
         iassert( frame_buffer_height == texture->height );
 
+        pass_depth_format = ( VkFormat )vk_texture->vk_format;
+
         VkAttachmentLoadOp load_op;
         switch ( depth_load_operation ) {
             case LoadOperation::Load:
@@ -148,7 +160,7 @@ void CommandBuffer::begin_pass( Span<const TextureHandle> render_targets,
     }
 
     VkRenderingInfoKHR rendering_info{ VK_STRUCTURE_TYPE_RENDERING_INFO_KHR };
-    rendering_info.flags = 0;
+    rendering_info.flags = secondary_contents ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT_KHR : 0;
     rendering_info.layerCount = 1;//framebuffer->layers;
     rendering_info.viewMask = 0;// render_pass->multiview_mask;
     rendering_info.colorAttachmentCount = ( u32 )render_targets.size;
@@ -167,27 +179,86 @@ void CommandBuffer::end_render_pass() {
     vkCmdEndRenderingKHR( vk_command_buffer );
 
     inside_pass = false;
+    pass_secondary_contents = false;
     frame_buffer_width = 0;
     frame_buffer_height = 0;
 }
 
-void CommandBuffer::bind_pipeline( PipelineHandle handle_ ) {
+void CommandBuffer::execute_secondary( Span<CommandBuffer* const> secondary_command_buffers ) {
+
+    iassertm( inside_pass && pass_secondary_contents, "Secondary command buffers need a pass begun with secondary contents!" );
+
+    static const u32 k_max_execute_batch = 16;
+    VkCommandBuffer vk_command_buffers[ k_max_execute_batch ];
+
+    u32 count = 0;
+    for ( u32 i = 0; i < secondary_command_buffers.size; ++i ) {
+        CommandBuffer* secondary = secondary_command_buffers[ i ];
+
+        vkEndCommandBuffer( secondary->vk_command_buffer );
+        secondary->is_recording = false;
+        state_statistics.add( secondary->state_statistics );
+
+        vk_command_buffers[ count++ ] = secondary->vk_command_buffer;
+        if ( count == k_max_execute_batch ) {
+            vkCmdExecuteCommands( vk_command_buffer, count, vk_command_buffers );
+            count = 0;
+        }
+    }
+
+    if ( count ) {
+        vkCmdExecuteCommands( vk_command_buffer, count, vk_command_buffers );
+    }
+
+    // State of the primary command buffer is undefined after executing secondaries.
+    current_pipeline = nullptr;
+    bound_state = {};
+}
+
+bool CommandBuffer::bind_pipeline( PipelineHandle handle_ ) {
+
+    if ( handle_ == bound_state.pipeline ) {
+        ++state_statistics.skipped[ CommandStateStatistics::Pipelines ];
+        return true;
+    }
 
     VulkanPipeline* pipeline = gpu_device->pipelines.get_hot( handle_ );
+
+    // Async pipelines are substituted by the one they replace until they are ready.
+    if ( !pipeline->ready ) {
+        pipeline = gpu_device->pipelines.get_hot( gpu_device->pipelines.get_cold( handle_ )->replaced );
+        if ( !pipeline || !pipeline->ready ) {
+            return false;
+        }
+    }
+
     vkCmdBindPipeline( vk_command_buffer, ( VkPipelineBindPoint )pipeline->vk_bind_point, pipeline->vk_pipeline );
+    ++state_statistics.recorded[ CommandStateStatistics::Pipelines ];
 
     // Cache pipeline
     current_pipeline = pipeline;
+    bound_state.pipeline = handle_;
+    return true;
 }
 
 void CommandBuffer::bind_vertex_buffer( BufferHandle handle_, u32 binding, u32 offset ) {
 
+    iassert( binding < k_max_vertex_streams );
+    if ( handle_ == bound_state.vertex_buffers[ binding ] && offset == bound_state.vertex_offsets[ binding ] ) {
+        ++state_statistics.skipped[ CommandStateStatistics::VertexBuffers ];
+        return;
+    }
+
     VulkanBuffer* buffer = gpu_device->buffers.get_hot( handle_ );
     VkDeviceSize offsets[] = { offset };
 
     VkBuffer vk_buffer = buffer->vk_buffer;
 
     vkCmdBindVertexBuffers( vk_command_buffer, binding, 1, &vk_buffer, offsets );
+    ++state_statistics.recorded[ CommandStateStatistics::VertexBuffers ];
+
+    bound_state.vertex_buffers[ binding ] = handle_;
+    bound_state.vertex_offsets[ binding ] = offset;
 }
 
 void CommandBuffer::bind_vertex_buffers( BufferHandle* handles, u32 first_binding, u32 binding_count, u32* offsets_ ) {
@@ -218,17 +289,38 @@ void CommandBuffer::bind_vertex_buffers( BufferHandle* handles, u32 first_bindin
 
 void CommandBuffer::bind_index_buffer( BufferHandle handle_, u32 offset_, IndexType::Enum index_type ) {
 
+    if ( handle_ == bound_state.index_buffer && offset_ == bound_state.index_offset ) {
+        ++state_statistics.skipped[ CommandStateStatistics::IndexBuffers ];
+        return;
+    }
+
     VulkanBuffer* buffer = gpu_device->buffers.get_hot( handle_ );
 
     VkBuffer vk_buffer = buffer->vk_buffer;
     VkDeviceSize offset = offset_;
 
     vkCmdBindIndexBuffer( vk_command_buffer, vk_buffer, offset, VK_INDEX_TYPE_UINT16/* to_vk_index_type( index_type )*/ );
+    ++state_statistics.recorded[ CommandStateStatistics::IndexBuffers ];
+
+    bound_state.index_buffer = handle_;
+    bound_state.index_offset = offset_;
 }
 
 void CommandBuffer::bind_descriptor_set( Span<const DescriptorSetHandle> handles, Span<const u32> offsets ) {
 
-    VkDescriptorSet vk_descriptor_sets[ 4 ];
+    iassert( handles.size <= k_max_bound_descriptor_sets );
+
+    // Sets bound with another layout may have been disturbed by the pipeline change.
+    const bool cacheable = offsets.size <= k_max_bound_dynamic_offsets;
+    if ( cacheable && bound_state.descriptor_layout == current_pipeline->vk_pipeline_layout &&
+         bound_state.descriptor_set_count == handles.size && bound_state.dynamic_offset_count == offsets.size &&
+         memcmp( bound_state.descriptor_sets, handles.data, handles.size * sizeof( DescriptorSetHandle ) ) == 0 &&
+         memcmp( bound_state.dynamic_offsets, offsets.data, offsets.size * sizeof( u32 ) ) == 0 ) {
+        ++state_statistics.skipped[ CommandStateStatistics::DescriptorSets ];
+        return;
+    }
+
+    VkDescriptorSet vk_descriptor_sets[ k_max_bound_descriptor_sets ];
     for (u32 i = 0; i < handles.size; ++ i) {
         VulkanDescriptorSet* ds = gpu_device->descriptor_sets.get_hot( handles[ i ] );
         vk_descriptor_sets[ i ] = ds->vk_descriptor_set;
@@ -237,6 +329,47 @@ void CommandBuffer::bind_descriptor_set( Span<const DescriptorSetHandle> handles
     const u32 k_first_set = 0;
     vkCmdBindDescriptorSets( vk_command_buffer, ( VkPipelineBindPoint )current_pipeline->vk_bind_point, current_pipeline->vk_pipeline_layout, k_first_set,
                              ( u32 )handles.size, vk_descriptor_sets, ( u32 )offsets.size, offsets.data );
+    ++state_statistics.recorded[ CommandStateStatistics::DescriptorSets ];
+
+    if ( cacheable ) {
+        bound_state.descriptor_layout = current_pipeline->vk_pipeline_layout;
+        bound_state.descriptor_set_count = ( u32 )handles.size;
+        bound_state.dynamic_offset_count = ( u32 )offsets.size;
+        memcpy( bound_state.descriptor_sets, handles.data, handles.size * sizeof( DescriptorSetHandle ) );
+        memcpy( bound_state.dynamic_offsets, offsets.data, offsets.size * sizeof( u32 ) );
+    } else {
+        bound_state.descriptor_layout = VK_NULL_HANDLE;
+    }
+}
+
+static void command_buffer_set_viewport( CommandBuffer* command_buffer, const VkViewport& vk_viewport ) {
+
+    CommandBuffer::BoundState& bound_state = command_buffer->bound_state;
+    if ( bound_state.viewport_set && memcmp( &bound_state.viewport, &vk_viewport, sizeof( VkViewport ) ) == 0 ) {
+        ++command_buffer->state_statistics.skipped[ CommandStateStatistics::Viewports ];
+        return;
+    }
+
+    vkCmdSetViewport( command_buffer->vk_command_buffer, 0, 1, &vk_viewport );
+    ++command_buffer->state_statistics.recorded[ CommandStateStatistics::Viewports ];
+
+    bound_state.viewport = vk_viewport;
+    bound_state.viewport_set = true;
+}
+
+static void command_buffer_set_scissor( CommandBuffer* command_buffer, const VkRect2D& vk_scissor ) {
+
+    CommandBuffer::BoundState& bound_state = command_buffer->bound_state;
+    if ( bound_state.scissor_set && memcmp( &bound_state.scissor, &vk_scissor, sizeof( VkRect2D ) ) == 0 ) {
+        ++command_buffer->state_statistics.skipped[ CommandStateStatistics::Scissors ];
+        return;
+    }
+
+    vkCmdSetScissor( command_buffer->vk_command_buffer, 0, 1, &vk_scissor );
+    ++command_buffer->state_statistics.recorded[ CommandStateStatistics::Scissors ];
+
+    bound_state.scissor = vk_scissor;
+    bound_state.scissor_set = true;
 }
 
 void CommandBuffer::set_framebuffer_viewport() {
@@ -252,7 +385,7 @@ void CommandBuffer::set_framebuffer_viewport() {
     vk_viewport.minDepth = 0.0f;
     vk_viewport.maxDepth = 1.0f;
 
-    vkCmdSetViewport( vk_command_buffer, 0, 1, &vk_viewport );
+    command_buffer_set_viewport( this, vk_viewport );
 }
 
 void CommandBuffer::set_viewport( const Viewport& viewport ) {
@@ -268,7 +401,7 @@ void CommandBuffer::set_viewport( const Viewport& viewport ) {
     vk_viewport.minDepth = viewport.min_depth;
     vk_viewport.maxDepth = viewport.max_depth;
 
-    vkCmdSetViewport( vk_command_buffer, 0, 1, &vk_viewport);
+    command_buffer_set_viewport( this, vk_viewport );
 }
 
 void CommandBuffer::set_framebuffer_scissor() {
@@ -280,7 +413,7 @@ void CommandBuffer::set_framebuffer_scissor() {
     vk_scissor.extent.width = frame_buffer_width;
     vk_scissor.extent.height = frame_buffer_height;
 
-    vkCmdSetScissor( vk_command_buffer, 0, 1, &vk_scissor );
+    command_buffer_set_scissor( this, vk_scissor );
 }
 
 void CommandBuffer::set_scissor( const Rect2DInt& rect ) {
@@ -293,12 +426,31 @@ void CommandBuffer::set_scissor( const Rect2DInt& rect ) {
     vk_scissor.extent.width = rect.width;
     vk_scissor.extent.height = rect.height;
 
-    vkCmdSetScissor( vk_command_buffer, 0, 1, &vk_scissor );
+    command_buffer_set_scissor( this, vk_scissor );
 }
 
 void CommandBuffer::push_constants( PipelineHandle pipeline, u32 offset, u32 size, void* data ) {
     VulkanPipeline* pipeline_ = gpu_device->pipelines.get_hot( pipeline );
+
+    const bool cacheable = size <= k_max_bound_push_constants;
+    if ( cacheable && bound_state.push_constants_layout == pipeline_->vk_pipeline_layout &&
+         bound_state.push_constants_offset == offset && bound_state.push_constants_size == size &&
+         memcmp( bound_state.push_constants, data, size ) == 0 ) {
+        ++state_statistics.skipped[ CommandStateStatistics::PushConstants ];
+        return;
+    }
+
     vkCmdPushConstants( vk_command_buffer, pipeline_->vk_pipeline_layout, VK_SHADER_STAGE_ALL, offset, size, data );
+    ++state_statistics.recorded[ CommandStateStatistics::PushConstants ];
+
+    if ( cacheable ) {
+        bound_state.push_constants_layout = pipeline_->vk_pipeline_layout;
+        bound_state.push_constants_offset = offset;
+        bound_state.push_constants_size = size;
+        memcpy( bound_state.push_constants, data, size );
+    } else {
+        bound_state.push_constants_layout = VK_NULL_HANDLE;
+    }
 }
 
 void CommandBuffer::draw( TopologyType::Enum topology, u32 first_vertex, u32 vertex_count, u32 first_instance, u32 instance_count ) {
@@ -309,6 +461,46 @@ void CommandBuffer::draw_indexed( TopologyType::Enum topology, u32 index_count,
     vkCmdDrawIndexed( vk_command_buffer, index_count, instance_count, first_index, vertex_offset, first_instance );
 }
 
+void CommandBuffer::draw_stream( const DrawStream& stream ) {
+
+    DrawStream::State state {};
+    bool pipeline_ready = false;
+
+    const u32* words = stream.data.data;
+    const u32* words_end = words + stream.data.size;
+    while ( words < words_end ) {
+
+        const u32 mask = DrawStream::decode( words, &words, state );
+
+        // Unset state is encoded as count 0 or invalid handles: skip those binds.
+        if ( mask & DrawStream::Pipeline ) {
+            pipeline_ready = state.pipeline.is_valid() && bind_pipeline( state.pipeline );
+        }
+        if ( ( mask & DrawStream::VertexBuffer ) && state.vertex_buffer.is_valid() ) {
+            bind_vertex_buffer( state.vertex_buffer, 0, state.vertex_buffer_offset );
+        }
+        if ( ( mask & DrawStream::IndexBuffer ) && state.index_buffer.is_valid() ) {
+            bind_index_buffer( state.index_buffer, state.index_buffer_offset, ( IndexType::Enum )state.index_type );
+        }
+
+        if ( !pipeline_ready ) {
+            continue;
+        }
+
+        // A new pipeline can have a different layout, rebind the sets.
+        if ( ( mask & ( DrawStream::Pipeline | DrawStream::DescriptorSets | DrawStream::DynamicOffsets ) ) && state.descriptor_set_count ) {
+            bind_descriptor_set( Span<const DescriptorSetHandle>( state.descriptor_sets, state.descriptor_set_count ),
+                                 Span<const u32>( state.dynamic_offsets, state.dynamic_offset_count ) );
+        }
+
+        if ( mask & DrawStream::Indexed ) {
+            vkCmdDrawIndexed( vk_command_buffer, state.element_count, state.instance_count, state.element_offset, state.vertex_offset, state.instance_offset );
+        } else {
+            vkCmdDraw( vk_command_buffer, state.element_count, state.instance_count, state.element_offset, state.instance_offset );
+        }
+    }
+}
+
 void CommandBuffer::draw_indirect( BufferHandle buffer_handle, u32 draw_count, u32 offset, u32 stride ) {
 
     VulkanBuffer* buffer = gpu_device->buffers.get_hot( buffer_handle );
@@ -426,7 +618,7 @@ void CommandBuffer::submit_barriers( Span<const TextureBarrier> texture_barriers
         const TextureBarrier& texture_barrier = texture_barriers[ b ];
 
         VulkanTexture* vk_texture = gpu_device->textures.get_hot( texture_barrier.texture );
-        if ( vk_texture->state == texture_barrier.new_state ) {
+        if ( vk_texture->state == texture_barrier.new_state && !texture_barrier.discard && !texture_barrier.hazard ) {
             continue;
         }
 
@@ -440,12 +632,19 @@ void CommandBuffer::submit_barriers( Span<const TextureBarrier> texture_barriers
                                         gpu_device->queue_indices[ texture_barrier.destination_queue ],
                                         texture_barrier.source_queue,
                                         texture_barrier.destination_queue );
+
+        if ( texture_barrier.discard ) {
+            // The memory was last accessed through another image: wait for any previous access.
+            barrier->srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            barrier->srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+            barrier->oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        }
     }
 
     for ( u32 b = 0; b < (u32)buffer_barriers.size; ++ b) {
         const BufferBarrier& buffer_barrier = buffer_barriers[ b ];
         Buffer* buffer = gpu_device->buffers.get_cold( buffer_barrier.buffer );
-        if ( buffer->state == buffer_barrier.new_state ) {
+        if ( buffer->state == buffer_barrier.new_state && !buffer_barrier.hazard ) {
             continue;
         }
 
@@ -500,8 +699,12 @@ void CommandBuffer::fill_buffer( BufferHandle buffer, u32 offset, u32 size, u32
 }
 
 void CommandBuffer::push_marker( StringView name ) {
+    push_marker( StringId( name ), name );
+}
+
+void CommandBuffer::push_marker( StringId name_id, StringView name ) {
 
-    GPUTimeQuery* time_query = time_query_tree.push( name );
+    GPUTimeQuery* time_query = time_query_tree.push( name_id, name );
     vkCmdWriteTimestamp( vk_command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, vk_time_query_pool, time_query->start_query_index );
 
     if ( !gpu_device->debug_utils_extension_present )
@@ -760,9 +963,10 @@ void CommandBuffer::upload_buffer_data( BufferHandle src_, BufferHandle dst_ ) {
     vkCmdCopyBuffer( vk_command_buffer, src->vk_buffer, dst->vk_buffer, 1, &region );*/
 }
 
-void CommandBufferManager::init( GpuDevice* gpu, u32 max_command_buffers ) {
+void CommandBufferManager::init( GpuDevice* gpu, u32 max_command_buffers, u32 recording_threads_ ) {
 
     gpu_device = gpu;
+    recording_threads = recording_threads_;
 
     // TODO: configurable number
     queries_per_pool = 50 * 2u;
@@ -828,6 +1032,38 @@ void CommandBufferManager::init( GpuDevice* gpu, u32 max_command_buffers ) {
         }
     }
 
+    // Secondary command buffers, in a pool per frame and recording thread.
+    const u32 secondary_pools_count = recording_threads * k_max_frames;
+    const u32 secondary_buffers_count = secondary_pools_count * k_max_secondary_command_buffers_per_thread;
+    vk_secondary_command_pools.init( gpu->allocator, secondary_pools_count, secondary_pools_count );
+    secondary_command_buffers.init( gpu->allocator, secondary_buffers_count, secondary_buffers_count );
+    used_secondary_command_buffers.init( gpu->allocator, recording_threads, recording_threads );
+
+    // Pools are reset as a whole every frame.
+    cmd_pool_info.flags = 0;
+    cmd_pool_info.queueFamilyIndex = gpu->queue_indices[ QueueType::Graphics ];
+
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+    for ( u32 p = 0; p < secondary_pools_count; ++p ) {
+        vkCreateCommandPool( gpu->vk_device, &cmd_pool_info, gpu->vk_allocation_callbacks, &vk_secondary_command_pools[ p ] );
+
+        allocateInfo.commandPool = vk_secondary_command_pools[ p ];
+
+        for ( u32 i = 0; i < k_max_secondary_command_buffers_per_thread; ++i ) {
+            CommandBuffer* command_buffer = &secondary_command_buffers[ p * k_max_secondary_command_buffers_per_thread + i ];
+            command_buffer->init( gpu );
+            command_buffer->type = QueueType::Graphics;
+            command_buffer->vk_time_query_pool = VK_NULL_HANDLE;
+
+            vkAllocateCommandBuffers( gpu->vk_device, &allocateInfo, &command_buffer->vk_command_buffer );
+        }
+    }
+
+    for ( u32 t = 0; t < recording_threads; ++t ) {
+        used_secondary_command_buffers[ t ] = 0;
+    }
+
     current_frame = 0;
 }
 
@@ -845,9 +1081,20 @@ void CommandBufferManager::shutdown() {
         vkDestroyQueryPool( gpu_device->vk_device, command_buffer->vk_time_query_pool, gpu_device->vk_allocation_callbacks );
     }
 
+    for ( u32 i = 0; i < secondary_command_buffers.size; ++i ) {
+        secondary_command_buffers[ i ].shutdown();
+    }
+
+    for ( u32 p = 0; p < vk_secondary_command_pools.size; ++p ) {
+        vkDestroyCommandPool( gpu_device->vk_device, vk_secondary_command_pools[ p ], gpu_device->vk_allocation_callbacks );
+    }
+
     time_queries.shutdown();
     command_buffers.shutdown();
     vk_command_pools.shutdown();
+    secondary_command_buffers.shutdown();
+    vk_secondary_command_pools.shutdown();
+    used_secondary_command_buffers.shutdown();
 }
 
 void CommandBufferManager::free_unused_buffers( u32 current_frame_ ) {
@@ -873,6 +1120,18 @@ void CommandBufferManager::free_unused_buffers( u32 current_frame_ ) {
 
         command_buffer->time_query_tree.reset();
     }
+
+    for ( u32 t = 0; t < recording_threads; ++t ) {
+
+        const u32 pool_index = t + current_frame_ * recording_threads;
+        vkResetCommandPool( gpu_device->vk_device, vk_secondary_command_pools[ pool_index ], 0 );
+
+        for ( u32 i = 0; i < k_max_secondary_command_buffers_per_thread; ++i ) {
+            secondary_command_buffers[ pool_index * k_max_secondary_command_buffers_per_thread + i ].reset();
+        }
+
+        used_secondary_command_buffers[ t ] = 0;
+    }
 }
 
 static void command_buffer_begin( CommandBuffer* command_buffer ) {
@@ -951,6 +1210,43 @@ CommandBuffer* CommandBufferManager::get_transfer_command_buffer() {
     return cb;
 }
 
+CommandBuffer* CommandBufferManager::get_secondary_command_buffer( u32 thread_index, const CommandBuffer* primary ) {
+
+    iassert( thread_index < recording_threads );
+    iassertm( primary->inside_pass && primary->pass_secondary_contents, "Secondary command buffers need a pass begun with secondary contents!" );
+
+    u32& used = used_secondary_command_buffers[ thread_index ];
+    iassert( used < k_max_secondary_command_buffers_per_thread );
+
+    const u32 pool_index = thread_index + current_frame * recording_threads;
+    CommandBuffer* cb = &secondary_command_buffers[ pool_index * k_max_secondary_command_buffers_per_thread + used ];
+    ++used;
+
+    // Continue the dynamic rendering pass of the primary command buffer.
+    VkCommandBufferInheritanceRenderingInfoKHR inheritance_rendering_info{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO_KHR };
+    inheritance_rendering_info.colorAttachmentCount = primary->pass_color_format_count;
+    inheritance_rendering_info.pColorAttachmentFormats = primary->pass_color_formats;
+    inheritance_rendering_info.depthAttachmentFormat = primary->pass_depth_format;
+    inheritance_rendering_info.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+    inheritance_rendering_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkCommandBufferInheritanceInfo inheritance_info{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+    inheritance_info.pNext = &inheritance_rendering_info;
+
+    VkCommandBufferBeginInfo begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    begin_info.pInheritanceInfo = &inheritance_info;
+    vkBeginCommandBuffer( cb->vk_command_buffer, &begin_info );
+
+    // Dynamic state is not inherited: viewport and scissor must be set again.
+    cb->is_recording = true;
+    cb->inside_pass = true;
+    cb->frame_buffer_width = primary->frame_buffer_width;
+    cb->frame_buffer_height = primary->frame_buffer_height;
+
+    return cb;
+}
+
 u32 CommandBufferManager::get_max_buffers_per_frame() const {
 
     return max_command_buffers_per_queue[ QueueType::Graphics ] +
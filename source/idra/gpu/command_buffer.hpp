@@ -18,6 +18,7 @@ struct VkBufferMemoryBarrier2;
 
 namespace idra {
 
+struct DrawStream;
 struct Pipeline;
 
 //
@@ -36,12 +37,22 @@ struct CommandBuffer {
     //void                            begin();
     //void                            end();
 
+    // With secondary_contents the pass content is only recorded in secondary command buffers,
+    // see CommandBufferManager::get_secondary_command_buffer and execute_secondary.
     void                            begin_pass( Span<const TextureHandle> render_targets, Span<const LoadOperation::Enum> load_operations, 
                                                 Span<const ClearColor> clear_values, TextureHandle depth, 
-                                                LoadOperation::Enum depth_load_operation, ClearDepthStencil depth_stencil_clear );
+                                                LoadOperation::Enum depth_load_operation, ClearDepthStencil depth_stencil_clear,
+                                                bool secondary_contents = false );
     void                            end_render_pass();
 
-    void                            bind_pipeline( PipelineHandle handle );
+    // Ends the secondary command buffers and executes them in the given order.
+    // State bound before is lost and must be bound again.
+    void                            execute_secondary( Span<CommandBuffer* const> secondary_command_buffers );
+
+    // False when an async pipeline and the one it replaces are not ready, draws and dispatches using it
+    // must be skipped. Only pipelines from GpuDevice::create_graphics_pipeline_async and
+    // create_compute_pipeline_async can be not ready, others always bind.
+    [[nodiscard]] bool              bind_pipeline( PipelineHandle handle );
     void                            bind_vertex_buffer( BufferHandle handle, u32 binding, u32 offset );
     void                            bind_vertex_buffers( BufferHandle* handles, u32 first_binding, u32 binding_count, u32* offsets );
     void                            bind_index_buffer( BufferHandle handle, u32 offset, IndexType::Enum index_type );
@@ -60,6 +71,9 @@ struct CommandBuffer {
     void                            draw_indirect( BufferHandle handle, u32 draw_count, u32 offset, u32 stride );
     void                            draw_indirect_count( BufferHandle argument_buffer, u32 argument_offset, BufferHandle count_buffer, u32 count_offset, u32 max_draws, u32 stride );
     void                            draw_indexed_indirect( BufferHandle handle, u32 draw_count, u32 offset, u32 stride );
+    // Decodes the stream, binding only the state that changed between draws.
+    // Draws using a pipeline that is not ready are skipped.
+    void                            draw_stream( const DrawStream& stream );
 
     void                            draw_mesh_task( u32 task_count );
     void                            draw_mesh_task_indirect( BufferHandle argument_buffer, u32 argument_offset, u32 command_count, u32 stride );
@@ -82,6 +96,7 @@ struct CommandBuffer {
     void                            fill_buffer( BufferHandle buffer, u32 offset, u32 size, u32 data );
 
     void                            push_marker( StringView name );
+    void                            push_marker( StringId name_id, StringView name );
     void                            pop_marker();
 
     // Non-drawing methods
@@ -108,6 +123,47 @@ struct CommandBuffer {
     VkQueryPool                     vk_time_query_pool;
 
     VulkanPipeline*                 current_pipeline;
+
+    static const u32                k_max_bound_descriptor_sets = 4;
+    static const u32                k_max_bound_dynamic_offsets = 8;
+    static const u32                k_max_bound_push_constants  = 128;
+
+    // State set since recording began, commands setting it again are skipped.
+    // Pipelines and descriptor sets are compared by handle: within a recording
+    // destroyed handles are not reused.
+    struct BoundState {
+        PipelineHandle              pipeline;
+
+        BufferHandle                vertex_buffers[ k_max_vertex_streams ];
+        u32                         vertex_offsets[ k_max_vertex_streams ];
+        BufferHandle                index_buffer;
+        u32                         index_offset;
+
+        VkPipelineLayout            descriptor_layout;
+        DescriptorSetHandle         descriptor_sets[ k_max_bound_descriptor_sets ];
+        u32                         descriptor_set_count;
+        u32                         dynamic_offsets[ k_max_bound_dynamic_offsets ];
+        u32                         dynamic_offset_count;
+
+        VkViewport                  viewport;
+        VkRect2D                    scissor;
+        bool                        viewport_set;
+        bool                        scissor_set;
+
+        VkPipelineLayout            push_constants_layout;
+        u32                         push_constants_offset;
+        u32                         push_constants_size;
+        u8                          push_constants[ k_max_bound_push_constants ];
+    }; // struct BoundState
+
+    BoundState                      bound_state;
+    CommandStateStatistics          state_statistics;
+
+    // Attachments of the current pass, inherited by its secondary command buffers.
+    VkFormat                        pass_color_formats[ k_max_image_outputs ];
+    u32                             pass_color_format_count = 0;
+    VkFormat                        pass_depth_format;
+    bool                            pass_secondary_contents = false;
 #endif // IDRA_VULKAN
 
     GpuTimeQueryTree                time_query_tree;
@@ -126,7 +182,7 @@ struct CommandBuffer {
 
 struct CommandBufferManager {
 
-    void                    init( GpuDevice* gpu, u32 max_command_buffers );
+    void                    init( GpuDevice* gpu, u32 max_command_buffers, u32 recording_threads );
     void                    shutdown();
 
     void                    free_unused_buffers( u32 current_frame );
@@ -136,6 +192,12 @@ struct CommandBufferManager {
     CommandBuffer*          get_compute_command_buffer();
     CommandBuffer*          get_transfer_command_buffer();
 
+    // Secondary command buffer recording inside the current pass of primary, started with
+    // secondary_contents. Each recording thread has its own command pools: a thread_index
+    // must be used by a single thread at a time, but any thread can record any job.
+    // Markers are not supported in secondary command buffers.
+    CommandBuffer*          get_secondary_command_buffer( u32 thread_index, const CommandBuffer* primary );
+
     u32                     get_max_buffers_per_frame() const;
 
     Span<CommandBuffer>     get_command_buffer_span( u32 frame );
@@ -144,6 +206,14 @@ struct CommandBufferManager {
     Array<CommandBuffer>    command_buffers;
     Array<GPUTimeQuery>     time_queries;
 
+    // A job system worker can run several of the jobs of a pass in the same frame.
+    static const u32        k_max_secondary_command_buffers_per_thread = 8;
+
+    Array<VkCommandPool>    vk_secondary_command_pools;     // Indexed by frame * recording_threads + thread.
+    Array<CommandBuffer>    secondary_command_buffers;      // k_max_secondary_command_buffers_per_thread per pool.
+    Array<u32>              used_secondary_command_buffers; // Per thread, in the current frame.
+    u32                     recording_threads = 0;
+
     GpuDevice*              gpu_device;
     u32                     current_frame;
     u32                     queries_per_pool = 100;
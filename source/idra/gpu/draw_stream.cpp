@@ -0,0 +1,247 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "gpu/draw_stream.hpp"
+
+#include "kernel/assert.hpp"
+
+#include <string.h>
+
+namespace idra {
+
+// DrawStream /////////////////////////////////////////////////////////////
+void DrawStream::init( Allocator* allocator, u32 initial_capacity ) {
+
+    data.init( allocator, initial_capacity );
+
+    reset();
+}
+
+void DrawStream::shutdown() {
+
+    data.shutdown();
+}
+
+void DrawStream::reset() {
+
+    data.clear();
+    draw_count = 0;
+
+    pending = {};
+    written = {};
+    written_valid = false;
+}
+
+void DrawStream::set_pipeline( PipelineHandle pipeline ) {
+    pending.pipeline = pipeline;
+}
+
+void DrawStream::set_descriptor_sets( Span<const DescriptorSetHandle> descriptor_sets ) {
+
+    iassert( descriptor_sets.size <= k_max_descriptor_sets );
+
+    memcpy( pending.descriptor_sets, descriptor_sets.data, descriptor_sets.size * sizeof( DescriptorSetHandle ) );
+    pending.descriptor_set_count = ( u32 )descriptor_sets.size;
+}
+
+void DrawStream::set_dynamic_offsets( Span<const u32> offsets ) {
+
+    iassert( offsets.size <= k_max_dynamic_offsets );
+
+    memcpy( pending.dynamic_offsets, offsets.data, offsets.size * sizeof( u32 ) );
+    pending.dynamic_offset_count = ( u32 )offsets.size;
+}
+
+void DrawStream::set_vertex_buffer( BufferHandle buffer, u32 offset ) {
+    pending.vertex_buffer = buffer;
+    pending.vertex_buffer_offset = offset;
+}
+
+void DrawStream::set_index_buffer( BufferHandle buffer, u32 offset, IndexType::Enum index_type ) {
+    pending.index_buffer = buffer;
+    pending.index_buffer_offset = offset;
+    pending.index_type = index_type;
+}
+
+// Writes the mask of the fields of pending that differ from the last draw, then the fields.
+static void draw_stream_encode( DrawStream* stream, u32 mask ) {
+
+    const DrawStream::State& pending = stream->pending;
+    const DrawStream::State& written = stream->written;
+
+    if ( stream->written_valid ) {
+        mask |= pending.pipeline != written.pipeline ? DrawStream::Pipeline : 0;
+        mask |= ( pending.descriptor_set_count != written.descriptor_set_count ||
+                  memcmp( pending.descriptor_sets, written.descriptor_sets, pending.descriptor_set_count * sizeof( DescriptorSetHandle ) ) != 0 ) ? DrawStream::DescriptorSets : 0;
+        mask |= ( pending.dynamic_offset_count != written.dynamic_offset_count ||
+                  memcmp( pending.dynamic_offsets, written.dynamic_offsets, pending.dynamic_offset_count * sizeof( u32 ) ) != 0 ) ? DrawStream::DynamicOffsets : 0;
+        mask |= ( pending.vertex_buffer != written.vertex_buffer || pending.vertex_buffer_offset != written.vertex_buffer_offset ) ? DrawStream::VertexBuffer : 0;
+        mask |= ( pending.index_buffer != written.index_buffer || pending.index_buffer_offset != written.index_buffer_offset ||
+                  pending.index_type != written.index_type ) ? DrawStream::IndexBuffer : 0;
+
+        mask |= pending.element_offset != written.element_offset ? DrawStream::ElementOffset : 0;
+        mask |= pending.element_count != written.element_count ? DrawStream::ElementCount : 0;
+        mask |= pending.vertex_offset != written.vertex_offset ? DrawStream::VertexOffset : 0;
+        mask |= pending.instance_offset != written.instance_offset ? DrawStream::InstanceOffset : 0;
+        mask |= pending.instance_count != written.instance_count ? DrawStream::InstanceCount : 0;
+    } else {
+        // First draw of the stream: write all the state, even unset fields (count 0 or
+        // invalid handles), so nothing is inherited from a stream appended before this one.
+        mask |= DrawStream::StateMask;
+        mask |= DrawStream::ElementOffset | DrawStream::ElementCount | DrawStream::VertexOffset |
+                DrawStream::InstanceOffset | DrawStream::InstanceCount;
+    }
+
+    Array<u32>& data = stream->data;
+    if ( data.size + DrawStream::k_max_draw_words > data.capacity ) {
+        data.grow( data.size + DrawStream::k_max_draw_words );
+    }
+
+    u32* words = data.data + data.size;
+    *words++ = mask;
+
+    if ( mask & DrawStream::Pipeline ) {
+        *words++ = pending.pipeline.index;
+        *words++ = pending.pipeline.generation;
+    }
+    if ( mask & DrawStream::DescriptorSets ) {
+        *words++ = pending.descriptor_set_count;
+        for ( u32 i = 0; i < pending.descriptor_set_count; ++i ) {
+            *words++ = pending.descriptor_sets[ i ].index;
+            *words++ = pending.descriptor_sets[ i ].generation;
+        }
+    }
+    if ( mask & DrawStream::DynamicOffsets ) {
+        *words++ = pending.dynamic_offset_count;
+        for ( u32 i = 0; i < pending.dynamic_offset_count; ++i ) {
+            *words++ = pending.dynamic_offsets[ i ];
+        }
+    }
+    if ( mask & DrawStream::VertexBuffer ) {
+        *words++ = pending.vertex_buffer.index;
+        *words++ = pending.vertex_buffer.generation;
+        *words++ = pending.vertex_buffer_offset;
+    }
+    if ( mask & DrawStream::IndexBuffer ) {
+        *words++ = pending.index_buffer.index;
+        *words++ = pending.index_buffer.generation;
+        *words++ = pending.index_buffer_offset;
+        *words++ = pending.index_type;
+    }
+    if ( mask & DrawStream::ElementOffset ) {
+        *words++ = pending.element_offset;
+    }
+    if ( mask & DrawStream::ElementCount ) {
+        *words++ = pending.element_count;
+    }
+    if ( mask & DrawStream::VertexOffset ) {
+        *words++ = ( u32 )pending.vertex_offset;
+    }
+    if ( mask & DrawStream::InstanceOffset ) {
+        *words++ = pending.instance_offset;
+    }
+    if ( mask & DrawStream::InstanceCount ) {
+        *words++ = pending.instance_count;
+    }
+
+    data.size = ( u32 )( words - data.data );
+    ++stream->draw_count;
+
+    stream->written = pending;
+    stream->written_valid = true;
+}
+
+void DrawStream::draw( u32 first_vertex, u32 vertex_count, u32 first_instance, u32 instance_count ) {
+
+    pending.element_offset = first_vertex;
+    pending.element_count = vertex_count;
+    pending.instance_offset = first_instance;
+    pending.instance_count = instance_count;
+
+    draw_stream_encode( this, 0 );
+}
+
+void DrawStream::draw_indexed( u32 first_index, u32 index_count, i32 vertex_offset, u32 first_instance, u32 instance_count ) {
+
+    pending.element_offset = first_index;
+    pending.element_count = index_count;
+    pending.vertex_offset = vertex_offset;
+    pending.instance_offset = first_instance;
+    pending.instance_count = instance_count;
+
+    draw_stream_encode( this, Indexed );
+}
+
+void DrawStream::append( const DrawStream& other ) {
+
+    if ( other.draw_count == 0 ) {
+        return;
+    }
+
+    if ( data.size + other.data.size > data.capacity ) {
+        data.grow( data.size + other.data.size );
+    }
+    memcpy( data.data + data.size, other.data.data, other.data.size * sizeof( u32 ) );
+    data.size += other.data.size;
+    draw_count += other.draw_count;
+
+    // Draws encoded after this are relative to the last draw of the other stream.
+    written = other.written;
+    written_valid = true;
+}
+
+u32 DrawStream::decode( const u32* words, const u32** next_words, State& state ) {
+
+    const u32 mask = *words++;
+
+    if ( mask & Pipeline ) {
+        state.pipeline.index = *words++;
+        state.pipeline.generation = *words++;
+    }
+    if ( mask & DescriptorSets ) {
+        state.descriptor_set_count = *words++;
+        for ( u32 i = 0; i < state.descriptor_set_count; ++i ) {
+            state.descriptor_sets[ i ].index = *words++;
+            state.descriptor_sets[ i ].generation = *words++;
+        }
+    }
+    if ( mask & DynamicOffsets ) {
+        state.dynamic_offset_count = *words++;
+        for ( u32 i = 0; i < state.dynamic_offset_count; ++i ) {
+            state.dynamic_offsets[ i ] = *words++;
+        }
+    }
+    if ( mask & VertexBuffer ) {
+        state.vertex_buffer.index = *words++;
+        state.vertex_buffer.generation = *words++;
+        state.vertex_buffer_offset = *words++;
+    }
+    if ( mask & IndexBuffer ) {
+        state.index_buffer.index = *words++;
+        state.index_buffer.generation = *words++;
+        state.index_buffer_offset = *words++;
+        state.index_type = *words++;
+    }
+    if ( mask & ElementOffset ) {
+        state.element_offset = *words++;
+    }
+    if ( mask & ElementCount ) {
+        state.element_count = *words++;
+    }
+    if ( mask & VertexOffset ) {
+        state.vertex_offset = ( i32 )*words++;
+    }
+    if ( mask & InstanceOffset ) {
+        state.instance_offset = *words++;
+    }
+    if ( mask & InstanceCount ) {
+        state.instance_count = *words++;
+    }
+
+    *next_words = words;
+    return mask;
+}
+
+} // namespace idra
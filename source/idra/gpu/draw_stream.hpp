@@ -0,0 +1,104 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#pragma once
+
+#include "gpu/gpu_resources.hpp"
+
+#include "kernel/array.hpp"
+#include "kernel/span.hpp"
+
+namespace idra {
+
+// DrawStream /////////////////////////////////////////////////////////////
+//
+// Draws encoded as a packed stream of u32, based on the HypeHype renderer:
+// https://enginearchitecture.realtimerendering.com/downloads/reac2023_modern_mobile_rendering_at_hypehype.pdf
+//
+// Each draw is a dirty mask followed only by the fields that changed since the
+// previous draw, in the order of the DirtyBits. State is set on the stream and
+// captured by draw calls; CommandBuffer::draw_stream decodes it, binding only
+// what the masks mark as changed.
+//
+// A stream is written by a single thread. Render systems can record one stream
+// per thread and append them before submit: the first draw of a stream always
+// encodes all its state, unset fields as count 0 or invalid handles that the
+// decoder does not bind, so streams can be concatenated as they are.
+//
+struct DrawStream {
+
+    static const u32            k_max_descriptor_sets   = 4;
+    static const u32            k_max_dynamic_offsets   = 4;
+
+    enum DirtyBits : u32 {
+        Pipeline                = 1 << 0,   // index, generation
+        DescriptorSets          = 1 << 1,   // count, count * (index, generation)
+        DynamicOffsets          = 1 << 2,   // count, count * offset
+        VertexBuffer            = 1 << 3,   // index, generation, offset. Bound at binding 0.
+        IndexBuffer             = 1 << 4,   // index, generation, offset, index type
+        ElementOffset           = 1 << 5,   // First vertex or first index
+        ElementCount            = 1 << 6,   // Vertex or index count
+        VertexOffset            = 1 << 7,   // Added to indices, indexed draws only
+        InstanceOffset          = 1 << 8,
+        InstanceCount           = 1 << 9,
+        Indexed                 = 1 << 10,  // Not a field: the draw is indexed.
+
+        StateMask               = Pipeline | DescriptorSets | DynamicOffsets | VertexBuffer | IndexBuffer,
+    }; // enum DirtyBits
+
+    // Worst case size of a draw, in u32.
+    static const u32            k_max_draw_words = 1 + 2 + ( 1 + k_max_descriptor_sets * 2 ) + ( 1 + k_max_dynamic_offsets ) + 3 + 4 + 5;
+
+    struct State {
+        PipelineHandle          pipeline;
+        DescriptorSetHandle     descriptor_sets[ k_max_descriptor_sets ];
+        u32                     descriptor_set_count;
+        u32                     dynamic_offsets[ k_max_dynamic_offsets ];
+        u32                     dynamic_offset_count;
+        BufferHandle            vertex_buffer;
+        u32                     vertex_buffer_offset;
+        BufferHandle            index_buffer;
+        u32                     index_buffer_offset;
+        u32                     index_type;
+
+        u32                     element_offset;
+        u32                     element_count;
+        i32                     vertex_offset;
+        u32                     instance_offset;
+        u32                     instance_count;
+    }; // struct State
+
+    void                        init( Allocator* allocator, u32 initial_capacity );
+    void                        shutdown();
+
+    // Removes all draws and the state set.
+    void                        reset();
+
+    void                        set_pipeline( PipelineHandle pipeline );
+    void                        set_descriptor_sets( Span<const DescriptorSetHandle> descriptor_sets );
+    void                        set_dynamic_offsets( Span<const u32> offsets );
+    void                        set_vertex_buffer( BufferHandle buffer, u32 offset );
+    void                        set_index_buffer( BufferHandle buffer, u32 offset, IndexType::Enum index_type );
+
+    void                        draw( u32 first_vertex, u32 vertex_count, u32 first_instance, u32 instance_count );
+    void                        draw_indexed( u32 first_index, u32 index_count, i32 vertex_offset, u32 first_instance, u32 instance_count );
+
+    // Appends the draws of another stream, recorded for example on another thread.
+    void                        append( const DrawStream& other );
+
+    // Reads the draw starting at words into state, returning its dirty mask and
+    // the start of the next draw in next_words.
+    static u32                  decode( const u32* words, const u32** next_words, State& state );
+
+    Array<u32>                  data;
+    u32                         draw_count      = 0;
+
+    State                       pending;        // State the next draw will use.
+    State                       written;        // State of the last draw encoded.
+    bool                        written_valid   = false;
+
+}; // struct DrawStream
+
+} // namespace idra
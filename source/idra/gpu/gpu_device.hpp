@@ -9,9 +9,18 @@
 #include "kernel/string_view.hpp"
 #include "kernel/pool.hpp"
 #include "kernel/allocator.hpp"
+#include "kernel/hash_map.hpp"
+#include "kernel/file.hpp"
+#include "kernel/array.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "gpu/gpu_enums.hpp"
 #include "gpu/gpu_resources.hpp"
+#include "gpu/staging_ring.hpp"
 
 #if defined (IDRA_VULKAN)
 
@@ -28,14 +37,7 @@ namespace idra {
     // Forward declarations
     struct CommandBuffer;
     struct CommandBufferManager;
-
-    // DrawStream /////////////////////////////////////////////////////////
-
-    //
-    //
-    struct DrawStream {
-
-    };
+    struct PipelineCompilation;
 
     // Dynamic buffer implementation
     // https://threadreaderapp.com/thread/1575469255168036864.html
@@ -126,8 +128,45 @@ namespace idra {
         void*                           os_window_handle    = nullptr;
 
         StringView                      shader_folder_path;
+        StringView                      shader_cache_path   = "shader_cache";     // Empty disables the SPIR-V cache.
+        StringView                      pipeline_cache_path = "shader_cache";     // Folder of the VkPipelineCache file, empty disables it.
+        u32                             pipeline_compilation_threads = 2;         // Zero creates async pipelines on the calling thread.
+        u32                             recording_threads   = 8;                  // Threads recording secondary command buffers in parallel.
+        u32                             staging_buffer_size = 32 * 1024 * 1024;   // Uploads bigger than the free part are split over frames.
     }; // struct GpuDeviceCreation
 
+    //
+    // Bind and dynamic state commands, skipped when the command buffer already
+    // had the same state set.
+    struct CommandStateStatistics {
+
+        enum Type {
+            Pipelines, VertexBuffers, IndexBuffers, DescriptorSets, Viewports, Scissors, PushConstants, Count
+        };
+
+        u32                             recorded[ Count ]   = {};
+        u32                             skipped[ Count ]    = {};
+
+        void                            add( const CommandStateStatistics& other ) {
+            for ( u32 i = 0; i < Count; ++i ) {
+                recorded[ i ] += other.recorded[ i ];
+                skipped[ i ] += other.skipped[ i ];
+            }
+        }
+    }; // struct CommandStateStatistics
+
+    //
+    // Uploads recorded by the last new_frame through the staging ring.
+    struct UploadStatistics {
+
+        u64                             total_bytes         = 0;    // Since the device creation.
+        u32                             bytes               = 0;
+        u32                             completed_uploads   = 0;
+        u32                             pending_uploads     = 0;    // Waiting for staging memory to be retired.
+        u32                             copy_commands       = 0;
+        u32                             staging_used        = 0;    // Bytes in flight after recording.
+    }; // struct UploadStatistics
+
     // GpuDevice //////////////////////////////////////////////////////////
     struct GpuDevice {
 
@@ -151,12 +190,18 @@ namespace idra {
         CommandBuffer*          acquire_command_buffer( u32 index );
         CommandBuffer*          acquire_compute_command_buffer();
         CommandBuffer*          acquire_transfer_command_buffer();
+        // Thread safe for distinct thread indices, see CommandBufferManager::get_secondary_command_buffer.
+        CommandBuffer*          acquire_secondary_command_buffer( u32 thread_index, const CommandBuffer* primary );
 
         BufferHandle            create_buffer( const BufferCreation& creation );
         TextureHandle           create_texture( const TextureCreation& creation );
         TextureHandle           create_texture_view( const TextureViewCreation& creation );
         PipelineHandle          create_graphics_pipeline( const GraphicsPipelineCreation& creation );
         PipelineHandle          create_compute_pipeline( const ComputePipelineCreation& creation );
+        // The handle is returned before the pipeline is compiled on a worker thread.
+        // The replaced pipeline is bound in its place until it is ready, then it is destroyed.
+        PipelineHandle          create_graphics_pipeline_async( const GraphicsPipelineCreation& creation, PipelineHandle replaced );
+        PipelineHandle          create_compute_pipeline_async( const ComputePipelineCreation& creation, PipelineHandle replaced );
         SamplerHandle           create_sampler( const SamplerCreation& creation );
         DescriptorSetLayoutHandle create_descriptor_set_layout( const DescriptorSetLayoutCreation& creation );
         DescriptorSetHandle     create_descriptor_set( const DescriptorSetCreation& creation );
@@ -171,6 +216,11 @@ namespace idra {
         void                    destroy_descriptor_set( DescriptorSetHandle set );
         void                    destroy_shader_state( ShaderStateHandle shader );
 
+        // Async pipelines become ready in new_frame after their compilation.
+        bool                    is_pipeline_ready( PipelineHandle pipeline );
+        u32                     get_pipeline_compilation_count() const;
+        void                    wait_pipeline_compilations();
+
         void*                   map_buffer( BufferHandle buffer, u32 offset, u32 size );
         void                    unmap_buffer( BufferHandle buffer );
 
@@ -181,10 +231,20 @@ namespace idra {
 
         BufferHandle            get_dynamic_buffer();
 
+        // Uploads are copied through the staging ring in new_frame, over several frames
+        // when it is full. Data must stay valid until then, and the destination must not
+        // be in use by the GPU.
         void                    upload_texture_data( TextureHandle texture, void* data );
+        void                    upload_buffer_data( BufferHandle buffer, void* data, u32 size, u32 offset );
 
         void                    resize_texture( TextureHandle texture, u32 width, u32 height );
         void                    resize_texture_3d( TextureHandle texture, u32 width, u32 height, u32 depth );
+        // Device memory needed by the image, also for textures aliasing another one.
+        sizet                   get_texture_memory_size( TextureHandle texture );
+
+        // Layout used by the pipeline for the set, derived from the shaders when
+        // the pipeline was created without layouts.
+        DescriptorSetLayoutHandle get_descriptor_set_layout( PipelineHandle pipeline, u32 set_index );
 
 #if defined (IDRA_VULKAN)
         
@@ -192,6 +252,18 @@ namespace idra {
         void                    frame_counters_advance();
 
         void                    delete_queued_resources( bool force_deletion );
+
+        // Pipelines are created in two steps: the layouts on the calling thread,
+        // the VkPipeline on the calling or a worker thread.
+        PipelineHandle          create_pipeline_layout( ShaderStateHandle shader, Span<const DescriptorSetLayoutHandle> layouts,
+                                                        VkPipelineBindPoint bind_point, StringView debug_name );
+        f64                     compile_graphics_pipeline( PipelineHandle pipeline, const GraphicsPipelineCreation& creation );
+        f64                     compile_compute_pipeline( PipelineHandle pipeline );
+        void                    finish_pipeline( PipelineHandle pipeline, f64 creation_ms, StringView debug_name );
+
+        void                    enqueue_pipeline_compilation( PipelineCompilation* compilation );
+        void                    update_pipeline_compilations( bool wait );
+        void                    pipeline_compilation_worker();
         void                    set_resource_name( VkObjectType type, u64 handle, StringView name );
 
         TextureHandle           get_current_swapchain_texture();
@@ -205,6 +277,12 @@ namespace idra {
 
         DescriptorSetLayoutHandle create_bindless_descriptor_set_layout( const DescriptorSetLayoutCreation& creation );
 
+        // Layouts from the shader reflection, or checks of the given ones against it.
+        u32                     create_reflected_descriptor_set_layouts( const spirv::ParseResult& parse_result, StringView debug_name,
+                                                                         DescriptorSetLayoutHandle* out_layouts );
+        void                    validate_descriptor_set_layouts( const spirv::ParseResult& parse_result, Span<const DescriptorSetLayoutHandle> layouts,
+                                                                 StringView debug_name );
+
         void                    fill_buffer_barrier( VkBufferMemoryBarrier2* barrier, BufferHandle buffer, ResourceState::Enum new_state,
                                                      u32 offset, u32 size, u32 source_family = VK_QUEUE_FAMILY_IGNORED,
                                                      u32 destination_family = VK_QUEUE_FAMILY_IGNORED,
@@ -283,14 +361,51 @@ namespace idra {
         SlotAllocator           shader_info_allocators[ PipelineType::Count ];
 
         SlotAllocator           descriptor_set_bindings_allocators[DescriptorSetBindingsPools::_Count];
+        // Hash of the bindings to the shared layout.
+        FlatHashMap<u64, DescriptorSetLayoutHandle> descriptor_set_layout_cache;
+
+        // Driver side cost of the compiled shaders, logged at shutdown.
+        struct PipelineStatistics {
+            u64                 shader_module_bytes = 0;
+            u32                 shader_modules      = 0;
+            u32                 pipelines           = 0;
+            f64                 creation_ms         = 0.0;
+            sizet               cache_loaded_bytes  = 0;    // Zero when pipelines were created with a cold cache.
+
+            void                add_pipeline( f64 ms )  { ++pipelines; creation_ms += ms; }
+        }; // struct PipelineStatistics
+
+        PipelineStatistics      pipeline_statistics;
+        CommandStateStatistics  command_state_statistics;   // Of the command buffers submitted last frame.
+        UploadStatistics        upload_statistics;
+
+        // Device-wide cache used by all pipeline creations, restored from
+        // pipeline_cache_path when its header matches the physical device.
+        void                    load_pipeline_cache( StringView folder );
+        void                    save_pipeline_cache();
+
+        VkPipelineCache         vk_pipeline_cache           = VK_NULL_HANDLE;
+        char                    pipeline_cache_path[ k_max_path ];
+        bool                    pipeline_cache_dirty        = false;
+
+        // Async pipelines, the queue is shared with the workers.
+        std::vector<std::thread> pipeline_compilation_threads;
+        std::mutex              pipeline_compilation_mutex;
+        std::condition_variable pipeline_compilation_condition;
+        Array<PipelineCompilation*> pipeline_compilation_queue;
+        u32                     pipeline_compilation_queue_head = 0;
+        bool                    pipeline_compilation_stop   = false;
+        // Enqueued and not yet finished, main thread only.
+        Array<PipelineCompilation*> pipeline_compilations;
 
         // These are dynamic - so that workload can be handled correctly.
         Array<ResourceUpdate>   resource_deletion_queue;
         //Array<DescriptorSetUpdate>      descriptor_set_updates;
         // [TAG: BINDLESS]
         Array<TextureUpdate>   texture_to_update_bindless;
-        Array<UploadTextureData> texture_uploads;
+        Array<StagingUpload>    staging_uploads;
         Array<UploadTextureData> texture_transfer_completes;
+        Array<BufferHandle>     buffer_transfer_completes;
 
         TextureFormat::Enum     swapchain_format;
         u32                     ubo_alignment;
@@ -312,7 +427,8 @@ namespace idra {
         DescriptorSetHandle     bindless_descriptor_set;
 
         BufferHandle            staging_buffer;
-        u32                     staging_buffer_offset = 0;
+        StagingRing             staging_ring;
+        StagingCopyBatcher      staging_copies;
 
         BufferHandle            dynamic_buffer;
         u32                     dynamic_per_frame_size = 0;
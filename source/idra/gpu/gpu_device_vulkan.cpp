@@ -5,9 +5,11 @@
 
 #include "gpu_device.hpp"
 #include "command_buffer.hpp"
+#include "spirv_parser.hpp"
 
 #include "kernel/assert.hpp"
 #include "kernel/file.hpp"
+#include "kernel/time.hpp"
 
 #include <vulkan/vk_enum_string_helper.h>
 
@@ -259,6 +261,10 @@ static DescriptorSetBindingsPools::Enum get_binding_allocator_index( u32 num_bin
 static const u32        k_bindless_texture_binding = 10;
 static const u32        k_bindless_image_binding = 11;
 static const u32        k_max_bindless_resources = 1024;
+// Frames between saves of a pipeline cache that received new pipelines.
+static const u32        k_pipeline_cache_save_frames = 600;
+// Buffer copies of a staging pass recorded with one command.
+static const u32        k_max_batched_buffer_copies = 32;
 
 // GpuDevice //////////////////////////////////////////////////////////////
 bool GpuDevice::internal_init( const GpuDeviceCreation& creation ) {
@@ -782,13 +788,25 @@ bool GpuDevice::internal_init( const GpuDeviceCreation& creation ) {
                                                                                 "VkDescriptorSetLayoutBinding Pool of 32" );
 
     resource_deletion_queue.init( allocator, 32, 0 );
-    texture_uploads.init( allocator, 32, 0 );
+    descriptor_set_layout_cache.init( allocator, 32 );
+    descriptor_set_layout_cache.set_default_value( { 0, k_invalid_generation } );
+    staging_uploads.init( allocator, 32, 0 );
     texture_transfer_completes.init( allocator, 32, 0 );
+    buffer_transfer_completes.init( allocator, 32, 0 );
     texture_to_update_bindless.init( allocator, 32, 0 );
 
     command_buffer_manager = ( CommandBufferManager* )ialloc( sizeof( CommandBufferManager ), allocator );
     *command_buffer_manager = {}; // init to default values
-    command_buffer_manager->init( this, creation.resource_pool_creation.command_buffers );
+    command_buffer_manager->init( this, creation.resource_pool_creation.command_buffers, creation.recording_threads );
+
+    load_pipeline_cache( creation.pipeline_cache_path );
+
+    pipeline_compilations.init( allocator, 16, 0 );
+    pipeline_compilation_queue.init( allocator, 16, 0 );
+    pipeline_compilation_stop = false;
+    for ( u32 i = 0; i < creation.pipeline_compilation_threads; ++i ) {
+        pipeline_compilation_threads.emplace_back( &GpuDevice::pipeline_compilation_worker, this );
+    }
 
     // Create semaphores
     VkSemaphoreCreateInfo semaphore_info{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
@@ -825,8 +843,10 @@ bool GpuDevice::internal_init( const GpuDeviceCreation& creation ) {
 
     staging_buffer = create_buffer( {
         .type = BufferUsage::Staging_mask, .usage = ResourceUsageType::Dynamic,
-        .size = imega( 32 ), .persistent = 1, .device_only = 0, .initial_data = nullptr,
+        .size = creation.staging_buffer_size, .persistent = 1, .device_only = 0, .initial_data = nullptr,
         .debug_name = "Staging_buffer" } );
+    staging_ring.init( allocator, creation.staging_buffer_size );
+    staging_copies.init( allocator, k_max_batched_buffer_copies );
 
     dynamic_per_frame_size = imega( 1 );
     dynamic_buffer = create_buffer( {
@@ -840,7 +860,7 @@ bool GpuDevice::internal_init( const GpuDeviceCreation& creation ) {
     // Create swapchain
     create_swapchain();
 
-    shader_compiler_init( creation.shader_folder_path );
+    shader_compiler_init( creation.shader_folder_path, creation.shader_cache_path );
 
     return true;
 }
@@ -849,6 +869,30 @@ void GpuDevice::internal_shutdown() {
 
     vkDeviceWaitIdle( vk_device );
 
+    wait_pipeline_compilations();
+    {
+        std::lock_guard<std::mutex> lock( pipeline_compilation_mutex );
+        pipeline_compilation_stop = true;
+    }
+    pipeline_compilation_condition.notify_all();
+
+    for ( std::thread& thread : pipeline_compilation_threads ) {
+        thread.join();
+    }
+    pipeline_compilation_threads.clear();
+    pipeline_compilations.shutdown();
+    pipeline_compilation_queue.shutdown();
+
+    // Compare runs with different shader compiler options.
+    // Cold and warm runs differ only by the pipeline cache loaded at init.
+    ilog( "Pipelines: %u shader modules, %.1f KB of SPIR-V, %u pipelines created in %.1f ms, %s pipeline cache (%.1f KB).\n",
+          pipeline_statistics.shader_modules, pipeline_statistics.shader_module_bytes / 1024.0,
+          pipeline_statistics.pipelines, pipeline_statistics.creation_ms,
+          pipeline_statistics.cache_loaded_bytes ? "warm" : "cold", pipeline_statistics.cache_loaded_bytes / 1024.0 );
+
+    save_pipeline_cache();
+    vkDestroyPipelineCache( vk_device, vk_pipeline_cache, vk_allocation_callbacks );
+
     shader_compiler_shutdown();
 
     unmap_buffer( dynamic_buffer );
@@ -875,8 +919,12 @@ void GpuDevice::internal_shutdown() {
     delete_queued_resources( true );
 
     resource_deletion_queue.shutdown();
-    texture_uploads.shutdown();
+    descriptor_set_layout_cache.shutdown();
+    staging_uploads.shutdown();
     texture_transfer_completes.shutdown();
+    buffer_transfer_completes.shutdown();
+    staging_ring.shutdown();
+    staging_copies.shutdown();
     texture_to_update_bindless.shutdown();
 
     // Free sub-resources slot allocators
@@ -1046,6 +1094,11 @@ void GpuDevice::delete_queued_resources( bool force_deletion ) {
                         ShaderState* v_shader_state = shader_states.get_cold( shader_state_handle );
                         if ( v_shader_state ) {
 
+                            if ( v_shader_state->parse_result ) {
+                                ifree( v_shader_state->parse_result, allocator );
+                                v_shader_state->parse_result = nullptr;
+                            }
+
                             switch ( v_shader_state->pipeline_type ) {
                                 case PipelineType::Compute:
                                 {
@@ -1126,6 +1179,172 @@ void GpuDevice::delete_queued_resources( bool force_deletion ) {
     }
 }
 
+// Staging uploads ////////////////////////////////////////////////////////
+static const u32        k_staging_alignment = 16;       // Multiple of the texel size of all formats.
+
+struct StagingBufferCopies {
+    VkBuffer            vk_buffer;
+    VkBufferCopy        regions[ k_max_batched_buffer_copies ];
+    u32                 count;
+}; // struct StagingBufferCopies
+
+static void vulkan_flush_buffer_copies( GpuDevice& gpu, CommandBuffer* cb, VkBuffer vk_staging_buffer, StagingBufferCopies& copies ) {
+
+    if ( copies.count == 0 ) {
+        return;
+    }
+
+    vkCmdCopyBuffer( cb->vk_command_buffer, vk_staging_buffer, copies.vk_buffer, copies.count, copies.regions );
+    ++gpu.upload_statistics.copy_commands;
+
+    copies.count = 0;
+}
+
+// Consecutive uploads to the same buffer are copied with one command, see StagingCopyBatcher.
+// An upload overlapping one recorded earlier in the pass is ordered after it by a barrier.
+static void vulkan_add_buffer_copy( GpuDevice& gpu, CommandBuffer* cb, VkBuffer vk_staging_buffer, StagingBufferCopies& copies,
+                                    BufferHandle buffer, const VkBufferCopy& region ) {
+
+    VkBuffer vk_buffer = gpu.buffers.get_hot( buffer )->vk_buffer;
+    const u32 actions = gpu.staging_copies.add( buffer.index, region.dstOffset, region.size );
+
+    if ( actions & StagingCopyBatcher::Flush ) {
+        vulkan_flush_buffer_copies( gpu, cb, vk_staging_buffer, copies );
+    }
+
+    if ( actions & StagingCopyBatcher::Barrier ) {
+        VkBufferMemoryBarrier2KHR barrier;
+        util_fill_buffer_barrier( &barrier, vk_buffer, ResourceState::CopyDest, ResourceState::CopyDest, 0, 0,
+                                  VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, QueueType::Transfer, QueueType::Transfer );
+        // Only copies need to wait, not all the commands of the transfer queue.
+        barrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR;
+
+        VkDependencyInfoKHR dependency_info{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR };
+        dependency_info.bufferMemoryBarrierCount = 1;
+        dependency_info.pBufferMemoryBarriers = &barrier;
+        vkCmdPipelineBarrier2KHR( cb->vk_command_buffer, &dependency_info );
+    }
+
+    copies.vk_buffer = vk_buffer;
+    copies.regions[ copies.count++ ] = region;
+}
+
+// Copies the queued uploads into the staging ring and records their transfers, in
+// order: an upload not fitting the free staging memory continues next frame, and
+// the following ones wait for it. Returns true if any command was recorded.
+static bool vulkan_record_staging_uploads( GpuDevice& gpu, CommandBuffer* cb ) {
+
+    Buffer* staging_buffer = gpu.buffers.get_cold( gpu.staging_buffer );
+    VkBuffer vk_staging_buffer = gpu.buffers.get_hot( gpu.staging_buffer )->vk_buffer;
+
+    StagingBufferCopies buffer_copies;
+    buffer_copies.vk_buffer = VK_NULL_HANDLE;
+    buffer_copies.count = 0;
+    gpu.staging_copies.reset();
+
+    const u32 first_completed_buffer = gpu.buffer_transfer_completes.size;
+    bool recorded = false;
+
+    u32 completed = 0;
+    for ( ; completed < gpu.staging_uploads.size; ++completed ) {
+        StagingUpload& upload = gpu.staging_uploads[ completed ];
+
+        // Textures are split in whole rows, or slices for 3D textures.
+        Texture* texture = upload.texture.is_valid() ? gpu.textures.get_cold( upload.texture ) : nullptr;
+        const u32 unit_count = texture ? ( texture->depth > 1 ? texture->depth : texture->height ) : upload.size;
+        const u32 granularity = upload.size / unit_count;
+
+        while ( upload.uploaded < upload.size ) {
+
+            u32 staging_offset = 0, staging_size = 0;
+            if ( !gpu.staging_ring.allocate( upload.size - upload.uploaded, granularity, k_staging_alignment, &staging_offset, &staging_size ) ) {
+                break;
+            }
+
+            memcpy( staging_buffer->mapped_data + staging_offset, upload.data + upload.uploaded, staging_size );
+
+            if ( texture ) {
+                if ( upload.uploaded == 0 ) {
+                    cb->submit_barriers( { {upload.texture, ResourceState::CopyDest, 0, 1, QueueType::Transfer, QueueType::Transfer} }, {} );
+                }
+
+                const u32 first_unit = upload.uploaded / granularity;
+                const u32 units = staging_size / granularity;
+
+                VkBufferImageCopy region = {};
+                region.bufferOffset = staging_offset;
+                region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+                if ( texture->depth > 1 ) {
+                    region.imageOffset = { 0, 0, ( i32 )first_unit };
+                    region.imageExtent = { texture->width, texture->height, units };
+                } else {
+                    region.imageOffset = { 0, ( i32 )first_unit, 0 };
+                    region.imageExtent = { texture->width, units, 1 };
+                }
+
+                vkCmdCopyBufferToImage( cb->vk_command_buffer, vk_staging_buffer, gpu.textures.get_hot( upload.texture )->vk_image,
+                                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region );
+                ++gpu.upload_statistics.copy_commands;
+            } else {
+                const VkBufferCopy region{ .srcOffset = staging_offset, .dstOffset = upload.buffer_offset + upload.uploaded, .size = staging_size };
+                vulkan_add_buffer_copy( gpu, cb, vk_staging_buffer, buffer_copies, upload.buffer, region );
+            }
+
+            upload.uploaded += staging_size;
+            gpu.upload_statistics.bytes += staging_size;
+            recorded = true;
+        }
+
+        if ( upload.uploaded < upload.size ) {
+            break;
+        }
+
+        // Release to the graphics queue, the acquire is in present.
+        if ( texture ) {
+            cb->submit_barriers( { {upload.texture, ResourceState::CopySource, 0, 1, QueueType::Transfer, QueueType::Graphics} }, {} );
+            gpu.texture_transfer_completes.push( { upload.texture, upload.data } );
+        } else {
+            bool already_completed = false;
+            for ( u32 i = first_completed_buffer; i < gpu.buffer_transfer_completes.size && !already_completed; ++i ) {
+                already_completed = gpu.buffer_transfer_completes[ i ] == upload.buffer;
+            }
+            if ( !already_completed ) {
+                gpu.buffer_transfer_completes.push( upload.buffer );
+            }
+        }
+    }
+
+    vulkan_flush_buffer_copies( gpu, cb, vk_staging_buffer, buffer_copies );
+
+    VkBufferMemoryBarrier2KHR buffer_barriers[ k_max_batched_buffer_copies ];
+    u32 buffer_barrier_count = 0;
+    for ( u32 i = first_completed_buffer; i < gpu.buffer_transfer_completes.size; ++i ) {
+        util_fill_buffer_barrier( &buffer_barriers[ buffer_barrier_count++ ], gpu.buffers.get_hot( gpu.buffer_transfer_completes[ i ] )->vk_buffer,
+                                  ResourceState::CopyDest, ResourceState::GenericRead, 0, 0,
+                                  gpu.queue_indices[ QueueType::Transfer ], gpu.queue_indices[ QueueType::Graphics ],
+                                  QueueType::Transfer, QueueType::Graphics );
+
+        if ( buffer_barrier_count == k_max_batched_buffer_copies || i + 1 == gpu.buffer_transfer_completes.size ) {
+            VkDependencyInfoKHR dependency_info{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR };
+            dependency_info.bufferMemoryBarrierCount = buffer_barrier_count;
+            dependency_info.pBufferMemoryBarriers = buffer_barriers;
+            vkCmdPipelineBarrier2KHR( cb->vk_command_buffer, &dependency_info );
+
+            buffer_barrier_count = 0;
+        }
+    }
+
+    // Remove the completed uploads, keeping the order of the others.
+    for ( u32 i = completed; i < gpu.staging_uploads.size; ++i ) {
+        gpu.staging_uploads[ i - completed ] = gpu.staging_uploads[ i ];
+    }
+    gpu.staging_uploads.set_size( gpu.staging_uploads.size - completed );
+    gpu.upload_statistics.completed_uploads = completed;
+
+    return recorded;
+}
+
 void GpuDevice::new_frame() {
 
     /*static VmaBudget gpu_heap_budgets[ 16 ];
@@ -1143,6 +1362,9 @@ void GpuDevice::new_frame() {
 
     iassertm( k_max_frames <= swapchain_image_count, "Cannot have more frame in flights than swapchains!" );
 
+    // Async pipelines compiled since the last frame can be bound from now on.
+    update_pipeline_compilations( false );
+
     // TODO: try to use the actual swapchain count.
     //if ( absolute_frame >= k_max_frames ) {
     if ( absolute_frame >= swapchain_image_count ) {
@@ -1183,41 +1405,41 @@ void GpuDevice::new_frame() {
     //dynamic_max_per_frame_size = idra_max( used_size, dynamic_max_per_frame_size );
     dynamic_allocated_size = dynamic_per_frame_size * current_frame;
 
+    // Keep pipelines created during the session, as hot reloaded ones, even if the application does not exit cleanly.
+    if ( pipeline_cache_dirty && ( absolute_frame % k_pipeline_cache_save_frames ) == 0 ) {
+        save_pipeline_cache();
+    }
+
     // Free all command buffers
     command_buffer_manager->free_unused_buffers( current_frame );
 
-    // TODO: add also buffer uploads
-    has_transfer_work = texture_uploads.size > 0;
-
-    CommandBuffer* cb = command_buffer_manager->get_transfer_command_buffer();
-
-    // Execute transfer operations
-    if ( texture_uploads.size ) {
+    // Staging memory read by completed transfers can be reused.
+    u64 completed_transfer_value = 0;
+    vkGetSemaphoreCounterValue( vk_device, vk_transfer_timeline_semaphore, &completed_transfer_value );
+    staging_ring.retire( completed_transfer_value );
 
-        // Go through all upload requests
-        for ( u32 i = 0; i < texture_uploads.size; ++i ) {
-            UploadTextureData& upload = texture_uploads[ i ];
+    upload_statistics.bytes = 0;
+    upload_statistics.completed_uploads = 0;
+    upload_statistics.copy_commands = 0;
 
-            Texture* texture = textures.get_cold( upload.texture );
-            u32 image_size = (u32)GpuUtils::calculate_texture_size( texture );
-
-            cb->upload_texture_data( upload.texture, upload.data, staging_buffer, staging_buffer_offset );
-
-            staging_buffer_offset += image_size;
+    has_transfer_work = false;
 
-            // Add to texture to finish transfer
-            texture_transfer_completes.push( upload );
-        }
+    CommandBuffer* cb = command_buffer_manager->get_transfer_command_buffer();
 
-        // Reset staging buffer
-        staging_buffer_offset = 0;
-        // Reset texture upload requests
-        texture_uploads.clear();
+    // Execute transfer operations
+    if ( staging_uploads.size && vulkan_record_staging_uploads( *this, cb ) ) {
 
         vkEndCommandBuffer( cb->vk_command_buffer );
 
         submit_transfer_work( cb );
+
+        // Memory staged for this submit is retired once it signals.
+        staging_ring.close_batch( last_transfer_semaphore_value );
     }
+
+    upload_statistics.total_bytes += upload_statistics.bytes;
+    upload_statistics.pending_uploads = staging_uploads.size;
+    upload_statistics.staging_used = staging_ring.used;
 }
 
 void GpuDevice::submit_transfer_work( CommandBuffer* command_buffer ) {
@@ -1261,11 +1483,31 @@ void GpuDevice::enqueue_command_buffer( CommandBuffer* command_buffer ) {
     enqueued_command_buffers[ num_enqueued_command_buffers++ ] = command_buffer;
 }
 
+// Acquires on the graphics queue the resources released by the transfer queue.
+static void vulkan_flush_transfer_acquire_barriers( CommandBuffer* cb ) {
+
+    if ( cb->num_vk_image_barriers == 0 && cb->num_vk_buffer_barriers == 0 ) {
+        return;
+    }
+
+    VkDependencyInfoKHR dependency_info{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR };
+    dependency_info.imageMemoryBarrierCount = cb->num_vk_image_barriers;
+    dependency_info.pImageMemoryBarriers = cb->vk_image_barriers;
+    dependency_info.bufferMemoryBarrierCount = cb->num_vk_buffer_barriers;
+    dependency_info.pBufferMemoryBarriers = cb->vk_buffer_barriers;
+
+    vkCmdPipelineBarrier2KHR( cb->vk_command_buffer, &dependency_info );
+
+    // Restore barrier count to 0
+    cb->num_vk_image_barriers = 0;
+    cb->num_vk_buffer_barriers = 0;
+}
+
 void GpuDevice::present() {
 
     // TODO: improve with a fence ?
 
-    if ( texture_transfer_completes.size ) {
+    if ( texture_transfer_completes.size || buffer_transfer_completes.size ) {
 
         CommandBuffer* cb = acquire_command_buffer( 0 );
 
@@ -1290,22 +1532,33 @@ void GpuDevice::present() {
                                      QueueType::Transfer, QueueType::Graphics);
 
             vk_texture->state = ResourceState::ShaderResource;
+
+            if ( cb->num_vk_image_barriers == k_max_image_outputs ) {
+                vulkan_flush_transfer_acquire_barriers( cb );
+            }
         }
 
-        // Submit all barriers
-        VkDependencyInfoKHR dependency_info{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR };
-        dependency_info.imageMemoryBarrierCount = cb->num_vk_image_barriers;
-        dependency_info.pImageMemoryBarriers = cb->vk_image_barriers;
-        dependency_info.bufferMemoryBarrierCount = 0;
-        dependency_info.pBufferMemoryBarriers = nullptr;
+        for ( u32 i = 0; i < buffer_transfer_completes.size; ++i ) {
+            Buffer* buffer = buffers.get_cold( buffer_transfer_completes[ i ] );
+            VulkanBuffer* vk_buffer = buffers.get_hot( buffer_transfer_completes[ i ] );
 
-        vkCmdPipelineBarrier2KHR( cb->vk_command_buffer, &dependency_info );
+            util_fill_buffer_barrier( &cb->vk_buffer_barriers[ cb->num_vk_buffer_barriers++ ], vk_buffer->vk_buffer,
+                                      ResourceState::CopyDest, ResourceState::GenericRead, 0, 0,
+                                      queue_indices[ QueueType::Transfer ], queue_indices[ QueueType::Graphics ],
+                                      QueueType::Transfer, QueueType::Graphics );
+
+            buffer->state = ResourceState::GenericRead;
+            buffer->ready = true;
+
+            if ( cb->num_vk_buffer_barriers == k_max_image_outputs ) {
+                vulkan_flush_transfer_acquire_barriers( cb );
+            }
+        }
 
-        // Restore barrier count to 0
-        cb->num_vk_image_barriers = 0;
-        cb->num_vk_buffer_barriers = 0;
+        vulkan_flush_transfer_acquire_barriers( cb );
 
         texture_transfer_completes.clear();
+        buffer_transfer_completes.clear();
     }
 
     if ( texture_to_update_bindless.size ) {
@@ -1414,10 +1667,14 @@ void GpuDevice::present() {
     bool wait_for_graphics_work = absolute_frame >= swapchain_image_count;
     VkCommandBufferSubmitInfoKHR command_buffer_info[ k_max_enqueued_command_buffers ]{ };
 
+    command_state_statistics = {};
+
     for ( u32 c = 0; c < num_enqueued_command_buffers; c++ ) {
         command_buffer_info[ c ].sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR;
         command_buffer_info[ c ].commandBuffer = enqueued_command_buffers[ c ]->vk_command_buffer;
 
+        command_state_statistics.add( enqueued_command_buffers[ c ]->state_statistics );
+
         // End command buffer
         vkEndCommandBuffer( enqueued_command_buffers[ c ]->vk_command_buffer );
     }
@@ -1709,10 +1966,15 @@ BufferHandle GpuDevice::create_buffer( const BufferCreation& creation ) {
     buffer->vk_device_memory = allocation_info.deviceMemory;
 
     if ( creation.initial_data ) {
-        void* data;
-        vmaMapMemory( vma_allocator, buffer->vma_allocation, &data );
-        memcpy( data, creation.initial_data, ( size_t )creation.size );
-        vmaUnmapMemory( vma_allocator, buffer->vma_allocation );
+        if ( creation.device_only ) {
+            // Not mappable, copied through the staging ring.
+            upload_buffer_data( handle, creation.initial_data, creation.size, 0 );
+        } else {
+            void* data;
+            vmaMapMemory( vma_allocator, buffer->vma_allocation, &data );
+            memcpy( data, creation.initial_data, ( size_t )creation.size );
+            vmaUnmapMemory( vma_allocator, buffer->vma_allocation );
+        }
     }
 
     if ( creation.persistent ) {
@@ -2035,6 +2297,33 @@ TextureHandle GpuDevice::create_texture_view( const TextureViewCreation& creatio
 
 static bool create_shader_module( GpuDevice& gpu, const ShaderStageCode& shader, VkPipelineShaderStageCreateInfo& out_shader_stage );
 
+// Reflection of all the stages, kept with the shader state as long as its SPIR-V modules.
+// Pipelines use it to derive or validate their descriptor set layouts.
+// A precomputed reflection, like the one stored in shader packs, is copied.
+static spirv::ParseResult* reflect_shader_stages( GpuDevice& gpu, Span<const ShaderStageCode> stages,
+                                                  const spirv::ParseResult* reflection, StringView debug_name ) {
+
+    spirv::ParseResult* parse_result = ialloct( spirv::ParseResult, gpu.allocator );
+
+    if ( reflection ) {
+        memcpy( parse_result, reflection, sizeof( spirv::ParseResult ) );
+        return parse_result;
+    }
+
+    memset( parse_result, 0, sizeof( spirv::ParseResult ) );
+
+    for ( u32 i = 0; i < stages.size; ++i ) {
+        if ( !spirv::parse_binary( stages[ i ].byte_code.data, stages[ i ].byte_code.size, parse_result ) ) {
+            ilog_warn( "Cannot reflect shader %s, its pipelines need explicit descriptor set layouts.\n", debug_name.data );
+
+            ifree( parse_result, gpu.allocator );
+            return nullptr;
+        }
+    }
+
+    return parse_result;
+}
+
 ShaderStateHandle GpuDevice::create_graphics_shader_state( const GraphicsShaderStateCreation& creation ) {
 
     ShaderStateHandle handle = shader_states.obtain_object();
@@ -2049,6 +2338,7 @@ ShaderStateHandle GpuDevice::create_graphics_shader_state( const GraphicsShaderS
     shader_state->pipeline_type = PipelineType::Graphics;
     shader_state->num_active_shaders = 0;
     shader_state->shader_group_info = nullptr;
+    shader_state->parse_result = nullptr;
     shader_state->shader_stage_info = ( VkPipelineShaderStageCreateInfo* )ialloc( sizeof( VkPipelineShaderStageCreateInfo ) * 2, &shader_info_allocators[ PipelineType::Graphics ] );
 
     if ( !create_shader_module( *this, creation.vertex_shader,
@@ -2072,6 +2362,9 @@ ShaderStateHandle GpuDevice::create_graphics_shader_state( const GraphicsShaderS
     shader_state->debug_name = creation.debug_name;
     shader_state->num_active_shaders = 2;
 
+    const ShaderStageCode stages[] = { creation.vertex_shader, creation.fragment_shader };
+    shader_state->parse_result = reflect_shader_stages( *this, { stages, 2 }, creation.reflection, creation.debug_name );
+
     set_resource_name( VK_OBJECT_TYPE_SHADER_MODULE, ( u64 )shader_state->shader_stage_info[ 0 ].module, creation.debug_name );
     set_resource_name( VK_OBJECT_TYPE_SHADER_MODULE, ( u64 )shader_state->shader_stage_info[ 1 ].module, creation.debug_name );
 
@@ -2296,6 +2589,9 @@ static bool create_shader_module( GpuDevice& gpu, const ShaderStageCode& shader,
         return false;
     }
 
+    gpu.pipeline_statistics.shader_modules++;
+    gpu.pipeline_statistics.shader_module_bytes += shader.byte_code.size;
+
     return true;
 }
 
@@ -2311,6 +2607,7 @@ ShaderStateHandle GpuDevice::create_compute_shader_state( const ComputeShaderSta
 
     shader_state->pipeline_type = PipelineType::Compute;
     shader_state->num_active_shaders = 0;
+    shader_state->parse_result = nullptr;
 
     VkPipelineShaderStageCreateInfo shader_stage_create_info{};
 
@@ -2334,60 +2631,404 @@ ShaderStateHandle GpuDevice::create_compute_shader_state( const ComputeShaderSta
     *shader_state->shader_stage_info = shader_stage_create_info;
     shader_state->shader_group_info = nullptr;
 
+    shader_state->parse_result = reflect_shader_stages( *this, { &creation.compute_shader, 1 }, creation.reflection, creation.debug_name );
+
     return handle;
 }
 
-PipelineHandle GpuDevice::create_graphics_pipeline( const GraphicsPipelineCreation& creation ) {
-    PipelineHandle handle = pipelines.obtain_object();
-    if ( handle.is_invalid() ) {
-        return handle;
+u32 GpuDevice::create_reflected_descriptor_set_layouts( const spirv::ParseResult& parse_result, StringView debug_name,
+                                                         DescriptorSetLayoutHandle* out_layouts ) {
+
+    iassertm( parse_result.set_count <= k_max_descriptor_set_layouts, "Pipeline %s uses %u sets\n", debug_name.data, parse_result.set_count );
+    const u32 set_count = parse_result.set_count < k_max_descriptor_set_layouts ? parse_result.set_count : k_max_descriptor_set_layouts;
+
+    for ( u32 set = 0; set < set_count; ++set ) {
+
+        DescriptorBinding bindings[ spirv::k_max_bindings ];
+        u32 dynamic_bindings[ spirv::k_max_bindings ];
+        u32 num_bindings = 0;
+        u32 num_dynamic_bindings = 0;
+        bool bindless_bindings = true;
+
+        for ( u32 b = 0; b < parse_result.num_bindings; ++b ) {
+            const spirv::Binding& binding = parse_result.bindings[ b ];
+            if ( binding.set != set ) {
+                continue;
+            }
+
+            bindless_bindings = bindless_bindings && binding.count == 0 &&
+                                ( ( binding.binding == k_bindless_texture_binding && binding.type == DescriptorType::Texture ) ||
+                                  ( binding.binding == k_bindless_image_binding && binding.type == DescriptorType::Image ) );
+
+            // Constants are always sub allocated from the dynamic buffer.
+            if ( binding.type == DescriptorType::Constants ) {
+                dynamic_bindings[ num_dynamic_bindings++ ] = binding.binding;
+                continue;
+            }
+
+            u16 count = binding.count;
+            if ( count == 0 ) {
+                ilog_warn( "Pipeline %s: runtime array %s (set %u, binding %u) outside of the bindless set, using a single descriptor.\n",
+                           debug_name.data, binding.name, binding.set, binding.binding );
+                count = 1;
+            }
+
+            bindings[ num_bindings++ ] = { .type = binding.type, .start = binding.binding, .count = count, .name = binding.name };
+        }
+
+        // Global textures and images, or the unused set 0, use the bindless set.
+        const bool empty_set = num_bindings + num_dynamic_bindings == 0;
+        if ( bindless_supported && bindless_bindings && ( !empty_set || set == 0 ) ) {
+            ++descriptor_set_layouts.get_cold( bindless_descriptor_set_layout )->reference_count;
+            out_layouts[ set ] = bindless_descriptor_set_layout;
+            continue;
+        }
+
+        DescriptorSetLayoutCreation layout_creation{
+            .bindings = { bindings, num_bindings },
+            .dynamic_buffer_bindings = { dynamic_bindings, num_dynamic_bindings },
+            .debug_name = debug_name };
+        out_layouts[ set ] = create_descriptor_set_layout( layout_creation );
     }
 
-    Pipeline* pipeline = pipelines.get_cold( handle );
-    VulkanPipeline* vk_pipeline = pipelines.get_hot( handle );
-    ShaderState* shader_state_data = shader_states.get_cold( creation.shader );
+    return set_count;
+}
 
-    pipeline->shader_state = creation.shader;
+void GpuDevice::validate_descriptor_set_layouts( const spirv::ParseResult& parse_result, Span<const DescriptorSetLayoutHandle> layouts,
+                                                 StringView debug_name ) {
 
-    VkDescriptorSetLayout vk_layouts[ k_max_descriptor_set_layouts ];
+    for ( u32 b = 0; b < parse_result.num_bindings; ++b ) {
+        const spirv::Binding& binding = parse_result.bindings[ b ];
 
-    u32 num_active_layouts = ( u32 )creation.descriptor_set_layouts.size;// shader_state_data->parse_result->set_count;
+        const DescriptorSetLayout* layout = binding.set < layouts.size ? descriptor_set_layouts.get_cold( layouts[ binding.set ] ) : nullptr;
+        if ( !layout ) {
+            ilog_warn( "Pipeline %s: %s (set %u, binding %u) has no descriptor set layout.\n", debug_name.data, binding.name, binding.set, binding.binding );
+            continue;
+        }
+
+        const VkDescriptorSetLayoutBinding* vk_binding = nullptr;
+        for ( u32 i = 0; i < ( u32 )( layout->num_bindings + layout->num_dynamic_bindings ); ++i ) {
+            if ( layout->vk_binding[ i ].binding == binding.binding ) {
+                vk_binding = &layout->vk_binding[ i ];
+                break;
+            }
+        }
+
+        if ( !vk_binding ) {
+            ilog_warn( "Pipeline %s: %s (set %u, binding %u) is missing from the layout.\n", debug_name.data, binding.name, binding.set, binding.binding );
+            continue;
+        }
+
+        const bool compatible_type = vk_binding->descriptorType == to_vk_descriptor_type( binding.type ) ||
+                                     ( binding.type == DescriptorType::Constants && vk_binding->descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC );
+        if ( !compatible_type ) {
+            ilog_warn( "Pipeline %s: %s (set %u, binding %u) is %s in the shader and %s in the layout.\n", debug_name.data, binding.name,
+                       binding.set, binding.binding, DescriptorType::s_value_names[ binding.type ], string_VkDescriptorType( vk_binding->descriptorType ) );
+        } else if ( binding.count > vk_binding->descriptorCount ) {
+            ilog_warn( "Pipeline %s: %s (set %u, binding %u) has %u descriptors in the shader and %u in the layout.\n", debug_name.data, binding.name,
+                       binding.set, binding.binding, binding.count, vk_binding->descriptorCount );
+        }
+    }
+}
+
+// Given layouts are checked against the shader, when none are given they are derived from it.
+// The pipeline keeps a reference to each layout until it is destroyed.
+static u32 acquire_pipeline_layouts( GpuDevice& gpu, Pipeline* pipeline, const ShaderState* shader_state, Span<const DescriptorSetLayoutHandle> layouts,
+                                     StringView debug_name, VkDescriptorSetLayout* out_vk_layouts ) {
+
+    u32 num_active_layouts = ( u32 )layouts.size;
+
+    if ( num_active_layouts ) {
+        if ( shader_state->parse_result ) {
+            gpu.validate_descriptor_set_layouts( *shader_state->parse_result, layouts, debug_name );
+        }
+
+        for ( u32 l = 0; l < num_active_layouts; ++l ) {
+            ++gpu.descriptor_set_layouts.get_cold( layouts[ l ] )->reference_count;
+            pipeline->descriptor_set_layout_handles[ l ] = layouts[ l ];
+        }
+    } else if ( shader_state->parse_result ) {
+        num_active_layouts = gpu.create_reflected_descriptor_set_layouts( *shader_state->parse_result, debug_name, pipeline->descriptor_set_layout_handles );
+    }
 
-    // Create VkPipelineLayout
     for ( u32 l = 0; l < num_active_layouts; ++l ) {
+        pipeline->descriptor_set_layout[ l ] = gpu.descriptor_set_layouts.get_cold( pipeline->descriptor_set_layout_handles[ l ] );
+        out_vk_layouts[ l ] = gpu.descriptor_set_layouts.get_hot( pipeline->descriptor_set_layout_handles[ l ] )->vk_descriptor_set_layout;
+    }
+
+    return num_active_layouts;
+}
+
+// Push constants are visible to all stages, as descriptor bindings.
+static void add_push_constants( const ShaderState* shader_state, VkPipelineLayoutCreateInfo& pipeline_layout_info, VkPushConstantRange& push_constant ) {
+
+    if ( !shader_state->parse_result || !shader_state->parse_result->push_constants_stride ) {
+        return;
+    }
+
+    push_constant.offset = 0;
+    push_constant.size = shader_state->parse_result->push_constants_stride;
+    push_constant.stageFlags = VK_SHADER_STAGE_ALL;
+
+    pipeline_layout_info.pPushConstantRanges = &push_constant;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+}
+
+void GpuDevice::load_pipeline_cache( StringView folder ) {
 
-        DescriptorSetLayout* descriptor_set_layout = descriptor_set_layouts.get_cold( creation.descriptor_set_layouts[ l ] );
-        pipeline->descriptor_set_layout[ l ] = descriptor_set_layout;
+    pipeline_cache_path[ 0 ] = 0;
 
-        VulkanDescriptorSetLayout* vk_dsl = descriptor_set_layouts.get_hot( creation.descriptor_set_layouts[ l ] );
-        vk_layouts[ l ] = vk_dsl->vk_descriptor_set_layout;
+    if ( folder.size ) {
+        if ( !fs_directory_exists( folder ) ) {
+            fs_directory_create( folder );
+        }
+
+        // Keep the absolute path, saves stay valid if the current directory changes.
+        char folder_path[ k_max_path ];
+        if ( fs_file_resolve_to_full_path( folder.data, folder_path, k_max_path ) ) {
+            snprintf( pipeline_cache_path, k_max_path, "%s/pipeline_cache.bin", folder_path );
+        } else {
+            ilog_warn( "Pipeline cache not persistent, cannot use folder %s\n", folder.data );
+        }
+    }
+
+    Span<char> file_data = pipeline_cache_path[ 0 ] && fs_file_exists( pipeline_cache_path ) ?
+                            file_read_allocate( pipeline_cache_path, allocator ) : Span<char>( nullptr, 0 );
+
+    // Data from another driver or device is ignored by the driver only in the best case, so check the header.
+    const VkPipelineCacheHeaderVersionOne* header = ( const VkPipelineCacheHeaderVersionOne* )file_data.data;
+
+    bool valid = file_data.size >= sizeof( VkPipelineCacheHeaderVersionOne );
+    valid = valid && header->headerSize >= sizeof( VkPipelineCacheHeaderVersionOne ) &&
+            header->headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE;
+    valid = valid && header->vendorID == vk_physical_device_properties.vendorID &&
+            header->deviceID == vk_physical_device_properties.deviceID &&
+            memcmp( header->pipelineCacheUUID, vk_physical_device_properties.pipelineCacheUUID, VK_UUID_SIZE ) == 0;
+
+    if ( file_data.data && !valid ) {
+        ilog_warn( "Pipeline cache %s does not match the device, starting cold\n", pipeline_cache_path );
     }
 
+    VkPipelineCacheCreateInfo pipeline_cache_create_info{ VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+    pipeline_cache_create_info.initialDataSize = valid ? file_data.size : 0;
+    pipeline_cache_create_info.pInitialData = valid ? file_data.data : nullptr;
+
+    // A cache rejected by the driver is not fatal, retry empty.
+    VkResult result = vkCreatePipelineCache( vk_device, &pipeline_cache_create_info, vk_allocation_callbacks, &vk_pipeline_cache );
+    if ( result != VK_SUCCESS && valid ) {
+        ilog_warn( "Pipeline cache %s rejected by the driver, starting cold\n", pipeline_cache_path );
+
+        valid = false;
+        pipeline_cache_create_info.initialDataSize = 0;
+        pipeline_cache_create_info.pInitialData = nullptr;
+        result = vkCreatePipelineCache( vk_device, &pipeline_cache_create_info, vk_allocation_callbacks, &vk_pipeline_cache );
+    }
+    vkcheck( result );
+
+    pipeline_statistics.cache_loaded_bytes = valid ? file_data.size : 0;
+    pipeline_cache_dirty = false;
+
+    if ( file_data.data ) {
+        ifree( file_data.data, allocator );
+    }
+}
+
+void GpuDevice::save_pipeline_cache() {
+
+    if ( !pipeline_cache_dirty || !pipeline_cache_path[ 0 ] ) {
+        return;
+    }
+
+    pipeline_cache_dirty = false;
+
+    sizet data_size = 0;
+    vkcheck( vkGetPipelineCacheData( vk_device, vk_pipeline_cache, &data_size, nullptr ) );
+
+    char* data = ( char* )ialloc( data_size, allocator );
+    vkcheck( vkGetPipelineCacheData( vk_device, vk_pipeline_cache, &data_size, data ) );
+
+    // Write aside and rename, a crash while saving must not leave a truncated cache.
+    char temporary_path[ k_max_path ];
+    snprintf( temporary_path, k_max_path, "%s.tmp", pipeline_cache_path );
+
+    FileHandle file = file_open_for_write( temporary_path );
+    const sizet written = file ? file_write( file, { data, data_size } ) : 0;
+    if ( file ) {
+        file_close( file );
+    }
+
+    if ( written != data_size || !fs_file_rename( temporary_path, pipeline_cache_path ) ) {
+        ilog_warn( "Pipeline cache cannot write %s\n", pipeline_cache_path );
+        fs_file_delete( temporary_path );
+    }
+
+    ifree( data, allocator );
+}
+
+// Every vertex shader input needs an attribute.
+static void validate_vertex_inputs( const ShaderState* shader_state, const VertexInputCreation& vertex_input_creation, StringView debug_name ) {
+
+    const spirv::ParseResult* parse_result = shader_state->parse_result;
+    for ( u32 i = 0; parse_result && i < parse_result->num_vertex_inputs; ++i ) {
+        const spirv::VertexInput& vertex_input = parse_result->vertex_inputs[ i ];
+
+        bool found = false;
+        for ( u32 a = 0; a < vertex_input_creation.vertex_attributes.size && !found; ++a ) {
+            found = vertex_input_creation.vertex_attributes[ a ].location == vertex_input.location;
+        }
+
+        if ( !found ) {
+            ilog_warn( "Pipeline %s: vertex input %s (location %u) has no vertex attribute.\n", debug_name.data, vertex_input.name, vertex_input.location );
+        }
+    }
+}
+
+static const u32        k_pipeline_debug_name_length = 64;     // Longer names are truncated.
+
+//
+// Async creation. The creation is copied, as its spans and name are often temporaries.
+struct PipelineCompilation {
+
+    GraphicsPipelineCreation        creation;
+    VertexStream                    vertex_streams[ k_max_vertex_streams ];
+    VertexAttribute                 vertex_attributes[ k_max_vertex_attributes ];
+    BlendState                      blend_states[ k_max_image_outputs ];
+    TextureFormat::Enum             color_formats[ k_max_image_outputs ];
+    char                            debug_name[ k_pipeline_debug_name_length ];
+
+    PipelineHandle                  pipeline;
+    f64                             creation_ms = 0.0;
+    bool                            compute     = false;
+    bool                            done        = false;    // Guarded by the compilation mutex.
+
+}; // struct PipelineCompilation
+
+PipelineHandle GpuDevice::create_pipeline_layout( ShaderStateHandle shader, Span<const DescriptorSetLayoutHandle> layouts,
+                                                  VkPipelineBindPoint bind_point, StringView debug_name ) {
+    PipelineHandle handle = pipelines.obtain_object();
+    if ( handle.is_invalid() ) {
+        return handle;
+    }
+
+    //resource_tracker.track_create_resource( ResourceUpdateType::Pipeline, handle.index, creation.name );
+
+    Pipeline* pipeline = pipelines.get_cold( handle );
+    VulkanPipeline* vk_pipeline = pipelines.get_hot( handle );
+    ShaderState* shader_state_data = shader_states.get_cold( shader );
+
+    pipeline->shader_state = shader;
+    pipeline->replaced = PipelineHandle{};
+
+    // Create VkPipelineLayout
+    VkDescriptorSetLayout vk_layouts[ k_max_descriptor_set_layouts ];
+    const u32 num_active_layouts = acquire_pipeline_layouts( *this, pipeline, shader_state_data, layouts, debug_name, vk_layouts );
+
     VkPipelineLayoutCreateInfo pipeline_layout_info = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
     pipeline_layout_info.pSetLayouts = vk_layouts;
     pipeline_layout_info.setLayoutCount = num_active_layouts;
     pipeline_layout_info.pushConstantRangeCount = 0;
 
-    //VkPushConstantRange push_constant;
-
-    /*if ( shader_state_data->parse_result->push_constants_stride ) {
-
-        push_constant.offset = 0;
-        push_constant.size = shader_state_data->parse_result->push_constants_stride;
-        push_constant.stageFlags = VK_SHADER_STAGE_ALL;
-
-        pipeline_layout_info.pPushConstantRanges = &push_constant;
-        pipeline_layout_info.pushConstantRangeCount = 1;
-    }*/
+    VkPushConstantRange push_constant;
+    add_push_constants( shader_state_data, pipeline_layout_info, push_constant );
 
-    // Create the Vulkan compute pipeline
     VkPipelineLayout pipeline_layout;
     vkcheck( vkCreatePipelineLayout( vk_device, &pipeline_layout_info, vk_allocation_callbacks, &pipeline_layout ) );
 
     // Cache pipeline layout
+    vk_pipeline->vk_pipeline = VK_NULL_HANDLE;
     vk_pipeline->vk_pipeline_layout = pipeline_layout;
+    vk_pipeline->vk_bind_point = bind_point;
+    vk_pipeline->ready = 0;
     pipeline->num_active_layouts = num_active_layouts;
 
+    return handle;
+}
+
+void GpuDevice::finish_pipeline( PipelineHandle handle, f64 creation_ms, StringView debug_name ) {
+
+    Pipeline* pipeline = pipelines.get_cold( handle );
+    VulkanPipeline* vk_pipeline = pipelines.get_hot( handle );
+
+    pipeline_statistics.add_pipeline( creation_ms );
+    pipeline_cache_dirty = true;
+
+    vk_pipeline->ready = 1;
+    set_resource_name( VK_OBJECT_TYPE_PIPELINE, ( u64 )vk_pipeline->vk_pipeline, debug_name );
+
+    // Frames in flight can still use the replaced pipeline, the deletion queue waits for them.
+    if ( pipeline->replaced.is_valid() ) {
+        destroy_pipeline( pipeline->replaced );
+        pipeline->replaced = PipelineHandle{};
+    }
+}
+
+PipelineHandle GpuDevice::create_graphics_pipeline( const GraphicsPipelineCreation& creation ) {
+
+    PipelineHandle handle = create_pipeline_layout( creation.shader, creation.descriptor_set_layouts, VK_PIPELINE_BIND_POINT_GRAPHICS, creation.debug_name );
+    if ( handle.is_invalid() ) {
+        return handle;
+    }
+
+    validate_vertex_inputs( shader_states.get_cold( creation.shader ), creation.vertex_input, creation.debug_name );
+
+    const f64 creation_ms = compile_graphics_pipeline( handle, creation );
+    finish_pipeline( handle, creation_ms, creation.debug_name );
+
+    return handle;
+}
+
+PipelineHandle GpuDevice::create_graphics_pipeline_async( const GraphicsPipelineCreation& creation, PipelineHandle replaced ) {
+
+    if ( pipeline_compilation_threads.empty() ) {
+        destroy_pipeline( replaced );
+        return create_graphics_pipeline( creation );
+    }
+
+    PipelineHandle handle = create_pipeline_layout( creation.shader, creation.descriptor_set_layouts, VK_PIPELINE_BIND_POINT_GRAPHICS, creation.debug_name );
+    if ( handle.is_invalid() ) {
+        return handle;
+    }
+
+    validate_vertex_inputs( shader_states.get_cold( creation.shader ), creation.vertex_input, creation.debug_name );
+
+    PipelineCompilation* compilation = ( PipelineCompilation* )ialloc( sizeof( PipelineCompilation ), allocator );
+    *compilation = {};
+    compilation->pipeline = handle;
+    compilation->creation = creation;
+
+    // Layouts are already acquired, the worker does not need them.
+    GraphicsPipelineCreation& copy = compilation->creation;
+    copy.descriptor_set_layouts = {};
+
+    const VertexInputCreation& vertex_input = creation.vertex_input;
+    iassert( vertex_input.vertex_streams.size <= ArraySize( compilation->vertex_streams ) );
+    iassert( vertex_input.vertex_attributes.size <= ArraySize( compilation->vertex_attributes ) );
+    iassert( creation.blend_state.blend_states.size <= ArraySize( compilation->blend_states ) );
+    iassert( creation.color_formats.size <= ArraySize( compilation->color_formats ) );
+
+    memcpy( compilation->vertex_streams, vertex_input.vertex_streams.data, sizeof( VertexStream ) * vertex_input.vertex_streams.size );
+    memcpy( compilation->vertex_attributes, vertex_input.vertex_attributes.data, sizeof( VertexAttribute ) * vertex_input.vertex_attributes.size );
+    memcpy( compilation->blend_states, creation.blend_state.blend_states.data, sizeof( BlendState ) * creation.blend_state.blend_states.size );
+    memcpy( compilation->color_formats, creation.color_formats.data, sizeof( TextureFormat::Enum ) * creation.color_formats.size );
+    snprintf( compilation->debug_name, ArraySize( compilation->debug_name ), "%.*s", ( int )creation.debug_name.size, creation.debug_name.data );
+
+    copy.vertex_input.vertex_streams = { compilation->vertex_streams, vertex_input.vertex_streams.size };
+    copy.vertex_input.vertex_attributes = { compilation->vertex_attributes, vertex_input.vertex_attributes.size };
+    copy.blend_state.blend_states = { compilation->blend_states, creation.blend_state.blend_states.size };
+    copy.color_formats = { compilation->color_formats, creation.color_formats.size };
+    copy.debug_name = compilation->debug_name;
+
+    pipelines.get_cold( handle )->replaced = replaced;
+    enqueue_pipeline_compilation( compilation );
+
+    return handle;
+}
+
+f64 GpuDevice::compile_graphics_pipeline( PipelineHandle handle, const GraphicsPipelineCreation& creation ) {
+
+    VulkanPipeline* vk_pipeline = pipelines.get_hot( handle );
+    const ShaderState* shader_state_data = shader_states.get_cold( creation.shader );
+
     VkGraphicsPipelineCreateInfo pipeline_info = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
 
     //pipeline_info.flags = creation.flags;
@@ -2396,7 +3037,7 @@ PipelineHandle GpuDevice::create_graphics_pipeline( const GraphicsPipelineCreati
     pipeline_info.pStages = shader_state_data->shader_stage_info;
     pipeline_info.stageCount = shader_state_data->num_active_shaders;
     //// PipelineLayout
-    pipeline_info.layout = pipeline_layout;
+    pipeline_info.layout = vk_pipeline->vk_pipeline_layout;
 
     //// Vertex input
     VkPipelineVertexInputStateCreateInfo vertex_input_info = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
@@ -2595,144 +3236,153 @@ PipelineHandle GpuDevice::create_graphics_pipeline( const GraphicsPipelineCreati
 
     pipeline_info.pDynamicState = &dynamic_state;
 
-    // TODO:
-    VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
-    vkcheck( vkCreateGraphicsPipelines( vk_device, pipeline_cache, 1, &pipeline_info, vk_allocation_callbacks, &vk_pipeline->vk_pipeline ) );
-
-    vk_pipeline->vk_bind_point = VkPipelineBindPoint::VK_PIPELINE_BIND_POINT_GRAPHICS;
-
-    set_resource_name( VK_OBJECT_TYPE_PIPELINE, ( u64 )vk_pipeline->vk_pipeline, creation.debug_name );
-
-    return handle;
+    const TimeTick creation_start = g_time->now();
+    vkcheck( vkCreateGraphicsPipelines( vk_device, vk_pipeline_cache, 1, &pipeline_info, vk_allocation_callbacks, &vk_pipeline->vk_pipeline ) );
+    return g_time->convert_milliseconds( g_time->delta( g_time->now(), creation_start ) );
 }
 
 PipelineHandle GpuDevice::create_compute_pipeline( const ComputePipelineCreation& creation ) {
 
-    PipelineHandle handle = pipelines.obtain_object();
+    PipelineHandle handle = create_pipeline_layout( creation.shader, creation.descriptor_set_layouts, VK_PIPELINE_BIND_POINT_COMPUTE, creation.debug_name );
     if ( handle.is_invalid() ) {
         return handle;
     }
 
-    //resource_tracker.track_create_resource( ResourceUpdateType::Pipeline, handle.index, creation.name );
+    const f64 creation_ms = compile_compute_pipeline( handle );
+    finish_pipeline( handle, creation_ms, creation.debug_name );
 
-    VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
-    VkPipelineCacheCreateInfo pipeline_cache_create_info{ VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+    return handle;
+}
 
-    //bool cache_exists = file_exists( cache_path );
-    //if ( cache_path != nullptr && cache_exists ) {
-    //    FileReadResult read_result = file_read_binary( cache_path, allocator );
-
-    //    VkPipelineCacheHeaderVersionOne* cache_header = ( VkPipelineCacheHeaderVersionOne* )read_result.data;
-
-    //    if ( cache_header->deviceID == vulkan_physical_properties.deviceID &&
-    //         cache_header->vendorID == vulkan_physical_properties.vendorID &&
-    //         memcmp( cache_header->pipelineCacheUUID, vulkan_physical_properties.pipelineCacheUUID, VK_UUID_SIZE ) == 0 )
-    //    {
-    //        pipeline_cache_create_info.initialDataSize = read_result.size;
-    //        pipeline_cache_create_info.pInitialData = read_result.data;
-    //    } else
-    //    {
-    //        cache_exists = false;
-    //    }
+PipelineHandle GpuDevice::create_compute_pipeline_async( const ComputePipelineCreation& creation, PipelineHandle replaced ) {
 
-    //    check( vkCreatePipelineCache( vulkan_device, &pipeline_cache_create_info, vulkan_allocation_callbacks, &pipeline_cache ) );
+    if ( pipeline_compilation_threads.empty() ) {
+        destroy_pipeline( replaced );
+        return create_compute_pipeline( creation );
+    }
 
-    //    allocator->deallocate( read_result.data );
-    //} else {
-    //    check( vkCreatePipelineCache( vulkan_device, &pipeline_cache_create_info, vulkan_allocation_callbacks, &pipeline_cache ) );
-    //}
+    PipelineHandle handle = create_pipeline_layout( creation.shader, creation.descriptor_set_layouts, VK_PIPELINE_BIND_POINT_COMPUTE, creation.debug_name );
+    if ( handle.is_invalid() ) {
+        return handle;
+    }
 
-    //ShaderStateHandle shader_state = create_shader_state( creation.shaders );
-    //if ( shader_state.index == k_invalid_index ) {
-    //    // Shader did not compile.
-    //    pipelines.release_resource( handle.index );
-    //    handle.index = k_invalid_index;
+    PipelineCompilation* compilation = ( PipelineCompilation* )ialloc( sizeof( PipelineCompilation ), allocator );
+    *compilation = {};
+    compilation->pipeline = handle;
+    compilation->compute = true;
+    snprintf( compilation->debug_name, ArraySize( compilation->debug_name ), "%.*s", ( int )creation.debug_name.size, creation.debug_name.data );
+    compilation->creation.debug_name = compilation->debug_name;
 
-    //    return handle;
-    //}
+    pipelines.get_cold( handle )->replaced = replaced;
+    enqueue_pipeline_compilation( compilation );
 
-    // Now that shaders have compiled we can create the pipeline.
-    Pipeline* pipeline = pipelines.get_cold( handle );
-    VulkanPipeline* vk_pipeline = pipelines.get_hot( handle );
+    return handle;
+}
 
-    ShaderState* shader_state_data = shader_states.get_cold( creation.shader );
+f64 GpuDevice::compile_compute_pipeline( PipelineHandle handle ) {
 
-    pipeline->shader_state = creation.shader;
+    VulkanPipeline* vk_pipeline = pipelines.get_hot( handle );
+    const ShaderState* shader_state_data = shader_states.get_cold( pipelines.get_cold( handle )->shader_state );
 
-    VkDescriptorSetLayout vk_layouts[ k_max_descriptor_set_layouts ];
+    VkComputePipelineCreateInfo pipeline_info{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
 
-    u32 num_active_layouts = (u32)creation.descriptor_set_layouts.size;// shader_state_data->parse_result->set_count;
+    pipeline_info.stage = shader_state_data->shader_stage_info[ 0 ];
+    pipeline_info.layout = vk_pipeline->vk_pipeline_layout;
 
-    // Create VkPipelineLayout
-    for ( u32 l = 0; l < num_active_layouts; ++l ) {
+    const TimeTick creation_start = g_time->now();
+    vkcheck( vkCreateComputePipelines( vk_device, vk_pipeline_cache, 1, &pipeline_info, vk_allocation_callbacks, &vk_pipeline->vk_pipeline ) );
+    return g_time->convert_milliseconds( g_time->delta( g_time->now(), creation_start ) );
+}
 
-        DescriptorSetLayout* descriptor_set_layout = descriptor_set_layouts.get_cold( creation.descriptor_set_layouts[ l ] );
-        pipeline->descriptor_set_layout[ l ] = descriptor_set_layout;
+void GpuDevice::enqueue_pipeline_compilation( PipelineCompilation* compilation ) {
 
-#if 0
-        DescriptorBinding* descriptor_bindings = descriptor_set_layout->bindings;
-        ilog( "Layout debug for pipeline %s\n", creation.name );
-        for ( u32 b = 0; b < descriptor_set_layout->num_bindings; ++b ) {
-            DescriptorBinding& binding = descriptor_bindings[ b ];
-            ilog( "%s (%d, %d)\n", binding.name, binding.set, binding.index );
-        }
-#endif
-        VulkanDescriptorSetLayout* vk_dsl = descriptor_set_layouts.get_hot( creation.descriptor_set_layouts[ l ] );
-        vk_layouts[ l ] = vk_dsl->vk_descriptor_set_layout;
-    }
+    pipeline_compilations.push( compilation );
 
-    VkPipelineLayoutCreateInfo pipeline_layout_info = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
-    pipeline_layout_info.pSetLayouts = vk_layouts;
-    pipeline_layout_info.setLayoutCount = num_active_layouts;
-    pipeline_layout_info.pushConstantRangeCount = 0;
+    {
+        std::lock_guard<std::mutex> lock( pipeline_compilation_mutex );
+        pipeline_compilation_queue.push( compilation );
+    }
+    pipeline_compilation_condition.notify_all();
+}
 
-    //VkPushConstantRange push_constant;
+void GpuDevice::pipeline_compilation_worker() {
 
-    /*if ( shader_state_data->parse_result->push_constants_stride ) {
+    std::unique_lock<std::mutex> lock( pipeline_compilation_mutex );
 
-        push_constant.offset = 0;
-        push_constant.size = shader_state_data->parse_result->push_constants_stride;
-        push_constant.stageFlags = VK_SHADER_STAGE_ALL;
+    while ( true ) {
+        pipeline_compilation_condition.wait( lock, [ this ]() {
+            return pipeline_compilation_stop || pipeline_compilation_queue_head < pipeline_compilation_queue.size; } );
 
-        pipeline_layout_info.pPushConstantRanges = &push_constant;
-        pipeline_layout_info.pushConstantRangeCount = 1;
-    }*/
+        // Stop only when the queue is empty.
+        if ( pipeline_compilation_queue_head == pipeline_compilation_queue.size ) {
+            return;
+        }
 
-    // Create the Vulkan compute pipeline
-    VkPipelineLayout pipeline_layout;
-    vkcheck( vkCreatePipelineLayout( vk_device, &pipeline_layout_info, vk_allocation_callbacks, &pipeline_layout ) );
+        PipelineCompilation* compilation = pipeline_compilation_queue[ pipeline_compilation_queue_head++ ];
+        if ( pipeline_compilation_queue_head == pipeline_compilation_queue.size ) {
+            pipeline_compilation_queue.clear();
+            pipeline_compilation_queue_head = 0;
+        }
 
-    VkComputePipelineCreateInfo pipeline_info{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+        // The pipeline slot is owned by the compilation until it is done, the pool does not move it.
+        lock.unlock();
+        compilation->creation_ms = compilation->compute ? compile_compute_pipeline( compilation->pipeline ) :
+                                                          compile_graphics_pipeline( compilation->pipeline, compilation->creation );
+        lock.lock();
 
-    pipeline_info.stage = shader_state_data->shader_stage_info[ 0 ];
-    pipeline_info.layout = pipeline_layout;
+        compilation->done = true;
+        pipeline_compilation_condition.notify_all();
+    }
+}
 
-    vkcheck( vkCreateComputePipelines( vk_device, pipeline_cache, 1, &pipeline_info, vk_allocation_callbacks, &vk_pipeline->vk_pipeline ) );
+void GpuDevice::update_pipeline_compilations( bool wait ) {
 
-    // Cache pipeline layout
-    vk_pipeline->vk_pipeline_layout = pipeline_layout;
-    vk_pipeline->vk_bind_point = VkPipelineBindPoint::VK_PIPELINE_BIND_POINT_COMPUTE;
+    while ( pipeline_compilations.size ) {
 
-    pipeline->num_active_layouts = num_active_layouts;
+        PipelineCompilation* compilation = nullptr;
+        {
+            std::unique_lock<std::mutex> lock( pipeline_compilation_mutex );
 
-    // TODO: restore pipeline cache
-    /*if ( cache_path != nullptr && !cache_exists ) {
-        sizet cache_data_size = 0;
-        check( vkGetPipelineCacheData( vulkan_device, pipeline_cache, &cache_data_size, nullptr ) );
+            if ( wait ) {
+                pipeline_compilation_condition.wait( lock, [ this ]() {
+                    for ( u32 i = 0; i < pipeline_compilations.size; ++i ) {
+                        if ( !pipeline_compilations[ i ]->done ) {
+                            return false;
+                        }
+                    }
+                    return true; } );
+            }
 
-        void* cache_data = allocator->allocate( cache_data_size, 64 );
-        check( vkGetPipelineCacheData( vulkan_device, pipeline_cache, &cache_data_size, cache_data ) );
+            for ( u32 i = 0; i < pipeline_compilations.size; ++i ) {
+                if ( pipeline_compilations[ i ]->done ) {
+                    compilation = pipeline_compilations[ i ];
+                    pipeline_compilations.delete_swap( i );
+                    break;
+                }
+            }
+        }
 
-        file_write_binary( cache_path, cache_data, cache_data_size );
+        if ( !compilation ) {
+            return;
+        }
 
-        allocator->deallocate( cache_data );
-    }*/
+        // Out of the array before finishing, destroying the replaced pipeline can wait for the others.
+        finish_pipeline( compilation->pipeline, compilation->creation_ms, compilation->debug_name );
+        ifree( compilation, allocator );
+    }
+}
 
-    vkDestroyPipelineCache( vk_device, pipeline_cache, vk_allocation_callbacks );
+bool GpuDevice::is_pipeline_ready( PipelineHandle pipeline ) {
+    const VulkanPipeline* vk_pipeline = pipelines.get_hot( pipeline );
+    return vk_pipeline && vk_pipeline->ready;
+}
 
-    set_resource_name( VK_OBJECT_TYPE_PIPELINE, ( u64 )vk_pipeline->vk_pipeline, creation.debug_name );
+u32 GpuDevice::get_pipeline_compilation_count() const {
+    return pipeline_compilations.size;
+}
 
-    return handle;
+void GpuDevice::wait_pipeline_compilations() {
+    update_pipeline_compilations( true );
 }
 
 SamplerHandle GpuDevice::create_sampler( const SamplerCreation& creation ) {
@@ -2810,6 +3460,52 @@ DescriptorSetBindingsPools::Enum get_binding_allocator_index( u32 num_bindings )
 }
 
 DescriptorSetLayoutHandle GpuDevice::create_descriptor_set_layout( const DescriptorSetLayoutCreation& creation ) {
+
+    const u32 num_bindings = (u32)creation.bindings.size;
+    const u32 total_bindings = num_bindings + (u32)creation.dynamic_buffer_bindings.size;
+
+    // Create flattened binding list, sorted so that the same bindings in a different order match.
+    VkDescriptorSetLayoutBinding vk_bindings[ 32 ];
+    iassertm( total_bindings <= ArraySize( vk_bindings ), "Too many bindings (%u) in layout %s\n", total_bindings, creation.debug_name.data );
+
+    for ( u32 r = 0; r < total_bindings; ++r ) {
+        VkDescriptorSetLayoutBinding vk_binding{};
+
+        if ( r < num_bindings ) {
+            const DescriptorBinding& input_binding = creation.bindings[ r ];
+            vk_binding.binding = input_binding.start;
+            vk_binding.descriptorType = to_vk_descriptor_type( input_binding.type );
+            vk_binding.descriptorCount = input_binding.count;
+        } else {
+            // Add dynamic buffer binding
+            vk_binding.binding = creation.dynamic_buffer_bindings[ r - num_bindings ];
+            vk_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+            vk_binding.descriptorCount = 1;
+        }
+
+        // TODO:
+        vk_binding.stageFlags = VK_SHADER_STAGE_ALL;
+        vk_binding.pImmutableSamplers = nullptr;
+
+        u32 insert_index = r;
+        for ( ; insert_index > 0 && vk_bindings[ insert_index - 1 ].binding > vk_binding.binding; --insert_index ) {
+            vk_bindings[ insert_index ] = vk_bindings[ insert_index - 1 ];
+        }
+        vk_bindings[ insert_index ] = vk_binding;
+    }
+
+    // Layouts with the same bindings share the Vulkan object, render systems
+    // declaring the same per pass constants end up using a single layout.
+    const u64 hash = hash_bytes( vk_bindings, sizeof( VkDescriptorSetLayoutBinding ) * total_bindings, total_bindings );
+    DescriptorSetLayoutHandle cached_handle = descriptor_set_layout_cache.get( hash );
+    DescriptorSetLayout* cached_layout = cached_handle.is_valid() ? descriptor_set_layouts.get_cold( cached_handle ) : nullptr;
+
+    if ( cached_layout && cached_layout->num_bindings + cached_layout->num_dynamic_bindings == total_bindings &&
+         memcmp( cached_layout->vk_binding, vk_bindings, sizeof( VkDescriptorSetLayoutBinding ) * total_bindings ) == 0 ) {
+        ++cached_layout->reference_count;
+        return cached_handle;
+    }
+
     DescriptorSetLayoutHandle handle = descriptor_set_layouts.obtain_object();
     if ( handle.is_invalid() ) {
         return handle;
@@ -2819,18 +3515,8 @@ DescriptorSetLayoutHandle GpuDevice::create_descriptor_set_layout( const Descrip
     DescriptorSetLayout* descriptor_set_layout = descriptor_set_layouts.get_cold( handle );
     VulkanDescriptorSetLayout* vk_descriptor_set_layout = descriptor_set_layouts.get_hot( handle );
 
-    const u32 num_bindings = (u32)creation.bindings.size;
-    u16 max_binding = 0;
-    for ( u32 r = 0; r < num_bindings; ++r ) {
-        const DescriptorBinding& input_binding = creation.bindings[ r ];
-        max_binding = max_binding > input_binding.start ? max_binding : input_binding.start;// idra_max( max_binding, input_binding.index );
-    }
-    max_binding += 1;
-
-    // Create flattened binding list
     descriptor_set_layout->num_bindings = ( u16 )num_bindings;
     descriptor_set_layout->num_dynamic_bindings = ( u16 )creation.dynamic_buffer_bindings.size;
-    const u32 total_bindings = num_bindings + (u32)creation.dynamic_buffer_bindings.size;
 
     DescriptorSetBindingsPools::Enum pool_index = get_binding_allocator_index( total_bindings );
     Allocator* binding_allocator = &descriptor_set_bindings_allocators[pool_index];
@@ -2843,45 +3529,23 @@ DescriptorSetLayoutHandle GpuDevice::create_descriptor_set_layout( const Descrip
     iassert( memory );
     descriptor_set_layout->vk_binding = ( VkDescriptorSetLayoutBinding* )( memory );
     descriptor_set_layout->handle = handle;
+    descriptor_set_layout->name = creation.debug_name;
     descriptor_set_layout->bindless = 0;
     descriptor_set_layout->dynamic = creation.dynamic_buffer_bindings.size ? 1 : 0;
+    descriptor_set_layout->reference_count = 1;
+    descriptor_set_layout->hash = hash;
 
-    u32 used_bindings = 0;
-
-    for ( u32 r = 0; r < num_bindings; ++r ) {
-        const DescriptorBinding& input_binding = creation.bindings[ r ];
-
-        VkDescriptorSetLayoutBinding& vk_binding = descriptor_set_layout->vk_binding[ used_bindings ];
-        ++used_bindings;
-
-        vk_binding.binding = input_binding.start;
-        vk_binding.descriptorType = to_vk_descriptor_type( input_binding.type );
-        vk_binding.descriptorCount = input_binding.count;
-
-        // TODO:
-        vk_binding.stageFlags = VK_SHADER_STAGE_ALL;
-        vk_binding.pImmutableSamplers = nullptr;
-    }
-
-    // Add dynamic buffer binding
-    for ( u32 r = 0; r < (u32)creation.dynamic_buffer_bindings.size; ++r ) {
-        VkDescriptorSetLayoutBinding& vk_binding = descriptor_set_layout->vk_binding[ used_bindings ];
-        ++used_bindings;
-
-        vk_binding.binding = creation.dynamic_buffer_bindings[ r ];
-        vk_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-        vk_binding.descriptorCount = 1;
-        vk_binding.stageFlags = VK_SHADER_STAGE_ALL;
-        vk_binding.pImmutableSamplers = nullptr;
-    }
+    memcpy( descriptor_set_layout->vk_binding, vk_bindings, sizeof( VkDescriptorSetLayoutBinding ) * total_bindings );
 
     // Create the descriptor set layout
     VkDescriptorSetLayoutCreateInfo layout_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
-    layout_info.bindingCount = used_bindings;
+    layout_info.bindingCount = total_bindings;
     layout_info.pBindings = descriptor_set_layout->vk_binding;
 
     vkCreateDescriptorSetLayout( vk_device, &layout_info, vk_allocation_callbacks, &vk_descriptor_set_layout->vk_descriptor_set_layout );
 
+    descriptor_set_layout_cache.insert( hash, handle );
+
     return handle;
 }
 
@@ -2923,6 +3587,9 @@ DescriptorSetLayoutHandle GpuDevice::create_bindless_descriptor_set_layout(
     descriptor_set_layout->handle = handle;
     descriptor_set_layout->bindless = 1;
     descriptor_set_layout->dynamic = creation.dynamic_buffer_bindings.size ? 1 : 0;
+    // Not shared, the bindless layout is unique.
+    descriptor_set_layout->reference_count = 1;
+    descriptor_set_layout->hash = 0;
 
     u32 used_bindings = 0;
 
@@ -3178,18 +3845,24 @@ void GpuDevice::destroy_texture( TextureHandle texture ) {
 void GpuDevice::destroy_pipeline( PipelineHandle pipeline ) {
     if ( pipeline.is_valid() ) {
 
+        // The VkPipeline of an async creation is written by a worker until it is ready.
+        if ( !is_pipeline_ready( pipeline ) && pipelines.get_hot( pipeline ) ) {
+            wait_pipeline_compilations();
+        }
+
         //resource_tracker.track_destroy_resource( ResourceUpdateType::Pipeline, pipeline.index );
 
         resource_deletion_queue.push( { {pipeline.index, pipeline.generation}, current_frame, ResourceUpdateType::Pipeline } );
         // Shader state creation is handled internally when creating a pipeline, thus add this to track correctly.
         Pipeline* v_pipeline = pipelines.get_cold( pipeline );
 
-        /*ShaderState* shader_state_data = access_shader_state( v_pipeline->shader_state );
-        for ( u32 l = 0; l < shader_state_data->parse_result->set_count; ++l ) {
-            if ( v_pipeline->descriptor_set_layout_handles[ l ].index != k_invalid_index ) {
+        // Release the layouts referenced at creation, derived ones are destroyed with their last pipeline.
+        if ( v_pipeline ) {
+            for ( u32 l = 0; l < v_pipeline->num_active_layouts; ++l ) {
                 destroy_descriptor_set_layout( v_pipeline->descriptor_set_layout_handles[ l ] );
             }
-        }*/
+            v_pipeline->num_active_layouts = 0;
+        }
 
         /*if ( shader_state_data->ray_tracing_pipeline ) {
             destroy_buffer( v_pipeline->shader_binding_table_hit );
@@ -3204,6 +3877,17 @@ void GpuDevice::destroy_pipeline( PipelineHandle pipeline ) {
     }
 }
 
+DescriptorSetLayoutHandle GpuDevice::get_descriptor_set_layout( PipelineHandle pipeline, u32 set_index ) {
+
+    // Valid as long as the pipeline, create a layout with the same bindings to keep it longer.
+    const Pipeline* v_pipeline = pipelines.get_cold( pipeline );
+    if ( !v_pipeline || set_index >= v_pipeline->num_active_layouts ) {
+        return { 0, k_invalid_generation };
+    }
+
+    return v_pipeline->descriptor_set_layout_handles[ set_index ];
+}
+
 void GpuDevice::destroy_sampler( SamplerHandle sampler ) {
     if ( sampler.is_valid() ) {
 
@@ -3220,6 +3904,19 @@ void GpuDevice::destroy_descriptor_set_layout( DescriptorSetLayoutHandle descrip
 
         //resource_tracker.track_destroy_resource( ResourceUpdateType::DescriptorSetLayout, descriptor_set_layout.index );
 
+        // Shared layouts are destroyed with their last user.
+        DescriptorSetLayout* v_descriptor_set_layout = descriptor_set_layouts.get_cold( descriptor_set_layout );
+        if ( v_descriptor_set_layout ) {
+            iassert( v_descriptor_set_layout->reference_count > 0 );
+            if ( --v_descriptor_set_layout->reference_count > 0 ) {
+                return;
+            }
+
+            if ( descriptor_set_layout_cache.get( v_descriptor_set_layout->hash ) == descriptor_set_layout ) {
+                descriptor_set_layout_cache.remove( v_descriptor_set_layout->hash );
+            }
+        }
+
         resource_deletion_queue.push( { {descriptor_set_layout.index, descriptor_set_layout.generation}, current_frame, ResourceUpdateType::DescriptorSetLayout } );
     } else {
         ilog_debug( "Graphics error: trying to free invalid DescriptorSetLayout %u\n", descriptor_set_layout.index );
@@ -3242,11 +3939,13 @@ void GpuDevice::destroy_shader_state( ShaderStateHandle shader ) {
 
         //resource_tracker.track_destroy_resource( ResourceUpdateType::ShaderState, shader.index );
 
-        resource_deletion_queue.push( { {shader.index, shader.generation}, current_frame, ResourceUpdateType::ShaderState } );
-
-        //ShaderState* state = access_shader_state( shader );
+        // Compiling pipelines read the stages, modules and parse result are freed later with the deletion queue.
+        if ( pipeline_compilations.size ) {
+            wait_pipeline_compilations();
+        }
 
-        //allocator->deallocate( state->parse_result );
+        // Parse result is freed with the modules, pipelines being created this frame could still read it.
+        resource_deletion_queue.push( { {shader.index, shader.generation}, current_frame, ResourceUpdateType::ShaderState } );
     } else {
         ilog_debug( "Graphics error: trying to free invalid Shader %u\n", shader.index );
     }
@@ -3478,8 +4177,25 @@ BufferHandle GpuDevice::get_dynamic_buffer() {
     return dynamic_buffer;
 }
 
-void GpuDevice::upload_texture_data( TextureHandle texture, void* data ) {
-    texture_uploads.push( { texture, data } );
+void GpuDevice::upload_texture_data( TextureHandle texture_handle, void* data ) {
+
+    Texture* texture = textures.get_cold( texture_handle );
+    const u32 size = ( u32 )GpuUtils::calculate_texture_size( texture );
+    // Textures are split in whole rows, or slices for 3D textures.
+    iassertm( size / ( texture->depth > 1 ? texture->depth : texture->height ) <= staging_ring.size,
+              "Texture %s rows do not fit in the staging buffer!", texture->name.data );
+
+    staging_uploads.push( { .texture = texture_handle, .buffer = {}, .data = ( u8* )data, .size = size, .uploaded = 0, .buffer_offset = 0 } );
+}
+
+void GpuDevice::upload_buffer_data( BufferHandle buffer_handle, void* data, u32 size, u32 offset ) {
+
+    Buffer* buffer = buffers.get_cold( buffer_handle );
+    iassert( size > 0 && offset + size <= buffer->size );
+    // Not usable on the graphics queue until the upload is acquired in present.
+    buffer->ready = false;
+
+    staging_uploads.push( { .texture = {}, .buffer = buffer_handle, .data = ( u8* )data, .size = size, .uploaded = 0, .buffer_offset = offset } );
 }
 
 
@@ -3524,6 +4240,18 @@ void GpuDevice::resize_texture_3d( TextureHandle texture_handle, u32 width, u32
     destroy_texture( texture_to_delete_handle );
 }
 
+sizet GpuDevice::get_texture_memory_size( TextureHandle texture ) {
+
+    VulkanTexture* vk_texture = textures.get_hot( texture );
+    if ( !vk_texture ) {
+        return 0;
+    }
+
+    VkMemoryRequirements memory_requirements;
+    vkGetImageMemoryRequirements( vk_device, vk_texture->vk_image, &memory_requirements );
+    return memory_requirements.size;
+}
+
 CommandBuffer* GpuDevice::acquire_new_command_buffer() {
     return command_buffer_manager->get_graphics_command_buffer();
 }
@@ -3540,6 +4268,10 @@ CommandBuffer* GpuDevice::acquire_transfer_command_buffer() {
     return command_buffer_manager->get_transfer_command_buffer();
 }
 
+CommandBuffer* GpuDevice::acquire_secondary_command_buffer( u32 thread_index, const CommandBuffer* primary ) {
+    return command_buffer_manager->get_secondary_command_buffer( thread_index, primary );
+}
+
 // Enum translations
 
 VkFormat to_vk_format( TextureFormat::Enum format ) {
@@ -97,13 +97,12 @@ void GpuVisualProfiler::update( GpuDevice& gpu ) {
     for ( u32 i = 0; i < active_timestamps; ++i ) {
         GPUTimeQuery& timestamp = timestamps[ max_queries_per_frame * current_frame + i ];
 
-        const u64 hashed_name = idra::hash_calculate( timestamp.name );
-        u32 color_index = name_to_color.get( hashed_name );
+        u32 color_index = name_to_color.get( timestamp.name_id );
         // No entry found, add new color
         if ( color_index == u32_max ) {
 
             color_index = ( u32 )name_to_color.size;
-            name_to_color.insert( hashed_name, color_index );
+            name_to_color.insert( timestamp.name_id, color_index );
         }
 
         timestamp.color = idra::Color::get_distinct_color( color_index );
@@ -333,6 +332,10 @@ void GpuTimeQueryTree::set_queries( GPUTimeQuery* time_queries_, u32 count ) {
 }
 
 GPUTimeQuery* GpuTimeQueryTree::push( StringView name ) {
+    return push( StringId( name ), name );
+}
+
+GPUTimeQuery* GpuTimeQueryTree::push( StringId name_id, StringView name ) {
 
     iassert( allocated_time_query < max_queries );
 
@@ -341,6 +344,7 @@ GPUTimeQuery* GpuTimeQueryTree::push( StringView name ) {
     time_query.end_query_index = time_query.start_query_index + 1;
     time_query.depth = depth++;
     time_query.name = name;
+    time_query.name_id = name_id;
     time_query.parent_index = current_time_query;
 
     current_time_query = allocated_time_query;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "kernel/memory.hpp"
+#include "kernel/string_id.hpp"
 #include "gpu/gpu_device.hpp"
 
 namespace idra {
@@ -22,6 +23,7 @@ struct GPUTimeQuery {
     u32                             frame_index;
 
     StringView                      name;
+    StringId                        name_id;
 }; // struct GPUTimeQuery
 
 //
@@ -32,6 +34,7 @@ struct GpuTimeQueryTree {
     void                            set_queries( GPUTimeQuery* time_queries, u32 count );
 
     GPUTimeQuery*                   push( StringView name );
+    GPUTimeQuery*                   push( StringId name_id, StringView name );
     GPUTimeQuery*                   pop();
 
     Span<GPUTimeQuery>              time_queries; // Allocated externally
@@ -14,6 +14,9 @@
 
 namespace idra {
 
+namespace spirv {
+    struct ParseResult;
+} // namespace spirv
 
 using BufferHandle              = Handle<struct BufferDummy>;
 using TextureHandle             = Handle<struct TextureDummy>;
@@ -245,6 +248,7 @@ struct GraphicsShaderStateCreation {
     ShaderStageCode                 fragment_shader;
 
     StringView                      debug_name;
+    const spirv::ParseResult*       reflection  = nullptr;  // Optional, copied instead of parsing the stages.
 
 }; // struct GraphicsShaderStateCreation
 
@@ -255,6 +259,7 @@ struct ComputeShaderStateCreation {
     ShaderStageCode                 compute_shader;
 
     StringView                      debug_name;
+    const spirv::ParseResult*       reflection  = nullptr;  // Optional, copied instead of parsing the stage.
 
 }; // struct ComputeShaderStateCreation
 
@@ -452,6 +457,18 @@ struct UploadTextureData {
     void*                           data;
 }; // struct UploadTextureData
 
+//
+// Texture or buffer upload through the staging ring, split over several frames
+// when the free staging memory is not enough.
+struct StagingUpload {
+    TextureHandle                   texture;
+    BufferHandle                    buffer;
+    u8*                             data;
+    u32                             size;
+    u32                             uploaded;       // Bytes already copied in previous chunks.
+    u32                             buffer_offset;
+}; // struct StagingUpload
+
 //
 //
 struct TextureBarrier {
@@ -461,6 +478,8 @@ struct TextureBarrier {
     u32                             mip_count;
     QueueType::Enum                 source_queue = QueueType::Graphics;
     QueueType::Enum                 destination_queue = QueueType::Graphics;
+    bool                            discard = false;    // Previous content is dropped, for memory shared with aliased textures.
+    bool                            hazard = false;     // Emitted even without a state change, to wait for the previous access.
 };
 
 //
@@ -470,6 +489,7 @@ struct BufferBarrier {
     ResourceState::Enum             new_state;
     u32                             offset = 0;
     u32                             size = 0;
+    bool                            hazard = false;     // Emitted even without a state change, to wait for the previous access.
 };
 
 } // namespace idra
@@ -572,6 +592,8 @@ namespace idra {
         u16                             num_dynamic_bindings = 0;
         u8                              bindless = 0;
         u8                              dynamic = 0;
+        u32                             reference_count = 0;    // Identical layouts are shared, see create_descriptor_set_layout.
+        u64                             hash = 0;
 
         DescriptorSetLayoutHandle       handle;
         StringView                      name;
@@ -614,6 +636,8 @@ namespace idra {
         BufferHandle                    shader_binding_table_miss;
 
         PipelineType::Enum              pipeline_type   = PipelineType::Count;
+
+        PipelineHandle                  replaced;       // Bound instead while an async creation is not ready.
     }; // struct Pipeline
 
     struct VulkanPipeline {
@@ -622,6 +646,7 @@ namespace idra {
         VkPipelineLayout                vk_pipeline_layout;
 
         VkOpaqueEnum                    vk_bind_point;
+        u8                              ready;          // Set by the main thread once vk_pipeline is created.
 
     }; // struct VulkanPipeline
 
@@ -632,6 +657,8 @@ namespace idra {
 
         VkPipelineShaderStageCreateInfo*    shader_stage_info   = nullptr;
         VkRayTracingShaderGroupCreateInfoKHR*  shader_group_info = nullptr;
+        // Bindings, push constants, specialization constants and vertex inputs of all stages.
+        spirv::ParseResult*             parse_result        = nullptr;
 
         StringView                      debug_name;
 
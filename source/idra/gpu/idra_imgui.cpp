@@ -333,7 +333,10 @@ void ImGuiService::render( idra::CommandBuffer& commands ) {
     // Do not bind any specific pass - this should be done externally.
     commands.push_marker( "ImGUI" );
 
-    commands.bind_pipeline( g_imgui_pipeline );
+    if ( !commands.bind_pipeline( g_imgui_pipeline ) ) {
+        commands.pop_marker();
+        return;
+    }
     commands.bind_vertex_buffer( g_vb, 0, vertex_memory_offset );
     commands.bind_index_buffer( g_ib, index_memory_offset, IndexType::Uint16 );
 
@@ -0,0 +1,655 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "gpu/spirv_parser.hpp"
+
+#include "kernel/allocator.hpp"
+#include "kernel/assert.hpp"
+#include "kernel/memory.hpp"
+#include "kernel/log.hpp"
+
+#include <string.h>
+
+namespace idra {
+namespace spirv {
+
+// Only the subset of the specification needed for reflection,
+// values from the SPIR-V unified headers.
+static const u32        k_magic_number = 0x07230203;
+static const u32        k_header_words = 5;
+
+enum Op : u32 {
+    OpName = 5,
+    OpEntryPoint = 15,
+    OpTypeBool = 20,
+    OpTypeInt = 21,
+    OpTypeFloat = 22,
+    OpTypeVector = 23,
+    OpTypeMatrix = 24,
+    OpTypeImage = 25,
+    OpTypeSampler = 26,
+    OpTypeSampledImage = 27,
+    OpTypeArray = 28,
+    OpTypeRuntimeArray = 29,
+    OpTypeStruct = 30,
+    OpTypePointer = 32,
+    OpConstant = 43,
+    OpSpecConstantTrue = 48,
+    OpSpecConstantFalse = 49,
+    OpSpecConstant = 50,
+    OpVariable = 59,
+    OpDecorate = 71,
+    OpMemberDecorate = 72,
+    OpTypeAccelerationStructureKHR = 5341,
+};
+
+enum Decoration : u32 {
+    DecorationSpecId = 1,
+    DecorationBlock = 2,
+    DecorationBufferBlock = 3,
+    DecorationArrayStride = 6,
+    DecorationMatrixStride = 7,
+    DecorationBuiltIn = 11,
+    DecorationLocation = 30,
+    DecorationBinding = 33,
+    DecorationDescriptorSet = 34,
+    DecorationOffset = 35,
+};
+
+enum StorageClass : u32 {
+    StorageClassUniformConstant = 0,
+    StorageClassInput = 1,
+    StorageClassUniform = 2,
+    StorageClassPushConstant = 9,
+    StorageClassStorageBuffer = 12,
+};
+
+enum ExecutionModel : u32 {
+    ExecutionModelVertex = 0,
+    ExecutionModelFragment = 4,
+    ExecutionModelGLCompute = 5,
+    ExecutionModelRayGeneration = 5313,
+    ExecutionModelIntersection = 5314,
+    ExecutionModelAnyHit = 5315,
+    ExecutionModelClosestHit = 5316,
+    ExecutionModelMiss = 5317,
+    ExecutionModelCallable = 5318,
+    ExecutionModelTask = 5364,
+    ExecutionModelMesh = 5365,
+};
+
+static const u32        k_image_dim_buffer = 5;
+static const u32        k_image_dim_subpass_data = 6;
+static const u32        k_image_sampled_storage = 2;
+
+//
+// Everything known about a result id, filled while walking the instructions.
+struct Id {
+    u32                 opcode;
+    u32                 operands;       // Word index of the first operand after the result id.
+    u32                 num_operands;
+
+    u32                 set;
+    u32                 binding;
+    u32                 location;
+    u32                 spec_id;
+    u32                 array_stride;
+
+    u32                 name;           // Word index of the name string, 0 if unnamed.
+
+    bool                has_binding;
+    bool                has_location;
+    bool                has_spec_id;
+    bool                block;
+    bool                buffer_block;
+    bool                builtin;
+}; // struct Id
+
+//
+// Offset and matrix stride of a struct member, decorated before the struct is declared.
+struct MemberDecoration {
+    u32                 struct_id;
+    u32                 member;
+    u32                 offset;
+    u32                 matrix_stride;
+}; // struct MemberDecoration
+
+//
+//
+struct Parser {
+
+    const u32*          words;
+    u32                 num_words;
+    Id*                 ids;
+    u32                 bound;
+
+    MemberDecoration*   member_decorations;
+    u32                 num_member_decorations;
+
+    const Id*           get( u32 id ) const { return id < bound ? &ids[ id ] : nullptr; }
+    // Operand counts are validated per opcode by parse_binary.
+    u32                 operand( const Id* id, u32 index ) const { iassert( index < id->num_operands ); return words[ id->operands + index ]; }
+    // Constants and variables only, the result type precedes the result id.
+    u32                 result_type( const Id* id ) const { return words[ id->operands - 2 ]; }
+
+}; // struct Parser
+
+// Operands after the result id that the reflection reads, for the opcodes it records.
+static u32 min_operands( u32 opcode ) {
+    switch ( opcode ) {
+        case OpTypeFloat:
+        case OpTypeSampledImage:
+        case OpTypeRuntimeArray:
+        case OpConstant:
+        case OpSpecConstant:
+        case OpVariable:
+            return 1;
+
+        case OpTypeInt:
+        case OpTypeVector:
+        case OpTypeMatrix:
+        case OpTypeArray:
+        case OpTypePointer:
+            return 2;
+
+        case OpTypeImage:
+            return 7;
+
+        default:
+            return 0;
+    }
+}
+
+static MemberDecoration* find_member_decoration( Parser& parser, u32 struct_id, u32 member ) {
+    for ( u32 i = 0; i < parser.num_member_decorations; ++i ) {
+        MemberDecoration& decoration = parser.member_decorations[ i ];
+        if ( decoration.struct_id == struct_id && decoration.member == member ) {
+            return &decoration;
+        }
+    }
+    return nullptr;
+}
+
+static void copy_name( const Parser& parser, u32 id, char* out_name ) {
+
+    const Id* id_data = parser.get( id );
+    if ( !id_data || !id_data->name ) {
+        out_name[ 0 ] = 0;
+        return;
+    }
+
+    // Literal strings are null terminated and padded to the word size.
+    const char* name = ( const char* )( parser.words + id_data->name );
+    sizet length = strnlen( name, k_max_name_length - 1 );
+    memcpy( out_name, name, length );
+    out_name[ length ] = 0;
+}
+
+static u32 constant_value( const Parser& parser, u32 id ) {
+    const Id* constant = parser.get( id );
+    if ( constant && ( constant->opcode == OpConstant || constant->opcode == OpSpecConstant ) ) {
+        return parser.operand( constant, 0 );
+    }
+    return 1;
+}
+
+// Size following the layout decorations, as std140/std430 decorated types carry them.
+static u32 type_size( Parser& parser, u32 type_id, u32 matrix_stride = 0 ) {
+
+    const Id* type = parser.get( type_id );
+    if ( !type ) {
+        return 0;
+    }
+
+    switch ( type->opcode ) {
+        case OpTypeBool:
+            return 4;
+
+        case OpTypeInt:
+        case OpTypeFloat:
+            return parser.operand( type, 0 ) / 8;
+
+        case OpTypeVector:
+            return type_size( parser, parser.operand( type, 0 ) ) * parser.operand( type, 1 );
+
+        case OpTypeMatrix:
+        {
+            const u32 columns = parser.operand( type, 1 );
+            return matrix_stride ? matrix_stride * columns : type_size( parser, parser.operand( type, 0 ) ) * columns;
+        }
+
+        case OpTypeArray:
+        {
+            const u32 length = constant_value( parser, parser.operand( type, 1 ) );
+            const u32 stride = type->array_stride ? type->array_stride : type_size( parser, parser.operand( type, 0 ), matrix_stride );
+            return length * stride;
+        }
+
+        case OpTypeStruct:
+        {
+            u32 size = 0;
+            for ( u32 m = 0; m < type->num_operands; ++m ) {
+                const MemberDecoration* decoration = find_member_decoration( parser, type_id, m );
+                const u32 offset = decoration ? decoration->offset : size;
+                const u32 member_end = offset + type_size( parser, parser.operand( type, m ), decoration ? decoration->matrix_stride : 0 );
+                size = member_end > size ? member_end : size;
+            }
+            return size;
+        }
+
+        default:
+            return 0;
+    }
+}
+
+static u32 execution_model_to_stage_mask( u32 execution_model ) {
+    switch ( execution_model ) {
+        case ExecutionModelVertex:          return ShaderStage::Vertex_mask;
+        case ExecutionModelFragment:        return ShaderStage::Fragment_mask;
+        case ExecutionModelGLCompute:       return ShaderStage::Compute_mask;
+        case ExecutionModelRayGeneration:   return ShaderStage::RayGen_mask;
+        case ExecutionModelIntersection:    return ShaderStage::Intersect_mask;
+        case ExecutionModelAnyHit:          return ShaderStage::AnyHit_mask;
+        case ExecutionModelClosestHit:      return ShaderStage::Closest_mask;
+        case ExecutionModelMiss:            return ShaderStage::Miss_mask;
+        case ExecutionModelCallable:        return ShaderStage::Callable_mask;
+        case ExecutionModelTask:            return ShaderStage::Task_mask;
+        case ExecutionModelMesh:            return ShaderStage::Mesh_mask;
+        default:                            return 0;
+    }
+}
+
+static DescriptorType::Enum descriptor_type( const Parser& parser, const Id* type, u32 storage_class ) {
+
+    switch ( type->opcode ) {
+        case OpTypeSampler:
+            return DescriptorType::Sampler;
+
+        case OpTypeSampledImage:
+            return DescriptorType::Texture;
+
+        case OpTypeImage:
+        {
+            const u32 dim = parser.operand( type, 1 );
+            const u32 sampled = parser.operand( type, 5 );
+            // Texel buffers, input attachments and separate images have no DescriptorType.
+            if ( dim != k_image_dim_buffer && dim != k_image_dim_subpass_data && sampled == k_image_sampled_storage ) {
+                return DescriptorType::Image;
+            }
+            return DescriptorType::Count;
+        }
+
+        case OpTypeAccelerationStructureKHR:
+            return DescriptorType::AccelerationStructure;
+
+        case OpTypeStruct:
+        {
+            if ( storage_class == StorageClassStorageBuffer || type->buffer_block ) {
+                return DescriptorType::StructuredBuffer;
+            }
+            return storage_class == StorageClassUniform ? DescriptorType::Constants : DescriptorType::Count;
+        }
+
+        default:
+            return DescriptorType::Count;
+    }
+}
+
+static VertexComponentFormat::Enum vertex_format( const Parser& parser, const Id* type ) {
+
+    u32 components = 1;
+    if ( type->opcode == OpTypeMatrix ) {
+        const Id* column = parser.get( parser.operand( type, 0 ) );
+        const bool mat4 = parser.operand( type, 1 ) == 4 && column && column->opcode == OpTypeVector && parser.operand( column, 1 ) == 4;
+        return mat4 ? VertexComponentFormat::Mat4 : VertexComponentFormat::Count;
+    }
+
+    if ( type->opcode == OpTypeVector ) {
+        components = parser.operand( type, 1 );
+        type = parser.get( parser.operand( type, 0 ) );
+    }
+
+    if ( !type || components > 4 ) {
+        return VertexComponentFormat::Count;
+    }
+
+    if ( type->opcode == OpTypeFloat ) {
+        static const VertexComponentFormat::Enum k_float_formats[] = { VertexComponentFormat::Float, VertexComponentFormat::Float2, VertexComponentFormat::Float3, VertexComponentFormat::Float4 };
+        return k_float_formats[ components - 1 ];
+    }
+
+    // Normalized and narrow formats are read as floats, integers only map to Uint.
+    if ( type->opcode == OpTypeInt ) {
+        static const VertexComponentFormat::Enum k_uint_formats[] = { VertexComponentFormat::Uint, VertexComponentFormat::Uint2, VertexComponentFormat::Count, VertexComponentFormat::Uint4 };
+        return k_uint_formats[ components - 1 ];
+    }
+
+    return VertexComponentFormat::Count;
+}
+
+static void add_binding( ParseResult* parse_result, const Binding& binding ) {
+
+    // Merge stages and aliased declarations, as the bindless arrays.
+    for ( u32 i = 0; i < parse_result->num_bindings; ++i ) {
+        Binding& existing = parse_result->bindings[ i ];
+        if ( existing.set == binding.set && existing.binding == binding.binding ) {
+            if ( existing.type != binding.type ) {
+                ilog_warn( "Spirv reflection: binding %s (set %u, binding %u) aliases %s with a different type.\n",
+                           binding.name, binding.set, binding.binding, existing.name );
+            }
+            existing.stage_mask |= binding.stage_mask;
+            existing.count = ( existing.count == 0 || binding.count == 0 ) ? 0 : ( existing.count > binding.count ? existing.count : binding.count );
+            return;
+        }
+    }
+
+    if ( parse_result->num_bindings == k_max_bindings ) {
+        ilog_warn( "Spirv reflection: too many bindings, skipping %s.\n", binding.name );
+        return;
+    }
+
+    parse_result->bindings[ parse_result->num_bindings++ ] = binding;
+    parse_result->set_count = binding.set + 1u > parse_result->set_count ? binding.set + 1u : parse_result->set_count;
+}
+
+static void reflect_variable( Parser& parser, u32 variable_id, u32 stage_mask, ParseResult* parse_result ) {
+
+    const Id* variable = parser.get( variable_id );
+    const u32 storage_class = parser.operand( variable, 0 );
+    const Id* pointer = parser.get( parser.result_type( variable ) );
+    if ( !pointer || pointer->opcode != OpTypePointer ) {
+        return;
+    }
+
+    const u32 pointee_id = parser.operand( pointer, 1 );
+
+    switch ( storage_class ) {
+        case StorageClassUniformConstant:
+        case StorageClassUniform:
+        case StorageClassStorageBuffer:
+        {
+            if ( !variable->has_binding ) {
+                return;
+            }
+
+            Binding binding;
+            binding.set = ( u16 )variable->set;
+            binding.binding = ( u16 )variable->binding;
+            binding.count = 1;
+            binding.stage_mask = ( u16 )stage_mask;
+            copy_name( parser, variable_id, binding.name );
+
+            // Unwrap arrays of descriptors.
+            u32 type_id = pointee_id;
+            const Id* type = parser.get( type_id );
+            while ( type && ( type->opcode == OpTypeArray || type->opcode == OpTypeRuntimeArray ) ) {
+                binding.count = type->opcode == OpTypeArray ? ( u16 )( binding.count * constant_value( parser, parser.operand( type, 1 ) ) ) : 0;
+                type_id = parser.operand( type, 0 );
+                type = parser.get( type_id );
+            }
+
+            if ( !type ) {
+                return;
+            }
+
+            // Blocks without a name use the name of their type.
+            if ( binding.name[ 0 ] == 0 ) {
+                copy_name( parser, type_id, binding.name );
+            }
+
+            binding.type = descriptor_type( parser, type, storage_class );
+            if ( binding.type == DescriptorType::Count ) {
+                ilog_warn( "Spirv reflection: unsupported descriptor type for %s (set %u, binding %u).\n", binding.name, binding.set, binding.binding );
+                return;
+            }
+
+            add_binding( parse_result, binding );
+            break;
+        }
+
+        case StorageClassPushConstant:
+        {
+            const u32 stride = type_size( parser, pointee_id );
+            parse_result->push_constants_stride = stride > parse_result->push_constants_stride ? stride : parse_result->push_constants_stride;
+            break;
+        }
+
+        case StorageClassInput:
+        {
+            const Id* type = parser.get( pointee_id );
+            if ( stage_mask != ShaderStage::Vertex_mask || !variable->has_location || variable->builtin || !type ) {
+                return;
+            }
+
+            if ( parse_result->num_vertex_inputs == k_max_vertex_inputs ) {
+                ilog_warn( "Spirv reflection: too many vertex inputs.\n" );
+                return;
+            }
+
+            VertexInput& vertex_input = parse_result->vertex_inputs[ parse_result->num_vertex_inputs++ ];
+            vertex_input.location = ( u16 )variable->location;
+            vertex_input.format = vertex_format( parser, type );
+            copy_name( parser, variable_id, vertex_input.name );
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+const Binding* ParseResult::find_binding( u32 set, u32 binding ) const {
+    for ( u32 i = 0; i < num_bindings; ++i ) {
+        if ( bindings[ i ].set == set && bindings[ i ].binding == binding ) {
+            return &bindings[ i ];
+        }
+    }
+    return nullptr;
+}
+
+bool parse_binary( const u32* data, sizet size, ParseResult* parse_result ) {
+
+    const u32 num_words = ( u32 )( size / 4 );
+    if ( num_words < k_header_words || data[ 0 ] != k_magic_number ) {
+        ilog_error( "Spirv reflection: invalid header.\n" );
+        return false;
+    }
+
+    BookmarkAllocator* temp_allocator = g_memory->get_thread_allocator();
+    const sizet marker = temp_allocator->get_marker();
+
+    Parser parser;
+    parser.words = data;
+    parser.num_words = num_words;
+    parser.bound = data[ 3 ];
+    parser.ids = ( Id* )ialloc( sizeof( Id ) * parser.bound, temp_allocator );
+    memset( parser.ids, 0, sizeof( Id ) * parser.bound );
+    // Each member decoration takes at least 4 words.
+    parser.member_decorations = ( MemberDecoration* )ialloc( sizeof( MemberDecoration ) * ( num_words / 4 + 1 ), temp_allocator );
+    parser.num_member_decorations = 0;
+
+    u32 stage_mask = 0;
+    bool valid = true;
+
+    u32 word_index = k_header_words;
+    while ( word_index < num_words ) {
+
+        const u32 instruction = data[ word_index ];
+        const u32 word_count = instruction >> 16;
+        const u32 opcode = instruction & 0xffff;
+
+        if ( word_count == 0 || word_index + word_count > num_words ) {
+            valid = false;
+            break;
+        }
+
+        // Reading operands[ 0 ] below needs at least one operand.
+        if ( word_count < 2 && ( opcode == OpEntryPoint || opcode == OpName || opcode == OpDecorate || opcode == OpMemberDecorate ) ) {
+            valid = false;
+            break;
+        }
+
+        const u32* operands = data + word_index + 1;
+
+        switch ( opcode ) {
+            case OpEntryPoint:
+            {
+                stage_mask |= execution_model_to_stage_mask( operands[ 0 ] );
+                break;
+            }
+
+            case OpName:
+            {
+                if ( operands[ 0 ] < parser.bound && word_count > 2 ) {
+                    parser.ids[ operands[ 0 ] ].name = word_index + 2;
+                }
+                break;
+            }
+
+            case OpDecorate:
+            {
+                if ( operands[ 0 ] >= parser.bound || word_count < 3 ) {
+                    break;
+                }
+
+                Id& id = parser.ids[ operands[ 0 ] ];
+                const u32 value = word_count > 3 ? operands[ 2 ] : 0;
+                switch ( operands[ 1 ] ) {
+                    case DecorationSpecId:          id.spec_id = value; id.has_spec_id = true; break;
+                    case DecorationBlock:           id.block = true; break;
+                    case DecorationBufferBlock:     id.buffer_block = true; break;
+                    case DecorationArrayStride:     id.array_stride = value; break;
+                    case DecorationBuiltIn:         id.builtin = true; break;
+                    case DecorationLocation:        id.location = value; id.has_location = true; break;
+                    case DecorationBinding:         id.binding = value; id.has_binding = true; break;
+                    case DecorationDescriptorSet:   id.set = value; break;
+                    default: break;
+                }
+                break;
+            }
+
+            case OpMemberDecorate:
+            {
+                if ( word_count < 5 || ( operands[ 2 ] != DecorationOffset && operands[ 2 ] != DecorationMatrixStride ) ) {
+                    break;
+                }
+
+                MemberDecoration* decoration = find_member_decoration( parser, operands[ 0 ], operands[ 1 ] );
+                if ( !decoration ) {
+                    decoration = &parser.member_decorations[ parser.num_member_decorations++ ];
+                    *decoration = { operands[ 0 ], operands[ 1 ], 0, 0 };
+                }
+
+                if ( operands[ 2 ] == DecorationOffset ) {
+                    decoration->offset = operands[ 3 ];
+                } else {
+                    decoration->matrix_stride = operands[ 3 ];
+                }
+                break;
+            }
+
+            case OpTypeBool:
+            case OpTypeInt:
+            case OpTypeFloat:
+            case OpTypeVector:
+            case OpTypeMatrix:
+            case OpTypeImage:
+            case OpTypeSampler:
+            case OpTypeSampledImage:
+            case OpTypeArray:
+            case OpTypeRuntimeArray:
+            case OpTypeStruct:
+            case OpTypePointer:
+            case OpTypeAccelerationStructureKHR:
+            {
+                // Result id first, the rest are operands.
+                if ( word_count < 2 + min_operands( opcode ) ) {
+                    valid = false;
+                    break;
+                }
+                if ( operands[ 0 ] >= parser.bound ) {
+                    break;
+                }
+                Id& id = parser.ids[ operands[ 0 ] ];
+                id.opcode = opcode;
+                id.operands = word_index + 2;
+                id.num_operands = word_count - 2;
+                break;
+            }
+
+            case OpConstant:
+            case OpSpecConstant:
+            case OpSpecConstantTrue:
+            case OpSpecConstantFalse:
+            case OpVariable:
+            {
+                // Result type, then result id.
+                if ( word_count < 3 + min_operands( opcode ) ) {
+                    valid = false;
+                    break;
+                }
+                if ( operands[ 1 ] >= parser.bound ) {
+                    break;
+                }
+                Id& id = parser.ids[ operands[ 1 ] ];
+                id.opcode = opcode;
+                id.operands = word_index + 3;
+                id.num_operands = word_count - 3;
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        // Set by the cases above when an instruction is too short for its opcode.
+        if ( !valid ) {
+            break;
+        }
+
+        word_index += word_count;
+    }
+
+    if ( valid ) {
+        parse_result->stage_mask |= stage_mask;
+
+        for ( u32 i = 0; i < parser.bound; ++i ) {
+            const Id& id = parser.ids[ i ];
+
+            if ( id.opcode == OpVariable ) {
+                reflect_variable( parser, i, stage_mask, parse_result );
+            } else if ( id.has_spec_id && ( id.opcode == OpSpecConstant || id.opcode == OpSpecConstantTrue || id.opcode == OpSpecConstantFalse ) ) {
+
+                // Stages of the same shader can share constants.
+                bool duplicate = false;
+                for ( u32 c = 0; c < parse_result->specialization_constants_count; ++c ) {
+                    duplicate = duplicate || parse_result->specialization_constants[ c ].constant_id == id.spec_id;
+                }
+                if ( duplicate ) {
+                    continue;
+                }
+
+                if ( parse_result->specialization_constants_count == k_max_specialization_constants ) {
+                    ilog_warn( "Spirv reflection: too many specialization constants.\n" );
+                    continue;
+                }
+
+                SpecializationConstant& constant = parse_result->specialization_constants[ parse_result->specialization_constants_count++ ];
+                constant.constant_id = id.spec_id;
+                constant.default_value = id.opcode == OpSpecConstant ? data[ id.operands ] : ( id.opcode == OpSpecConstantTrue ? 1 : 0 );
+                copy_name( parser, i, constant.name );
+            }
+        }
+    } else {
+        ilog_error( "Spirv reflection: malformed instruction at word %u.\n", word_index );
+    }
+
+    temp_allocator->free_marker( marker );
+
+    return valid;
+}
+
+} // namespace spirv
+} // namespace idra
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#pragma once
+
+#include "kernel/platform.hpp"
+#include "gpu/gpu_enums.hpp"
+
+namespace idra {
+namespace spirv {
+
+static const u32                    k_max_bindings = 32;
+static const u32                    k_max_specialization_constants = 16;
+static const u32                    k_max_vertex_inputs = 16;
+static const u32                    k_max_name_length = 32;
+
+//
+// Descriptor used by the shader. Count is 0 for runtime sized arrays.
+struct Binding {
+
+    DescriptorType::Enum            type        = DescriptorType::Count;
+    u16                             set         = 0;
+    u16                             binding     = 0;
+    u16                             count       = 1;
+    u16                             stage_mask  = 0;        // ShaderStage::Mask of the stages using it.
+
+    char                            name[ k_max_name_length ];
+}; // struct Binding
+
+//
+// Specialization constants are 32 bits, default_value holds the raw bits.
+struct SpecializationConstant {
+
+    u32                             constant_id     = 0;
+    u32                             default_value   = 0;
+
+    char                            name[ k_max_name_length ];
+}; // struct SpecializationConstant
+
+//
+//
+struct VertexInput {
+
+    u16                             location    = 0;
+    VertexComponentFormat::Enum     format      = VertexComponentFormat::Count;
+
+    char                            name[ k_max_name_length ];
+}; // struct VertexInput
+
+//
+// Reflection of one or more stages of a shader, parse_binary merges each
+// stage into the same result.
+struct ParseResult {
+
+    Binding                         bindings[ k_max_bindings ];
+    SpecializationConstant          specialization_constants[ k_max_specialization_constants ];
+    VertexInput                     vertex_inputs[ k_max_vertex_inputs ];
+
+    u32                             num_bindings            = 0;
+    u32                             specialization_constants_count = 0;
+    u32                             num_vertex_inputs       = 0;
+
+    u32                             set_count               = 0;    // Highest used set + 1.
+    u32                             push_constants_stride   = 0;
+    u32                             stage_mask              = 0;
+
+    const Binding*                  find_binding( u32 set, u32 binding ) const;
+
+}; // struct ParseResult
+
+// Size is in bytes, like VkShaderModuleCreateInfo::codeSize.
+// Returns false if the code is not valid SPIR-V.
+bool                                parse_binary( const u32* data, sizet size, ParseResult* parse_result );
+
+} // namespace spirv
+} // namespace idra
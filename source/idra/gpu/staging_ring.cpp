@@ -0,0 +1,161 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "gpu/staging_ring.hpp"
+
+#include "kernel/assert.hpp"
+#include "kernel/memory.hpp"
+
+namespace idra {
+
+// StagingRing ////////////////////////////////////////////////////////////
+void StagingRing::init( Allocator* allocator, u32 size_ ) {
+
+    batches.init( allocator, 8 );
+
+    size = size_;
+    head = 0;
+    tail = 0;
+    used = 0;
+    open_batch_size = 0;
+}
+
+void StagingRing::shutdown() {
+
+    batches.shutdown();
+}
+
+bool StagingRing::allocate( u32 request_size, u32 granularity, u32 alignment, u32* offset, u32* allocated_size ) {
+
+    iassert( granularity > 0 );
+
+    if ( used == 0 ) {
+        head = 0;
+        tail = 0;
+    }
+
+    const u32 minimum_size = request_size < granularity ? request_size : granularity;
+
+    u32 start = ( u32 )mem_align( head, alignment );
+    u32 end = tail;
+    // Bytes between head and start, used by the allocation.
+    u32 skipped = start - head;
+
+    if ( used == 0 || head > tail ) {
+        // Free memory is at the end of the ring and before the tail.
+        end = size;
+        if ( start > end || end - start < minimum_size ) {
+            // Wrap, skipping the end of the ring.
+            skipped = size - head;
+            start = 0;
+            end = tail;
+        }
+    }
+
+    if ( start > end || end - start < minimum_size ) {
+        return false;
+    }
+
+    const u32 available = end - start;
+    const u32 allocation_size = available >= request_size ? request_size : ( available / granularity ) * granularity;
+
+    head = start + allocation_size;
+    used += skipped + allocation_size;
+    open_batch_size += skipped + allocation_size;
+
+    *offset = start;
+    *allocated_size = allocation_size;
+    return true;
+}
+
+void StagingRing::close_batch( u64 timeline_value ) {
+
+    if ( open_batch_size == 0 ) {
+        return;
+    }
+
+    batches.push( { timeline_value, head, open_batch_size } );
+    open_batch_size = 0;
+}
+
+void StagingRing::retire( u64 completed_timeline_value ) {
+
+    u32 retired = 0;
+    for ( ; retired < batches.size; ++retired ) {
+        const Batch& batch = batches[ retired ];
+        if ( batch.timeline_value > completed_timeline_value ) {
+            break;
+        }
+
+        tail = batch.end;
+        used -= batch.size;
+    }
+
+    if ( retired == 0 ) {
+        return;
+    }
+
+    // Batches are few, keep them ordered by shifting.
+    for ( u32 i = retired; i < batches.size; ++i ) {
+        batches[ i - retired ] = batches[ i ];
+    }
+    batches.set_size( batches.size - retired );
+}
+
+// StagingCopyBatcher /////////////////////////////////////////////////////
+void StagingCopyBatcher::init( Allocator* allocator, u32 max_batched_copies_ ) {
+
+    written.init( allocator, 32 );
+    max_batched_copies = max_batched_copies_;
+    reset();
+}
+
+void StagingCopyBatcher::shutdown() {
+
+    written.shutdown();
+}
+
+void StagingCopyBatcher::reset() {
+
+    written.clear();
+    batch_buffer = 0;
+    batch_count = 0;
+}
+
+u32 StagingCopyBatcher::add( u32 buffer, u64 offset, u64 size ) {
+
+    bool overlap = false;
+    for ( u32 i = 0; i < written.size && !overlap; ++i ) {
+        const Range& range = written[ i ];
+        overlap = range.buffer == buffer && offset < range.offset + range.size && range.offset < offset + size;
+    }
+
+    u32 actions = 0;
+    if ( overlap || batch_count == max_batched_copies || ( batch_count && batch_buffer != buffer ) ) {
+        actions |= batch_count ? Flush : 0;
+        batch_count = 0;
+    }
+
+    if ( overlap ) {
+        actions |= Barrier;
+
+        // The barrier orders all the previous writes to the buffer.
+        for ( u32 i = 0; i < written.size; ) {
+            if ( written[ i ].buffer == buffer ) {
+                written.delete_swap( i );
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    written.push( { buffer, offset, size } );
+    batch_buffer = buffer;
+    ++batch_count;
+
+    return actions;
+}
+
+} // namespace idra
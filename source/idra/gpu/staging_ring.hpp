@@ -0,0 +1,82 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#pragma once
+
+#include "kernel/array.hpp"
+
+namespace idra {
+
+//
+// Sub-allocates a staging buffer as a ring. Allocations made between two
+// close_batch calls are retired together, once the GPU timeline reaches the
+// value the batch was closed with: their memory is then reused.
+//
+struct StagingRing {
+
+    void                        init( Allocator* allocator, u32 size );
+    void                        shutdown();
+
+    // Allocates at most size bytes, in multiples of granularity unless the
+    // whole size fits. Returns false when not even granularity bytes are free.
+    bool                        allocate( u32 size, u32 granularity, u32 alignment,
+                                          u32* offset, u32* allocated_size );
+
+    // Allocations since the previous batch are freed when timeline_value completes.
+    void                        close_batch( u64 timeline_value );
+    void                        retire( u64 completed_timeline_value );
+
+    struct Batch {
+        u64                     timeline_value;
+        u32                     end;            // Head of the ring when the batch was closed.
+        u32                     size;           // Bytes used, including wasted ones at the end of the ring.
+    }; // struct Batch
+
+    Array<Batch>                batches;
+
+    u32                         size            = 0;
+    u32                         head            = 0;    // Next free byte.
+    u32                         tail            = 0;    // Oldest byte in use.
+    u32                         used            = 0;
+    u32                         open_batch_size = 0;    // Bytes allocated since the last closed batch.
+
+}; // struct StagingRing
+
+//
+// Decides how the buffer copies of a staging pass are recorded. Consecutive copies
+// to the same buffer share a command, and regions of a command must not overlap.
+// A copy overlapping a range written earlier in the pass, in any command, must be
+// ordered after it by a barrier so the later upload wins.
+//
+struct StagingCopyBatcher {
+
+    enum Action : u32 {
+        Flush   = 1 << 0,       // Record the open batch before adding the copy.
+        Barrier = 1 << 1,       // Order the copy after the previous writes to its buffer.
+    };
+
+    void                        init( Allocator* allocator, u32 max_batched_copies );
+    void                        shutdown();
+
+    // Starts a pass, forgetting the ranges written by the previous one.
+    void                        reset();
+    // Adds a copy to the open batch, returning the Action flags needed before it.
+    u32                         add( u32 buffer, u64 offset, u64 size );
+
+    struct Range {
+        u32                     buffer;
+        u64                     offset;
+        u64                     size;
+    }; // struct Range
+
+    Array<Range>                written;        // Since the pass start or the last barrier on their buffer.
+
+    u32                         max_batched_copies = 0;
+    u32                         batch_buffer    = 0;
+    u32                         batch_count     = 0;
+
+}; // struct StagingCopyBatcher
+
+} // namespace idra
@@ -49,6 +49,7 @@ void AtmosphericScatteringRenderSystem::create_resources( AssetManager* asset_ma
         setup_earth_atmosphere( s_atmosphere_parameters, 1000.f );
 
         ShaderAssetLoader* shader_loader = asset_manager->get_loader<ShaderAssetLoader>();
+        shader_loader->begin_batch();
 
         transmittance_lut_shader = shader_loader->compile_compute( {},
             { "platform.h", "atmospheric_scattering/definitions.glsl",
@@ -87,6 +88,7 @@ void AtmosphericScatteringRenderSystem::create_resources( AssetManager* asset_ma
             "atmospheric_scattering/sky_apply.frag",
             "sky_apply" );
 
+        shader_loader->end_batch();
 
         sampler_clamp = gpu_device->create_sampler( {
             .min_filter = TextureFilter::Linear, .mag_filter = TextureFilter::Linear,
@@ -254,9 +256,10 @@ void AtmosphericScatteringRenderSystem::render( CommandBuffer* cb, Camera* camer
         cb->push_marker( "transmittance lut" );
         cb->submit_barriers( { {transmittance_lut, ResourceState::UnorderedAccess, 0, 1} },
                              {  } );
-        cb->bind_pipeline( transmittance_lut_pso );
-        cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { constants_offset } );
-        cb->dispatch_2d( 256, 64, 32, 32 );
+        if ( cb->bind_pipeline( transmittance_lut_pso ) ) {
+            cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { constants_offset } );
+            cb->dispatch_2d( 256, 64, 32, 32 );
+        }
 
         cb->submit_barriers( { {transmittance_lut, ResourceState::ShaderResource, 0, 1} }, {} );
         cb->pop_marker();
@@ -265,9 +268,10 @@ void AtmosphericScatteringRenderSystem::render( CommandBuffer* cb, Camera* camer
         cb->push_marker( "multiscattering lut" );
         cb->submit_barriers( { {multiscattering_lut, ResourceState::UnorderedAccess, 0, 1} },
                              {  } );
-        cb->bind_pipeline( multiscattering_lut_pso );
-        cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { constants_offset } );
-        cb->dispatch_2d( 32, 32, 1, 1 );
+        if ( cb->bind_pipeline( multiscattering_lut_pso ) ) {
+            cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { constants_offset } );
+            cb->dispatch_2d( 32, 32, 1, 1 );
+        }
 
         cb->submit_barriers( { {multiscattering_lut, ResourceState::ShaderResource, 0, 1} }, {} );
 
@@ -278,9 +282,10 @@ void AtmosphericScatteringRenderSystem::render( CommandBuffer* cb, Camera* camer
         cb->submit_barriers( { {aerial_perspective_texture, ResourceState::UnorderedAccess, 0, 1},
                              {aerial_perspective_texture_debug, ResourceState::UnorderedAccess, 0, 1} },
                              {  } );
-        cb->bind_pipeline( aerial_perspective_pso );
-        cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { constants_offset } );
-        cb->dispatch_3d( 32, 32, 32, 8, 8, 1 );
+        if ( cb->bind_pipeline( aerial_perspective_pso ) ) {
+            cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { constants_offset } );
+            cb->dispatch_3d( 32, 32, 32, 8, 8, 1 );
+        }
 
         cb->submit_barriers( { {aerial_perspective_texture, ResourceState::ShaderResource, 0, 1},
                              {aerial_perspective_texture_debug, ResourceState::UnorderedAccess, 0, 1} }, {} );
@@ -290,10 +295,10 @@ void AtmosphericScatteringRenderSystem::render( CommandBuffer* cb, Camera* camer
         cb->push_marker( "sky view" );
         cb->submit_barriers( { {sky_view_lut, ResourceState::UnorderedAccess, 0, 1} },
                              {  } );
-        cb->bind_pipeline( sky_lut_pso );
-        cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { constants_offset } );
-
-        cb->dispatch_2d( 192, 108, 32, 32 );
+        if ( cb->bind_pipeline( sky_lut_pso ) ) {
+            cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { constants_offset } );
+            cb->dispatch_2d( 192, 108, 32, 32 );
+        }
 
         cb->submit_barriers( { {sky_view_lut, ResourceState::ShaderResource, 0, 1} }, {} );
         cb->pop_marker();
@@ -312,9 +317,10 @@ void AtmosphericScatteringRenderSystem::render( CommandBuffer* cb, Camera* camer
         cb->set_framebuffer_scissor();
         cb->set_framebuffer_viewport();
 
-        cb->bind_pipeline( sky_apply_pso );
-        cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { constants_offset } );
-        cb->draw( TopologyType::Triangle, 0, 3, 0, 1 );
+        if ( cb->bind_pipeline( sky_apply_pso ) ) {
+            cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, shared_ds }, { constants_offset } );
+            cb->draw( TopologyType::Triangle, 0, 3, 0, 1 );
+        }
 
         cb->end_render_pass();
 
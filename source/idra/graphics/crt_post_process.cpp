@@ -47,12 +47,84 @@ struct CRTPostMattiasBlur {
 
 static CRTPostMattiasLocals s_crt_mattias_constants;
 
+// Newpixie frame graph passes ////////////////////////////////////////////
+
+static void newpixie_accumulation_execute( CommandBuffer* gpu_commands, void* user_data ) {
+    CRTPostprocess* crt = ( CRTPostprocess* )user_data;
+
+    gpu_commands->begin_pass( { crt->newpixie_graph.get_texture( crt->newpixie_accumulation_texture ) }, { LoadOperation::DontCare }, { {0,0,0,0} }, {}, LoadOperation::DontCare, {} );
+
+    if ( gpu_commands->bind_pipeline( crt->newpixie_accumulation_pass.pso ) ) {
+        gpu_commands->bind_descriptor_set( { crt->gpu_device->bindless_descriptor_set, crt->newpixie_accumulation_pass.descriptor_set }, { crt->newpixie_constants_offset } );
+
+        u32 texture_ids = ( ( crt->newpixie_graph_input.index & 0xffff ) << 16 ) | ( ( crt->newpixie_previous_horizontal_blur_texture.index & 0xffff ) );
+        gpu_commands->draw( TopologyType::Triangle, 0, 3, texture_ids, 1 );
+    }
+
+    gpu_commands->end_render_pass();
+}
+
+static void newpixie_horizontal_blur_execute( CommandBuffer* gpu_commands, void* user_data ) {
+    CRTPostprocess* crt = ( CRTPostprocess* )user_data;
+
+    gpu_commands->begin_pass( { crt->newpixie_graph.get_texture( crt->newpixie_horizontal_blur_texture ) }, { LoadOperation::DontCare }, { {0,0,0,0} }, {}, LoadOperation::DontCare, {} );
+
+    if ( gpu_commands->bind_pipeline( crt->newpixie_blur_pass.pso ) ) {
+        gpu_commands->bind_descriptor_set( { crt->gpu_device->bindless_descriptor_set, crt->newpixie_blur_pass.descriptor_set }, { crt->newpixie_hblur_constants_offset } );
+        gpu_commands->draw( TopologyType::Triangle, 0, 3, crt->newpixie_graph.get_texture( crt->newpixie_accumulation_texture ).index, 1 );
+    }
+
+    gpu_commands->end_render_pass();
+}
+
+static void newpixie_copy_horizontal_blur_execute( CommandBuffer* gpu_commands, void* user_data ) {
+    CRTPostprocess* crt = ( CRTPostprocess* )user_data;
+
+    gpu_commands->copy_texture( crt->newpixie_graph.get_texture( crt->newpixie_horizontal_blur_texture ),
+                                crt->newpixie_previous_horizontal_blur_texture, ResourceState::ShaderResource );
+}
+
+static void newpixie_vertical_blur_execute( CommandBuffer* gpu_commands, void* user_data ) {
+    CRTPostprocess* crt = ( CRTPostprocess* )user_data;
+
+    gpu_commands->begin_pass( { crt->newpixie_graph.get_texture( crt->newpixie_vertical_blur_texture ) }, { LoadOperation::DontCare }, { {0,0,0,0} }, {}, LoadOperation::DontCare, {} );
+
+    if ( gpu_commands->bind_pipeline( crt->newpixie_blur_pass.pso ) ) {
+        gpu_commands->bind_descriptor_set( { crt->gpu_device->bindless_descriptor_set, crt->newpixie_blur_pass.descriptor_set }, { crt->newpixie_vblur_constants_offset } );
+        gpu_commands->draw( TopologyType::Triangle, 0, 3, crt->newpixie_graph.get_texture( crt->newpixie_horizontal_blur_texture ).index, 1 );
+    }
+
+    gpu_commands->end_render_pass();
+}
+
+static void newpixie_main_execute( CommandBuffer* gpu_commands, void* user_data ) {
+    CRTPostprocess* crt = ( CRTPostprocess* )user_data;
+
+    gpu_commands->begin_pass( { crt->newpixie_graph_output }, { LoadOperation::Clear }, { {0,0,0,0} }, {}, LoadOperation::DontCare, {} );
+
+    if ( gpu_commands->bind_pipeline( crt->newpixie_main_pass.pso ) ) {
+        gpu_commands->bind_descriptor_set( { crt->gpu_device->bindless_descriptor_set, crt->newpixie_main_pass.descriptor_set }, { crt->newpixie_constants_offset } );
+        u32 texture_ids = ( ( crt->newpixie_graph.get_texture( crt->newpixie_vertical_blur_texture ).index & 0xffff ) << 16 ) |
+                          ( ( crt->newpixie_graph.get_texture( crt->newpixie_accumulation_texture ).index & 0xffff ) );
+        gpu_commands->draw( TopologyType::Triangle, 0, 3, texture_ids, 1 );
+    }
+
+    gpu_commands->end_render_pass();
+}
+
+// CRTPostprocess /////////////////////////////////////////////////////////
+
 void CRTPostprocess::init( GpuDevice* gpu_device_, Allocator* resident_allocator ) {
 
     gpu_device = gpu_device_;
+
+    newpixie_graph.init( resident_allocator, gpu_device );
 }
 
 void CRTPostprocess::shutdown() {
+
+    newpixie_graph.reset();
+    newpixie_graph.shutdown();
 }
 
 void CRTPostprocess::update( f32 delta_time ) {
@@ -91,17 +163,22 @@ void CRTPostprocess::render( CommandBuffer* gpu_commands, Camera* camera, u32 ph
         vblur_gpu_constants->v_blur = s_crt_mattias_constants.v_blur / camera->viewport_height;
     }
 
-    // TODO: handle resize properly
-    Texture* final_tex = gpu_device->textures.get_cold( output );
-    if ( final_tex ) {
+    newpixie_constants_offset = constants_offset;
+    newpixie_hblur_constants_offset = hblur_constants_offset;
+    newpixie_vblur_constants_offset = vblur_constants_offset;
 
-        Texture* accum_tex = gpu_device->textures.get_cold( newpixie_accumulation_texture );
+    // Transient textures are recreated with the graph, history is resized.
+    Texture* final_tex = gpu_device->textures.get_cold( output );
+    if ( final_tex && type == Newpixie_Multipass ) {
 
-        if ( accum_tex->width != final_tex->width || accum_tex->height != final_tex->height ) {
-            gpu_device->resize_texture( newpixie_accumulation_texture, final_tex->width, final_tex->height );
+        Texture* history_tex = gpu_device->textures.get_cold( newpixie_previous_horizontal_blur_texture );
+        if ( history_tex->width != final_tex->width || history_tex->height != final_tex->height ) {
             gpu_device->resize_texture( newpixie_previous_horizontal_blur_texture, final_tex->width, final_tex->height );
-            gpu_device->resize_texture( newpixie_horizontal_blur_texture, final_tex->width, final_tex->height );
-            gpu_device->resize_texture( newpixie_vertical_blur_texture, final_tex->width, final_tex->height );
+        }
+
+        if ( newpixie_graph_width != final_tex->width || newpixie_graph_height != final_tex->height ||
+             newpixie_graph_input != input || newpixie_graph_output != output ) {
+            build_newpixie_graph( final_tex->width, final_tex->height );
         }
     }
 
@@ -114,9 +191,10 @@ void CRTPostprocess::render( CommandBuffer* gpu_commands, Camera* camera, u32 ph
 
         gpu_commands->begin_pass( { output }, { LoadOperation::Clear }, { {0,0,0,0} }, {}, LoadOperation::DontCare, {} );
 
-        gpu_commands->bind_pipeline( mattias_singlepass_pso );
-        gpu_commands->bind_descriptor_set( { gpu_device->bindless_descriptor_set, mattias_singlepass_ds }, { constants_offset } );
-        gpu_commands->draw( TopologyType::Triangle, 0, 3, input.index, 1 );
+        if ( gpu_commands->bind_pipeline( mattias_singlepass_pso ) ) {
+            gpu_commands->bind_descriptor_set( { gpu_device->bindless_descriptor_set, mattias_singlepass_ds }, { constants_offset } );
+            gpu_commands->draw( TopologyType::Triangle, 0, 3, input.index, 1 );
+        }
 
         gpu_commands->end_render_pass();
 
@@ -124,84 +202,70 @@ void CRTPostprocess::render( CommandBuffer* gpu_commands, Camera* camera, u32 ph
         gpu_commands->pop_marker();
     } else if ( type == Newpixie_Multipass ) {
 
-        gpu_commands->push_marker( "CRT Post" );
-
-        // Accumulation
-        {
-            gpu_commands->submit_barriers( { {newpixie_accumulation_texture, ResourceState::RenderTarget, 0, 1} }, {} );
-
-            gpu_commands->begin_pass( { newpixie_accumulation_texture }, { LoadOperation::Load }, { {0,0,0,0} }, {}, LoadOperation::DontCare, {} );
-
-            gpu_commands->bind_pipeline( newpixie_accumulation_pass.pso );
-            gpu_commands->bind_descriptor_set( { gpu_device->bindless_descriptor_set, newpixie_accumulation_pass.descriptor_set }, { constants_offset } );
-
-            u32 texture_ids = ( ( input.index & 0xffff ) << 16 ) | ( ( newpixie_previous_horizontal_blur_texture.index & 0xffff ) );
-            gpu_commands->draw( TopologyType::Triangle, 0, 3, texture_ids, 1 );
-
-            gpu_commands->end_render_pass();
-
-            gpu_commands->submit_barriers( { {newpixie_accumulation_texture, ResourceState::ShaderResource, 0, 1} }, {} );
-        }
-
-        // Horizontal blur
-        {
-            gpu_commands->submit_barriers( { {newpixie_horizontal_blur_texture, ResourceState::RenderTarget, 0, 1} }, {} );
-
-            gpu_commands->begin_pass( { newpixie_horizontal_blur_texture }, { LoadOperation::Load }, { {0,0,0,0} }, {}, LoadOperation::DontCare, {} );
-
-            gpu_commands->bind_pipeline( newpixie_blur_pass.pso );
-            gpu_commands->bind_descriptor_set( { gpu_device->bindless_descriptor_set, newpixie_blur_pass.descriptor_set }, { hblur_constants_offset } );
-            gpu_commands->draw( TopologyType::Triangle, 0, 3, newpixie_accumulation_texture.index, 1 );
-
-            gpu_commands->end_render_pass();
-
-            gpu_commands->submit_barriers( { {newpixie_horizontal_blur_texture, ResourceState::ShaderResource, 0, 1} }, {} );
+        if ( newpixie_graph.compiled ) {
+            gpu_commands->push_marker( "CRT Post" );
+            newpixie_graph.execute( gpu_commands );
+            gpu_commands->pop_marker();
         }
+    }
+}
 
-        // Copy horizontal blur
-        {
-            gpu_commands->copy_texture( newpixie_horizontal_blur_texture, newpixie_previous_horizontal_blur_texture, ResourceState::ShaderResource );
-        }
+void CRTPostprocess::build_newpixie_graph( u32 width, u32 height ) {
 
-        // Vertical blur
-        {
-            gpu_commands->submit_barriers( { {newpixie_vertical_blur_texture, ResourceState::RenderTarget, 0, 1} }, {} );
+    newpixie_graph.reset();
 
-            gpu_commands->begin_pass( { newpixie_vertical_blur_texture }, { LoadOperation::Load }, { {0,0,0,0} }, {}, LoadOperation::DontCare, {} );
+    newpixie_graph_width = width;
+    newpixie_graph_height = height;
+    newpixie_graph_input = externals.input;
+    newpixie_graph_output = externals.output;
 
-            gpu_commands->bind_pipeline( newpixie_blur_pass.pso );
-            gpu_commands->bind_descriptor_set( { gpu_device->bindless_descriptor_set, newpixie_blur_pass.descriptor_set }, { vblur_constants_offset } );
-            gpu_commands->draw( TopologyType::Triangle, 0, 3, newpixie_horizontal_blur_texture.index, 1 );
+    TextureCreation texture_creation = {
+        .width = ( u16 )width, .height = ( u16 )height, .depth = 1, .array_layer_count = 1,
+        .mip_level_count = 1, .flags = TextureFlags::Compute_mask | TextureFlags::RenderTarget_mask,
+        .format = gpu_device->swapchain_format, .type = TextureType::Texture2D };
 
-            gpu_commands->end_render_pass();
+    texture_creation.debug_name = "newpixie_accumulation_texture";
+    newpixie_accumulation_texture = newpixie_graph.create_texture( texture_creation );
+    texture_creation.debug_name = "newpixie_horizontal_blur_texture";
+    newpixie_horizontal_blur_texture = newpixie_graph.create_texture( texture_creation );
+    texture_creation.debug_name = "newpixie_vertical_blur_texture";
+    newpixie_vertical_blur_texture = newpixie_graph.create_texture( texture_creation );
 
-            gpu_commands->submit_barriers( { {newpixie_vertical_blur_texture, ResourceState::ShaderResource, 0, 1} }, {} );
-        }
+    const FrameGraphResource input = newpixie_graph.import_texture( externals.input, "crt_input" );
+    const FrameGraphResource output = newpixie_graph.import_texture( externals.output, "crt_output", ResourceState::ShaderResource );
+    const FrameGraphResource previous_horizontal_blur = newpixie_graph.import_texture( newpixie_previous_horizontal_blur_texture,
+                                                                                       "newpixie_previous_horizontal_blur_texture" );
 
-        // Final pass
-        {
-            gpu_commands->submit_barriers( { {output, ResourceState::RenderTarget, 0, 1} }, {} );
+    u32 pass = newpixie_graph.add_pass( "accumulation", newpixie_accumulation_execute, this );
+    newpixie_graph.read( pass, input, ResourceState::ShaderResource );
+    newpixie_graph.read( pass, previous_horizontal_blur, ResourceState::ShaderResource );
+    newpixie_graph.write( pass, newpixie_accumulation_texture, ResourceState::RenderTarget );
 
-            gpu_commands->begin_pass( { output }, { LoadOperation::Clear }, { {0,0,0,0} }, {}, LoadOperation::DontCare, {} );
+    pass = newpixie_graph.add_pass( "horizontal blur", newpixie_horizontal_blur_execute, this );
+    newpixie_graph.read( pass, newpixie_accumulation_texture, ResourceState::ShaderResource );
+    newpixie_graph.write( pass, newpixie_horizontal_blur_texture, ResourceState::RenderTarget );
 
-            gpu_commands->bind_pipeline( newpixie_main_pass.pso );
-            gpu_commands->bind_descriptor_set( { gpu_device->bindless_descriptor_set, newpixie_main_pass.descriptor_set }, { constants_offset } );
-            u32 texture_ids = ( ( newpixie_vertical_blur_texture.index & 0xffff ) << 16 ) | ( ( newpixie_accumulation_texture.index & 0xffff ) );
-            gpu_commands->draw( TopologyType::Triangle, 0, 3, texture_ids, 1 );
+    pass = newpixie_graph.add_pass( "copy horizontal blur", newpixie_copy_horizontal_blur_execute, this );
+    newpixie_graph.read( pass, newpixie_horizontal_blur_texture, ResourceState::CopySource );
+    newpixie_graph.write( pass, previous_horizontal_blur, ResourceState::CopyDest );
 
-            gpu_commands->end_render_pass();
+    pass = newpixie_graph.add_pass( "vertical blur", newpixie_vertical_blur_execute, this );
+    newpixie_graph.read( pass, newpixie_horizontal_blur_texture, ResourceState::ShaderResource );
+    newpixie_graph.write( pass, newpixie_vertical_blur_texture, ResourceState::RenderTarget );
 
-            gpu_commands->submit_barriers( { {output, ResourceState::ShaderResource, 0, 1} }, {} );
-        }
+    pass = newpixie_graph.add_pass( "main", newpixie_main_execute, this );
+    newpixie_graph.read( pass, newpixie_vertical_blur_texture, ResourceState::ShaderResource );
+    newpixie_graph.read( pass, newpixie_accumulation_texture, ResourceState::ShaderResource );
+    newpixie_graph.write( pass, output, ResourceState::RenderTarget );
 
-        gpu_commands->pop_marker();
-    }
+    newpixie_graph.compile();
 }
 
 void CRTPostprocess::create_resources( AssetManager* asset_manager, AssetCreationPhase::Enum phase ) {
 
     if ( phase == AssetCreationPhase::Startup ) {
         ShaderAssetLoader* shader_loader = asset_manager->get_loader<ShaderAssetLoader>();
+        shader_loader->begin_batch();
 
         // Single pass
         mattias_singlepass_shader = shader_loader->compile_graphics( {}, { "platform.h" },
@@ -260,29 +324,13 @@ void CRTPostprocess::create_resources( AssetManager* asset_manager, AssetCreatio
             .debug_name = "newpixie_main_ds" } );
 
 
-        newpixie_accumulation_texture = gpu_device->create_texture( {
-            .width = ( u16 )gpu_device->swapchain_width, .height = ( u16 )gpu_device->swapchain_height, .depth = 1, .array_layer_count = 1,
-            .mip_level_count = 1, .flags = TextureFlags::Compute_mask | TextureFlags::RenderTarget_mask,
-            .format = gpu_device->swapchain_format, .type = TextureType::Texture2D,
-            .debug_name = "newpixie_accumulation_texture" } );
-
         newpixie_previous_horizontal_blur_texture = gpu_device->create_texture( {
             .width = ( u16 )gpu_device->swapchain_width, .height = ( u16 )gpu_device->swapchain_height, .depth = 1, .array_layer_count = 1,
             .mip_level_count = 1, .flags = TextureFlags::Compute_mask | TextureFlags::RenderTarget_mask,
             .format = gpu_device->swapchain_format, .type = TextureType::Texture2D,
             .debug_name = "newpixie_previous_horizontal_blur_texture" } );
 
-        newpixie_horizontal_blur_texture = gpu_device->create_texture( {
-            .width = ( u16 )gpu_device->swapchain_width, .height = ( u16 )gpu_device->swapchain_height, .depth = 1, .array_layer_count = 1,
-            .mip_level_count = 1, .flags = TextureFlags::Compute_mask | TextureFlags::RenderTarget_mask,
-            .format = gpu_device->swapchain_format, .type = TextureType::Texture2D,
-            .debug_name = "newpixie_horizontal_blur_texture" } );
-
-        newpixie_vertical_blur_texture = gpu_device->create_texture( {
-            .width = ( u16 )gpu_device->swapchain_width, .height = ( u16 )gpu_device->swapchain_height, .depth = 1, .array_layer_count = 1,
-            .mip_level_count = 1, .flags = TextureFlags::Compute_mask | TextureFlags::RenderTarget_mask,
-            .format = gpu_device->swapchain_format, .type = TextureType::Texture2D,
-            .debug_name = "newpixie_vertical_blur_texture" } );
+        shader_loader->end_batch();
     }
 
     // Update dependent assets/resources
@@ -345,10 +393,11 @@ void CRTPostprocess::destroy_resources( AssetManager* asset_manager, AssetDestru
     gpu_device->destroy_descriptor_set_layout( newpixie_main_pass.descriptor_set_layout );
     gpu_device->destroy_descriptor_set( newpixie_main_pass.descriptor_set );
 
-    gpu_device->destroy_texture( newpixie_accumulation_texture );
-    gpu_device->destroy_texture( newpixie_horizontal_blur_texture );
+    newpixie_graph.reset();
+    newpixie_graph_width = 0;
+    newpixie_graph_height = 0;
+
     gpu_device->destroy_texture( newpixie_previous_horizontal_blur_texture );
-    gpu_device->destroy_texture( newpixie_vertical_blur_texture );
 }
 
 void CRTPostprocess::debug_ui() {
@@ -386,6 +435,14 @@ void CRTPostprocess::debug_ui() {
 
         ImGui::Separator();
 
+        const FrameGraph& graph = newpixie_graph;
+        ImGui::Text( "Frame graph transient textures %.1f MB, saved by aliasing %.1f MB",
+                     graph.transient_memory_size / ( 1024.0 * 1024.0 ),
+                     ( graph.transient_memory_size - graph.allocated_memory_size ) / ( 1024.0 * 1024.0 ) );
+        if ( ImGui::Button( "Dump frame graph" ) ) {
+            newpixie_graph.debug_dump();
+        }
+
     }
     ImGui::End();
 }
@@ -7,6 +7,7 @@
 
 #include "gpu/gpu_resources.hpp"
 
+#include "graphics/frame_graph.hpp"
 #include "graphics/render_system_interface.hpp"
 
 namespace idra {
@@ -64,6 +65,9 @@ struct CRTPostprocess : public RenderSystemInterface {
 
     void                        debug_ui();
 
+    // Recreates the newpixie passes and their transient textures for the output size.
+    void                        build_newpixie_graph( u32 width, u32 height );
+
     GpuDevice*                  gpu_device;
 
     // Mattias single pass
@@ -77,10 +81,21 @@ struct CRTPostprocess : public RenderSystemInterface {
     GraphicsPostFullscreenPass  newpixie_blur_pass;
     GraphicsPostFullscreenPass  newpixie_main_pass;
 
-    TextureHandle               newpixie_accumulation_texture;
+    // Blur of the previous frame is history, the other textures are transient.
     TextureHandle               newpixie_previous_horizontal_blur_texture;
-    TextureHandle               newpixie_horizontal_blur_texture;
-    TextureHandle               newpixie_vertical_blur_texture;
+
+    FrameGraph                  newpixie_graph;
+    FrameGraphResource          newpixie_accumulation_texture;
+    FrameGraphResource          newpixie_horizontal_blur_texture;
+    FrameGraphResource          newpixie_vertical_blur_texture;
+    TextureHandle               newpixie_graph_input;
+    TextureHandle               newpixie_graph_output;
+    u32                         newpixie_graph_width    = 0;
+    u32                         newpixie_graph_height   = 0;
+
+    u32                         newpixie_constants_offset;
+    u32                         newpixie_hblur_constants_offset;
+    u32                         newpixie_vblur_constants_offset;
 
     // Parameters
     enum Types {
@@ -112,8 +112,8 @@ void DebugRenderer::create_resources( AssetManager* asset_manager, AssetCreation
         iassert( s_line_buffer_2d );
     }
 
-    // These are always created
-    debug_lines_draw_pipeline = gpu_device->create_graphics_pipeline( {
+    // These are always created, on reload they replace the previous ones once compiled.
+    debug_lines_draw_pipeline = gpu_device->create_graphics_pipeline_async( {
         .rasterization = {},
         .depth_stencil = {.depth_comparison = ComparisonFunction::Always, .depth_enable = 1, .depth_write_enable = 0 },
         .blend_state = {.blend_states = { {.source_color = Blend::SrcAlpha,
@@ -130,9 +130,9 @@ void DebugRenderer::create_resources( AssetManager* asset_manager, AssetCreation
         .viewport = {},
         .color_formats = { gpu_device->swapchain_format },
         .depth_format = TextureFormat::D32_FLOAT,
-        .debug_name = "debug_lines_draw_pipeline" } );
+        .debug_name = "debug_lines_draw_pipeline" }, debug_lines_draw_pipeline );
 
-    debug_lines_2d_draw_pipeline = gpu_device->create_graphics_pipeline( {
+    debug_lines_2d_draw_pipeline = gpu_device->create_graphics_pipeline_async( {
         .rasterization = {},
         .depth_stencil = {.depth_comparison = ComparisonFunction::Always, .depth_enable = 1, .depth_write_enable = 0 },
         .blend_state = {.blend_states = { {.source_color = Blend::SrcAlpha,
@@ -149,19 +149,20 @@ void DebugRenderer::create_resources( AssetManager* asset_manager, AssetCreation
         .viewport = {},
         .color_formats = { gpu_device->swapchain_format },
         .depth_format = TextureFormat::D32_FLOAT,
-        .debug_name = "debug_lines_draw_pipeline" } );
+        .debug_name = "debug_lines_draw_pipeline" }, debug_lines_2d_draw_pipeline );
 
 }
 
 void DebugRenderer::destroy_resources( AssetManager* asset_manager, AssetDestructionPhase::Enum phase ) {
 
-    gpu_device->destroy_pipeline( debug_lines_draw_pipeline );
-    gpu_device->destroy_pipeline( debug_lines_2d_draw_pipeline );
-
+    // Pipelines are replaced by the reloaded ones.
     if ( phase == AssetDestructionPhase::Reload ) {        
         return;
     }
 
+    gpu_device->destroy_pipeline( debug_lines_draw_pipeline );
+    gpu_device->destroy_pipeline( debug_lines_2d_draw_pipeline );
+
     ShaderAssetLoader* shader_loader = asset_manager->get_loader<ShaderAssetLoader>();
     shader_loader->unload( draw_shader );
     shader_loader->unload( draw_2d_shader );
@@ -201,12 +202,13 @@ void DebugRenderer::render( CommandBuffer* gpu_commands, Camera* camera, u32 pha
 
         const u32 vertex_buffer_offset = phase * max_lines * sizeof( LineVertex );
 
-        gpu_commands->bind_pipeline( debug_lines_draw_pipeline );
-        gpu_commands->bind_vertex_buffer( lines_vb, 0, vertex_buffer_offset );
-        gpu_commands->bind_descriptor_set( { debug_lines_draw_set }, { dynamic_constants_offset } );
-        // Draw using instancing and 6 vertices.
-        const uint32_t num_vertices = 6;
-        gpu_commands->draw( TopologyType::Triangle, 0, num_vertices, 0, current_line / 2 );
+        if ( gpu_commands->bind_pipeline( debug_lines_draw_pipeline ) ) {
+            gpu_commands->bind_vertex_buffer( lines_vb, 0, vertex_buffer_offset );
+            gpu_commands->bind_descriptor_set( { debug_lines_draw_set }, { dynamic_constants_offset } );
+            // Draw using instancing and 6 vertices.
+            const uint32_t num_vertices = 6;
+            gpu_commands->draw( TopologyType::Triangle, 0, num_vertices, 0, current_line / 2 );
+        }
 
         current_line_per_view[ phase ] = 0;
     }
@@ -215,12 +217,13 @@ void DebugRenderer::render( CommandBuffer* gpu_commands, Camera* camera, u32 pha
 
         const u32 vertex_buffer_offset = phase * max_lines * sizeof( LineVertex2D );
 
-        gpu_commands->bind_pipeline( debug_lines_2d_draw_pipeline );
-        gpu_commands->bind_vertex_buffer( lines_vb_2d, 0, vertex_buffer_offset );
-        gpu_commands->bind_descriptor_set( { debug_lines_draw_set }, { dynamic_constants_offset } );
-        // Draw using instancing and 6 vertices.
-        const uint32_t num_vertices = 6;
-        gpu_commands->draw( TopologyType::Triangle, 0, num_vertices, 0, current_line_2d / 2 );
+        if ( gpu_commands->bind_pipeline( debug_lines_2d_draw_pipeline ) ) {
+            gpu_commands->bind_vertex_buffer( lines_vb_2d, 0, vertex_buffer_offset );
+            gpu_commands->bind_descriptor_set( { debug_lines_draw_set }, { dynamic_constants_offset } );
+            // Draw using instancing and 6 vertices.
+            const uint32_t num_vertices = 6;
+            gpu_commands->draw( TopologyType::Triangle, 0, num_vertices, 0, current_line_2d / 2 );
+        }
 
         current_line_2d_per_view[ phase ] = 0;
     }
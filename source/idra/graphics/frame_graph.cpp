@@ -0,0 +1,377 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "graphics/frame_graph.hpp"
+
+#include "kernel/assert.hpp"
+#include "kernel/log.hpp"
+
+namespace idra {
+
+// Aliased textures share the memory of the largest one, so they must not be
+// bigger in any dimension and must have the same format and usage.
+static bool texture_fits( const TextureCreation& texture, const TextureCreation& memory_owner ) {
+    return texture.type == memory_owner.type && texture.format == memory_owner.format &&
+        texture.flags == memory_owner.flags && texture.mip_level_count == memory_owner.mip_level_count &&
+        texture.width <= memory_owner.width && texture.height <= memory_owner.height &&
+        texture.depth <= memory_owner.depth && texture.array_layer_count <= memory_owner.array_layer_count;
+}
+
+static u64 texture_footprint( const TextureCreation& texture ) {
+    return ( u64 )texture.width * texture.height * texture.depth * texture.array_layer_count;
+}
+
+// FrameGraph /////////////////////////////////////////////////////////////
+void FrameGraph::init( Allocator* allocator, GpuDevice* gpu_device_ ) {
+
+    gpu_device = gpu_device_;
+
+    resources.init( allocator, 16 );
+    passes.init( allocator, 16 );
+    accesses.init( allocator, 32 );
+    barriers.init( allocator, 32 );
+}
+
+void FrameGraph::shutdown() {
+
+    for ( u32 i = 0; i < resources.size; ++i ) {
+        iassertm( !resources[ i ].transient || resources[ i ].texture.is_invalid(), "Reset the frame graph before shutdown." );
+    }
+
+    resources.shutdown();
+    passes.shutdown();
+    accesses.shutdown();
+    barriers.shutdown();
+}
+
+void FrameGraph::clear() {
+
+    resources.clear();
+    passes.clear();
+    accesses.clear();
+    barriers.clear();
+
+    first_final_barrier = 0;
+    transient_memory_size = 0;
+    allocated_memory_size = 0;
+    compiled = false;
+}
+
+FrameGraphResource FrameGraph::create_texture( const TextureCreation& creation ) {
+    iassert( !compiled );
+    iassertm( creation.initial_data == nullptr, "Transient texture content is undefined at first use." );
+
+    Resource& resource = resources.push_use();
+    resource = {};
+    resource.name = creation.debug_name;
+    resource.creation = creation;
+    resource.final_state = ResourceState::Undefined;
+    resource.transient = true;
+
+    return resources.size - 1;
+}
+
+FrameGraphResource FrameGraph::import_texture( TextureHandle texture, StringView name, ResourceState::Enum final_state ) {
+    iassert( !compiled );
+
+    Resource& resource = resources.push_use();
+    resource = {};
+    resource.name = name;
+    resource.texture = texture;
+    resource.final_state = final_state;
+
+    return resources.size - 1;
+}
+
+FrameGraphResource FrameGraph::import_buffer( BufferHandle buffer, StringView name ) {
+    iassert( !compiled );
+
+    Resource& resource = resources.push_use();
+    resource = {};
+    resource.name = name;
+    resource.buffer = buffer;
+    resource.final_state = ResourceState::Undefined;
+
+    return resources.size - 1;
+}
+
+void FrameGraph::mark_output( FrameGraphResource resource ) {
+    resources[ resource ].output = true;
+}
+
+u32 FrameGraph::add_pass( StringView name, FrameGraphExecute execute, void* user_data ) {
+    iassert( !compiled );
+
+    passes.push( { name, execute, user_data, 0, 0, 0, false } );
+    return passes.size - 1;
+}
+
+void FrameGraph::read( u32 pass, FrameGraphResource resource, ResourceState::Enum state ) {
+    iassert( pass < passes.size && resource < resources.size );
+    accesses.push( { pass, resource, state, false } );
+}
+
+void FrameGraph::write( u32 pass, FrameGraphResource resource, ResourceState::Enum state ) {
+    iassert( pass < passes.size && resource < resources.size );
+    accesses.push( { pass, resource, state, true } );
+}
+
+void FrameGraph::plan() {
+
+    // Resources are referenced by the passes reading them, passes by the
+    // resources they write. Imported resources and outputs are always used.
+    for ( u32 i = 0; i < resources.size; ++i ) {
+        Resource& resource = resources[ i ];
+        resource.reference_count = ( resource.output || !resource.transient ) ? 1 : 0;
+        resource.first_pass = k_invalid_frame_graph_index;
+        resource.last_pass = k_invalid_frame_graph_index;
+        resource.alias = k_invalid_frame_graph_index;
+        resource.discard = false;
+    }
+
+    for ( u32 i = 0; i < passes.size; ++i ) {
+        passes[ i ].reference_count = 0;
+        passes[ i ].culled = false;
+    }
+
+    for ( u32 i = 0; i < accesses.size; ++i ) {
+        const Access& access = accesses[ i ];
+        if ( access.write ) {
+            ++passes[ access.pass ].reference_count;
+        } else {
+            ++resources[ access.resource ].reference_count;
+        }
+    }
+
+    // Cull passes writing only unused resources, releasing what they read.
+    Array<u32> unused_resources;
+    unused_resources.init( resources.allocator, resources.size );
+
+    for ( u32 i = 0; i < resources.size; ++i ) {
+        if ( resources[ i ].reference_count == 0 ) {
+            unused_resources.push( i );
+        }
+    }
+
+    while ( unused_resources.size ) {
+        const u32 resource_index = unused_resources.back();
+        unused_resources.pop();
+
+        for ( u32 i = 0; i < accesses.size; ++i ) {
+            const Access& producer = accesses[ i ];
+            if ( !producer.write || producer.resource != resource_index ) {
+                continue;
+            }
+
+            Pass& pass = passes[ producer.pass ];
+            if ( pass.culled || --pass.reference_count > 0 ) {
+                continue;
+            }
+
+            pass.culled = true;
+
+            for ( u32 a = 0; a < accesses.size; ++a ) {
+                const Access& read = accesses[ a ];
+                if ( read.pass == producer.pass && !read.write &&
+                     --resources[ read.resource ].reference_count == 0 ) {
+                    unused_resources.push( read.resource );
+                }
+            }
+        }
+    }
+
+    // Lifetimes, in pass indices.
+    for ( u32 i = 0; i < accesses.size; ++i ) {
+        const Access& access = accesses[ i ];
+        if ( passes[ access.pass ].culled ) {
+            continue;
+        }
+
+        Resource& resource = resources[ access.resource ];
+        if ( resource.first_pass == k_invalid_frame_graph_index ) {
+            resource.first_pass = access.pass;
+            resource.last_pass = access.pass;
+        } else {
+            resource.first_pass = access.pass < resource.first_pass ? access.pass : resource.first_pass;
+            resource.last_pass = access.pass > resource.last_pass ? access.pass : resource.last_pass;
+        }
+    }
+
+    unused_resources.shutdown();
+
+    // Used transient textures, biggest first so that they own the memory.
+    Array<u32> transients;
+    transients.init( resources.allocator, resources.size );
+
+    for ( u32 i = 0; i < resources.size; ++i ) {
+        const Resource& resource = resources[ i ];
+        if ( !resource.transient || resource.first_pass == k_invalid_frame_graph_index ) {
+            continue;
+        }
+
+        transients.push( i );
+        for ( u32 t = transients.size - 1; t > 0; --t ) {
+            if ( texture_footprint( resources[ transients[ t - 1 ] ].creation ) >= texture_footprint( resource.creation ) ) {
+                break;
+            }
+            const u32 swap = transients[ t - 1 ];
+            transients[ t - 1 ] = transients[ t ];
+            transients[ t ] = swap;
+        }
+    }
+
+    // Alias each texture with the first memory owner whose users are all
+    // dead before it is written or born after it is last read.
+    for ( u32 t = 0; t < transients.size; ++t ) {
+        Resource& resource = resources[ transients[ t ] ];
+
+        for ( u32 o = 0; o < t; ++o ) {
+            const u32 owner_index = transients[ o ];
+            Resource& owner = resources[ owner_index ];
+            if ( owner.alias != k_invalid_frame_graph_index || !texture_fits( resource.creation, owner.creation ) ) {
+                continue;
+            }
+
+            bool overlaps = false;
+            for ( u32 u = 0; u < t && !overlaps; ++u ) {
+                const Resource& user = resources[ transients[ u ] ];
+                if ( transients[ u ] != owner_index && user.alias != owner_index ) {
+                    continue;
+                }
+                overlaps = resource.first_pass <= user.last_pass && user.first_pass <= resource.last_pass;
+            }
+
+            if ( !overlaps ) {
+                resource.alias = owner_index;
+                resource.discard = true;
+                owner.discard = true;
+                break;
+            }
+        }
+    }
+
+    transients.shutdown();
+
+    // Barriers before each pass. Reads after a write and writes after any access need
+    // an execution and memory dependency, that a state transition alone does not give
+    // when the state is the same (e.g. UnorderedAccess between compute passes).
+    barriers.clear();
+
+    for ( u32 i = 0; i < resources.size; ++i ) {
+        resources[ i ].last_access_pass = k_invalid_frame_graph_index;
+        resources[ i ].last_write_pass = k_invalid_frame_graph_index;
+    }
+
+    for ( u32 p = 0; p < passes.size; ++p ) {
+        Pass& pass = passes[ p ];
+        pass.first_barrier = barriers.size;
+        pass.barrier_count = 0;
+
+        if ( pass.culled ) {
+            continue;
+        }
+
+        for ( u32 i = 0; i < accesses.size; ++i ) {
+            const Access& access = accesses[ i ];
+            if ( access.pass != p ) {
+                continue;
+            }
+
+            const Resource& resource = resources[ access.resource ];
+            const bool hazard = resource.last_access_pass != k_invalid_frame_graph_index &&
+                                ( resource.last_write_pass == resource.last_access_pass || access.write );
+
+            // A texture accessed twice by a pass has one barrier, to the first state.
+            bool merged = false;
+            for ( u32 b = pass.first_barrier; b < barriers.size && !merged; ++b ) {
+                if ( barriers[ b ].resource == access.resource && resource.buffer.is_invalid() ) {
+                    barriers[ b ].hazard |= hazard;
+                    merged = true;
+                }
+            }
+
+            if ( !merged ) {
+                barriers.push( { access.resource, access.state, resource.discard && resource.first_pass == p, hazard } );
+            }
+        }
+
+        pass.barrier_count = barriers.size - pass.first_barrier;
+
+        for ( u32 i = 0; i < accesses.size; ++i ) {
+            const Access& access = accesses[ i ];
+            if ( access.pass != p ) {
+                continue;
+            }
+
+            Resource& resource = resources[ access.resource ];
+            resource.last_access_pass = p;
+            if ( access.write ) {
+                resource.last_write_pass = p;
+            }
+        }
+    }
+
+    // Imported textures go to their final state after the last pass.
+    first_final_barrier = barriers.size;
+    for ( u32 i = 0; i < resources.size; ++i ) {
+        const Resource& resource = resources[ i ];
+        if ( resource.final_state != ResourceState::Undefined && resource.buffer.is_invalid() ) {
+            barriers.push( { i, resource.final_state, false, false } );
+        }
+    }
+}
+
+
+TextureHandle FrameGraph::get_texture( FrameGraphResource resource ) const {
+    return resources[ resource ].texture;
+}
+
+BufferHandle FrameGraph::get_buffer( FrameGraphResource resource ) const {
+    return resources[ resource ].buffer;
+}
+
+void FrameGraph::debug_dump() {
+
+    u32 culled_passes = 0;
+    for ( u32 p = 0; p < passes.size; ++p ) {
+        culled_passes += passes[ p ].culled ? 1 : 0;
+    }
+
+    ilog( "Frame graph: %u passes (%u culled), %u resources\n", passes.size, culled_passes, resources.size );
+
+    for ( u32 p = 0; p < passes.size; ++p ) {
+        const Pass& pass = passes[ p ];
+        ilog( "  Pass %u %s%s\n", p, pass.name.data, pass.culled ? " (culled)" : "" );
+
+        for ( u32 i = 0; i < accesses.size; ++i ) {
+            const Access& access = accesses[ i ];
+            if ( access.pass == p ) {
+                ilog( "    %s %s, state 0x%x\n", access.write ? "write" : "read ", resources[ access.resource ].name.data, ( u32 )access.state );
+            }
+        }
+    }
+
+    for ( u32 i = 0; i < resources.size; ++i ) {
+        const Resource& resource = resources[ i ];
+
+        if ( !resource.transient ) {
+            ilog( "  Resource %s, imported %s\n", resource.name.data, resource.texture.is_valid() ? "texture" : "buffer" );
+        } else if ( resource.first_pass == k_invalid_frame_graph_index ) {
+            ilog( "  Resource %s, unused\n", resource.name.data );
+        } else {
+            ilog( "  Resource %s %ux%ux%u %s, passes %u-%u, %s %s\n", resource.name.data,
+                  resource.creation.width, resource.creation.height, resource.creation.depth,
+                  TextureFormat::ToString( resource.creation.format ), resource.first_pass, resource.last_pass,
+                  resource.alias != k_invalid_frame_graph_index ? "aliases" : "owns memory",
+                  resource.alias != k_invalid_frame_graph_index ? resources[ resource.alias ].name.data : "" );
+        }
+    }
+
+    ilog( "  Transient textures %.1f KB, allocated %.1f KB, saved by aliasing %.1f KB\n",
+          transient_memory_size / 1024.0, allocated_memory_size / 1024.0,
+          ( transient_memory_size - allocated_memory_size ) / 1024.0 );
+}
+
+} // namespace idra
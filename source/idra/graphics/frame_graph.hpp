@@ -0,0 +1,136 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#pragma once
+
+#include "gpu/gpu_resources.hpp"
+
+#include "kernel/array.hpp"
+
+namespace idra {
+
+struct CommandBuffer;
+struct GpuDevice;
+
+// Index of a texture or buffer declared in a FrameGraph.
+typedef u32                     FrameGraphResource;
+
+typedef void                    ( *FrameGraphExecute )( CommandBuffer* gpu_commands, void* user_data );
+
+static const u32                k_invalid_frame_graph_index = u32_max;
+
+//
+// Passes declare the resources they read and write, in the state they need.
+// compile() culls the passes whose writes are never read, computes when each
+// transient texture is used and creates the ones with disjoint lifetimes in the
+// memory of a single texture. execute() records the passes, each preceded by one
+// batched barrier for all its resources. Accesses after a write, and writes
+// after any access, get a barrier even when the state does not change.
+//
+// Imported resources and outputs are never culled and keep their content
+// between frames, transient textures content is undefined at their first use.
+// The graph is compiled once and executed every frame, until reset.
+//
+// frame_graph.cpp holds the declarations and plan(), that do not touch the GPU
+// and are unit tested; frame_graph_gpu.cpp creates the textures and records.
+//
+struct FrameGraph {
+
+    void                        init( Allocator* allocator, GpuDevice* gpu_device );
+    // Transient textures must have been destroyed by reset.
+    void                        shutdown();
+
+    // Removes passes and resources, destroying the transient textures.
+    void                        reset();
+    // Removes passes and resources.
+    void                        clear();
+
+    FrameGraphResource          create_texture( const TextureCreation& creation );
+    // Imported textures are transitioned to final_state after the last pass, if not undefined.
+    FrameGraphResource          import_texture( TextureHandle texture, StringView name,
+                                                ResourceState::Enum final_state = ResourceState::Undefined );
+    FrameGraphResource          import_buffer( BufferHandle buffer, StringView name );
+    // Passes writing an output are kept even if no other pass reads it.
+    void                        mark_output( FrameGraphResource resource );
+
+    u32                         add_pass( StringView name, FrameGraphExecute execute, void* user_data );
+    void                        read( u32 pass, FrameGraphResource resource, ResourceState::Enum state );
+    void                        write( u32 pass, FrameGraphResource resource, ResourceState::Enum state );
+
+    // Plans the graph and creates its transient textures.
+    void                        compile();
+    void                        execute( CommandBuffer* gpu_commands );
+
+    // Culls the passes, computes lifetimes and aliases of the transient textures
+    // and the barriers before each pass, without creating any GPU resource.
+    void                        plan();
+
+    TextureHandle               get_texture( FrameGraphResource resource ) const;
+    BufferHandle                get_buffer( FrameGraphResource resource ) const;
+
+    // Logs passes, resource lifetimes and aliases, and the memory saved by aliasing.
+    void                        debug_dump();
+
+    struct Resource {
+        StringView              name;
+        TextureCreation         creation;
+        TextureHandle           texture;
+        BufferHandle            buffer;
+
+        ResourceState::Enum     final_state;
+        u32                     first_pass;
+        u32                     last_pass;
+        u32                     alias;          // Resource owning the memory, invalid if not aliased.
+        u32                     reference_count;
+
+        // Last passes accessing and writing the resource, tracked while planning barriers.
+        u32                     last_access_pass;
+        u32                     last_write_pass;
+
+        bool                    transient;
+        bool                    output;
+        bool                    discard;        // Memory is shared: drop content at first use.
+    }; // struct Resource
+
+    struct Pass {
+        StringView              name;
+        FrameGraphExecute       execute;
+        void*                   user_data;
+        u32                     reference_count;
+        u32                     first_barrier;
+        u32                     barrier_count;
+        bool                    culled;
+    }; // struct Pass
+
+    struct Access {
+        u32                     pass;
+        FrameGraphResource      resource;
+        ResourceState::Enum     state;
+        bool                    write;
+    }; // struct Access
+
+    struct Barrier {
+        FrameGraphResource      resource;
+        ResourceState::Enum     state;
+        bool                    discard;        // First use of a texture sharing memory.
+        bool                    hazard;         // Dependency needed even if the state is the same.
+    }; // struct Barrier
+
+    GpuDevice*                  gpu_device      = nullptr;
+
+    Array<Resource>             resources;
+    Array<Pass>                 passes;
+    Array<Access>               accesses;
+    Array<Barrier>              barriers;       // Ranges of the passes, then the final states.
+
+    u32                         first_final_barrier     = 0;
+
+    sizet                       transient_memory_size   = 0;    // Memory of the transient textures if not aliased.
+    sizet                       allocated_memory_size   = 0;
+    bool                        compiled        = false;
+
+}; // struct FrameGraph
+
+} // namespace idra
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "graphics/frame_graph.hpp"
+
+#include "gpu/gpu_device.hpp"
+#include "gpu/command_buffer.hpp"
+
+namespace idra {
+
+// FrameGraph GPU /////////////////////////////////////////////////////////
+void FrameGraph::reset() {
+
+    for ( u32 i = 0; i < resources.size; ++i ) {
+        Resource& resource = resources[ i ];
+        if ( resource.transient && resource.texture.is_valid() ) {
+            gpu_device->destroy_texture( resource.texture );
+            resource.texture = {};
+        }
+    }
+
+    clear();
+}
+
+void FrameGraph::compile() {
+    iassert( !compiled );
+
+    plan();
+
+    auto create_transient = [&]( Resource& resource ) {
+        const bool owner = resource.alias == k_invalid_frame_graph_index;
+
+        TextureCreation creation = resource.creation;
+        if ( !owner ) {
+            creation.alias = resources[ resource.alias ].texture;
+        }
+        resource.texture = gpu_device->create_texture( creation );
+
+        const sizet memory_size = gpu_device->get_texture_memory_size( resource.texture );
+        transient_memory_size += memory_size;
+        if ( owner ) {
+            allocated_memory_size += memory_size;
+        }
+    };
+
+    // Memory owners are created before their aliases.
+    for ( u32 i = 0; i < resources.size; ++i ) {
+        Resource& resource = resources[ i ];
+        if ( resource.transient && resource.first_pass != k_invalid_frame_graph_index && resource.alias == k_invalid_frame_graph_index ) {
+            create_transient( resource );
+        }
+    }
+    for ( u32 i = 0; i < resources.size; ++i ) {
+        Resource& resource = resources[ i ];
+        if ( resource.transient && resource.alias != k_invalid_frame_graph_index ) {
+            create_transient( resource );
+        }
+    }
+
+    compiled = true;
+}
+
+void FrameGraph::execute( CommandBuffer* gpu_commands ) {
+    iassert( compiled );
+
+    TextureBarrier texture_barriers[ k_max_image_outputs ];
+    BufferBarrier buffer_barriers[ k_max_image_outputs ];
+
+    auto submit_barriers = [&]( u32 first_barrier, u32 barrier_count ) {
+        u32 texture_barrier_count = 0;
+        u32 buffer_barrier_count = 0;
+
+        for ( u32 b = first_barrier; b < first_barrier + barrier_count; ++b ) {
+            const Barrier& barrier = barriers[ b ];
+            const Resource& resource = resources[ barrier.resource ];
+
+            if ( texture_barrier_count == k_max_image_outputs || buffer_barrier_count == k_max_image_outputs ) {
+                gpu_commands->submit_barriers( Span<const TextureBarrier>( texture_barriers, texture_barrier_count ),
+                                               Span<const BufferBarrier>( buffer_barriers, buffer_barrier_count ) );
+                texture_barrier_count = 0;
+                buffer_barrier_count = 0;
+            }
+
+            if ( resource.buffer.is_valid() ) {
+                buffer_barriers[ buffer_barrier_count++ ] = { .buffer = resource.buffer, .new_state = barrier.state, .hazard = barrier.hazard };
+            } else {
+                Texture* texture_data = gpu_device->textures.get_cold( resource.texture );
+                texture_barriers[ texture_barrier_count++ ] = { .texture = resource.texture, .new_state = barrier.state, .mip_level = 0,
+                                                                .mip_count = texture_data->mip_level_count, .discard = barrier.discard, .hazard = barrier.hazard };
+            }
+        }
+
+        gpu_commands->submit_barriers( Span<const TextureBarrier>( texture_barriers, texture_barrier_count ),
+                                       Span<const BufferBarrier>( buffer_barriers, buffer_barrier_count ) );
+    };
+
+    for ( u32 p = 0; p < passes.size; ++p ) {
+        const Pass& pass = passes[ p ];
+        if ( pass.culled ) {
+            continue;
+        }
+
+        submit_barriers( pass.first_barrier, pass.barrier_count );
+
+        gpu_commands->push_marker( pass.name );
+        pass.execute( gpu_commands, pass.user_data );
+        gpu_commands->pop_marker();
+    }
+
+    submit_barriers( first_final_barrier, barriers.size - first_final_barrier );
+}
+
+} // namespace idra
@@ -174,9 +174,10 @@ void GpuDebugPrintSystem::render( CommandBuffer* cb, Camera* camera, u32 phase )
                              {entries_ub, ResourceState::ShaderResource},
                              {indirect_buffer, ResourceState::ShaderResource} } );
         cb->fill_buffer( constants_ub, 0, 64, 0 );
-        cb->bind_pipeline( dispatch_pso );
-        cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, dispatch_ds }, {} );
-        cb->dispatch_1d( 1, 1 );
+        if ( cb->bind_pipeline( dispatch_pso ) ) {
+            cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, dispatch_ds }, {} );
+            cb->dispatch_1d( 1, 1 );
+        }
 
         cb->submit_barriers( {}, { {indirect_buffer, ResourceState::IndirectArgument} } );
         cb->pop_marker();
@@ -184,9 +185,10 @@ void GpuDebugPrintSystem::render( CommandBuffer* cb, Camera* camera, u32 phase )
 
     // Draw phase
     if ( phase == Draw ) {
-        cb->bind_pipeline( draw_pso );
-        cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, draw_ds }, { dynamic_draw_offset } );
-        cb->draw_indirect( indirect_buffer, 1, 0, sizeof( u32 ) * 4 );
+        if ( cb->bind_pipeline( draw_pso ) ) {
+            cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, draw_ds }, { dynamic_draw_offset } );
+            cb->draw_indirect( indirect_buffer, 1, 0, sizeof( u32 ) * 4 );
+        }
     }
 }
 
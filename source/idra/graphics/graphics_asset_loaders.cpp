@@ -7,6 +7,7 @@
 
 #include "kernel/file.hpp"
 #include "kernel/memory_hooks.hpp"
+#include "kernel/numerics.hpp"
 
 #include "gpu/gpu_device.hpp"
 
@@ -25,40 +26,86 @@
 
 namespace idra {
 
+// ShaderPermutations /////////////////////////////////////////////////////
+u64 ShaderPermutations::set_option( u64 key, u32 option_index, u32 value ) const {
+    iassert( option_index < num_options );
+    iassert( value < idra::max( option_num_values[ option_index ], ( u8 )2 ) );
+
+    const u64 mask = ( ( 1ull << option_bit_count[ option_index ] ) - 1 ) << option_bit_offset[ option_index ];
+    return ( key & ~mask ) | ( ( ( u64 )value << option_bit_offset[ option_index ] ) & mask );
+}
+
+u32 ShaderPermutations::get_option( u64 key, u32 option_index ) const {
+    iassert( option_index < num_options );
+
+    return ( u32 )( ( key >> option_bit_offset[ option_index ] ) & ( ( 1ull << option_bit_count[ option_index ] ) - 1 ) );
+}
+
 // ShaderAssetLoader //////////////////////////////////////////////////////
-void ShaderAssetLoader::init( Allocator* allocator, u32 size, AssetManager* asset_manager, GpuDevice* gpu ) {
-    AssetLoader<ShaderAsset>::init( allocator, size, asset_manager );
+void ShaderAssetLoader::init( Allocator* allocator_, u32 size, AssetManager* asset_manager, GpuDevice* gpu ) {
+    AssetLoader<ShaderAsset>::init( allocator_, size, asset_manager );
 
     gpu_device = gpu;
+    allocator = allocator_;
 
-    string_array.init( ikilo( 128 ), allocator );
+    strings.init( allocator, 256 );
     shader_creations.init( allocator, 32 );
+    shader_dependencies.init( allocator, 128 );
+    batch_shaders.init( allocator, 32 );
+
+    permutations.init( allocator, 8 );
+    used_variants.init( allocator, 32 );
+    requested_variants.init( allocator, 16 );
+    compiling_variants.init( allocator, 16 );
 }
 
 void ShaderAssetLoader::shutdown() {
+    wait_variant_compilation();
+
+    // Permutations still alive are recorded before being destroyed.
+    while ( permutations.size ) {
+        destroy_permutations( permutations[ permutations.size - 1 ] );
+    }
+    save_used_variants();
+    unload_shader_pack();
+
     AssetLoader<ShaderAsset>::shutdown();
 
-    string_array.shutdown();
+    strings.shutdown();
     shader_creations.shutdown();
+    shader_dependencies.shutdown();
+    batch_shaders.shutdown();
+
+    permutations.shutdown();
+    used_variants.shutdown();
+    requested_variants.shutdown();
+    compiling_variants.shutdown();
 }
 
 ShaderAsset* ShaderAssetLoader::load( StringView name ) {
-    ShaderAsset* shader = path_to_asset.get( hash_calculate( name ) );
+    ShaderAsset* shader = acquire( StringId( name ) );
 
-    if ( shader ) {
-        shader->reference_count++;
-        return shader;
+    if ( !shader ) {
+        ilog_error( "Could not find shader %s\n", name.data );
     }
+    return shader;
+}
 
-    ilog_error( "Could not find shader %s\n", name.data );
-    return nullptr;
+ShaderAsset* ShaderAssetLoader::load( StringId name_id ) {
+    ShaderAsset* shader = acquire( name_id );
+
+    if ( !shader ) {
+        ilog_error( "Could not find shader 0x%llx %s\n", name_id.hash, string_id_get_name( name_id ).data );
+    }
+    return shader;
 }
 
 void ShaderAssetLoader::unload( StringView name ) {
-    const u64 hashed_name = hash_calculate( name );
-    ShaderAsset* shader = path_to_asset.get( hashed_name );
+    unload( StringId( name ) );
+}
 
-    unload( shader );
+void ShaderAssetLoader::unload( StringId name_id ) {
+    unload( path_to_asset.get( name_id ) );
 }
 
 void ShaderAssetLoader::unload( ShaderAsset* shader ) {
@@ -66,116 +113,226 @@ void ShaderAssetLoader::unload( ShaderAsset* shader ) {
         shader->reference_count--;
 
         if ( shader->reference_count == 0 ) {
-            gpu_device->destroy_shader_state( shader->shader );
-
-            const u64 hashed_path = hash_calculate( shader->path.path );
-            path_to_asset.remove( hashed_path );
-            assets.release( shader );
-            asset_manager->free_path( shader->path );
+            destroy_shader_asset( shader );
         }
     }
 }
 
 void ShaderAssetLoader::reload_assets() {
 
-    // Reload and substitute shader states
+    // The background job could be writing the states of the variants it compiles.
+    wait_variant_compilation();
+
+    BookmarkAllocator* temp_allocator = g_memory->get_thread_allocator();
+    const sizet marker = temp_allocator->get_marker();
+
+    Array<ShaderAsset*> shaders;
+    shaders.init( temp_allocator, path_to_asset.size );
+
+    u32 total_shaders = 0;
     FlatHashMapIterator it = path_to_asset.iterator_begin();
     while ( it.is_valid() ) {
+        ShaderAsset* shader = path_to_asset.get_structure( it ).value;
+        if ( dependencies_changed( shader ) ) {
+            shaders.push( shader );
+        }
+        ++total_shaders;
+        path_to_asset.iterator_advance( it );
+    }
+
+    // Requested variants were never compiled, so they are part of the reload.
+    requested_variants.clear();
 
-        auto key_value = path_to_asset.get_structure( it );
-        const u64 key = key_value.key;
-        ShaderAsset* shader = key_value.value;
-
-        // Compile shader and substitute handle
-        ShaderState* shader_state = gpu_device->shader_states.get_cold( shader->shader );
-        
-        if ( shader_state ) {
-            switch ( shader_state->pipeline_type ) {
-                case PipelineType::Graphics:
-                {
-                    ShaderAssetCreation& vs_creation = shader_creations[ shader->creation_index ];
-                    // TODO: always true ?
-                    ShaderAssetCreation& fs_creation = shader_creations[ shader->creation_index + 1];
-
-                    std::vector<unsigned int> vs_spirv, fs_spirv;
-                    // TODO: includes are common between vertex and fragment shaders for now.
-                    StringView includes[ 8 ];
-                    for ( u32 i = 0; i < vs_creation.num_includes; ++i ) {
-                        includes[ i ] = vs_creation.includes[ i ];
-                    }
-
-                    StringView defines[ 8 ];
-                    for ( u32 i = 0; i < vs_creation.num_defines; ++i ) {
-                        defines[ i ] = vs_creation.defines[ i ];
-                    }
-
-                    shader_compiler_compile_from_file( { .defines = Span<const StringView>( defines, vs_creation.num_defines ),
-                                                       .include_paths = Span<const StringView>( includes, vs_creation.num_includes ),
-                                                       .source_path =  vs_creation.source_path, .stage = ShaderStage::Vertex }, vs_spirv );
-
-                    shader_compiler_compile_from_file( { .defines = Span<const StringView>( defines, vs_creation.num_defines ),
-                                                       .include_paths = Span<const StringView>( includes, fs_creation.num_includes ),
-                                                       .source_path =  fs_creation.source_path, .stage = ShaderStage::Fragment }, fs_spirv );
-
-                    // Compilation succeeded, create new shader state and substitute the one in the asset.
-                    if ( vs_spirv.size() != 0 && fs_spirv.size() != 0 ) {
-                        ShaderStateHandle new_shader_state = gpu_device->create_graphics_shader_state( {
-                            .vertex_shader = {
-                                .byte_code = Span<u32>( vs_spirv.data(), vs_spirv.size() * 4 ),
-                                .type = ShaderStage::Vertex } ,
-                            .fragment_shader = {
-                                .byte_code = Span<u32>( fs_spirv.data(), fs_spirv.size() * 4 ),
-                                .type = ShaderStage::Fragment } ,
-                            .debug_name = vs_creation.name } );
-
-                        gpu_device->destroy_shader_state( shader->shader );
-
-                        shader->shader = new_shader_state;
-                    }
-
-                    break;
-                }
-
-                case PipelineType::Compute:
-                {
-                    ShaderAssetCreation& creation = shader_creations[ shader->creation_index ];
-                    
-                    std::vector<unsigned int> spirv;
-                    
-                    StringView includes[ 8 ];
-                    for ( u32 i = 0; i < creation.num_includes; ++i ) {
-                        includes[ i ] = creation.includes[ i ];
-                    }
-
-                    shader_compiler_compile_from_file( { .defines = {}, .include_paths = Span<const StringView>( includes, creation.num_includes ),
-                                                       .source_path =  creation.source_path, .stage = ShaderStage::Compute }, spirv );
-
-                    // Compilation succeeded, create new shader state and substitute the one in the asset.
-                    if ( spirv.size() != 0 ) {
-                        ShaderStateHandle new_shader_state = gpu_device->create_compute_shader_state( {
-                            .compute_shader = {
-                                .byte_code = Span<u32>( spirv.data(), spirv.size() * 4 ),
-                                .type = ShaderStage::Compute } ,
-                            .debug_name = creation.name } );
-
-                        gpu_device->destroy_shader_state( shader->shader );
-
-                        shader->shader = new_shader_state;
-                    }
-
-                    break;
-                }
-
-                case PipelineType::Raytracing:
-                default:
-                {
-                    iassertm( false, "Pipeline not supported!\n" );
-                    break;
-                }
+    ilog( "Reloading %u of %u shaders\n", shaders.size, total_shaders );
+    compile_shader_states( Span<ShaderAsset*>( shaders.data, shaders.size ) );
+
+    temp_allocator->free_marker( marker );
+}
+
+// Union of the files read by all stages, reusing the previous range when it fits.
+void ShaderAssetLoader::update_dependencies( ShaderAsset* shader, Span<std::vector<ShaderFileDependency>> stage_dependencies ) {
+
+    const u32 previous_index = shader->dependency_index;
+    const u32 previous_count = shader->dependency_count;
+
+    // Build the new list at the end of the array, then move it in place if possible.
+    const u32 new_index = shader_dependencies.size;
+    for ( u32 s = 0; s < stage_dependencies.size; ++s ) {
+        for ( const ShaderFileDependency& file : stage_dependencies[ s ] ) {
+            bool found = false;
+            for ( u32 d = new_index; d < shader_dependencies.size && !found; ++d ) {
+                found = shader_dependencies[ d ].path.size == file.path.size &&
+                        strncmp( shader_dependencies[ d ].path.data, file.path.data, file.path.size ) == 0;
+            }
+
+            if ( !found ) {
+                shader_dependencies.push( { strings.get( strings.intern( file.path ) ), file.content_hash } );
             }
         }
-        
-        path_to_asset.iterator_advance( it );
+    }
+
+    const u32 new_count = shader_dependencies.size - new_index;
+    if ( previous_count && new_count <= previous_count ) {
+        memcpy( &shader_dependencies[ previous_index ], &shader_dependencies[ new_index ], new_count * sizeof( ShaderAssetDependency ) );
+        shader_dependencies.set_size( new_index );
+        shader->dependency_count = new_count;
+        return;
+    }
+
+    shader->dependency_index = new_index;
+    shader->dependency_count = new_count;
+}
+
+bool ShaderAssetLoader::dependencies_changed( const ShaderAsset* shader ) const {
+    // Never compiled successfully.
+    if ( shader->dependency_count == 0 ) {
+        return true;
+    }
+
+    for ( u32 i = 0; i < shader->dependency_count; ++i ) {
+        const ShaderAssetDependency& dependency = shader_dependencies[ shader->dependency_index + i ];
+        if ( shader_compiler_file_hash( dependency.path ) != dependency.content_hash ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ShaderAssetLoader::begin_batch() {
+    iassert( !batching );
+    batching = true;
+}
+
+void ShaderAssetLoader::end_batch() {
+    iassert( batching );
+    batching = false;
+
+    compile_shader_states( Span<ShaderAsset*>( batch_shaders.data, batch_shaders.size ) );
+
+    for ( u32 i = 0; i < batch_shaders.size; ++i ) {
+        if ( !batch_shaders[ i ]->shader.is_valid() ) {
+            ilog_error( "Error compiling shader %s\n", shader_creations[ batch_shaders[ i ]->creation_index ].name.data );
+        }
+    }
+    batch_shaders.clear();
+}
+
+void ShaderAssetLoader::compile_shader_states( Span<ShaderAsset*> shaders ) {
+
+    shaders.size = create_from_shader_pack( shaders );
+    if ( shaders.size == 0 ) {
+        return;
+    }
+
+    CompilationJob job;
+    prepare_compilation( shaders, job );
+
+    shader_compiler_compile_many( Span<const ShaderCompilationInfo>( job.infos.data(), job.infos.size() ),
+                                  Span<std::vector<unsigned int>>( job.spirv.data(), job.spirv.size() ) );
+
+    finish_compilation( shaders, job );
+}
+
+void ShaderAssetLoader::prepare_compilation( Span<ShaderAsset*> shaders, CompilationJob& job ) {
+
+    // One compilation per stage, stages of a shader are subsequent creations.
+    job.creations.clear();
+    for ( u32 i = 0; i < shaders.size; ++i ) {
+        for ( u32 c = 0; c < shaders[ i ]->creation_count; ++c ) {
+            job.creations.push_back( shader_creations[ shaders[ i ]->creation_index + c ] );
+        }
+    }
+
+    const sizet num_compilations = job.creations.size();
+    job.infos.resize( num_compilations );
+    job.spirv.clear();
+    job.spirv.resize( num_compilations );
+    job.dependencies.clear();
+    job.dependencies.resize( num_compilations );
+
+    for ( sizet i = 0; i < num_compilations; ++i ) {
+        const ShaderAssetCreation& creation = job.creations[ i ];
+
+        job.infos[ i ] = { .defines = Span<const StringView>( creation.defines, creation.num_defines ),
+                           .include_paths = Span<const StringView>( creation.includes, creation.num_includes ),
+                           .source_path = creation.source_path, .stage = creation.stage,
+                           .dependencies = &job.dependencies[ i ] };
+    }
+}
+
+// Stage byte codes are the vertex and fragment, or the compute one. Invalid if any stage is empty.
+static ShaderStateHandle create_shader_state( GpuDevice* gpu_device, ShaderStage::Enum stage, const Span<u32>* byte_code,
+                                              const spirv::ParseResult* reflection, StringView name ) {
+
+    switch ( stage ) {
+        case ShaderStage::Vertex:
+        {
+            // TODO: always true ?
+            if ( byte_code[ 0 ].size != 0 && byte_code[ 1 ].size != 0 ) {
+                return gpu_device->create_graphics_shader_state( {
+                    .vertex_shader = {
+                        .byte_code = byte_code[ 0 ],
+                        .type = ShaderStage::Vertex } ,
+                    .fragment_shader = {
+                        .byte_code = byte_code[ 1 ],
+                        .type = ShaderStage::Fragment } ,
+                    .debug_name = name,
+                    .reflection = reflection } );
+            }
+            break;
+        }
+
+        case ShaderStage::Compute:
+        {
+            if ( byte_code[ 0 ].size != 0 ) {
+                return gpu_device->create_compute_shader_state( {
+                    .compute_shader = {
+                        .byte_code = byte_code[ 0 ],
+                        .type = ShaderStage::Compute } ,
+                    .debug_name = name,
+                    .reflection = reflection } );
+            }
+            break;
+        }
+
+        default:
+        {
+            iassertm( false, "Pipeline not supported!\n" );
+            break;
+        }
+    }
+
+    return {};
+}
+
+void ShaderAssetLoader::finish_compilation( Span<ShaderAsset*> shaders, CompilationJob& job ) {
+
+    // Shader states are created serially, the gpu device is not thread safe.
+    u32 compilation_index = 0;
+    for ( u32 i = 0; i < shaders.size; ++i ) {
+        ShaderAsset* shader = shaders[ i ];
+        const ShaderAssetCreation& creation = job.creations[ compilation_index ];
+        std::vector<unsigned int>* shader_spirv = &job.spirv[ compilation_index ];
+        const u32 first_compilation = compilation_index;
+        compilation_index += shader->creation_count;
+
+        // Byte code size is in bytes.
+        Span<u32> byte_code[ 2 ];
+        for ( u32 c = 0; c < shader->creation_count && c < ArraySize( byte_code ); ++c ) {
+            byte_code[ c ] = Span<u32>( shader_spirv[ c ].data(), shader_spirv[ c ].size() * 4 );
+        }
+
+        const ShaderStateHandle new_shader_state = create_shader_state( gpu_device, creation.stage, byte_code, nullptr, creation.name );
+
+        // Compilation succeeded, substitute the shader state in the asset.
+        if ( new_shader_state.is_valid() ) {
+            if ( shader->shader.is_valid() ) {
+                gpu_device->destroy_shader_state( shader->shader );
+            }
+            shader->shader = new_shader_state;
+
+            update_dependencies( shader, Span<std::vector<ShaderFileDependency>>( &job.dependencies[ first_compilation ], shader->creation_count ) );
+        }
     }
 }
 
@@ -184,71 +341,95 @@ u32 ShaderAssetLoader::cache_creation_info( Span<const StringView> defines,
                                             ShaderStage::Enum stage, StringView name ) {
     ShaderAssetCreation& creation = shader_creations.push_use();
 
+    iassert( defines.size <= ArraySize( creation.defines ) );
+    iassert( include_paths.size <= ArraySize( creation.includes ) );
+
     creation.num_defines = 0;
 
     for ( sizet i = 0; i < defines.size; ++i ) {
-        creation.defines[ creation.num_defines++ ] = string_array.intern( defines[ i ].data );
+        creation.defines[ creation.num_defines++ ] = strings.get( strings.intern( defines[ i ] ) );
     }
     
     creation.num_includes = 0;
     // Cache includes and interns the strings to create the views
     for ( sizet i = 0; i < include_paths.size; ++i ) {
-        creation.includes[ creation.num_includes++ ] = string_array.intern( include_paths[ i ].data );
+        creation.includes[ creation.num_includes++ ] = strings.get( strings.intern( include_paths[ i ] ) );
     }
 
-    creation.source_path = string_array.intern( path.data );
+    creation.source_path = strings.get( strings.intern( path ) );
     creation.stage = stage;
-    creation.name = string_array.intern( name.data );
+    creation.name = strings.get( strings.intern( name ) );
 
     return shader_creations.size - 1;
 }
 
+ShaderAsset* ShaderAssetLoader::create_shader_asset( Span<const StringView> defines,
+                                                     Span<const StringView> includes,
+                                                     Span<const StringView> paths,
+                                                     ShaderStage::Enum stage,
+                                                     StringView name, StringId name_id ) {
+    ShaderAsset* shader = assets.obtain();
+    iassert( shader );
+
+    shader->path = asset_manager->allocate_path( name );
+    shader->path_id = name_id;
+    shader->shader = {};
+    shader->reference_count = 1;
+    shader->dependency_index = 0;
+    shader->dependency_count = 0;
+
+    path_to_asset.insert( name_id, shader );
+
+    // Cache shader creation infos, graphics shaders have a vertex and a fragment stage.
+    shader->creation_count = ( u32 )paths.size;
+    shader->creation_index = cache_creation_info( defines, includes, paths[ 0 ], stage, name );
+    // TODO: always subsequent index is valid ?
+    if ( paths.size > 1 ) {
+        cache_creation_info( defines, includes, paths[ 1 ], ShaderStage::Fragment, name );
+    }
+
+    return shader;
+}
+
+void ShaderAssetLoader::destroy_shader_asset( ShaderAsset* shader ) {
+    if ( shader->shader.is_valid() ) {
+        gpu_device->destroy_shader_state( shader->shader );
+    }
+
+    path_to_asset.remove( shader->path_id );
+    assets.release( shader );
+    asset_manager->free_path( shader->path );
+}
+
 ShaderAsset* ShaderAssetLoader::compile_graphics( Span<const StringView> defines,
                                                   Span<const StringView> includes,
                                                   StringView vertex_path,
                                                   StringView fragment_path,
                                                   StringView name ) {
-    const u64 hashed_name = hash_calculate( name );
-    ShaderAsset* shader = path_to_asset.get( hashed_name );
+    const StringId name_id( name );
+    ShaderAsset* shader = acquire( name_id );
 
     if ( shader ) {
-        shader->reference_count++;
         return shader;
     }
 
-    std::vector<unsigned int> vs_spirv, fs_spirv;
-    // Shader compiler DLL interaction.
-    shader_compiler_compile_from_file( { .defines = defines, .include_paths = includes, .source_path =  vertex_path, .stage = ShaderStage::Vertex }, vs_spirv );
-    shader_compiler_compile_from_file( { .defines = defines, .include_paths = includes, .source_path =  fragment_path, .stage = ShaderStage::Fragment }, fs_spirv );
+    const StringView paths[] = { vertex_path, fragment_path };
+    shader = create_shader_asset( defines, includes, { paths, 2 }, ShaderStage::Vertex, name, name_id );
 
-    if ( vs_spirv.size() == 0 || fs_spirv.size() == 0 ) {
-        ilog_error( "Error compiling shader %s\n", name.data );
-        return nullptr;
+    // Batched shaders are compiled in end_batch.
+    if ( batching ) {
+        batch_shaders.push( shader );
+        return shader;
     }
 
-    ShaderStateHandle shader_state = gpu_device->create_graphics_shader_state( {
-        .vertex_shader = {
-            .byte_code = Span<u32>( vs_spirv.data(), vs_spirv.size() * 4 ),
-            .type = ShaderStage::Vertex } ,
-        .fragment_shader = {
-            .byte_code = Span<u32>( fs_spirv.data(), fs_spirv.size() * 4 ),
-            .type = ShaderStage::Fragment } ,
-        .debug_name = name } );
-
-    shader = assets.obtain();
-    iassert( shader );
-
-    shader->path = asset_manager->allocate_path( name );
-    shader->shader = shader_state;
-    shader->reference_count = 1;
+    compile_shader_states( Span<ShaderAsset*>( &shader, 1 ) );
 
-    path_to_asset.insert( hashed_name, shader );
+    if ( shader->shader.is_invalid() ) {
+        ilog_error( "Error compiling shader %s\n", name.data );
 
-    // Cache shader creation infos
-    shader->creation_count = 2;
-    shader->creation_index = cache_creation_info( defines, includes, vertex_path, ShaderStage::Vertex, name );
-    // TODO: always subsequent index is valid ?
-    cache_creation_info( defines, includes, fragment_path, ShaderStage::Fragment, name );
+        destroy_shader_asset( shader );
+        return nullptr;
+    }
 
     return shader;
 }
@@ -258,44 +439,488 @@ ShaderAsset* ShaderAssetLoader::compile_compute( Span<const StringView> defines,
                                                  StringView path,
                                                  StringView name ) {
 
-    const u64 hashed_name = hash_calculate( name );
-    ShaderAsset* shader = path_to_asset.get( hashed_name );
+    const StringId name_id( name );
+    ShaderAsset* shader = acquire( name_id );
 
     if ( shader ) {
-        shader->reference_count++;
         return shader;
     }
 
-    std::vector<unsigned int> spirv;
-    // Shader compiler DLL interaction.
-    shader_compiler_compile_from_file( { .defines = defines, .include_paths = includes, 
-                                       .source_path =  path, .stage = ShaderStage::Compute }, spirv );
+    shader = create_shader_asset( defines, includes, { &path, 1 }, ShaderStage::Compute, name, name_id );
+
+    // Batched shaders are compiled in end_batch.
+    if ( batching ) {
+        batch_shaders.push( shader );
+        return shader;
+    }
+
+    compile_shader_states( Span<ShaderAsset*>( &shader, 1 ) );
 
-    if ( spirv.size() == 0 ) {
+    if ( shader->shader.is_invalid() ) {
         ilog_error( "Error compiling shader %s\n", name.data );
+
+        destroy_shader_asset( shader );
         return nullptr;
     }
 
-    ShaderStateHandle shader_state = gpu_device->create_compute_shader_state( {
-        .compute_shader = {
-            .byte_code = Span<u32>( spirv.data(), spirv.size() * 4 ),
-            .type = ShaderStage::Compute } ,
-        .debug_name = name } );
+    return shader;
+}
 
-    shader = assets.obtain();
-    iassert( shader );
+ShaderPermutations* ShaderAssetLoader::declare_graphics_permutations( Span<const ShaderOption> options,
+                                                                      Span<const StringView> includes,
+                                                                      StringView vertex_path,
+                                                                      StringView fragment_path,
+                                                                      StringView name ) {
+    const StringView paths[] = { vertex_path, fragment_path };
+    return declare_permutations( options, includes, { paths, 2 }, ShaderStage::Vertex, name );
+}
 
-    shader->path = asset_manager->allocate_path( name );
-    shader->shader = shader_state;
-    shader->reference_count = 1;
+ShaderPermutations* ShaderAssetLoader::declare_compute_permutations( Span<const ShaderOption> options,
+                                                                     Span<const StringView> includes,
+                                                                     StringView path,
+                                                                     StringView name ) {
+    return declare_permutations( options, includes, { &path, 1 }, ShaderStage::Compute, name );
+}
 
-    path_to_asset.insert( hashed_name, shader );
+ShaderPermutations* ShaderAssetLoader::declare_permutations( Span<const ShaderOption> options,
+                                                             Span<const StringView> includes,
+                                                             Span<const StringView> paths,
+                                                             ShaderStage::Enum stage,
+                                                             StringView name ) {
+    iassert( options.size <= ShaderPermutations::k_max_options );
+    iassert( includes.size <= ArraySize( ShaderPermutations::includes ) );
+
+    const u64 name_hash = StringId( name ).hash;
+    for ( u32 i = 0; i < permutations.size; ++i ) {
+        iassertm( StringId( permutations[ i ]->name ).hash != name_hash, "Permutations %s already declared\n", name.data );
+    }
 
-    // Cache shader creation infos
-    shader->creation_count = 1;
-    shader->creation_index = cache_creation_info( defines, includes, path, ShaderStage::Compute, name );
+    ShaderPermutations* shader_permutations = ialloct( ShaderPermutations, allocator );
+    iassert( shader_permutations );
 
-    return shader;
+    shader_permutations->name = strings.get( strings.intern( name ) );
+    shader_permutations->stage = stage;
+    for ( u32 i = 0; i < paths.size; ++i ) {
+        shader_permutations->paths[ i ] = strings.get( strings.intern( paths[ i ] ) );
+    }
+
+    shader_permutations->num_includes = ( u32 )includes.size;
+    for ( u32 i = 0; i < includes.size; ++i ) {
+        shader_permutations->includes[ i ] = strings.get( strings.intern( includes[ i ] ) );
+    }
+
+    // Pack the options, an option with N values needs log2( N ) bits.
+    u64 layout_hash = 0;
+    u32 bit_offset = 0;
+    u32 num_values = 0;
+    for ( u32 o = 0; o < options.size; ++o ) {
+        const ShaderOption& option = options[ o ];
+        const u32 num_option_values = ( u32 )option.values.size;
+
+        iassertm( num_option_values != 1, "Option %s has a single value\n", option.name.data );
+        iassert( num_values + num_option_values <= ShaderPermutations::k_max_values );
+
+        shader_permutations->option_names[ o ] = strings.get( strings.intern( option.name ) );
+        shader_permutations->option_first_value[ o ] = ( u8 )num_values;
+        shader_permutations->option_num_values[ o ] = ( u8 )num_option_values;
+        shader_permutations->option_bit_offset[ o ] = ( u8 )bit_offset;
+        shader_permutations->option_bit_count[ o ] = ( u8 )( num_option_values ? 32 - leading_zeroes_u32( num_option_values - 1 ) : 1 );
+
+        layout_hash = hash_calculate( option.name, layout_hash );
+        for ( u32 v = 0; v < num_option_values; ++v ) {
+            shader_permutations->option_values[ num_values++ ] = strings.get( strings.intern( option.values[ v ] ) );
+            layout_hash = hash_calculate( option.values[ v ], layout_hash );
+        }
+
+        bit_offset += shader_permutations->option_bit_count[ o ];
+    }
+    iassertm( bit_offset <= 64, "Permutations %s need more than 64 bits\n", name.data );
+
+    shader_permutations->num_options = ( u32 )options.size;
+    shader_permutations->num_values = num_values;
+    shader_permutations->layout_hash = layout_hash;
+
+    shader_permutations->variants.init( allocator, 16 );
+    shader_permutations->variants.set_default_value( nullptr );
+
+    // Compile the fallback and the variants used last time together.
+    BookmarkAllocator* temp_allocator = g_memory->get_thread_allocator();
+    const sizet marker = temp_allocator->get_marker();
+
+    Array<ShaderAsset*> shaders;
+    shaders.init( temp_allocator, 16 );
+
+    shader_permutations->fallback = create_variant( shader_permutations, 0 );
+    shaders.push( shader_permutations->fallback );
+
+    const u64 valid_bits = bit_offset < 64 ? ( 1ull << bit_offset ) - 1 : u64_max;
+    for ( u32 i = 0; i < used_variants.size; ++i ) {
+        const UsedVariant& used = used_variants[ i ];
+        if ( used.name_hash != name_hash || used.layout_hash != layout_hash || ( used.key & ~valid_bits ) ||
+             shader_permutations->variants.get( used.key ) ) {
+            continue;
+        }
+
+        // Enum values past the last one can be encoded in the bits of the option.
+        bool valid_key = true;
+        for ( u32 o = 0; o < options.size && valid_key; ++o ) {
+            valid_key = shader_permutations->option_num_values[ o ] == 0 ||
+                        shader_permutations->get_option( used.key, o ) < shader_permutations->option_num_values[ o ];
+        }
+
+        if ( valid_key ) {
+            shaders.push( create_variant( shader_permutations, used.key ) );
+        }
+    }
+
+    permutations.push( shader_permutations );
+
+    if ( batching ) {
+        for ( u32 i = 0; i < shaders.size; ++i ) {
+            batch_shaders.push( shaders[ i ] );
+        }
+        temp_allocator->free_marker( marker );
+        return shader_permutations;
+    }
+
+    ilog( "Compiling permutations %s, %u recorded variants\n", name.data, shaders.size - 1 );
+    compile_shader_states( Span<ShaderAsset*>( shaders.data, shaders.size ) );
+
+    temp_allocator->free_marker( marker );
+
+    if ( shader_permutations->fallback->shader.is_invalid() ) {
+        ilog_error( "Error compiling shader %s\n", name.data );
+
+        destroy_permutations( shader_permutations );
+        return nullptr;
+    }
+
+    return shader_permutations;
+}
+
+// Keep the keys in the used list, they are written out at shutdown.
+static void record_used_variants( ShaderPermutations* permutations, Array<ShaderAssetLoader::UsedVariant>& used_variants ) {
+
+    const u64 name_hash = StringId( permutations->name ).hash;
+    for ( u32 i = 0; i < used_variants.size; ) {
+        if ( used_variants[ i ].name_hash == name_hash ) {
+            used_variants.delete_swap( i );
+        }
+        else {
+            ++i;
+        }
+    }
+
+    FlatHashMapIterator it = permutations->variants.iterator_begin();
+    while ( it.is_valid() ) {
+        const u64 key = permutations->variants.get_structure( it ).key;
+        if ( key ) {
+            used_variants.push( { permutations->name, name_hash, permutations->layout_hash, key } );
+        }
+        permutations->variants.iterator_advance( it );
+    }
+}
+
+void ShaderAssetLoader::destroy_permutations( ShaderPermutations* shader_permutations ) {
+    if ( !shader_permutations ) {
+        return;
+    }
+
+    wait_variant_compilation();
+
+    record_used_variants( shader_permutations, used_variants );
+
+    FlatHashMapIterator it = shader_permutations->variants.iterator_begin();
+    while ( it.is_valid() ) {
+        ShaderAsset* variant = shader_permutations->variants.get_structure( it ).value;
+
+        // Requested but not compiled yet.
+        for ( u32 i = 0; i < requested_variants.size; ++i ) {
+            if ( requested_variants[ i ] == variant ) {
+                requested_variants.delete_swap( i );
+                break;
+            }
+        }
+        for ( u32 i = 0; i < batch_shaders.size; ++i ) {
+            if ( batch_shaders[ i ] == variant ) {
+                batch_shaders.delete_swap( i );
+                break;
+            }
+        }
+
+        unload( variant );
+        shader_permutations->variants.iterator_advance( it );
+    }
+    shader_permutations->variants.shutdown();
+
+    for ( u32 i = 0; i < permutations.size; ++i ) {
+        if ( permutations[ i ] == shader_permutations ) {
+            permutations.delete_swap( i );
+            break;
+        }
+    }
+
+    ifree( shader_permutations, allocator );
+}
+
+ShaderAsset* ShaderAssetLoader::create_variant( ShaderPermutations* shader_permutations, u64 key ) {
+
+    // Bool options define their name when set, enum options their value.
+    StringView defines[ ShaderPermutations::k_max_options ];
+    u32 num_defines = 0;
+    for ( u32 o = 0; o < shader_permutations->num_options; ++o ) {
+        const u32 value = shader_permutations->get_option( key, o );
+
+        if ( shader_permutations->option_num_values[ o ] == 0 ) {
+            if ( value ) {
+                defines[ num_defines++ ] = shader_permutations->option_names[ o ];
+            }
+        }
+        else {
+            defines[ num_defines++ ] = shader_permutations->option_values[ shader_permutations->option_first_value[ o ] + value ];
+        }
+    }
+
+    char variant_name[ 256 ];
+    const i32 name_length = snprintf( variant_name, ArraySize( variant_name ), "%s#%llx",
+                                      shader_permutations->name.data, ( unsigned long long )key );
+    const StringView name( variant_name, idra::min( ( u32 )name_length, ( u32 )ArraySize( variant_name ) - 1 ) );
+
+    const u32 num_paths = shader_permutations->stage == ShaderStage::Compute ? 1 : 2;
+    ShaderAsset* variant = create_shader_asset( { defines, num_defines },
+                                                { shader_permutations->includes, shader_permutations->num_includes },
+                                                { shader_permutations->paths, num_paths },
+                                                shader_permutations->stage, name, StringId( name ) );
+
+    shader_permutations->variants.insert( key, variant );
+    return variant;
+}
+
+ShaderStateHandle ShaderAssetLoader::get_variant( ShaderPermutations* shader_permutations, u64 key ) {
+
+    ShaderAsset* variant = shader_permutations->variants.get( key );
+    if ( !variant ) {
+        variant = create_variant( shader_permutations, key );
+        requested_variants.push( variant );
+    }
+
+    if ( variant->shader.is_valid() ) {
+        return variant->shader;
+    }
+    return shader_permutations->fallback->shader;
+}
+
+void ShaderAssetLoader::update() {
+
+    if ( variant_job_done.valid() ) {
+        if ( variant_job_done.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready ) {
+            return;
+        }
+        wait_variant_compilation();
+    }
+
+    if ( requested_variants.size == 0 ) {
+        return;
+    }
+
+    for ( u32 i = 0; i < requested_variants.size; ++i ) {
+        compiling_variants.push( requested_variants[ i ] );
+    }
+    requested_variants.clear();
+
+    compiling_variants.set_size( create_from_shader_pack( Span<ShaderAsset*>( compiling_variants.data, compiling_variants.size ) ) );
+    if ( compiling_variants.size == 0 ) {
+        return;
+    }
+
+    prepare_compilation( Span<ShaderAsset*>( compiling_variants.data, compiling_variants.size ), variant_job );
+
+    variant_job_done = std::async( std::launch::async, [ this ]() {
+        shader_compiler_compile_many( Span<const ShaderCompilationInfo>( variant_job.infos.data(), variant_job.infos.size() ),
+                                      Span<std::vector<unsigned int>>( variant_job.spirv.data(), variant_job.spirv.size() ) );
+    } );
+}
+
+void ShaderAssetLoader::wait_variant_compilation() {
+
+    if ( !variant_job_done.valid() ) {
+        return;
+    }
+
+    variant_job_done.get();
+    finish_compilation( Span<ShaderAsset*>( compiling_variants.data, compiling_variants.size ), variant_job );
+
+    // Failed variants keep using the fallback, they are compiled again on reload.
+    for ( u32 i = 0; i < compiling_variants.size; ++i ) {
+        if ( compiling_variants[ i ]->shader.is_invalid() ) {
+            ilog_error( "Error compiling shader %s\n", shader_creations[ compiling_variants[ i ]->creation_index ].name.data );
+        }
+    }
+    compiling_variants.clear();
+}
+
+bool ShaderAssetLoader::load_shader_pack( StringView path ) {
+
+    unload_shader_pack();
+
+    if ( !fs_file_exists( path ) ) {
+        return false;
+    }
+
+    Span<char> file_data = file_read_allocate( path, allocator );
+    if ( file_data.size < sizeof( ShaderPackBlueprint ) || !blob_validate( file_data ) ) {
+        ilog_error( "Invalid shader pack %s\n", path.data );
+        if ( file_data.data ) {
+            ifree( file_data.data, allocator );
+        }
+        return false;
+    }
+
+    BlobReader blob_reader;
+    shader_pack = blob_reader.read<ShaderPackBlueprint>( allocator, ShaderPackBlueprint::k_version, file_data, false );
+
+    // Upgraded blueprints live in the reader memory.
+    if ( blob_reader.data_memory ) {
+        ifree( file_data.data, allocator );
+        shader_pack_memory = blob_reader.data_memory;
+    }
+    else {
+        shader_pack_memory = file_data.data;
+    }
+
+    if ( !shader_pack ) {
+        ilog_error( "Invalid shader pack %s\n", path.data );
+        unload_shader_pack();
+        return false;
+    }
+
+    ilog( "Loaded shader pack %s, %u programs\n", path.data, shader_pack->programs.size );
+    return true;
+}
+
+void ShaderAssetLoader::unload_shader_pack() {
+    if ( shader_pack_memory ) {
+        ifree( shader_pack_memory, allocator );
+    }
+    shader_pack = nullptr;
+    shader_pack_memory = nullptr;
+}
+
+u32 ShaderAssetLoader::create_from_shader_pack( Span<ShaderAsset*> shaders ) {
+
+    if ( !shader_pack ) {
+        return ( u32 )shaders.size;
+    }
+
+    u32 num_to_compile = 0;
+    for ( u32 i = 0; i < shaders.size; ++i ) {
+        ShaderAsset* shader = shaders[ i ];
+        const ShaderAssetCreation& creation = shader_creations[ shader->creation_index ];
+
+        // Shaders with a state are being reloaded, so their sources changed after the pack was built.
+        const ShaderPackProgram* program = nullptr;
+        if ( shader->shader.is_invalid() ) {
+            StringView paths[ 2 ];
+            for ( u32 c = 0; c < shader->creation_count && c < ArraySize( paths ); ++c ) {
+                paths[ c ] = shader_creations[ shader->creation_index + c ].source_path;
+            }
+
+            const u64 key = ShaderPackBlueprint::calculate_key( { creation.defines, creation.num_defines },
+                                                                { creation.includes, creation.num_includes },
+                                                                { paths, shader->creation_count }, creation.stage );
+            program = shader_pack->find_program( key );
+        }
+
+        ShaderStateHandle shader_state = {};
+        if ( program && program->num_stages == shader->creation_count ) {
+            Span<u32> byte_code[ 2 ];
+            for ( u32 s = 0; s < program->num_stages; ++s ) {
+                byte_code[ s ] = Span<u32>( ( u32* )program->spirv[ s ].get(), program->spirv[ s ].size * 4 );
+            }
+
+            const spirv::ParseResult* reflection = program->reflection.size ? program->reflection.get() : nullptr;
+            shader_state = create_shader_state( gpu_device, creation.stage, byte_code, reflection, creation.name );
+        }
+
+        if ( shader_state.is_invalid() ) {
+            shaders[ i ] = shaders[ num_to_compile ];
+            shaders[ num_to_compile++ ] = shader;
+            continue;
+        }
+
+        shader->shader = shader_state;
+
+        // Files used to build the pack, so reloads recompile only what changed since then.
+        std::vector<ShaderFileDependency> dependencies( program->dependencies.size );
+        for ( u32 d = 0; d < program->dependencies.size; ++d ) {
+            const ShaderPackDependency& dependency = program->dependencies[ d ];
+            dependencies[ d ] = { StringView( dependency.path.c_str(), dependency.path.size ), dependency.content_hash };
+        }
+        update_dependencies( shader, Span<std::vector<ShaderFileDependency>>( &dependencies, 1 ) );
+    }
+
+    return num_to_compile;
+}
+
+void ShaderAssetLoader::load_used_variants( StringView path ) {
+
+    used_variants_path = strings.get( strings.intern( path ) );
+
+    if ( !fs_file_exists( path ) ) {
+        return;
+    }
+
+    Span<char> file_data = file_read_allocate( path, allocator );
+    if ( !file_data.data ) {
+        return;
+    }
+
+    // One variant per line: name, layout hash and key.
+    cstring line = file_data.data;
+    while ( *line ) {
+        char name[ 256 ];
+        unsigned long long layout_hash, key;
+        if ( sscanf( line, "%255s %llx %llx", name, &layout_hash, &key ) == 3 ) {
+            const StringView name_view = strings.get( strings.intern( StringView( name, ( u32 )strlen( name ) ) ) );
+            used_variants.push( { name_view, StringId( name_view ).hash, layout_hash, key } );
+        }
+
+        cstring line_end = strchr( line, '\n' );
+        line = line_end ? line_end + 1 : line + strlen( line );
+    }
+
+    ifree( file_data.data, allocator );
+
+    ilog( "Loaded %u used shader variants from %s\n", used_variants.size, path.data );
+}
+
+void ShaderAssetLoader::save_used_variants() {
+
+    if ( !used_variants_path.size ) {
+        return;
+    }
+
+    for ( u32 i = 0; i < permutations.size; ++i ) {
+        record_used_variants( permutations[ i ], used_variants );
+    }
+
+    FileHandle file = file_open_for_write( used_variants_path );
+    if ( !file ) {
+        ilog_warn( "Cannot write used shader variants to %s\n", used_variants_path.data );
+        return;
+    }
+
+    char line[ 320 ];
+    for ( u32 i = 0; i < used_variants.size; ++i ) {
+        const UsedVariant& used = used_variants[ i ];
+
+        const i32 length = snprintf( line, ArraySize( line ), "%s %016llx %llx\n",
+                                     used.name.data,
+                                     ( unsigned long long )used.layout_hash, ( unsigned long long )used.key );
+        file_write( file, { line, ( sizet )length } );
+    }
+
+    file_close( file );
 }
 
 // TextureAssetLoader /////////////////////////////////////////////////////
@@ -311,12 +936,14 @@ void TextureAssetLoader::shutdown() {
 }
 
 TextureAsset* TextureAssetLoader::load( StringView path ) {
+    return load( StringId( path ), path );
+}
 
-    const u64 hashed_path = hash_calculate( path );
-    TextureAsset* texture = path_to_asset.get( hashed_path );
+TextureAsset* TextureAssetLoader::load( StringId path_id, StringView path ) {
+    string_id_check( path_id, path );
 
+    TextureAsset* texture = acquire( path_id );
     if ( texture ) {
-        texture->reference_count++;
         return texture;
     }
 
@@ -332,14 +959,34 @@ TextureAsset* TextureAssetLoader::load( StringView path ) {
     Span<char> file = file_read_allocate( path, allocator );
 
     if ( !file.data ) {
-        ilog_error( "Failed loading texture %s\n", path );
+        ilog_error( "Failed loading texture %s\n", path.data );
+        assets.release( texture );
+        return nullptr;
+    }
+
+    if ( file.size < sizeof( TextureBlueprint ) || !blob_validate( file ) ) {
+        ilog_error( "Invalid texture blueprint %s\n", path.data );
+        ifree( file.data, allocator );
+        assets.release( texture );
         return nullptr;
     }
 
     // Load from blueprint!
     BlobReader blob_reader;
-    // TODO: allocation when versions are different ?
-    TextureBlueprint* blueprint = blob_reader.read<TextureBlueprint>( nullptr, TextureBlueprint::k_version, file, false );
+    TextureBlueprint* blueprint = blob_reader.read<TextureBlueprint>( allocator, TextureBlueprint::k_version, file, false );
+
+    // Upgraded blueprints live in the reader memory.
+    if ( blob_reader.data_memory ) {
+        ifree( file.data, allocator );
+    }
+
+    if ( !blueprint ) {
+        ilog_error( "Invalid texture blueprint %s\n", path.data );
+        ifree( blob_reader.data_memory ? blob_reader.data_memory : file.data, allocator );
+        assets.release( texture );
+        return nullptr;
+    }
+
     // Patch pointers
     blueprint->gpu_creation.initial_data = blueprint->texture_data.get();
     blueprint->gpu_creation.debug_name = blueprint->name.c_str();
@@ -369,17 +1016,18 @@ TextureAsset* TextureAssetLoader::load( StringView path ) {
     
     texture->path = asset_manager->allocate_path( path );
 
-    path_to_asset.insert( hashed_path, texture );
+    texture->path_id = path_id;
+    path_to_asset.insert( path_id, texture );
 
     return texture;
 }
 
 void TextureAssetLoader::unload( StringView path ) {
+    unload( StringId( path ) );
+}
 
-    const u64 hashed_path = hash_calculate( path );
-    TextureAsset* texture = path_to_asset.get( hashed_path );
-
-    unload( texture );
+void TextureAssetLoader::unload( StringId path_id ) {
+    unload( path_to_asset.get( path_id ) );
 }
 
 void TextureAssetLoader::unload( TextureAsset* texture ) {
@@ -401,8 +1049,7 @@ void TextureAssetLoader::unload( TextureAsset* texture ) {
             }
 #endif // IDRA_USE_COMPRESSED_TEXTURES
 
-            const u64 hashed_path = hash_calculate( texture->path.path );
-            path_to_asset.remove( hashed_path );
+            path_to_asset.remove( texture->path_id );
             assets.release( texture );
             asset_manager->free_path( texture->path );
        }
@@ -423,12 +1070,14 @@ void TextureAtlasLoader::shutdown() {
 }
 
 AtlasAsset* TextureAtlasLoader::load( StringView path ) {
+    return load( StringId( path ), path );
+}
 
-    const u64 hashed_path = hash_calculate( path );
-    AtlasAsset* atlas = path_to_asset.get( hashed_path );
+AtlasAsset* TextureAtlasLoader::load( StringId path_id, StringView path ) {
+    string_id_check( path_id, path );
 
+    AtlasAsset* atlas = acquire( path_id );
     if ( atlas ) {
-        atlas->reference_count++;
         return atlas;
     }
 
@@ -441,29 +1090,50 @@ AtlasAsset* TextureAtlasLoader::load( StringView path ) {
     Span<char> atlas_file = file_read_allocate( path, allocator );
 
     if ( !atlas_file.data ) {
-        ilog_error( "Failed loading atlas %s\n", path );
+        ilog_error( "Failed loading atlas %s\n", path.data );
+        assets.release( atlas );
+        return nullptr;
+    }
+
+    if ( atlas_file.size < sizeof( AtlasBlueprint ) || !blob_validate( atlas_file ) ) {
+        ilog_error( "Invalid atlas blueprint %s\n", path.data );
+        ifree( atlas_file.data, allocator );
+        assets.release( atlas );
         return nullptr;
     }
 
     BlobReader blob_reader;
-    // TODO: allocation when versions are different ?
-    atlas->blueprint = blob_reader.read<AtlasBlueprint>( nullptr, AtlasBlueprint::k_version, atlas_file, false );
+    atlas->blueprint = blob_reader.read<AtlasBlueprint>( allocator, AtlasBlueprint::k_version, atlas_file, false );
+
+    // Upgraded blueprints live in the reader memory.
+    if ( blob_reader.data_memory ) {
+        ifree( atlas_file.data, allocator );
+    }
+
+    if ( !atlas->blueprint ) {
+        ilog_error( "Invalid atlas blueprint %s\n", path.data );
+        ifree( blob_reader.data_memory ? blob_reader.data_memory : atlas_file.data, allocator );
+        assets.release( atlas );
+        return nullptr;
+    }
+
     atlas->path = asset_manager->allocate_path( path );
 
     // Load dependant resource
     atlas->texture = asset_manager->get_loader<TextureAssetLoader>()->load( atlas->blueprint->texture_name.c_str() );
 
-    path_to_asset.insert( hashed_path, atlas );
+    atlas->path_id = path_id;
+    path_to_asset.insert( path_id, atlas );
 
     return atlas;
 }
 
 void TextureAtlasLoader::unload( StringView path ) {
+    unload( StringId( path ) );
+}
 
-    const u64 hashed_path = hash_calculate( path );
-    AtlasAsset* asset = path_to_asset.get( hashed_path );
-
-    unload( asset );
+void TextureAtlasLoader::unload( StringId path_id ) {
+    unload( path_to_asset.get( path_id ) );
 }
 
 void TextureAtlasLoader::unload( AtlasAsset* asset ) {
@@ -477,8 +1147,7 @@ void TextureAtlasLoader::unload( AtlasAsset* asset ) {
                 ifree( asset->blueprint, allocator );
             }
 
-            const u64 hashed_path = hash_calculate( asset->path.path );
-            path_to_asset.remove( hashed_path );
+            path_to_asset.remove( asset->path_id );
             assets.release( asset );
             asset_manager->free_path( asset->path );
         }
@@ -498,12 +1167,14 @@ void SpriteAnimationAssetLoader::shutdown() {
 }
 
 SpriteAnimationAsset* SpriteAnimationAssetLoader::load( StringView path ) {
+    return load( StringId( path ), path );
+}
 
-    const u64 hashed_path = hash_calculate( path );
-    SpriteAnimationAsset* asset = path_to_asset.get( hashed_path );
+SpriteAnimationAsset* SpriteAnimationAssetLoader::load( StringId path_id, StringView path ) {
+    string_id_check( path_id, path );
 
+    SpriteAnimationAsset* asset = acquire( path_id );
     if ( asset ) {
-        asset->reference_count++;
         return asset;
     }
 
@@ -515,6 +1186,19 @@ SpriteAnimationAsset* SpriteAnimationAssetLoader::load( StringView path ) {
     // Actual load
     Span<char> blob_memory = file_read_allocate( path, allocator );
 
+    if ( !blob_memory.data ) {
+        ilog_error( "Failed loading sprite animation %s\n", path.data );
+        assets.release( asset );
+        return nullptr;
+    }
+
+    if ( blob_memory.size < sizeof( SpriteAnimationBlueprint ) || !blob_validate( blob_memory ) ) {
+        ilog_error( "Invalid sprite animation blueprint %s\n", path.data );
+        ifree( blob_memory.data, allocator );
+        assets.release( asset );
+        return nullptr;
+    }
+
     BlobReader blob_reader{};
     // TODO: force serialize for now.
     asset->blueprint = blob_reader.read<SpriteAnimationBlueprint>( allocator, SpriteAnimationBlueprint::k_version, blob_memory, false );
@@ -525,19 +1209,27 @@ SpriteAnimationAsset* SpriteAnimationAssetLoader::load( StringView path ) {
         ifree( blob_memory.data, allocator );
     }
 
+    if ( !asset->blueprint ) {
+        ilog_error( "Invalid sprite animation blueprint %s\n", path.data );
+        ifree( blob_reader.data_memory ? blob_reader.data_memory : blob_memory.data, allocator );
+        assets.release( asset );
+        return nullptr;
+    }
+
     asset->path = asset_manager->allocate_path( path );
 
-    path_to_asset.insert( hashed_path, asset );
+    asset->path_id = path_id;
+    path_to_asset.insert( path_id, asset );
 
     return asset;
 }
 
 void SpriteAnimationAssetLoader::unload( StringView path ) {
+    unload( StringId( path ) );
+}
 
-    const u64 hashed_path = hash_calculate( path );
-    SpriteAnimationAsset* asset = path_to_asset.get( hashed_path );
-
-    unload( asset );
+void SpriteAnimationAssetLoader::unload( StringId path_id ) {
+    unload( path_to_asset.get( path_id ) );
 }
 
 void SpriteAnimationAssetLoader::unload( SpriteAnimationAsset* asset ) {
@@ -551,8 +1243,7 @@ void SpriteAnimationAssetLoader::unload( SpriteAnimationAsset* asset ) {
                 ifree( asset->blueprint, allocator );
             }
 
-            const u64 hashed_path = hash_calculate( asset->path.path );
-            path_to_asset.remove( hashed_path );
+            path_to_asset.remove( asset->path_id );
             assets.release( asset );
 
             asset_manager->free_path( asset->path );
@@ -589,11 +1280,14 @@ void FontAssetLoader::shutdown() {
 }
 
 FontAsset* FontAssetLoader::load( StringView path ) {
-    const u64 hashed_path = hash_calculate( path );
-    FontAsset* texture = path_to_asset.get( hashed_path );
+    return load( StringId( path ), path );
+}
+
+FontAsset* FontAssetLoader::load( StringId path_id, StringView path ) {
+    string_id_check( path_id, path );
 
+    FontAsset* texture = acquire( path_id );
     if ( texture ) {
-        texture->reference_count++;
         return texture;
     }
 
@@ -691,17 +1385,18 @@ FontAsset* FontAssetLoader::load( StringView path ) {
 
     texture->path = asset_manager->allocate_path( path );
 
-    path_to_asset.insert( hashed_path, texture );
+    texture->path_id = path_id;
+    path_to_asset.insert( path_id, texture );
 
     return texture;
 }
 
 void FontAssetLoader::unload( StringView path ) {
+    unload( StringId( path ) );
+}
 
-    const u64 hashed_path = hash_calculate( path );
-    FontAsset* asset = path_to_asset.get( hashed_path );
-
-    unload( asset );
+void FontAssetLoader::unload( StringId path_id ) {
+    unload( path_to_asset.get( path_id ) );
 }
 
 void FontAssetLoader::unload( FontAsset* asset ) {
@@ -716,14 +1411,284 @@ void FontAssetLoader::unload( FontAsset* asset ) {
                 ifree( asset->rgba_bitmap_memory, allocator );
             }
 
-            const u64 hashed_path = hash_calculate( asset->path.path );
-            path_to_asset.remove( hashed_path );
+            path_to_asset.remove( asset->path_id );
+            assets.release( asset );
+            asset_manager->free_path( asset->path );
+        }
+    }
+}
+
+// PipelineAssetLoader ////////////////////////////////////////////////////
+PipelineHandle PipelineAsset::get_pipeline( StringView pass_name ) const {
+    const u32 pass_index = blueprint->find_pass( pass_name );
+    return pass_index < num_passes ? pipelines[ pass_index ] : PipelineHandle{};
+}
+
+// Field by field, padding of the blob structs is not guaranteed to be zero.
+static u64 hash_render_state( const PipelineRenderState& state, u64 seed ) {
+    u64 hash = hash_calculate( state.rasterization, seed );
+
+    const DepthStencilCreation& depth_stencil = state.depth_stencil;
+    hash = hash_calculate( depth_stencil.front, hash );
+    hash = hash_calculate( depth_stencil.back, hash );
+    hash = hash_calculate( depth_stencil.depth_comparison, hash );
+    hash = hash_calculate( ( u32 )( depth_stencil.depth_enable | depth_stencil.depth_write_enable << 8 | depth_stencil.stencil_enable << 16 ), hash );
+
+    const BlendState& blend = state.blend;
+    hash = hash_calculate( blend.blend_disabled, hash );
+    if ( !blend.blend_disabled ) {
+        const u32 factors[] = { blend.source_color, blend.destination_color, blend.color_operation,
+                                blend.source_alpha, blend.destination_alpha, blend.alpha_operation,
+                                blend.color_write_mask, blend.separate_blend };
+        hash = hash_bytes( ( void* )factors, sizeof( factors ), hash );
+    }
+    return hash;
+}
+
+void PipelineAssetLoader::init( Allocator* allocator_, u32 size, AssetManager* asset_manager, GpuDevice* gpu_device_ ) {
+    AssetLoader<PipelineAsset>::init( allocator_, size, asset_manager );
+
+    gpu_device = gpu_device_;
+    allocator = allocator_;
+
+    shared_pipelines.init( allocator, 32 );
+}
+
+void PipelineAssetLoader::shutdown() {
+    // Pipelines of assets still referenced. Their shaders are released by the shader loader.
+    FlatHashMapIterator it = path_to_asset.iterator_begin();
+    while ( it.is_valid() ) {
+        PipelineAsset* asset = path_to_asset.get_structure( it ).value;
+        destroy_pipelines( asset );
+        ifree( asset->blueprint_memory, allocator );
+        path_to_asset.iterator_advance( it );
+    }
+
+    AssetLoader<PipelineAsset>::shutdown();
+
+    shared_pipelines.shutdown();
+}
+
+PipelineAsset* PipelineAssetLoader::load( StringView path, const RenderPassOutput& output ) {
+    return load( StringId( path ), path, output );
+}
+
+PipelineAsset* PipelineAssetLoader::load( StringId path_id, StringView path, const RenderPassOutput& output ) {
+    string_id_check( path_id, path );
+
+    PipelineAsset* asset = acquire( path_id );
+    if ( asset ) {
+        return asset;
+    }
+
+    Span<char> file_data = file_read_allocate( path, allocator );
+    if ( file_data.size < sizeof( PipelineBlueprint ) || !blob_validate( file_data ) ) {
+        ilog_error( "Invalid pipeline blueprint %s\n", path.data );
+        if ( file_data.data ) {
+            ifree( file_data.data, allocator );
+        }
+        return nullptr;
+    }
+
+    BlobReader blob_reader;
+    PipelineBlueprint* blueprint = blob_reader.read<PipelineBlueprint>( allocator, PipelineBlueprint::k_version, file_data, false );
+
+    // Upgraded blueprints live in the reader memory.
+    char* blueprint_memory = file_data.data;
+    if ( blob_reader.data_memory ) {
+        ifree( file_data.data, allocator );
+        blueprint_memory = blob_reader.data_memory;
+    }
+
+    if ( !blueprint || blueprint->passes.size > PipelineAsset::k_max_passes ) {
+        ilog_error( "Invalid pipeline blueprint %s\n", path.data );
+        ifree( blueprint_memory, allocator );
+        return nullptr;
+    }
+
+    asset = assets.obtain();
+    iassert( asset );
+
+    asset->reference_count = 1;
+    asset->blueprint = blueprint;
+    asset->blueprint_memory = blueprint_memory;
+    asset->num_passes = blueprint->passes.size;
+
+    asset->num_color_formats = idra::min( ( u32 )output.color_formats.size, ( u32 )k_max_image_outputs );
+    for ( u32 i = 0; i < asset->num_color_formats; ++i ) {
+        asset->color_formats[ i ] = output.color_formats[ i ];
+    }
+    asset->depth_format = output.depth_stencil_format;
+
+    // Shaders of all the passes are compiled together.
+    ShaderAssetLoader* shader_loader = asset_manager->get_loader<ShaderAssetLoader>();
+    const ShaderPackBlueprint* shader_pack = shader_loader->shader_pack;
+    shader_loader->begin_batch();
+
+    for ( u32 p = 0; p < asset->num_passes; ++p ) {
+        const PipelinePass& pass = blueprint->passes[ p ];
+
+        if ( shader_pack && !shader_pack->find_program( pass.program_key ) ) {
+            ilog_warn( "Pass %s of %s is not in the shader pack, compiling it\n", pass.name.c_str(), path.data );
+        }
+
+        if ( pass.stage == ShaderStage::Compute ) {
+            asset->shaders[ p ] = shader_loader->compile_compute( {}, {}, pass.paths[ 0 ].c_str(), pass.shader_name.c_str() );
+        } else {
+            asset->shaders[ p ] = shader_loader->compile_graphics( {}, {}, pass.paths[ 0 ].c_str(), pass.paths[ 1 ].c_str(),
+                                                                   pass.shader_name.c_str() );
+        }
+    }
+
+    shader_loader->end_batch();
+
+    create_pipelines( asset );
+
+    asset->path = asset_manager->allocate_path( path );
+    asset->path_id = path_id;
+    path_to_asset.insert( path_id, asset );
+
+    return asset;
+}
+
+void PipelineAssetLoader::unload( StringView path ) {
+    unload( StringId( path ) );
+}
+
+void PipelineAssetLoader::unload( StringId path_id ) {
+    unload( path_to_asset.get( path_id ) );
+}
+
+void PipelineAssetLoader::unload( PipelineAsset* asset ) {
+    if ( asset ) {
+        asset->reference_count--;
+
+        if ( asset->reference_count == 0 ) {
+            destroy_pipelines( asset );
+
+            ShaderAssetLoader* shader_loader = asset_manager->get_loader<ShaderAssetLoader>();
+            for ( u32 p = 0; p < asset->num_passes; ++p ) {
+                shader_loader->unload( asset->shaders[ p ] );
+            }
+
+            ifree( asset->blueprint_memory, allocator );
+
+            path_to_asset.remove( asset->path_id );
             assets.release( asset );
             asset_manager->free_path( asset->path );
         }
     }
 }
 
+void PipelineAssetLoader::reload_pipelines( PipelineAsset* asset ) {
+    destroy_pipelines( asset );
+    create_pipelines( asset );
+}
+
+void PipelineAssetLoader::create_pipelines( PipelineAsset* asset ) {
+    const PipelineBlueprint* blueprint = asset->blueprint;
+
+    // Passes without a render state use the gpu defaults, without blending.
+    PipelineRenderState default_render_state;
+    default_render_state.blend.blend_disabled = 1;
+
+    for ( u32 p = 0; p < asset->num_passes; ++p ) {
+        const PipelinePass& pass = blueprint->passes[ p ];
+        const ShaderAsset* shader = asset->shaders[ p ];
+
+        asset->pipelines[ p ] = PipelineHandle{};
+        asset->pipeline_keys[ p ] = 0;
+
+        // Failed shaders are already reported by the shader loader.
+        if ( !shader || shader->shader.is_invalid() ) {
+            continue;
+        }
+
+        const bool compute = pass.stage == ShaderStage::Compute;
+        const PipelineRenderState& render_state = pass.render_state != PipelinePass::k_no_index ?
+                                                  blueprint->render_states[ pass.render_state ] : default_render_state;
+        const PipelineVertexInput* vertex_input = pass.vertex_input != PipelinePass::k_no_index ?
+                                                  &blueprint->vertex_inputs[ pass.vertex_input ] : nullptr;
+
+        u64 key = hash_calculate( shader->shader );
+        if ( !compute ) {
+            key = hash_render_state( render_state, key );
+            if ( vertex_input ) {
+                key = hash_bytes( ( void* )vertex_input->streams.get(), sizeof( VertexStream ) * vertex_input->streams.size, key );
+                key = hash_bytes( ( void* )vertex_input->attributes.get(), sizeof( VertexAttribute ) * vertex_input->attributes.size, key );
+            }
+            key = hash_bytes( asset->color_formats, sizeof( TextureFormat::Enum ) * asset->num_color_formats, key );
+            key = hash_calculate( asset->depth_format, key );
+        }
+
+        FlatHashMapIterator it = shared_pipelines.find( key );
+        if ( it.is_valid() ) {
+            SharedPipeline& shared_pipeline = shared_pipelines.get( it );
+            ++shared_pipeline.reference_count;
+
+            asset->pipelines[ p ] = shared_pipeline.pipeline;
+            asset->pipeline_keys[ p ] = key;
+            continue;
+        }
+
+        PipelineHandle pipeline;
+        if ( compute ) {
+            pipeline = gpu_device->create_compute_pipeline( {
+                .shader = shader->shader,
+                .debug_name = pass.shader_name.c_str() } );
+        } else {
+            // A single blend state in the effect, for every output.
+            BlendState blend_states[ k_max_image_outputs ];
+            const u32 num_blend_states = render_state.blend.blend_disabled ? 0 : asset->num_color_formats;
+            for ( u32 i = 0; i < num_blend_states; ++i ) {
+                blend_states[ i ] = render_state.blend;
+            }
+
+            VertexInputCreation vertex_input_creation;
+            if ( vertex_input ) {
+                vertex_input_creation.vertex_streams = { vertex_input->streams.get(), vertex_input->streams.size };
+                vertex_input_creation.vertex_attributes = { vertex_input->attributes.get(), vertex_input->attributes.size };
+            }
+
+            pipeline = gpu_device->create_graphics_pipeline( {
+                .rasterization = render_state.rasterization,
+                .depth_stencil = render_state.depth_stencil,
+                .blend_state = {.blend_states = { blend_states, num_blend_states } },
+                .vertex_input = vertex_input_creation,
+                .shader = shader->shader,
+                .color_formats = { asset->color_formats, asset->num_color_formats },
+                .depth_format = asset->depth_format,
+                .debug_name = pass.shader_name.c_str() } );
+        }
+
+        if ( pipeline.is_invalid() ) {
+            ilog_error( "Error creating pipeline for pass %s of %s\n", pass.name.c_str(), blueprint->name.c_str() );
+            continue;
+        }
+
+        shared_pipelines.insert( key, { pipeline, 1 } );
+        asset->pipelines[ p ] = pipeline;
+        asset->pipeline_keys[ p ] = key;
+    }
+}
+
+void PipelineAssetLoader::destroy_pipelines( PipelineAsset* asset ) {
+    for ( u32 p = 0; p < asset->num_passes; ++p ) {
+        if ( asset->pipelines[ p ].is_invalid() ) {
+            continue;
+        }
+
+        FlatHashMapIterator it = shared_pipelines.find( asset->pipeline_keys[ p ] );
+        iassert( it.is_valid() );
 
+        SharedPipeline& shared_pipeline = shared_pipelines.get( it );
+        if ( --shared_pipeline.reference_count == 0 ) {
+            gpu_device->destroy_pipeline( shared_pipeline.pipeline );
+            shared_pipelines.remove( it );
+        }
+
+        asset->pipelines[ p ] = PipelineHandle{};
+    }
+}
 
 } // namespace idra
\ No newline at end of file
@@ -8,13 +8,21 @@
 #include "kernel/asset.hpp"
 #include "kernel/string.hpp"
 #include "kernel/array.hpp"
+#include "kernel/hash_map.hpp"
 
 #include "gpu/gpu_resources.hpp"
 
+#include "tools/shader_compiler/shader_compiler.hpp"
+
+#include <future>
+#include <vector>
+
 namespace idra {
 
 struct AtlasBlueprint;
 struct GpuDevice;
+struct PipelineBlueprint;
+struct ShaderPackBlueprint;
 struct SpriteAnimationBlueprint;
 struct TextureBlueprint;
 
@@ -22,8 +30,8 @@ struct TextureBlueprint;
 //
 struct ShaderAssetCreation {
 
-    cstring             defines[ 8 ];
-    cstring             includes[ 8 ];
+    StringView          defines[ 16 ];      // One per permutation option at most.
+    StringView          includes[ 8 ];
 
     u32                 num_defines = 0;
     u32                 num_includes = 0;
@@ -46,9 +54,67 @@ struct ShaderAsset : public Asset {
     // Reloading informations
     u32                 creation_index;
     u32                 creation_count;
+    u32                 dependency_index;
+    u32                 dependency_count;
 
 }; // struct ShaderAsset
 
+//
+// File read to compile a shader, with the content hash it was compiled with.
+struct ShaderAssetDependency {
+
+    StringView          path;
+    u64                 content_hash;
+
+}; // struct ShaderAssetDependency
+
+//
+// Option axis of a shader with permutations. Bool options have no values and
+// define their name when set, enum options define the selected value.
+struct ShaderOption {
+
+    StringView          name;
+    Span<const StringView> values;
+
+}; // struct ShaderOption
+
+//
+// A shader compiled with different combinations of options.
+// Each option takes the bits needed for its values, the key of a variant is the
+// union of them. Variants are compiled the first time they are requested, on a
+// background thread, and the variant with key 0 is returned until they are ready.
+struct ShaderPermutations {
+
+    static constexpr u32 k_max_options  = 16;
+    static constexpr u32 k_max_values   = 64;   // Enum values of all the options.
+
+    // Value is the index of the enum value, 0 or 1 for bool options.
+    u64                 set_option( u64 key, u32 option_index, u32 value ) const;
+    u32                 get_option( u64 key, u32 option_index ) const;
+
+    StringView          name;
+    StringView          paths[ 2 ];             // Vertex and fragment, or compute.
+    StringView          includes[ 8 ];
+    StringView          option_names[ k_max_options ];
+    StringView          option_values[ k_max_values ];
+
+    u8                  option_first_value[ k_max_options ];
+    u8                  option_num_values[ k_max_options ];     // 0 for bool options.
+    u8                  option_bit_offset[ k_max_options ];
+    u8                  option_bit_count[ k_max_options ];
+
+    u32                 num_includes;
+    u32                 num_options;
+    u32                 num_values;
+    ShaderStage::Enum   stage;                  // Vertex for graphics shaders.
+
+    u64                 layout_hash;            // Recorded keys are valid only with the same options.
+
+    FlatHashMap<u64, ShaderAsset*> variants;    // Owned, one reference each.
+    ShaderAsset*        fallback;
+
+}; // struct ShaderPermutations
+
 //
 //
 struct TextureAsset : public Asset {
@@ -105,6 +171,32 @@ struct FontAsset : public Asset {
 }; // struct FontAsset
 
 
+//
+// Pipelines of the passes of a compiled effect, indexed like the blueprint passes.
+// Pipelines are shared with other passes and effects with the same shader,
+// states and outputs.
+struct PipelineAsset : public Asset {
+
+    static constexpr u32 k_max_passes = 16;
+
+    // Invalid handle if the effect has no pass with that name or it failed.
+    PipelineHandle      get_pipeline( StringView pass_name ) const;
+
+    PipelineBlueprint*  blueprint;
+    char*               blueprint_memory;
+
+    ShaderAsset*        shaders[ k_max_passes ];
+    PipelineHandle      pipelines[ k_max_passes ];
+    u64                 pipeline_keys[ k_max_passes ];  // Into PipelineAssetLoader::shared_pipelines.
+    u32                 num_passes;
+
+    // Outputs of the graphics passes.
+    TextureFormat::Enum color_formats[ k_max_image_outputs ];
+    TextureFormat::Enum depth_format;
+    u32                 num_color_formats;
+
+}; // struct PipelineAsset
+
 //
 //
 struct ShaderAssetLoader : public AssetLoader<ShaderAsset> {
@@ -127,21 +219,123 @@ struct ShaderAssetLoader : public AssetLoader<ShaderAsset> {
 
 
     ShaderAsset*        load( StringView path );
+    ShaderAsset*        load( StringId name_id );
     void                unload( StringView path );
+    void                unload( StringId name_id );
     void                unload( ShaderAsset* shader );
 
+    // Recompile only shaders with a source or include changed since their last compilation.
     void                reload_assets();
 
+    // Compilations between begin and end batch are deferred and run in parallel
+    // in end_batch, the shader handles of the returned assets are valid after it.
+    void                begin_batch();
+    void                end_batch();
+
     // Cache per shader creation info, returns index into array.
     u32                 cache_creation_info( Span<const StringView> defines,
                                              Span<const StringView> include_paths,
                                              StringView path, ShaderStage::Enum stage,
                                              StringView name );
 
+    // Permutations, the fallback and the variants recorded in the used variants
+    // list are compiled before returning. Returns nullptr if the fallback fails.
+    ShaderPermutations* declare_graphics_permutations( Span<const ShaderOption> options,
+                                                       Span<const StringView> includes,
+                                                       StringView vertex_path,
+                                                       StringView fragment_path,
+                                                       StringView name );
+
+    ShaderPermutations* declare_compute_permutations( Span<const ShaderOption> options,
+                                                      Span<const StringView> includes,
+                                                      StringView path,
+                                                      StringView name );
+
+    void                destroy_permutations( ShaderPermutations* permutations );
+
+    // Shader state of the variant, or of the fallback while it compiles or if it failed.
+    // The returned handle changes when the variant is ready.
+    ShaderStateHandle   get_variant( ShaderPermutations* permutations, u64 key );
+
+    // Once per frame, substitutes the variants compiled in the background and
+    // starts compiling the ones requested since the last call.
+    void                update();
+    void                wait_variant_compilation();
+
+    // Keys requested in a previous run, saved at shutdown to the same path.
+    void                load_used_variants( StringView path );
+    void                save_used_variants();
+
+    // Shaders built offline by shader_compiler_cli. Shaders found in the pack
+    // are created without compiling, the others are compiled as usual.
+    // Returns false if the pack is missing or invalid.
+    bool                load_shader_pack( StringView path );
+    void                unload_shader_pack();
+
+    // New asset with its creation infos, compiled by the caller.
+    ShaderAsset*        create_shader_asset( Span<const StringView> defines,
+                                             Span<const StringView> includes,
+                                             Span<const StringView> paths,
+                                             ShaderStage::Enum stage,
+                                             StringView name, StringId name_id );
+    void                destroy_shader_asset( ShaderAsset* shader );
+
+    ShaderPermutations* declare_permutations( Span<const ShaderOption> options,
+                                              Span<const StringView> includes,
+                                              Span<const StringView> paths,
+                                              ShaderStage::Enum stage,
+                                              StringView name );
+    ShaderAsset*        create_variant( ShaderPermutations* permutations, u64 key );
+
+    // Compilations of a group of shaders. Creations are copied, so the job can
+    // run on another thread while new creations are cached.
+    struct CompilationJob {
+        std::vector<ShaderAssetCreation>        creations;
+        std::vector<ShaderCompilationInfo>      infos;
+        std::vector<std::vector<unsigned int>>  spirv;
+        std::vector<std::vector<ShaderFileDependency>> dependencies;
+    }; // struct CompilationJob
+
+    // Compile all stages of the shaders in parallel and substitute their shader
+    // states. Shaders that fail compilation keep the previous state.
+    void                compile_shader_states( Span<ShaderAsset*> shaders );
+    // Create the shaders without a state from the pack. Shaders still to compile
+    // are moved at the start of the span, returns their count.
+    u32                 create_from_shader_pack( Span<ShaderAsset*> shaders );
+    void                prepare_compilation( Span<ShaderAsset*> shaders, CompilationJob& job );
+    void                finish_compilation( Span<ShaderAsset*> shaders, CompilationJob& job );
+    void                update_dependencies( ShaderAsset* shader, Span<std::vector<ShaderFileDependency>> stage_dependencies );
+    bool                dependencies_changed( const ShaderAsset* shader ) const;
+
     GpuDevice*          gpu_device = nullptr;
+    Allocator*          allocator = nullptr;
 
-    StringArray         string_array;   // Used to cache strings and create views.
+    StringInterner      strings;        // Defines, includes and paths shared between creations.
     Array<ShaderAssetCreation> shader_creations;
+    Array<ShaderAssetDependency> shader_dependencies;
+
+    Array<ShaderAsset*> batch_shaders;
+    bool                batching = false;
+
+    ShaderPackBlueprint* shader_pack = nullptr;
+    char*               shader_pack_memory = nullptr;
+
+    // Permutations ///////////////////////////////////////////////////////
+    struct UsedVariant {
+        StringView      name;
+        u64             name_hash;
+        u64             layout_hash;
+        u64             key;
+    }; // struct UsedVariant
+
+    Array<ShaderPermutations*> permutations;
+    Array<UsedVariant>  used_variants;      // Loaded from the previous run.
+    StringView          used_variants_path;
+
+    Array<ShaderAsset*> requested_variants; // Compiled by the next job.
+    Array<ShaderAsset*> compiling_variants;
+    CompilationJob      variant_job;
+    std::future<void>   variant_job_done;
 
 }; // struct ShaderAssetLoader
 
@@ -155,7 +349,9 @@ struct TextureAssetLoader : public AssetLoader<TextureAsset> {
     void                shutdown() override;
 
     TextureAsset*       load( StringView path );
+    TextureAsset*       load( StringId path_id, StringView path );   // Id can be built at compile time, see string_id.hpp.
     void                unload( StringView path );
+    void                unload( StringId path_id );
     void                unload( TextureAsset* texture );
 
     GpuDevice*          gpu_device = nullptr;
@@ -173,7 +369,9 @@ struct TextureAtlasLoader : public AssetLoader<AtlasAsset> {
     void                shutdown() override;
 
     AtlasAsset*         load( StringView path );
+    AtlasAsset*         load( StringId path_id, StringView path );
     void                unload( StringView path );
+    void                unload( StringId path_id );
     void                unload( AtlasAsset* atlas );
 
     GpuDevice*          gpu_device  = nullptr;
@@ -191,7 +389,9 @@ struct SpriteAnimationAssetLoader : public AssetLoader<SpriteAnimationAsset> {
     void                shutdown() override;
 
     SpriteAnimationAsset* load( StringView path );
+    SpriteAnimationAsset* load( StringId path_id, StringView path );
     void                unload( StringView path );
+    void                unload( StringId path_id );
     void                unload( SpriteAnimationAsset* asset );
 
     Allocator*          allocator;
@@ -209,7 +409,9 @@ struct FontAssetLoader : public AssetLoader<FontAsset> {
     void                shutdown() override;
 
     FontAsset*          load( StringView path );
+    FontAsset*          load( StringId path_id, StringView path );
     void                unload( StringView path );
+    void                unload( StringId path_id );
     void                unload( FontAsset* font );
 
     GpuDevice*          gpu_device;
@@ -217,4 +419,40 @@ struct FontAssetLoader : public AssetLoader<FontAsset> {
 
 }; // struct FontAssetLoader
 
+//
+// Creates all the pipelines of an effect (.bhfx) in one call. Shaders come from
+// the shader pack when it has them, descriptor set layouts are derived from
+// their reflection and shared by the device.
+struct PipelineAssetLoader : public AssetLoader<PipelineAsset> {
+
+    static constexpr u32 k_loader_index = 5;
+
+    void                init( Allocator* allocator, u32 size, AssetManager* asset_manager, GpuDevice* gpu_device );
+    void                shutdown() override;
+
+    // Output is used only the first time the path is loaded.
+    PipelineAsset*      load( StringView path, const RenderPassOutput& output );
+    PipelineAsset*      load( StringId path_id, StringView path, const RenderPassOutput& output );
+    void                unload( StringView path );
+    void                unload( StringId path_id );
+    void                unload( PipelineAsset* asset );
+
+    // Recreate the pipelines with the current shader states, after a shader reload.
+    void                reload_pipelines( PipelineAsset* asset );
+
+    void                create_pipelines( PipelineAsset* asset );
+    void                destroy_pipelines( PipelineAsset* asset );
+
+    struct SharedPipeline {
+        PipelineHandle  pipeline;
+        u32             reference_count;
+    }; // struct SharedPipeline
+
+    FlatHashMap<u64, SharedPipeline> shared_pipelines;  // Keyed by the hash of shader, states and outputs.
+
+    GpuDevice*          gpu_device  = nullptr;
+    Allocator*          allocator   = nullptr;
+
+}; // struct PipelineAssetLoader
+
 } // namespace idra
\ No newline at end of file
@@ -2,80 +2,52 @@
 
 namespace idra {
 
-// Serializer specializations /////////////////////////////////////////////
-#if defined ( IDRA_USE_COMPRESSED_TEXTURES )
-
-template<>
-void BlobReader::serialize<TextureBlueprint>( TextureBlueprint* data ) {
-    iassert( false ); // TODO: lazy
-}
-
-#endif // IDRA_USE_COMPRESSED_TEXTURES
-
-template<>
-void BlobReader::serialize<SpriteAnimationCreation>( SpriteAnimationCreation* data ) {
-
-    // TODO:
-    //serialize( &data->frame_table_{});
-    data->frame_table_ = {};
-    blob_read_offset += sizeof( Span<u16> );
-
-    serialize( &data->texture_width );
-    serialize( &data->texture_height );
-    serialize( &data->offset_x );
-    serialize( &data->offset_y );
-    serialize( &data->frame_width );
-    serialize( &data->frame_height );
-    serialize( &data->num_frames );
-    serialize( &data->columns );
-    serialize( &data->fps );
-    serialize( &data->looping );
-    serialize( &data->invert );
-}
-
-template<>
-void BlobReader::serialize<SpriteAnimationBlueprint>( SpriteAnimationBlueprint* data ) {
-    serialize( &data->animations );
-}
-
-
 // Atlas blueprints ///////////////////////////////////////////////////////
-template<>
-void BlobReader::serialize<AtlasEntry>( AtlasEntry* data ) {
-    serialize( &data->uv_offset_x );
-    serialize( &data->uv_offset_y );
-    serialize( &data->uv_width );
-    serialize( &data->uv_height );
-}
-
-template<>
-void BlobReader::serialize<AtlasBlueprint>( AtlasBlueprint* data ) {
-    serialize( &data->entries );
-    serialize( &data->entry_names );
-    serialize( &data->texture_name );
+const AtlasEntry* AtlasBlueprint::find_entry( StringView name ) const {
+    const u32* index = entry_name_to_index.get( name );
+    return index ? &entries[ *index ] : nullptr;
 }
 
 // UI blueprint ///////////////////////////////////////////////////////////
-template<>
-void BlobReader::serialize<UITextFrameEntry>( UITextFrameEntry* data ) {
-    serialize( &data->uv_offset_x );
-    serialize( &data->uv_offset_y );
-    serialize( &data->uv_width );
-    serialize( &data->uv_height );
-    serialize( &data->position_offset_x );
-    serialize( &data->position_offset_y );
+const UITextFrameEntry* UIBlueprint::find_entry( StringView name ) const {
+    const u32* index = entry_name_to_index.get( name );
+    return index && *index < TextFrameElements::Count ? &text_frame_elements[ *index ] : nullptr;
 }
 
-template<>
-void BlobReader::serialize<UIBlueprint>( UIBlueprint* data ) {
+// Shader pack blueprint //////////////////////////////////////////////////
+const ShaderPackProgram* ShaderPackBlueprint::find_program( u64 key ) const {
+    const u32* index = key_to_program.get_hashed( key );
+    return index && programs[ *index ].key == key ? &programs[ *index ] : nullptr;
+}
 
-    for ( u32 i = 0; i < UIBlueprint::TextFrameElements::Count; ++i ) {
-        serialize( &data->text_frame_elements[ i ] );
+u64 ShaderPackBlueprint::calculate_key( Span<const StringView> defines, Span<const StringView> includes,
+                                        Span<const StringView> paths, ShaderStage::Enum stage ) {
+    // Counts are hashed too, so that moving a string between lists changes the key.
+    u64 key = hash_calculate( stage );
+    key = hash_calculate( ( u64 )defines.size, key );
+    for ( sizet i = 0; i < defines.size; ++i ) {
+        key = hash_calculate( defines[ i ], key );
     }
-    
-    serialize( &data->entry_names );
-    serialize( &data->texture_name );
+    key = hash_calculate( ( u64 )includes.size, key );
+    for ( sizet i = 0; i < includes.size; ++i ) {
+        key = hash_calculate( includes[ i ], key );
+    }
+    for ( sizet i = 0; i < paths.size; ++i ) {
+        key = hash_calculate( paths[ i ], key );
+    }
+    return key;
 }
 
+// Pipeline blueprint /////////////////////////////////////////////////////
+u32 PipelineBlueprint::find_pass( StringView pass_name ) const {
+    // Effects have a handful of passes, a linear search is enough.
+    for ( u32 i = 0; i < passes.size; ++i ) {
+        if ( passes[ i ].name.size == pass_name.size &&
+             memcmp( passes[ i ].name.c_str(), pass_name.data, pass_name.size ) == 0 ) {
+            return i;
+        }
+    }
+    return PipelinePass::k_no_index;
+}
 
-} // namespace idra
\ No newline at end of file
+} // namespace idra
@@ -9,6 +9,7 @@
 #include "kernel/file.hpp"
 
 #include "gpu/gpu_resources.hpp"
+#include "gpu/spirv_parser.hpp"
 
 #include "graphics/sprite_animation.hpp"
 
@@ -34,8 +35,13 @@ struct TextureBlueprint : public Blob {
 
 }; // struct TextureBlueprint
 
-template<>
-void BlobReader::serialize<TextureBlueprint>( TextureBlueprint* data );
+IDRA_BLOB_SCHEMA_BEGIN( TextureBlueprint )
+    IDRA_BLOB_FIELD( source_last_write_time, 0 )
+    IDRA_BLOB_FIELD( source_last_size, 0 )
+    IDRA_BLOB_FIELD( gpu_creation, 0 )
+    IDRA_BLOB_FIELD( name, 0 )
+    IDRA_BLOB_FIELD( texture_data, 0 )
+IDRA_BLOB_SCHEMA_END()
 
 #endif // IDRA_USE_COMPRESSED_TEXTURES
 
@@ -48,12 +54,9 @@ struct SpriteAnimationBlueprint : public Blob {
     RelativeArray<SpriteAnimationCreation> animations;
 }; // struct SpriteAnimationBlueprint
 
-
-template<>
-void BlobReader::serialize<SpriteAnimationCreation>( SpriteAnimationCreation* data );
-
-template<>
-void BlobReader::serialize<SpriteAnimationBlueprint>( SpriteAnimationBlueprint* data );
+IDRA_BLOB_SCHEMA_BEGIN( SpriteAnimationBlueprint )
+    IDRA_BLOB_FIELD( animations, 0 )
+IDRA_BLOB_SCHEMA_END()
 
 
 // Atlas blueprints ///////////////////////////////////////////////////////
@@ -66,20 +69,24 @@ struct AtlasEntry {
 
 struct AtlasBlueprint : public Blob {
 
+    // Returns nullptr if no entry has the given name.
+    const AtlasEntry*               find_entry( StringView name ) const;
+
     RelativeArray<AtlasEntry>       entries;
     RelativeArray<RelativeString>   entry_names;
     RelativeString                  texture_name;
+    RelativeFlatHashMap<StringView, u32> entry_name_to_index;
 
-    static constexpr u32            k_version = 0;
+    static constexpr u32            k_version = 1;
 
 }; // struct AtlasBlueprint
 
-
-template<>
-void BlobReader::serialize<AtlasEntry>( AtlasEntry* data );
-
-template<>
-void BlobReader::serialize<AtlasBlueprint>( AtlasBlueprint* data );
+IDRA_BLOB_SCHEMA_BEGIN( AtlasBlueprint )
+    IDRA_BLOB_FIELD( entries, 0 )
+    IDRA_BLOB_FIELD( entry_names, 0 )
+    IDRA_BLOB_FIELD( texture_name, 0 )
+    IDRA_BLOB_FIELD( entry_name_to_index, 1 )
+IDRA_BLOB_SCHEMA_END()
 
 
 // UI blueprint ///////////////////////////////////////////////////////////
@@ -114,19 +121,141 @@ struct UIBlueprint : public Blob {
         Count
     };
 
+    // Returns nullptr if no entry has the given name.
+    const UITextFrameEntry*         find_entry( StringView name ) const;
+
     UITextFrameEntry                text_frame_elements[ TextFrameElements::Count ];
     RelativeArray<RelativeString>   entry_names;
     RelativeString                  texture_name;
+    RelativeFlatHashMap<StringView, u32> entry_name_to_index;
 
-    static constexpr u32            k_version = 0;
+    static constexpr u32            k_version = 1;
 
 }; // struct UIBlueprint
 
+IDRA_BLOB_SCHEMA_BEGIN( UIBlueprint )
+    IDRA_BLOB_FIELD( text_frame_elements, 0 )
+    IDRA_BLOB_FIELD( entry_names, 0 )
+    IDRA_BLOB_FIELD( texture_name, 0 )
+    IDRA_BLOB_FIELD( entry_name_to_index, 1 )
+IDRA_BLOB_SCHEMA_END()
+
+// Shader pack blueprint //////////////////////////////////////////////////
+
+//
+// File read to compile a program, to recompile it when it changes.
+struct ShaderPackDependency {
+
+    RelativeString                  path;           // Relative to the shader folder.
+    u64                             content_hash;
+
+}; // struct ShaderPackDependency
+
+//
+// Compiled stages of a shader, a graphics program has vertex and fragment.
+struct ShaderPackProgram {
+
+    u64                             key;            // ShaderPackBlueprint::calculate_key of its creation.
+    RelativeString                  name;
+    ShaderStage::Enum               stage;          // Vertex for graphics programs.
+    u32                             num_stages;
+
+    RelativeArray<u32>              spirv[ 2 ];     // Size in words.
+    RelativeArray<spirv::ParseResult> reflection;   // Empty if the SPIR-V could not be reflected.
+    RelativeArray<ShaderPackDependency> dependencies;
+
+}; // struct ShaderPackProgram
+
+//
+// All the programs and permutations of a project compiled offline by
+// shader_compiler_cli, so that they are loaded without compiling.
+// Reflection is stored as it is, bump the version when spirv::ParseResult changes.
+struct ShaderPackBlueprint : public Blob {
+
+    // Returns nullptr if the program was not compiled in the pack.
+    const ShaderPackProgram*        find_program( u64 key ) const;
+
+    // Defines, includes and paths as passed to the ShaderAssetLoader, stage is
+    // Vertex for graphics programs.
+    static u64                      calculate_key( Span<const StringView> defines, Span<const StringView> includes,
+                                                   Span<const StringView> paths, ShaderStage::Enum stage );
+
+    RelativeArray<ShaderPackProgram> programs;
+    RelativeFlatHashMap<u64, u32>   key_to_program;
+
+    static constexpr u32            k_version = 0;
+
+}; // struct ShaderPackBlueprint
+
+IDRA_BLOB_SCHEMA_BEGIN( ShaderPackBlueprint )
+    IDRA_BLOB_FIELD( programs, 0 )
+    IDRA_BLOB_FIELD( key_to_program, 0 )
+IDRA_BLOB_SCHEMA_END()
+
+// Pipeline blueprint /////////////////////////////////////////////////////
+
+//
+// Fixed function states of a 'state' block, blend applies to all color outputs.
+struct PipelineRenderState {
+
+    RasterizationCreation           rasterization;
+    DepthStencilCreation            depth_stencil;
+    BlendState                      blend;
+
+}; // struct PipelineRenderState
+
+//
+//
+struct PipelineVertexInput {
+
+    RelativeArray<VertexStream>     streams;
+    RelativeArray<VertexAttribute>  attributes;
+
+}; // struct PipelineVertexInput
+
+//
+// Stages are sources generated from the effect glsl blocks. They are compiled,
+// or found in the shader pack, with no defines and includes, so program_key is
+// the ShaderPackBlueprint key of the pass. Layouts are not stored: pipelines
+// derive them from the reflection of the stages.
+struct PipelinePass {
+
+    static constexpr u32            k_no_index = u32_max;
+
+    RelativeString                  name;
+    RelativeString                  shader_name;    // Unique between effects.
+    RelativeString                  paths[ 2 ];     // Vertex and fragment, or compute. Relative to the shader folder.
+
+    u64                             program_key;
+    ShaderStage::Enum               stage;          // Vertex for graphics passes.
+
+    u32                             render_state;   // Index into PipelineBlueprint::render_states, or k_no_index.
+    u32                             vertex_input;   // Index into PipelineBlueprint::vertex_inputs, or k_no_index.
+    u16                             dispatch_size[ 3 ];
+
+}; // struct PipelinePass
+
+//
+// Passes of an effect (.hfx) compiled by the asset compiler.
+struct PipelineBlueprint : public Blob {
+
+    // Returns PipelinePass::k_no_index if no pass has the given name.
+    u32                             find_pass( StringView name ) const;
+
+    RelativeString                  name;
+    RelativeArray<PipelinePass>     passes;
+    RelativeArray<PipelineRenderState> render_states;
+    RelativeArray<PipelineVertexInput> vertex_inputs;
+
+    static constexpr u32            k_version = 0;
 
-template<>
-void BlobReader::serialize<UITextFrameEntry>( UITextFrameEntry* data );
+}; // struct PipelineBlueprint
 
-template<>
-void BlobReader::serialize<UIBlueprint>( UIBlueprint* data );
+IDRA_BLOB_SCHEMA_BEGIN( PipelineBlueprint )
+    IDRA_BLOB_FIELD( name, 0 )
+    IDRA_BLOB_FIELD( passes, 0 )
+    IDRA_BLOB_FIELD( render_states, 0 )
+    IDRA_BLOB_FIELD( vertex_inputs, 0 )
+IDRA_BLOB_SCHEMA_END()
 
 } // namespace idra
\ No newline at end of file
@@ -17,6 +17,7 @@ void SpriteBatch::init( GpuDevice* gpu_device_, Allocator* allocator ) {
     gpu_device = gpu_device_;
 
     draw_batches.init( allocator, 8 );
+    draw_stream.init( allocator, 64 );
 
     sprite_instance_vb = gpu_device->create_buffer( {
         .type = BufferUsage::Vertex_mask, .usage = ResourceUsageType::Dynamic,
@@ -31,6 +32,7 @@ void SpriteBatch::shutdown() {
     gpu_device->destroy_buffer( sprite_instance_vb );
 
     draw_batches.shutdown();
+    draw_stream.shutdown();
 }
 
 void SpriteBatch::begin() {
@@ -113,18 +115,23 @@ void SpriteBatch::draw( CommandBuffer* cb, Camera* camera, u32 phase ) {
         cb_data->disable_non_uniform_ext = 0;
     }
 
+    draw_stream.reset();
+    draw_stream.set_vertex_buffer( sprite_instance_vb, 0 );
+    draw_stream.set_dynamic_offsets( { dynamic_buffer_offset } );
+
     const u32 batches_count = draw_batches.size;
     for ( u32 i = 0; i < batches_count; ++i ) {
 
         DrawBatch& batch = draw_batches[ i ];
         if ( batch.count ) {
-            cb->bind_vertex_buffer( sprite_instance_vb, 0, 0 );
-            cb->bind_pipeline( batch.pipeline );
-            cb->bind_descriptor_set( { cb->gpu_device->bindless_descriptor_set, batch.resource_list }, { dynamic_buffer_offset } );
-            cb->draw( TopologyType::Triangle, 0, 6, batch.offset, batch.count);
+            draw_stream.set_pipeline( batch.pipeline );
+            draw_stream.set_descriptor_sets( { gpu_device->bindless_descriptor_set, batch.resource_list } );
+            draw_stream.draw( 0, 6, batch.offset, batch.count );
         }
     }
 
+    cb->draw_stream( draw_stream );
+
     draw_batches.set_size( 0 );
 
     // Reset drawing
@@ -2,6 +2,7 @@
 
 #include "kernel/array.hpp"
 
+#include "gpu/draw_stream.hpp"
 #include "gpu/gpu_resources.hpp"
 
 #include "cglm/struct/vec2.h"
@@ -75,6 +76,7 @@ struct SpriteBatch {
     void                            draw( CommandBuffer* cb, Camera* camera, u32 phase );
 
     Array<DrawBatch>                draw_batches;
+    DrawStream                      draw_stream;
 
     GpuDevice*                      gpu_device;
     BufferHandle                    sprite_instance_vb;
@@ -4,7 +4,6 @@
 namespace idra {
 
 static AssetManager s_asset_manager;
-static constexpr u32 k_max_path = 64;
 
 AssetManager* AssetManager::init_system() {
 
@@ -12,7 +11,7 @@ AssetManager* AssetManager::init_system() {
         s_asset_manager.loaders[ i ] = nullptr;
     }
 
-    s_asset_manager.path_string_pool.init( g_memory->get_resident_allocator(), 128, k_max_path );
+    s_asset_manager.path_interner.init( g_memory->get_resident_allocator(), 128 );
 
     return &s_asset_manager;
 }
@@ -27,7 +26,7 @@ void AssetManager::shutdown_system( AssetManager* instance ) {
         }
     }
 
-    s_asset_manager.path_string_pool.shutdown();
+    s_asset_manager.path_interner.shutdown();
 }
 
 void AssetManager::set_loader( u32 index, AssetLoaderBase* loader ) {
@@ -42,23 +41,17 @@ void AssetManager::set_loader( u32 index, AssetLoaderBase* loader ) {
 AssetPath AssetManager::allocate_path( StringView path ) {
 
     AssetPath asset_path;
-
-    // TODO: max 64 characters for now.
-    iassert( path.size < k_max_path );
-    // Allocate a string
-    asset_path.pool_index = path_string_pool.obtain_resource();
-    void* string_data = path_string_pool.access_resource( asset_path.pool_index );
-    memcpy( string_data, path.data, path.size );
-    // Update the path
-    asset_path.path.data = ( cstring )string_data;
-    asset_path.path.size = path.size;
+    asset_path.id = path_interner.intern( path );
+    asset_path.path = path_interner.get( asset_path.id );
 
     return asset_path;
 }
 
 void AssetManager::free_path( AssetPath& path ) {
 
-    path_string_pool.release_resource( path.pool_index );
+    // Interned storage is shared and kept until shutdown, reloads get the same id back.
+    path.path = { nullptr, 0 };
+    path.id = StringInterner::k_invalid_id;
 }
 
 
@@ -7,6 +7,7 @@
 
 #include "kernel/pool.hpp"
 #include "kernel/hash_map.hpp"
+#include "kernel/string_interner.hpp"
 
 namespace idra {
 
@@ -35,7 +36,7 @@ namespace AssetDestructionPhase {
 //
 struct AssetPath {
     StringView      path;
-    u16             pool_index;
+    u32             id;             // Id in AssetManager::path_interner.
 }; // struct AssetPath
 
 //
@@ -48,6 +49,7 @@ struct Asset {
     u16             pool_index;
 
     AssetPath       path;
+    StringId        path_id;        // Key into AssetLoader::path_to_asset.
 }; // struct Asset
 
 
@@ -64,6 +66,9 @@ struct AssetLoader : public AssetLoaderBase {
     void                    init( Allocator* allocator, u32 size, AssetManager* asset_manager );
     void                    shutdown();
 
+    // Returns an already loaded asset adding a reference, nullptr otherwise.
+    T*                      acquire( StringId path_id );
+
     ResourcePoolTyped<T>    assets;
     FlatHashMap<u64, T*>    path_to_asset;
     AssetManager*           asset_manager;
@@ -81,11 +86,12 @@ struct AssetManager {
     template <typename T>
     T*                      get_loader();
 
-    // Allocate a path inside the 
+    // Paths are interned: the same path always gets the same storage and id,
+    // and it stays valid until shutdown. Thread safe.
     AssetPath               allocate_path( StringView path );
     void                    free_path( AssetPath& path );
 
-    ResourcePool            path_string_pool;
+    StringInterner          path_interner;
 
     AssetLoaderBase*        loaders[ 32 ];
 
@@ -110,6 +116,16 @@ inline void AssetLoader<T>::shutdown() {
     path_to_asset.shutdown();
 }
 
+template<typename T>
+inline T* AssetLoader<T>::acquire( StringId path_id ) {
+    T* asset = path_to_asset.get( path_id );
+
+    if ( asset ) {
+        asset->reference_count++;
+    }
+    return asset;
+}
+
 // AssetManager ///////////////////////////////////////////////////////////
 
 
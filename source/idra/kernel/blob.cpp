@@ -1,24 +1,102 @@
 
 #include "kernel/blob.hpp"
+#include "kernel/hash_map.hpp"
 
 namespace idra {
 
+u32 blob_calculate_checksum( Span<char> blob_memory ) {
+    if ( blob_memory.size <= sizeof( BlobHeader ) ) {
+        return 0;
+    }
+
+    const u64 hash = hash_bytes( blob_memory.data + sizeof( BlobHeader ), blob_memory.size - sizeof( BlobHeader ) );
+    // Fold the hash and avoid 0, that means no checksum.
+    const u32 checksum = ( u32 )( hash ^ ( hash >> 32 ) );
+    return checksum ? checksum : 1;
+}
+
+bool blob_validate( Span<char> blob_memory ) {
+    if ( blob_memory.size < sizeof( BlobHeader ) ) {
+        return false;
+    }
+
+    const BlobHeader* header = ( const BlobHeader* )blob_memory.data;
+    if ( header->size > blob_memory.size ) {
+        ilog_error( "Blob truncated: header size %u, memory size %llu\n", header->size, blob_memory.size );
+        return false;
+    }
+
+    if ( header->checksum ) {
+        const u32 checksum = blob_calculate_checksum( Span<char>( blob_memory.data, header->size ) );
+        if ( checksum != header->checksum ) {
+            ilog_error( "Blob checksum mismatch: %u, expected %u\n", checksum, header->checksum );
+            return false;
+        }
+    }
+
+    return true;
+}
+
 // BlobWriter /////////////////////////////////////////////////////////////
-char* BlobWriter::reserve( sizet size ) {
-    if ( reserved_offset + size > total_size ) {
-        ilog_debug( "Blob allocation error: reserved, requested, total - %u + %u > %u\n", reserved_offset, size, total_size );
-        return nullptr;
+void BlobWriter::shutdown() {
+    if ( blob_destination_memory ) {
+        ifree( blob_destination_memory, allocator );
     }
 
-    u32 offset = reserved_offset;
-    reserved_offset += ( u32 )size;
+    blob_destination_memory = nullptr;
+    total_size = write_offset = reserved_offset = 0;
+}
+
+Span<char> BlobWriter::finalize( bool calculate_checksum ) {
+    BlobHeader* header = ( BlobHeader* )blob_destination_memory;
+    header->size = reserved_offset;
+    header->checksum = calculate_checksum ? blob_calculate_checksum( Span<char>( blob_destination_memory, reserved_offset ) ) : 0;
+
+    return Span<char>( blob_destination_memory, reserved_offset );
+}
+
+char* BlobWriter::reserve( sizet size, sizet alignment ) {
+    const u32 offset = ( u32 )mem_align( reserved_offset, alignment );
+
+    if ( offset + size > total_size ) {
+        grow( offset + size );
+    }
+
+    reserved_offset = offset + ( u32 )size;
 
     return blob_destination_memory + offset;
 }
 
+void BlobWriter::grow( sizet required_size ) {
+    // Double the size to amortize copies.
+    sizet new_size = total_size * 2;
+    new_size = new_size < required_size ? required_size : new_size;
+    new_size = mem_align( new_size, k_blob_alignment );
+
+    ilog_debug( "Blob growing from %u to %llu bytes\n", total_size, new_size );
+
+    char* new_memory = ( char* )ialloca( new_size, allocator, k_blob_alignment );
+    iassert( new_memory );
+
+    // Relative pointers are still valid after the copy.
+    memcpy( new_memory, blob_destination_memory, reserved_offset );
+    memset( new_memory + reserved_offset, 0, new_size - reserved_offset );
+
+    ifree( blob_destination_memory, allocator );
+
+    blob_destination_memory = new_memory;
+    total_size = ( u32 )new_size;
+}
+
 void BlobWriter::reserve_and_set( RelativeString& data, const StringView string_data ) {
+    // Data lives inside the blob: cache its offset as reserve could move the memory.
+    const sizet data_offset = ( char* )&data - blob_destination_memory;
+    iassert( data_offset < total_size );
+
     char* destination_memory = reserve( string_data.size + 1 );
-    data.set( destination_memory, (u32)string_data.size );
+
+    RelativeString* destination_data = ( RelativeString* )( blob_destination_memory + data_offset );
+    destination_data->set( destination_memory, (u32)string_data.size );
     memcpy( destination_memory, string_data.data, string_data.size );
     // Add null termination
     destination_memory[ string_data.size ] = 0;
@@ -46,18 +124,30 @@ void BlobWriter::reserve_and_set( RelativeString& data, const StringView string_
 //}
 
 void BlobWriter::serialize( u32* data ) {
+    if ( write_offset + sizeof( u32 ) > total_size ) {
+        grow( write_offset + sizeof( u32 ) );
+    }
+
     memcpy( &blob_destination_memory[ write_offset ], data, sizeof( u32 ) );
 
     write_offset += sizeof( u32 );
 }
 
 void BlobWriter::serialize( i32* data ) {
+    if ( write_offset + sizeof( i32 ) > total_size ) {
+        grow( write_offset + sizeof( i32 ) );
+    }
+
     memcpy( &blob_destination_memory[ write_offset ], data, sizeof( i32 ) );
 
     write_offset += sizeof( i32 );
 }
 
 void BlobWriter::serialize( f32* data ) {
+    if ( write_offset + sizeof( f32 ) > total_size ) {
+        grow( write_offset + sizeof( f32 ) );
+    }
+
     memcpy( &blob_destination_memory[ write_offset ], data, sizeof( f32 ) );
 
     write_offset += sizeof( f32 );
@@ -11,24 +11,187 @@ namespace idra {
 struct BlobHeader {
     u32                 version;
     u32                 mappable;
+    u32                 size;           // Uncompressed blob size, header included.
+    u32                 checksum;       // Optional, 0 if not calculated.
 }; // struct BlobHeader
 
+// Blob memory and reserved data are aligned to this, so that mapped blobs
+// can be consumed directly by SIMD code and GPU copies.
+static constexpr sizet  k_blob_alignment = 16;
+
+// Checksum of the blob data following the header.
+u32                     blob_calculate_checksum( Span<char> blob_memory );
+// Checks size and, if present, checksum of a blob.
+bool                    blob_validate( Span<char> blob_memory );
+
 struct Blob {
     BlobHeader          header;
 }; // struct Blob
 
+// Blob schema ////////////////////////////////////////////////////////////
+//
+// Describes the fields of a root blob structure, in memory order, with the
+// version they were added in. New fields must be appended at the end of the
+// structure: an old blob is then upgraded by copying the matching prefix,
+// relocating relative pointers and filling new fields with defaults.
+// Elements pointed by relative data are copied as they are, so only the
+// root structure can change between versions.
+//
+// (in a header file)
+// IDRA_BLOB_SCHEMA_BEGIN( CustomBlueprint )
+//     IDRA_BLOB_FIELD( variable0, 0 )
+//     IDRA_BLOB_FIELD_DEFAULT( variable1, 1, 8 )
+// IDRA_BLOB_SCHEMA_END()
+//
+template<typename T>
+struct BlobSchema {
+    static constexpr bool k_declared = false;
+}; // struct BlobSchema
+
+#define IDRA_BLOB_SCHEMA_BEGIN( type )                          \
+    template<> struct BlobSchema<type> {                        \
+        static constexpr bool k_declared = true;                \
+        template<typename Visitor>                              \
+        static void visit( Visitor& visitor, type* data ) {
+
+#define IDRA_BLOB_FIELD( name, added_in_version )               \
+            visitor.field( data->name, added_in_version );
+
+#define IDRA_BLOB_FIELD_DEFAULT( name, added_in_version, default_value )    \
+            visitor.field( data->name, added_in_version, default_value );
+
+#define IDRA_BLOB_SCHEMA_END()                                  \
+        }                                                       \
+    };
+
+// Move relative data by delta bytes, used when the root structure grows.
+template<typename T>
+inline void blob_relocate( T& data, i32 delta ) {
+    // Plain data, nothing to do.
+}
+
+template<typename T, sizet N>
+inline void blob_relocate( T( &data )[ N ], i32 delta ) {
+    for ( sizet i = 0; i < N; ++i ) {
+        blob_relocate( data[ i ], delta );
+    }
+}
+
+template<typename T>
+inline void blob_relocate( RelativePointer<T>& data, i32 delta ) {
+    if ( data.offset != 0 ) {
+        data.offset += delta;
+    }
+}
+
+template<typename T>
+inline void blob_relocate( RelativeArray<T>& data, i32 delta ) {
+    blob_relocate( data.data, delta );
+}
+
+inline void blob_relocate( RelativeString& data, i32 delta ) {
+    blob_relocate( data.data, delta );
+}
+
+template<typename K, typename V>
+inline void blob_relocate( RelativeFlatHashMap<K, V>& data, i32 delta ) {
+    blob_relocate( data.slots, delta );
+}
+
+// Visitors used by BlobWriter and BlobReader.
+struct BlobSchemaRootSize {
+
+    template<typename T>
+    void            field( T& data, u32 added_in_version ) {
+        // First field not present in the blob marks the end of the old root.
+        if ( added_in_version > data_version && root_size == u32_max ) {
+            root_size = ( u32 )( ( char* )&data - root );
+        }
+    }
+
+    template<typename T, typename D>
+    void            field( T& data, u32 added_in_version, const D& ) {
+        field( data, added_in_version );
+    }
+
+    char*           root;
+    u32             data_version;
+    u32             root_size       = u32_max;
+}; // struct BlobSchemaRootSize
+
+struct BlobSchemaUpgrade {
+
+    template<typename T>
+    void            field( T& data, u32 added_in_version ) {
+        if ( added_in_version > data_version ) {
+            memset( &data, 0, sizeof( T ) );
+        } else {
+            blob_relocate( data, delta );
+        }
+    }
+
+    template<typename T, typename D>
+    void            field( T& data, u32 added_in_version, const D& default_value ) {
+        if ( added_in_version > data_version ) {
+            data = default_value;
+        } else {
+            blob_relocate( data, delta );
+        }
+    }
+
+    u32             data_version;
+    i32             delta;
+}; // struct BlobSchemaUpgrade
+
+struct BlobSchemaDefaults {
+
+    template<typename T>
+    void            field( T& data, u32 added_in_version ) {
+        // Blob memory is already zeroed.
+    }
+
+    template<typename T, typename D>
+    void            field( T& data, u32 added_in_version, const D& default_value ) {
+        data = default_value;
+    }
+}; // struct BlobSchemaDefaults
+
 // Serializers
+
+/// <summary>
+/// 
+/// Class that writes a blob of memory. Size passed to write is just the initial
+/// capacity: the blob grows when more memory is reserved.
+/// Growing moves the blob memory, so any raw pointer inside the blob must be
+/// retrieved again with get_blob<T>() after a reserve. Relative pointers stay valid.
+/// Allocator must support out of order frees (no Bookmark/Linear allocators).
+/// 
+/// </summary>
 struct BlobWriter {
 
     template <typename T>
-    T*              write( Allocator* allocator_, u32 serializer_version, sizet size );
+    T*              write( Allocator* allocator_, u32 serializer_version, sizet initial_size );
+
+    // Free blob memory. Call once the blob has been saved.
+    void            shutdown();
 
-    char*           reserve( sizet size );
+    // Finalize header with size and optional checksum, returns the blob memory to save.
+    Span<char>      finalize( bool calculate_checksum );
+
+    template <typename T>
+    T*              get_blob();
+
+    char*           reserve( sizet size, sizet alignment = 1 );
+    void            grow( sizet required_size );
 
     void            reserve_and_set( RelativeString& data, const StringView string_data );
 
     template<typename T>
-    void            reserve_and_set( RelativeArray<T>& data, u32 num_elements );
+    void            reserve_and_set( RelativeArray<T>& data, u32 num_elements, sizet alignment = alignof( T ) );
+
+    // Reserve slots for num_elements entries, fill with RelativeFlatHashMap::insert.
+    template<typename K, typename V>
+    void            reserve_and_set( RelativeFlatHashMap<K, V>& data, u32 num_elements );
 
     // NOTE: this is really error prone, as serialization of element type
     // could break if subsequent elements are not allocated properly.
@@ -55,7 +218,8 @@ struct BlobWriter {
 /// <summary>
 /// 
 /// Class that reads from a blob of memory. If the blob and the serializer have
-/// different versions, manually serialize the data, allocating memory.
+/// different versions, upgrade types with a BlobSchema or manually serialize
+/// the data, allocating memory.
 /// 
 /// </summary>
 struct BlobReader {
@@ -64,6 +228,11 @@ struct BlobReader {
     T*              read( Allocator* allocator_, u32 serializer_version_, 
                           Span<char> blob_memory, bool force_serialization );
 
+    // Used for types with a BlobSchema: single copy of the blob with
+    // relocation of relative data and defaults for new fields.
+    template<typename T>
+    T*              upgrade();
+
     char*           reserve_static( sizet size );
 
     template<typename T>
@@ -94,6 +263,12 @@ struct BlobReader {
     template<typename T>
     void            serialize( RelativeArray<T>* data );
 
+    template<typename K, typename V>
+    void            serialize( RelativeFlatHashMap<K, V>* data );
+
+    template<typename V>
+    void            serialize( RelativeHashSlot<V>* data );
+
     void            serialize( char* data );
     void            serialize( i8* data );
     void            serialize( u8* data );
@@ -128,13 +303,15 @@ struct BlobReader {
 
 // BlobWriter /////////////////////////////////////////////////////////////
 template<typename T>
-inline T* BlobWriter::write( Allocator* allocator_, u32 serializer_version, sizet size ) {
+inline T* BlobWriter::write( Allocator* allocator_, u32 serializer_version, sizet initial_size ) {
 
     allocator = allocator_;
 
-    blob_destination_memory = ( char* )ialloc( size + sizeof( BlobHeader ), allocator );
+    total_size = ( u32 )mem_align( initial_size + sizeof( T ), k_blob_alignment );
+    blob_destination_memory = ( char* )ialloca( total_size, allocator, k_blob_alignment );
+    // Zero memory so that padding is deterministic for checksums.
+    memset( blob_destination_memory, 0, total_size );
 
-    total_size = ( u32 )size + sizeof( BlobHeader );
     write_offset = reserved_offset = 0;
 
     // Write header
@@ -145,13 +322,43 @@ inline T* BlobWriter::write( Allocator* allocator_, u32 serializer_version, size
 
     reserve( sizeof( T ) - sizeof( BlobHeader ) );
 
+    if constexpr ( BlobSchema<T>::k_declared ) {
+        BlobSchemaDefaults defaults;
+        BlobSchema<T>::visit( defaults, ( T* )blob_destination_memory );
+    }
+
     return ( T* )blob_destination_memory;
 }
 
 template<typename T>
-inline void BlobWriter::reserve_and_set( RelativeArray<T>& data, u32 num_elements ) {
-    char* destination_memory = reserve( sizeof( T ) * num_elements );
-    data.set( destination_memory, num_elements );
+inline T* BlobWriter::get_blob() {
+    return ( T* )blob_destination_memory;
+}
+
+template<typename T>
+inline void BlobWriter::reserve_and_set( RelativeArray<T>& data, u32 num_elements, sizet alignment ) {
+    // Data lives inside the blob: cache its offset as reserve could move the memory.
+    const sizet data_offset = ( char* )&data - blob_destination_memory;
+    iassert( data_offset < total_size );
+
+    char* destination_memory = reserve( sizeof( T ) * num_elements, alignment );
+
+    RelativeArray<T>* destination_data = ( RelativeArray<T>* )( blob_destination_memory + data_offset );
+    destination_data->set( destination_memory, num_elements );
+}
+
+template<typename K, typename V>
+inline void BlobWriter::reserve_and_set( RelativeFlatHashMap<K, V>& data, u32 num_elements ) {
+    const sizet data_offset = ( char* )&data - blob_destination_memory;
+    iassert( data_offset < total_size );
+
+    const u32 capacity = RelativeFlatHashMap<K, V>::calculate_capacity( num_elements );
+    // Blob memory is zeroed, so all slots are empty.
+    char* destination_memory = reserve( sizeof( RelativeHashSlot<V> ) * capacity, alignof( RelativeHashSlot<V> ) );
+
+    RelativeFlatHashMap<K, V>* destination_data = ( RelativeFlatHashMap<K, V>* )( blob_destination_memory + data_offset );
+    destination_data->size = 0;
+    destination_data->slots.set( destination_memory, capacity );
 }
 
 template<typename T>
@@ -176,8 +383,18 @@ inline T* BlobReader::read( Allocator* allocator_, u32 serializer_version_,
     // is_reading = 1;
      //has_allocated_memory = 0;
 
+    if ( blob_source_memory.size < sizeof( BlobHeader ) ) {
+        ilog_error( "Blob truncated: memory size %llu smaller than its header\n", blob_source_memory.size );
+        return nullptr;
+    }
+
      // Read header from blob.
     BlobHeader* header = ( BlobHeader* )blob_source_memory.data;
+    if ( header->size > blob_source_memory.size ) {
+        ilog_error( "Blob truncated: header size %u, memory size %llu\n", header->size, blob_source_memory.size );
+        return nullptr;
+    }
+
     data_version = header->version;
     //is_mappable = header->mappable;
 
@@ -187,6 +404,10 @@ inline T* BlobReader::read( Allocator* allocator_, u32 serializer_version_,
         return ( T* )( blob_source_memory.data );
     }
 
+    if constexpr ( BlobSchema<T>::k_declared ) {
+        return upgrade<T>();
+    }
+
     ilog_debug( "Serializer is different version - serialize and allocate.\n" );
 
     // has_allocated_memory = 1;
@@ -205,6 +426,44 @@ inline T* BlobReader::read( Allocator* allocator_, u32 serializer_version_,
     return destination_data;
 }
 
+template<typename T>
+inline T* BlobReader::upgrade() {
+
+    if ( data_version > serializer_version ) {
+        ilog_error( "Blob version %u is newer than serializer version %u\n", data_version, serializer_version );
+        return nullptr;
+    }
+
+    ilog_debug( "Upgrading blob from version %u to %u.\n", data_version, serializer_version );
+
+    char* source = blob_source_memory.data;
+
+    BlobSchemaRootSize root_size{ .root = source, .data_version = data_version };
+    BlobSchema<T>::visit( root_size, ( T* )source );
+    const u32 old_root_size = root_size.root_size == u32_max ? ( u32 )sizeof( T ) : root_size.root_size;
+
+    // Keep the delta aligned so that data after the root keeps its alignment.
+    const i32 delta = ( i32 )mem_align( sizeof( T ) - old_root_size, k_blob_alignment );
+    const sizet data_size = blob_source_memory.size - old_root_size;
+    const sizet new_size = old_root_size + delta + data_size;
+
+    data_memory = ( char* )ialloca( new_size, allocator, k_blob_alignment );
+    memcpy( data_memory, source, old_root_size );
+    memset( data_memory + old_root_size, 0, delta );
+    memcpy( data_memory + old_root_size + delta, source + old_root_size, data_size );
+
+    T* destination_data = ( T* )data_memory;
+    BlobSchemaUpgrade upgrade_visitor{ .data_version = data_version, .delta = delta };
+    BlobSchema<T>::visit( upgrade_visitor, destination_data );
+
+    BlobHeader* header = ( BlobHeader* )data_memory;
+    header->version = serializer_version;
+    header->size = ( u32 )new_size;
+    header->checksum = 0;
+
+    return destination_data;
+}
+
 template<typename T>
 inline T* BlobReader::reserve_static() {
     return ( T* )reserve_static( sizeof( T ) );
@@ -245,6 +504,20 @@ inline void BlobReader::serialize( RelativeArray<T>* data ) {
     blob_read_offset = cached_read_offset;
 }
 
+template<typename K, typename V>
+inline void BlobReader::serialize( RelativeFlatHashMap<K, V>* data ) {
+    serialize( &data->size );
+    serialize( &data->slots );
+}
+
+template<typename V>
+inline void BlobReader::serialize( RelativeHashSlot<V>* data ) {
+    serialize( &data->hash );
+    serialize( &data->value );
+    // Skip trailing padding.
+    blob_read_offset += sizeof( RelativeHashSlot<V> ) - sizeof( u64 ) - sizeof( V );
+}
+
 // NOTE: this is really error prone, as serialization of element type
 // could break if subsequent elements are not allocated properly.
 //template<typename T>
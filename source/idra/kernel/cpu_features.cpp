@@ -0,0 +1,127 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "kernel/cpu_features.hpp"
+#include "kernel/log.hpp"
+
+#include <string.h>
+
+#if defined (IDRA_CPU_X86)
+#if defined (_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif // _MSC_VER
+#endif // IDRA_CPU_X86
+
+namespace idra {
+
+#if defined (IDRA_CPU_X86)
+// Registers in eax, ebx, ecx, edx order.
+static void cpuid( u32 leaf, u32 subleaf, u32 registers[ 4 ] ) {
+#if defined (_MSC_VER)
+    __cpuidex( ( int* )registers, ( int )leaf, ( int )subleaf );
+#else
+    __cpuid_count( leaf, subleaf, registers[ 0 ], registers[ 1 ], registers[ 2 ], registers[ 3 ] );
+#endif // _MSC_VER
+}
+
+// Register state enabled by the OS.
+static u64 xgetbv() {
+#if defined (_MSC_VER)
+    return _xgetbv( 0 );
+#else
+    u32 eax, edx;
+    __asm__ volatile( "xgetbv" : "=a"( eax ), "=d"( edx ) : "c"( 0 ) );
+    return ( ( u64 )edx << 32 ) | eax;
+#endif // _MSC_VER
+}
+
+static inline bool bit( u32 value, u32 index ) {
+    return ( value >> index ) & 1;
+}
+#endif // IDRA_CPU_X86
+
+static CpuFeatures cpu_features_detect() {
+
+    CpuFeatures features;
+    strcpy( features.vendor, "Unknown" );
+    strcpy( features.brand, "Unknown" );
+
+#if defined (IDRA_CPU_X86)
+    u32 registers[ 4 ];
+    cpuid( 0, 0, registers );
+    const u32 max_leaf = registers[ 0 ];
+
+    // Vendor is ebx, edx, ecx.
+    memcpy( features.vendor, &registers[ 1 ], 4 );
+    memcpy( features.vendor + 4, &registers[ 3 ], 4 );
+    memcpy( features.vendor + 8, &registers[ 2 ], 4 );
+    features.vendor[ 12 ] = 0;
+
+    if ( max_leaf >= 1 ) {
+        cpuid( 1, 0, registers );
+        const u32 ecx = registers[ 2 ], edx = registers[ 3 ];
+
+        features.sse2 = bit( edx, 26 );
+        features.sse3 = bit( ecx, 0 );
+        features.ssse3 = bit( ecx, 9 );
+        features.sse41 = bit( ecx, 19 );
+        features.sse42 = bit( ecx, 20 );
+        features.popcnt = bit( ecx, 23 );
+
+        // AVX needs the OS to save YMM registers, checked with xgetbv.
+        const bool os_xsave = bit( ecx, 27 );
+        const u64 xcr0 = os_xsave ? xgetbv() : 0;
+        const bool os_ymm = ( xcr0 & 0x6 ) == 0x6;
+        const bool os_zmm = ( xcr0 & 0xE6 ) == 0xE6;
+
+        features.avx = bit( ecx, 28 ) && os_ymm;
+        features.fma = bit( ecx, 12 ) && os_ymm;
+
+        if ( max_leaf >= 7 ) {
+            cpuid( 7, 0, registers );
+            const u32 ebx = registers[ 1 ];
+
+            features.bmi1 = bit( ebx, 3 );
+            features.bmi2 = bit( ebx, 8 );
+            features.avx2 = bit( ebx, 5 ) && os_ymm;
+            features.avx512f = bit( ebx, 16 ) && os_zmm;
+            features.avx512bw = bit( ebx, 30 ) && os_zmm;
+            features.avx512vl = bit( ebx, 31 ) && os_zmm;
+        }
+    }
+
+    cpuid( 0x80000000, 0, registers );
+    if ( registers[ 0 ] >= 0x80000004 ) {
+        for ( u32 i = 0; i < 3; ++i ) {
+            cpuid( 0x80000002 + i, 0, registers );
+            memcpy( features.brand + i * 16, registers, 16 );
+        }
+        features.brand[ 48 ] = 0;
+    }
+#endif // IDRA_CPU_X86
+
+    return features;
+}
+
+const CpuFeatures& cpu_features_get() {
+    static const CpuFeatures s_features = cpu_features_detect();
+    return s_features;
+}
+
+void cpu_features_log() {
+    const CpuFeatures& features = cpu_features_get();
+
+    ilog( "CPU %s, %s\n", features.vendor, features.brand );
+    ilog( "CPU features:%s%s%s%s%s%s%s%s%s%s%s%s%s%s\n",
+          features.sse2 ? " SSE2" : "", features.sse3 ? " SSE3" : "", features.ssse3 ? " SSSE3" : "",
+          features.sse41 ? " SSE4.1" : "", features.sse42 ? " SSE4.2" : "", features.popcnt ? " POPCNT" : "",
+          features.avx ? " AVX" : "", features.avx2 ? " AVX2" : "", features.fma ? " FMA" : "",
+          features.bmi1 ? " BMI1" : "", features.bmi2 ? " BMI2" : "",
+          features.avx512f ? " AVX512F" : "", features.avx512bw ? " AVX512BW" : "", features.avx512vl ? " AVX512VL" : "" );
+}
+
+} // namespace idra
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#pragma once
+
+#include "kernel/platform.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define IDRA_CPU_X86
+#endif // x86
+
+// Compile a single function for an instruction set, so one binary can ship
+// several variants of a kernel. MSVC accepts any intrinsic without flags.
+#if defined(IDRA_CPU_X86) && ( defined(__GNUC__) || defined(__clang__) )
+#define IDRA_TARGET_AVX2                        __attribute__( ( target( "avx2,bmi,bmi2,popcnt" ) ) )
+#else
+#define IDRA_TARGET_AVX2
+#endif // IDRA_CPU_X86 && GCC
+
+namespace idra {
+
+    // CpuFeatures ////////////////////////////////////////////////////////
+    //
+    // Instruction sets of the host, read with CPUID. AVX and AVX-512 are
+    // reported only when the OS saves their registers.
+    // Kernels with several variants pick one with these flags, once, and
+    // keep the choice in a table of function pointers (see utf.cpp).
+    //
+    struct CpuFeatures {
+
+        char                        vendor[ 13 ];
+        char                        brand[ 49 ];
+
+        bool                        sse2        = false;
+        bool                        sse3        = false;
+        bool                        ssse3       = false;
+        bool                        sse41       = false;
+        bool                        sse42       = false;
+        bool                        popcnt      = false;
+        bool                        avx         = false;
+        bool                        avx2        = false;
+        bool                        fma         = false;
+        bool                        bmi1        = false;
+        bool                        bmi2        = false;
+        bool                        avx512f     = false;
+        bool                        avx512bw    = false;
+        bool                        avx512vl    = false;
+
+    }; // struct CpuFeatures
+
+    // Detected on first call, thread safe.
+    const CpuFeatures&              cpu_features_get();
+    void                            cpu_features_log();
+
+} // namespace idra
@@ -126,6 +126,14 @@ bool fs_file_copy( StringView existing_file, StringView new_file ) {
 #endif // _WIN64
 }
 
+bool fs_file_rename( StringView existing_file, StringView new_file ) {
+#if defined(_WIN64)
+    return MoveFileExA( existing_file.data, new_file.data, MOVEFILE_REPLACE_EXISTING ) != 0;
+#else
+    return rename( existing_file.data, new_file.data ) == 0;
+#endif // _WIN64
+}
+
 long fs_file_get_size( FileHandle f ) {
     long fileSizeSigned;
 
@@ -168,10 +176,12 @@ FileTime fs_file_last_write_time( StringView filename ) {
 
     return last_write_time;
 #else
+    // Nanoseconds, edits within the same second are common when hot reloading.
     struct stat file_details;
-    stat( filename.data , &file_details );
-    time_t modify_time = file_details.st_mtime; 
-    return modify_time;
+    if ( stat( filename.data, &file_details ) != 0 ) {
+        return 0;
+    }
+    return ( u64 )file_details.st_mtim.tv_sec * 1000000000ull + ( u64 )file_details.st_mtim.tv_nsec;
 #endif // _WIN64
 }
 
@@ -180,7 +190,19 @@ u32 fs_file_resolve_to_full_path( cstring path, char* out_full_path, u32 max_siz
 #if defined(_WIN64)
     return GetFullPathNameA( path, max_size, out_full_path, nullptr );
 #else
-    return readlink( path, out_full_path, max_size );
+    // readlink only resolves symbolic links, realpath handles any existing path.
+    char* full_path = realpath( path, nullptr );
+    if ( !full_path ) {
+        return 0;
+    }
+
+    const u32 length = ( u32 )strlen( full_path );
+    const bool fits = length < max_size;
+    if ( fits ) {
+        memcpy( out_full_path, full_path, length + 1 );
+    }
+    free( full_path );
+    return fits ? length : 0;
 #endif // _WIN64
 }
 
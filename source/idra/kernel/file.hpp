@@ -58,6 +58,7 @@ namespace idra {
     bool                            fs_file_exists( StringView path );
     bool                            fs_file_delete( StringView path );
     bool                            fs_file_copy( StringView existing_file, StringView new_file );
+    bool                            fs_file_rename( StringView existing_file, StringView new_file );   // Replaces new_file if present, atomically on the same volume.
 
     long                            fs_file_get_size( FileHandle file );
     sizet                           fs_file_get_size( StringView path );
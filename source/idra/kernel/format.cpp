@@ -0,0 +1,397 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "kernel/format.hpp"
+
+#include <stdio.h>
+#include <charconv>
+
+namespace idra {
+
+static const char s_digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char s_hex_digits_lower[] = "0123456789abcdef";
+static const char s_hex_digits_upper[] = "0123456789ABCDEF";
+
+void format_string_error( cstring ) {
+    // Never called at runtime: reaching this from a consteval function is a compile error.
+}
+
+// FormatOutput ///////////////////////////////////////////////////////////
+void FormatOutput::init( char* buffer, u32 capacity_ ) {
+    data = buffer;
+    capacity = capacity_;
+    size = 0;
+    truncated = false;
+}
+
+void FormatOutput::append( cstring text, u32 length ) {
+    const u32 available = get_available();
+    if ( length > available ) {
+        length = available;
+        truncated = true;
+    }
+
+    memcpy( data + size, text, length );
+    size += length;
+}
+
+void FormatOutput::append( char c ) {
+    if ( get_available() == 0 ) {
+        truncated = true;
+        return;
+    }
+
+    data[ size++ ] = c;
+}
+
+void FormatOutput::terminate() {
+    if ( capacity ) {
+        data[ size ] = 0;
+    }
+}
+
+// Conversions ////////////////////////////////////////////////////////////
+u32 format_u64( char* out, u64 value ) {
+    // Write backwards two digits at a time, then move to the start of out.
+    char buffer[ k_format_integer_max_chars ];
+    char* end = buffer + k_format_integer_max_chars;
+    char* current = end;
+
+    while ( value >= 100 ) {
+        const u32 pair = ( u32 )( value % 100 ) * 2;
+        value /= 100;
+        current -= 2;
+        current[ 0 ] = s_digit_pairs[ pair ];
+        current[ 1 ] = s_digit_pairs[ pair + 1 ];
+    }
+
+    if ( value >= 10 ) {
+        const u32 pair = ( u32 )value * 2;
+        current -= 2;
+        current[ 0 ] = s_digit_pairs[ pair ];
+        current[ 1 ] = s_digit_pairs[ pair + 1 ];
+    } else {
+        *--current = ( char )( '0' + value );
+    }
+
+    const u32 length = ( u32 )( end - current );
+    memcpy( out, current, length );
+    return length;
+}
+
+u32 format_i64( char* out, i64 value ) {
+    if ( value < 0 ) {
+        out[ 0 ] = '-';
+        // Negate as unsigned to handle the minimum value.
+        return 1 + format_u64( out + 1, 0 - ( u64 )value );
+    }
+    return format_u64( out, ( u64 )value );
+}
+
+u32 format_hex_u64( char* out, u64 value, bool uppercase ) {
+    const char* digits = uppercase ? s_hex_digits_upper : s_hex_digits_lower;
+
+    u32 length = 1;
+    for ( u64 v = value >> 4; v; v >>= 4 ) {
+        ++length;
+    }
+
+    for ( u32 i = length; i > 0; --i ) {
+        out[ i - 1 ] = digits[ value & 0xf ];
+        value >>= 4;
+    }
+    return length;
+}
+
+u32 format_f64( char* out, f64 value ) {
+    // Shortest round trip representation, implemented with Ryu by the standard libraries.
+    const std::to_chars_result result = std::to_chars( out, out + k_format_float_max_chars, value );
+    return result.ec == std::errc() ? ( u32 )( result.ptr - out ) : 0;
+}
+
+u32 format_f32( char* out, f32 value ) {
+    const std::to_chars_result result = std::to_chars( out, out + k_format_float_max_chars, value );
+    return result.ec == std::errc() ? ( u32 )( result.ptr - out ) : 0;
+}
+
+u32 format_f64_fixed( char* out, u32 out_size, f64 value, u32 precision ) {
+    const std::to_chars_result result = std::to_chars( out, out + out_size, value, std::chars_format::fixed, ( int )precision );
+    return result.ec == std::errc() ? ( u32 )( result.ptr - out ) : 0;
+}
+
+// Format /////////////////////////////////////////////////////////////////
+static void format_write_argument( FormatOutput& output, const FormatArg& arg, FormatSegment::Spec spec ) {
+    char buffer[ k_format_float_max_chars ];
+    u32 length = 0;
+
+    const bool hex = spec == FormatSegment::Spec_Hex;
+
+    switch ( arg.type ) {
+        case FormatArg::Type_Signed:
+        {
+            length = hex ? format_hex_u64( buffer, ( u64 )arg.i, false ) : format_i64( buffer, arg.i );
+            break;
+        }
+        case FormatArg::Type_Unsigned:
+        {
+            length = hex ? format_hex_u64( buffer, arg.u, false ) : format_u64( buffer, arg.u );
+            break;
+        }
+        case FormatArg::Type_F32:
+        {
+            length = format_f32( buffer, arg.f );
+            break;
+        }
+        case FormatArg::Type_F64:
+        {
+            length = format_f64( buffer, arg.d );
+            break;
+        }
+        case FormatArg::Type_Bool:
+        {
+            arg.u ? output.append( "true", 4 ) : output.append( "false", 5 );
+            return;
+        }
+        case FormatArg::Type_Char:
+        {
+            output.append( ( char )arg.u );
+            return;
+        }
+        case FormatArg::Type_String:
+        {
+            output.append( arg.string.data, ( u32 )arg.string.size );
+            return;
+        }
+        case FormatArg::Type_Pointer:
+        {
+            buffer[ 0 ] = '0';
+            buffer[ 1 ] = 'x';
+            length = 2 + format_hex_u64( buffer + 2, ( u64 )( uintptr )arg.pointer, false );
+            break;
+        }
+        default:
+            return;
+    }
+
+    output.append( buffer, length );
+}
+
+void format_write( FormatOutput& output, const FormatPattern& pattern, const FormatArg* args ) {
+    u32 argument_index = 0;
+
+    for ( u32 i = 0; i < pattern.num_segments; ++i ) {
+        const FormatSegment& segment = pattern.segments[ i ];
+        output.append( pattern.text + segment.offset, segment.length );
+
+        if ( segment.spec != FormatSegment::Spec_None ) {
+            format_write_argument( output, args[ argument_index++ ], segment.spec );
+        }
+    }
+}
+
+// Printf shim ////////////////////////////////////////////////////////////
+// Appends integer digits with the printf precision: a minimum digit count,
+// zero padded, where a zero value with zero precision prints nothing.
+static void format_append_digits( FormatOutput& output, cstring digits, u32 length, bool negative, i32 precision ) {
+    if ( precision == 0 && length == 1 && digits[ 0 ] == '0' ) {
+        length = 0;
+    }
+
+    if ( negative ) {
+        output.append( '-' );
+    }
+
+    for ( i32 i = ( i32 )length; i < precision; ++i ) {
+        output.append( '0' );
+    }
+
+    output.append( digits, length );
+}
+
+void format_printf( FormatOutput& output, cstring format, va_list args ) {
+    // Keep a copy to restart with vsnprintf on conversions not handled here.
+    va_list args_copy;
+    va_copy( args_copy, args );
+
+    const u32 start_size = output.size;
+    char buffer[ 352 ];     // Fits any f64 printed with %f and default precision.
+
+    cstring current = format;
+    while ( *current ) {
+        // Copy literal text up to the next conversion.
+        cstring percent = strchr( current, '%' );
+        if ( !percent ) {
+            output.append( current, ( u32 )strlen( current ) );
+            break;
+        }
+
+        output.append( current, ( u32 )( percent - current ) );
+        current = percent + 1;
+
+        // Precision, for integers, %f and %s.
+        i32 precision = -1;
+        if ( *current == '.' ) {
+            ++current;
+            if ( *current == '*' ) {
+                precision = va_arg( args, int );
+                ++current;
+            } else {
+                precision = 0;
+                while ( *current >= '0' && *current <= '9' ) {
+                    precision = precision * 10 + ( *current - '0' );
+                    ++current;
+                }
+            }
+        }
+
+        // Length modifiers.
+        enum Length { Length_Int, Length_Char, Length_Short, Length_Long, Length_LongLong, Length_Size, Length_Max, Length_Ptrdiff };
+        Length length = Length_Int;
+        switch ( *current ) {
+            case 'h':
+                length = current[ 1 ] == 'h' ? Length_Char : Length_Short;
+                current += length == Length_Char ? 2 : 1;
+                break;
+            case 'l':
+                length = current[ 1 ] == 'l' ? Length_LongLong : Length_Long;
+                current += length == Length_LongLong ? 2 : 1;
+                break;
+            case 'z': length = Length_Size; ++current; break;
+            case 'j': length = Length_Max; ++current; break;
+            case 't': length = Length_Ptrdiff; ++current; break;
+            default: break;
+        }
+
+        const char conversion = *current++;
+        switch ( conversion ) {
+            case '%':
+            {
+                output.append( '%' );
+                break;
+            }
+            case 'd':
+            case 'i':
+            {
+                i64 value = 0;
+                switch ( length ) {
+                    case Length_Long:       value = va_arg( args, long ); break;
+                    case Length_LongLong:   value = va_arg( args, long long ); break;
+                    case Length_Size:       value = va_arg( args, ptrdiff_t ); break;
+                    case Length_Max:        value = va_arg( args, intmax_t ); break;
+                    case Length_Ptrdiff:    value = va_arg( args, ptrdiff_t ); break;
+                    case Length_Char:       value = ( signed char )va_arg( args, int ); break;
+                    case Length_Short:      value = ( short )va_arg( args, int ); break;
+                    default:                value = va_arg( args, int ); break;
+                }
+                const bool negative = value < 0;
+                // Negate as unsigned to handle the minimum value.
+                const u32 written = format_u64( buffer, negative ? 0 - ( u64 )value : ( u64 )value );
+                format_append_digits( output, buffer, written, negative, precision );
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X':
+            {
+                u64 value = 0;
+                switch ( length ) {
+                    case Length_Long:       value = va_arg( args, unsigned long ); break;
+                    case Length_LongLong:   value = va_arg( args, unsigned long long ); break;
+                    case Length_Size:       value = va_arg( args, sizet ); break;
+                    case Length_Max:        value = va_arg( args, uintmax_t ); break;
+                    case Length_Ptrdiff:    value = ( u64 )va_arg( args, ptrdiff_t ); break;
+                    case Length_Char:       value = ( unsigned char )va_arg( args, unsigned int ); break;
+                    case Length_Short:      value = ( unsigned short )va_arg( args, unsigned int ); break;
+                    default:                value = va_arg( args, unsigned int ); break;
+                }
+                const u32 written = conversion == 'u' ? format_u64( buffer, value ) : format_hex_u64( buffer, value, conversion == 'X' );
+                format_append_digits( output, buffer, written, false, precision );
+                break;
+            }
+            case 'c':
+            {
+                output.append( ( char )va_arg( args, int ) );
+                break;
+            }
+            case 's':
+            {
+                if ( length != Length_Int ) {
+                    goto fallback;
+                }
+
+                cstring string = va_arg( args, cstring );
+                if ( !string ) {
+                    string = "(null)";
+                }
+
+                u32 string_length = 0;
+                if ( precision >= 0 ) {
+                    const void* terminator = memchr( string, 0, ( sizet )precision );
+                    string_length = terminator ? ( u32 )( ( cstring )terminator - string ) : ( u32 )precision;
+                } else {
+                    string_length = ( u32 )strlen( string );
+                }
+                output.append( string, string_length );
+                break;
+            }
+            case 'f':
+            case 'F':
+            {
+                const f64 value = va_arg( args, f64 );
+                const u32 written = format_f64_fixed( buffer, sizeof( buffer ), value, precision >= 0 ? ( u32 )precision : 6 );
+                if ( written == 0 ) {
+                    goto fallback;
+                }
+                // Only inf and nan contain letters.
+                if ( conversion == 'F' ) {
+                    for ( u32 i = 0; i < written; ++i ) {
+                        if ( buffer[ i ] >= 'a' && buffer[ i ] <= 'z' ) {
+                            buffer[ i ] -= 'a' - 'A';
+                        }
+                    }
+                }
+                output.append( buffer, written );
+                break;
+            }
+            default:
+            {
+                // Flags, width and the other conversions.
+                goto fallback;
+            }
+        }
+    }
+
+    va_end( args_copy );
+    return;
+
+fallback:
+    {
+        output.size = start_size;
+        output.truncated = false;
+
+        const u32 available = output.capacity > start_size ? output.capacity - start_size : 0;
+        const int written = available ? vsnprintf( output.data + start_size, available, format, args_copy ) : 0;
+        if ( written < 0 || ( u32 )written >= available ) {
+            output.truncated = true;
+            output.size = available ? output.capacity - 1 : start_size;
+        } else {
+            output.size += ( u32 )written;
+        }
+        va_end( args_copy );
+    }
+}
+
+} // namespace idra
@@ -0,0 +1,269 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#pragma once
+
+#include "kernel/string_view.hpp"
+
+#include <stdarg.h>
+#include <type_traits>
+
+namespace idra {
+
+    static const u32                k_format_max_arguments = 16;
+    static const u32                k_format_max_segments = 32;
+    static const u32                k_format_integer_max_chars = 24;    // Sign, 20 digits, hex prefix.
+    static const u32                k_format_float_max_chars = 32;      // Shortest representation of a f64.
+
+    // Format /////////////////////////////////////////////////////////////
+    //
+    // Type safe formatting with "{}" placeholders, parsed at compile time:
+    //
+    //   string_buffer.append_format( "{}/{}.bhat", folder, filename );
+    //   g_log->log_format( LogLevel_Info, "Loaded {} textures in {}ms\n", count, ms );
+    //
+    // "{:x}" writes integers in hexadecimal, "{{" and "}}" write braces.
+    // Integers use a digit pair table, floats the shortest representation
+    // that round trips. There is no locale handling.
+    // Printf style formats go through format_printf, that handles the
+    // common conversions and falls back to vsnprintf for the rest.
+    //
+
+    //
+    // Type erased argument.
+    struct FormatArg {
+
+        enum Type : u8 {
+            Type_None = 0,
+            Type_Signed,
+            Type_Unsigned,
+            Type_F32,
+            Type_F64,
+            Type_Bool,
+            Type_Char,
+            Type_String,
+            Type_Pointer
+        }; // enum Type
+
+        constexpr FormatArg() : u( 0 ), type( Type_None ) {}
+
+        template <typename T>
+        FormatArg( const T& value );
+
+        union {
+            i64                     i;
+            u64                     u;
+            f32                     f;
+            f64                     d;
+            const void*             pointer;
+            struct {
+                cstring             data;
+                sizet               size;
+            }                       string;
+        };
+
+        Type                        type;
+
+    }; // struct FormatArg
+
+    //
+    // Literal text followed by an optional argument.
+    struct FormatSegment {
+
+        enum Spec : u8 {
+            Spec_None = 0,
+            Spec_Default,
+            Spec_Hex
+        }; // enum Spec
+
+        u16                         offset      = 0;
+        u16                         length      = 0;
+        Spec                        spec        = Spec_None;    // Spec_None means no argument.
+
+    }; // struct FormatSegment
+
+    //
+    // Parsed format string, usable from non template code.
+    struct FormatPattern {
+
+        cstring                     text                = nullptr;
+        FormatSegment               segments[ k_format_max_segments ];
+        u32                         num_segments        = 0;
+        u32                         num_arguments       = 0;
+
+    }; // struct FormatPattern
+
+    // Called from constant evaluation only, to raise a compile error.
+    void                            format_string_error( cstring message );
+
+    template <typename T>
+    struct FormatIdentity { using Type = T; };
+
+    //
+    // Format string checked at compile time against the argument count.
+    template <typename... Args>
+    struct FormatString : public FormatPattern {
+
+        consteval                   FormatString( cstring format );
+
+    }; // struct FormatString
+
+    template <typename... Args>
+    using FormatStringFor           = FormatString<typename FormatIdentity<Args>::Type...>;
+
+    //
+    // Output buffer that truncates instead of overflowing.
+    // Capacity includes the null terminator.
+    struct FormatOutput {
+
+        void                        init( char* buffer, u32 capacity );
+
+        void                        append( cstring text, u32 length );
+        void                        append( char c );
+        // Write the null terminator, not counted in size.
+        void                        terminate();
+
+        u32                         get_available() const   { return capacity > size + 1 ? capacity - size - 1 : 0; }
+
+        char*                       data        = nullptr;
+        u32                         capacity    = 0;
+        u32                         size        = 0;
+        bool                        truncated   = false;
+
+    }; // struct FormatOutput
+
+    // Conversions, return the number of chars written.
+    u32                             format_u64( char* out, u64 value );         // Out must hold k_format_integer_max_chars.
+    u32                             format_i64( char* out, i64 value );
+    u32                             format_hex_u64( char* out, u64 value, bool uppercase );
+    u32                             format_f64( char* out, f64 value );         // Out must hold k_format_float_max_chars.
+    u32                             format_f32( char* out, f32 value );
+    u32                             format_f64_fixed( char* out, u32 out_size, f64 value, u32 precision );    // Like printf %.*f, 0 if it does not fit.
+
+    void                            format_write( FormatOutput& output, const FormatPattern& pattern, const FormatArg* args );
+    void                            format_printf( FormatOutput& output, cstring format, va_list args );
+
+    // Write a null terminated string into buffer, truncating. Returns the length.
+    template <typename... Args>
+    u32                             format_to( char* buffer, u32 buffer_size, FormatStringFor<Args...> format, const Args&... args );
+
+
+    // Implementation /////////////////////////////////////////////////////
+
+    template <typename T>
+    inline FormatArg::FormatArg( const T& value ) {
+        using Decayed = std::decay_t<T>;
+
+        if constexpr ( std::is_same_v<Decayed, bool> ) {
+            u = value ? 1 : 0;
+            type = Type_Bool;
+        } else if constexpr ( std::is_same_v<Decayed, char> ) {
+            u = ( u8 )value;
+            type = Type_Char;
+        } else if constexpr ( std::is_enum_v<Decayed> ) {
+            i = ( i64 )value;
+            type = Type_Signed;
+        } else if constexpr ( std::is_integral_v<Decayed> && std::is_signed_v<Decayed> ) {
+            i = value;
+            type = Type_Signed;
+        } else if constexpr ( std::is_integral_v<Decayed> ) {
+            u = value;
+            type = Type_Unsigned;
+        } else if constexpr ( std::is_same_v<Decayed, f32> ) {
+            f = value;
+            type = Type_F32;
+        } else if constexpr ( std::is_same_v<Decayed, f64> ) {
+            d = value;
+            type = Type_F64;
+        } else if constexpr ( std::is_same_v<Decayed, char*> || std::is_same_v<Decayed, const char*> ) {
+            string.data = value;
+            string.size = value ? strlen( value ) : 0;
+            type = Type_String;
+        } else if constexpr ( std::is_convertible_v<const T&, Span<const char>> ) {
+            const Span<const char>& text = value;
+            string.data = text.data;
+            string.size = text.size;
+            type = Type_String;
+        } else if constexpr ( std::is_pointer_v<Decayed> ) {
+            pointer = value;
+            type = Type_Pointer;
+        } else {
+            static_assert( sizeof( T ) == 0, "Type not supported by format." );
+        }
+    }
+
+    template <typename... Args>
+    consteval FormatString<Args...>::FormatString( cstring format ) {
+        text = format;
+
+        u32 segment_start = 0;
+        u32 i = 0;
+        for ( ; format[ i ]; ++i ) {
+            const char c = format[ i ];
+            if ( c != '{' && c != '}' ) {
+                continue;
+            }
+
+            if ( num_segments == k_format_max_segments - 1 ) {
+                format_string_error( "Too many segments in format string." );
+            }
+
+            FormatSegment& segment = segments[ num_segments++ ];
+            segment.offset = ( u16 )segment_start;
+
+            // Escaped braces: keep the first as literal text, skip the second.
+            if ( format[ i + 1 ] == c ) {
+                segment.length = ( u16 )( i + 1 - segment_start );
+                segment.spec = FormatSegment::Spec_None;
+                ++i;
+                segment_start = i + 1;
+                continue;
+            }
+
+            if ( c == '}' ) {
+                format_string_error( "Unmatched } in format string." );
+            }
+
+            segment.length = ( u16 )( i - segment_start );
+            if ( format[ i + 1 ] == '}' ) {
+                segment.spec = FormatSegment::Spec_Default;
+                i += 1;
+            } else if ( format[ i + 1 ] == ':' && format[ i + 2 ] == 'x' && format[ i + 3 ] == '}' ) {
+                segment.spec = FormatSegment::Spec_Hex;
+                i += 3;
+            } else {
+                format_string_error( "Unsupported placeholder in format string, use {} or {:x}." );
+            }
+
+            ++num_arguments;
+            segment_start = i + 1;
+        }
+
+        FormatSegment& last_segment = segments[ num_segments++ ];
+        last_segment.offset = ( u16 )segment_start;
+        last_segment.length = ( u16 )( i - segment_start );
+        last_segment.spec = FormatSegment::Spec_None;
+
+        if ( num_arguments != sizeof...( Args ) ) {
+            format_string_error( "Format string placeholders and arguments count differ." );
+        }
+        if ( num_arguments > k_format_max_arguments ) {
+            format_string_error( "Too many format arguments." );
+        }
+    }
+
+    template <typename... Args>
+    inline u32 format_to( char* buffer, u32 buffer_size, FormatStringFor<Args...> format, const Args&... args ) {
+        const FormatArg format_args[ sizeof...( Args ) + 1 ] = { FormatArg( args )... };
+
+        FormatOutput output;
+        output.init( buffer, buffer_size );
+        format_write( output, format, format_args );
+        output.terminate();
+
+        return output.size;
+    }
+
+} // namespace idra
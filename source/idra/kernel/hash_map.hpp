@@ -9,6 +9,7 @@
 #include "kernel/assert.hpp"
 #include "kernel/bit.hpp"
 #include "kernel/string_view.hpp"
+#include "kernel/string_id.hpp"
 
 #include "external/wyhash.h"
 
@@ -89,6 +90,12 @@ namespace idra {
         V&                          get( const K& key );
         V&                          get( const FlatHashMapIterator& it );
 
+        // StringId versions, for maps keyed by hashed names (u64).
+        FlatHashMapIterator         find( StringId key )                    { return find( ( K )key.hash ); }
+        void                        insert( StringId key, const V& value )  { insert( ( K )key.hash, value ); }
+        u32                         remove( StringId key )                  { return remove( ( K )key.hash ); }
+        V&                          get( StringId key )                     { return get( ( K )key.hash ); }
+
         KeyValue&                   get_structure( const K& key );
         KeyValue&                   get_structure( const FlatHashMapIterator& it );
 
@@ -311,7 +318,7 @@ namespace idra {
     inline void FlatHashMap<K, V>::init( Allocator* allocator_, u64 initial_capacity ) {
         allocator = allocator_;
         size = capacity = growth_left = 0;
-        default_key_value = { ( K )-1, ( V )0 };
+        default_key_value = { ( K )-1, V{} };
 
         control_bytes = group_init_empty();
         slots_ = nullptr;
@@ -0,0 +1,374 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "kernel/json.hpp"
+#include "kernel/allocator.hpp"
+#include "kernel/memory.hpp"
+#include "kernel/assert.hpp"
+#include "kernel/bit.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IDRA_JSON_SSE2
+#endif // __SSE2__ || _M_X64
+
+namespace idra {
+
+static const u32                k_json_block_size = 16;
+static const u32                k_json_max_depth = 1024;
+
+// Stage 1 ////////////////////////////////////////////////////////////////
+
+//
+// Character classes of a 16 bytes block, one bit per byte.
+struct JsonBlockMasks {
+    u32                         quote;
+    u32                         backslash;
+    u32                         operators;      // {}[]:,
+    u32                         whitespace;
+}; // struct JsonBlockMasks
+
+//
+// State carried between blocks.
+struct JsonScanState {
+    u32                         in_string       = 0;
+    u32                         escape_next     = 0;
+    u32                         prev_boundary   = 1;    // Source start counts as a boundary.
+}; // struct JsonScanState
+
+static JsonBlockMasks json_classify_block( const char* block ) {
+    JsonBlockMasks masks;
+#if defined (IDRA_JSON_SSE2)
+    const __m128i chunk = _mm_loadu_si128( ( const __m128i* )block );
+
+    masks.quote = _mm_movemask_epi8( _mm_cmpeq_epi8( chunk, _mm_set1_epi8( '"' ) ) );
+    masks.backslash = _mm_movemask_epi8( _mm_cmpeq_epi8( chunk, _mm_set1_epi8( '\\' ) ) );
+
+    __m128i operators = _mm_cmpeq_epi8( chunk, _mm_set1_epi8( '{' ) );
+    operators = _mm_or_si128( operators, _mm_cmpeq_epi8( chunk, _mm_set1_epi8( '}' ) ) );
+    operators = _mm_or_si128( operators, _mm_cmpeq_epi8( chunk, _mm_set1_epi8( '[' ) ) );
+    operators = _mm_or_si128( operators, _mm_cmpeq_epi8( chunk, _mm_set1_epi8( ']' ) ) );
+    operators = _mm_or_si128( operators, _mm_cmpeq_epi8( chunk, _mm_set1_epi8( ':' ) ) );
+    operators = _mm_or_si128( operators, _mm_cmpeq_epi8( chunk, _mm_set1_epi8( ',' ) ) );
+    masks.operators = _mm_movemask_epi8( operators );
+
+    __m128i whitespace = _mm_cmpeq_epi8( chunk, _mm_set1_epi8( ' ' ) );
+    whitespace = _mm_or_si128( whitespace, _mm_cmpeq_epi8( chunk, _mm_set1_epi8( '\t' ) ) );
+    whitespace = _mm_or_si128( whitespace, _mm_cmpeq_epi8( chunk, _mm_set1_epi8( '\n' ) ) );
+    whitespace = _mm_or_si128( whitespace, _mm_cmpeq_epi8( chunk, _mm_set1_epi8( '\r' ) ) );
+    masks.whitespace = _mm_movemask_epi8( whitespace );
+#else
+    masks = {};
+    for ( u32 i = 0; i < k_json_block_size; ++i ) {
+        const char c = block[ i ];
+        const u32 bit = 1u << i;
+
+        masks.quote |= c == '"' ? bit : 0;
+        masks.backslash |= c == '\\' ? bit : 0;
+        masks.operators |= ( c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',' ) ? bit : 0;
+        masks.whitespace |= ( c == ' ' || c == '\t' || c == '\n' || c == '\r' ) ? bit : 0;
+    }
+#endif // IDRA_JSON_SSE2
+    return masks;
+}
+
+// Each bit becomes the xor of itself and all the previous bits.
+static u32 json_prefix_xor( u32 mask ) {
+    mask ^= mask << 1;
+    mask ^= mask << 2;
+    mask ^= mask << 4;
+    mask ^= mask << 8;
+    return mask & 0xffff;
+}
+
+static u32 json_scan_block( const char* block, JsonScanState& state ) {
+
+    const JsonBlockMasks masks = json_classify_block( block );
+
+    // Escaped characters: rare, resolved with a scalar loop.
+    u32 escaped = 0;
+    if ( masks.backslash || state.escape_next ) {
+        for ( u32 i = 0; i < k_json_block_size; ++i ) {
+            const u32 bit = 1u << i;
+            if ( state.escape_next ) {
+                escaped |= bit;
+                state.escape_next = 0;
+            } else if ( masks.backslash & bit ) {
+                state.escape_next = 1;
+            }
+        }
+    }
+
+    const u32 quotes = masks.quote & ~escaped;
+    // Opening quote and string content are inside, closing quote is outside.
+    const u32 in_string = json_prefix_xor( quotes ) ^ ( state.in_string ? 0xffff : 0 );
+    state.in_string = ( in_string >> 15 ) & 1;
+
+    const u32 outside = ~in_string & 0xffff;
+    const u32 boundary = ( masks.operators | masks.whitespace | quotes ) & outside;
+    const u32 scalars = ~( masks.operators | masks.whitespace | masks.quote ) & outside & 0xffff;
+    const u32 scalar_starts = scalars & ( ( boundary << 1 ) | state.prev_boundary );
+    state.prev_boundary = ( boundary >> 15 ) & 1;
+
+    return ( masks.operators & outside ) | ( quotes & in_string ) | scalar_starts;
+}
+
+u32 json_find_structurals( StringView source, u32* out_structurals, bool* out_unterminated_string ) {
+
+    JsonScanState state;
+    u32 count = 0;
+
+    const u32 full_blocks_size = ( u32 )( source.size & ~( sizet )( k_json_block_size - 1 ) );
+    u32 offset = 0;
+    for ( ; offset < full_blocks_size; offset += k_json_block_size ) {
+        u32 structurals = json_scan_block( source.data + offset, state );
+        while ( structurals ) {
+            out_structurals[ count++ ] = offset + trailing_zeros_u32( structurals );
+            structurals &= structurals - 1;
+        }
+    }
+
+    // Last partial block, padded with whitespace.
+    if ( offset < source.size ) {
+        char block[ k_json_block_size ];
+        memset( block, ' ', k_json_block_size );
+        memcpy( block, source.data + offset, source.size - offset );
+
+        u32 structurals = json_scan_block( block, state );
+        while ( structurals ) {
+            const u32 position = offset + trailing_zeros_u32( structurals );
+            if ( position < source.size ) {
+                out_structurals[ count++ ] = position;
+            }
+            structurals &= structurals - 1;
+        }
+    }
+
+    *out_unterminated_string = state.in_string != 0;
+
+    return count;
+}
+
+// JsonReader /////////////////////////////////////////////////////////////
+bool JsonReader::init( Allocator* allocator_, StringView source_ ) {
+
+    allocator = allocator_;
+    source = source_;
+
+    // Worst case is one structural per character, plus the end sentinel.
+    structurals = ( u32* )ialloc( sizeof( u32 ) * ( source.size + 1 ), allocator );
+    bool unterminated_string = false;
+    num_structurals = json_find_structurals( source, structurals, &unterminated_string );
+
+    if ( unterminated_string ) {
+        ilog_error( "Json error: unterminated string\n" );
+        return false;
+    }
+
+    // Sentinel pointing to the null terminator.
+    structurals[ num_structurals ] = ( u32 )source.size;
+
+    container_ends = ( u32* )ialloc( sizeof( u32 ) * ( num_structurals + 1 ), allocator );
+
+    // Match open and close brackets.
+    u32 stack[ k_json_max_depth ];
+    u32 depth = 0;
+
+    for ( u32 i = 0; i < num_structurals; ++i ) {
+        const char c = source.data[ structurals[ i ] ];
+        container_ends[ i ] = i;
+
+        if ( c == '{' || c == '[' ) {
+            if ( depth == k_json_max_depth ) {
+                ilog_error( "Json error: maximum depth %u reached\n", k_json_max_depth );
+                return false;
+            }
+            stack[ depth++ ] = i;
+        } else if ( c == '}' || c == ']' ) {
+            const char expected_open = c == '}' ? '{' : '[';
+            if ( depth == 0 || source.data[ structurals[ stack[ depth - 1 ] ] ] != expected_open ) {
+                ilog_error( "Json error: unexpected %c at offset %u\n", c, structurals[ i ] );
+                return false;
+            }
+            container_ends[ stack[ --depth ] ] = i;
+        }
+    }
+
+    container_ends[ num_structurals ] = num_structurals;
+
+    if ( depth != 0 ) {
+        ilog_error( "Json error: %u containers not closed\n", depth );
+        return false;
+    }
+
+    return true;
+}
+
+void JsonReader::shutdown() {
+    if ( container_ends ) {
+        ifree( container_ends, allocator );
+    }
+    if ( structurals ) {
+        ifree( structurals, allocator );
+    }
+
+    container_ends = nullptr;
+    structurals = nullptr;
+    num_structurals = 0;
+}
+
+JsonValue JsonReader::get_root() const {
+    if ( num_structurals == 0 ) {
+        return {};
+    }
+    return { this, 0 };
+}
+
+// JsonValue //////////////////////////////////////////////////////////////
+static char json_value_char( const JsonReader* reader, u32 index ) {
+    return reader->source.data[ reader->structurals[ index ] ];
+}
+
+JsonType JsonValue::get_type() const {
+    if ( !reader || index >= reader->num_structurals ) {
+        return JsonType_Invalid;
+    }
+
+    switch ( json_value_char( reader, index ) ) {
+        case '{':
+            return JsonType_Object;
+        case '[':
+            return JsonType_Array;
+        case '"':
+            return JsonType_String;
+        case 't':
+        case 'f':
+            return JsonType_Bool;
+        case 'n':
+            return JsonType_Null;
+        case '-':
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            return JsonType_Number;
+        default:
+            return JsonType_Invalid;
+    }
+}
+
+StringView JsonValue::as_string( StringView default_value ) const {
+    if ( get_type() != JsonType_String ) {
+        return default_value;
+    }
+
+    const char* start = reader->source.data + reader->structurals[ index ] + 1;
+    const char* end = start;
+    while ( *end != '"' && *end != 0 ) {
+        // Skip escaped character
+        end += ( *end == '\\' && end[ 1 ] != 0 ) ? 2 : 1;
+    }
+
+    return StringView( start, end - start );
+}
+
+f64 JsonValue::as_f64( f64 default_value ) const {
+    if ( get_type() != JsonType_Number ) {
+        return default_value;
+    }
+
+    return strtod( reader->source.data + reader->structurals[ index ], nullptr );
+}
+
+bool JsonValue::as_bool( bool default_value ) const {
+    if ( get_type() != JsonType_Bool ) {
+        return default_value;
+    }
+
+    return json_value_char( reader, index ) == 't';
+}
+
+JsonValue JsonValue::get( StringView key ) const {
+    if ( get_type() != JsonType_Object ) {
+        return {};
+    }
+
+    const u32 end = reader->container_ends[ index ];
+    u32 i = index + 1;
+    // Members are: key string, colon, value, optional comma.
+    while ( i < end ) {
+        const JsonValue member_key{ reader, i };
+        const JsonValue member_value{ reader, i + 2 };
+
+        const StringView member_name = member_key.as_string();
+        if ( member_name.size == key.size && memcmp( member_name.data, key.data, key.size ) == 0 ) {
+            return member_value;
+        }
+
+        i = member_value.get_end_index();
+        if ( i < end && json_value_char( reader, i ) == ',' ) {
+            ++i;
+        }
+    }
+
+    return {};
+}
+
+StringView JsonValue::get_string( StringView key, StringView default_value ) const {
+    return get( key ).as_string( default_value );
+}
+
+f32 JsonValue::get_f32( StringView key, f32 default_value ) const {
+    return ( f32 )get( key ).as_f64( default_value );
+}
+
+i32 JsonValue::get_i32( StringView key, i32 default_value ) const {
+    return ( i32 )get( key ).as_f64( default_value );
+}
+
+bool JsonValue::get_bool( StringView key, bool default_value ) const {
+    return get( key ).as_bool( default_value );
+}
+
+u32 JsonValue::get_size() const {
+    u32 size = 0;
+    for ( JsonValue value = first(); value.is_valid(); value = value.next() ) {
+        ++size;
+    }
+    return size;
+}
+
+JsonValue JsonValue::first() const {
+    if ( get_type() != JsonType_Array ) {
+        return {};
+    }
+
+    const u32 first_index = index + 1;
+    if ( first_index >= reader->container_ends[ index ] ) {
+        return {};
+    }
+
+    return { reader, first_index };
+}
+
+JsonValue JsonValue::next() const {
+    const u32 end_index = get_end_index();
+    if ( end_index < reader->num_structurals && json_value_char( reader, end_index ) == ',' ) {
+        return { reader, end_index + 1 };
+    }
+
+    return {};
+}
+
+u32 JsonValue::get_end_index() const {
+    const JsonType type = get_type();
+    if ( type == JsonType_Object || type == JsonType_Array ) {
+        return reader->container_ends[ index ] + 1;
+    }
+    return index + 1;
+}
+
+} // namespace idra
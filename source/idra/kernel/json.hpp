@@ -0,0 +1,101 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#pragma once
+
+#include "kernel/string_view.hpp"
+
+namespace idra {
+
+    struct Allocator;
+    struct JsonReader;
+
+    // Json ///////////////////////////////////////////////////////////////
+    //
+    // Read only json parser working in two stages, inspired by simdjson:
+    // 1. SIMD scan of the source, 16 bytes at a time, to find the index of
+    //    every structural character ( {}[]:, ), string and scalar start.
+    // 2. Pull interface over the structural indices. Strings and numbers are
+    //    read directly from the source buffer, without per node allocations.
+    //
+    // Source must be null terminated (like file_read_allocate output) and
+    // live as long as the reader. Strings are returned as they are in the
+    // source, escape sequences are not decoded.
+    //
+
+    enum JsonType : u8 {
+        JsonType_Invalid = 0,
+        JsonType_Object,
+        JsonType_Array,
+        JsonType_String,
+        JsonType_Number,
+        JsonType_Bool,
+        JsonType_Null
+    }; // enum JsonType
+
+    //
+    // Lightweight handle to a value inside a JsonReader.
+    struct JsonValue {
+
+        JsonType                    get_type() const;
+
+        bool                        is_valid() const        { return reader != nullptr; }
+        bool                        is_object() const       { return get_type() == JsonType_Object; }
+        bool                        is_array() const        { return get_type() == JsonType_Array; }
+        bool                        is_string() const       { return get_type() == JsonType_String; }
+
+        // Scalar accessors, return the default if the type is different.
+        StringView                  as_string( StringView default_value = {} ) const;
+        f64                         as_f64( f64 default_value = 0.0 ) const;
+        bool                        as_bool( bool default_value = false ) const;
+
+        // Object interface. Lookup is linear in the number of members.
+        JsonValue                   get( StringView key ) const;
+
+        StringView                  get_string( StringView key, StringView default_value = {} ) const;
+        f32                         get_f32( StringView key, f32 default_value ) const;
+        i32                         get_i32( StringView key, i32 default_value ) const;
+        bool                        get_bool( StringView key, bool default_value ) const;
+
+        // Array interface.
+        // for ( JsonValue v = array.first(); v.is_valid(); v = v.next() )
+        u32                         get_size() const;
+        JsonValue                   first() const;
+        JsonValue                   next() const;
+
+        // Index of the first structural after this value.
+        u32                         get_end_index() const;
+
+        const JsonReader*           reader  = nullptr;
+        u32                         index   = 0;        // Index into structural indices.
+
+    }; // struct JsonValue
+
+    //
+    //
+    struct JsonReader {
+
+        // Returns false and logs the error on malformed structure.
+        bool                        init( Allocator* allocator, StringView source );
+        void                        shutdown();
+
+        JsonValue                   get_root() const;
+
+        StringView                  source;
+
+        u32*                        structurals         = nullptr;  // Source offsets of structural characters.
+        u32*                        container_ends      = nullptr;  // For each structural, index of the matching close for { and [.
+        u32                         num_structurals     = 0;
+
+        Allocator*                  allocator           = nullptr;
+
+    }; // struct JsonReader
+
+    // Stage 1, exposed for reuse: writes source offsets of structurals and
+    // returns their count. Output must hold source.size + 1 entries.
+    // out_unterminated_string is set when the source ends inside a string.
+    u32                             json_find_structurals( StringView source, u32* out_structurals, bool* out_unterminated_string );
+
+} // namespace idra
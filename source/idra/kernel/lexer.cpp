@@ -1,10 +1,16 @@
-// Hydra Lexer 0.02
+// Hydra Lexer 0.03
 
 #include "lexer.hpp"
+#include "kernel/bit.hpp"
 
 #include <string.h>
 #include <stdlib.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IDRA_LEXER_SSE2
+#endif // __SSE2__ || _M_X64
+
 //
 // DataBuffer ///////////////////////////////////////////////////////////////////
 
@@ -38,11 +44,15 @@ void data_buffer_reset( DataBuffer* data_buffer ) {
 //
 uint32_t data_buffer_add( DataBuffer* data_buffer, double data ) {
 
-    if ( data_buffer->current_entries >= data_buffer->max_entries )
-        return k_invalid_entry;
+    if ( data_buffer->current_entries >= data_buffer->max_entries ) {
+        data_buffer->max_entries = data_buffer->max_entries ? data_buffer->max_entries * 2 : 256;
+        data_buffer->entries = (DataBuffer::Entry*)realloc( data_buffer->entries, sizeof( DataBuffer::Entry ) * data_buffer->max_entries );
+    }
 
-    if ( data_buffer->current_size + sizeof( double ) >= data_buffer->buffer_size )
-        return k_invalid_entry;
+    if ( data_buffer->current_size + sizeof( double ) > data_buffer->buffer_size ) {
+        data_buffer->buffer_size = data_buffer->buffer_size ? data_buffer->buffer_size * 2 : 1024;
+        data_buffer->data = (char*)realloc( data_buffer->data, data_buffer->buffer_size );
+    }
 
     // Init entry
     DataBuffer::Entry& entry = data_buffer->entries[data_buffer->current_entries++];
@@ -74,6 +84,148 @@ void data_buffer_get( const DataBuffer& data_buffer, uint32_t entry_index, float
     value = (float)(*value_data);
 }
 
+//
+// Run scanning /////////////////////////////////////////////////////////////////
+
+static const uint32_t               k_lexer_block_size = 16;
+static const uint32_t               k_lexer_page_size = 4096;
+
+enum LexerCharClass {
+    LexerCharClass_Whitespace,      // ' ', \t, \v, \f, \r, \n
+    LexerCharClass_Identifier,      // a-z, A-Z, 0-9, _
+    LexerCharClass_Digit,           // 0-9
+    LexerCharClass_LineContent,     // Anything but \r, \n and the terminator
+    LexerCharClass_BlockComment,    // Anything but * and the terminator
+}; // enum LexerCharClass
+
+//
+// Classify 16 bytes, one bit per byte. Also returns the end of line bits,
+// used to count lines while skipping whitespace.
+template <LexerCharClass char_class>
+static uint32_t lexer_classify_block( const char* block, uint32_t& out_end_of_line_mask ) {
+#if defined (IDRA_LEXER_SSE2)
+    const __m128i chunk = _mm_loadu_si128( ( const __m128i* )block );
+
+    const __m128i end_of_line = _mm_or_si128( _mm_cmpeq_epi8( chunk, _mm_set1_epi8( '\n' ) ),
+                                              _mm_cmpeq_epi8( chunk, _mm_set1_epi8( '\r' ) ) );
+    out_end_of_line_mask = _mm_movemask_epi8( end_of_line );
+
+    // Signed compares: bytes >= 0x80 are negative and never fall in an ascii range.
+    const __m128i digits = _mm_and_si128( _mm_cmpgt_epi8( chunk, _mm_set1_epi8( '0' - 1 ) ),
+                                          _mm_cmplt_epi8( chunk, _mm_set1_epi8( '9' + 1 ) ) );
+
+    switch ( char_class ) {
+        case LexerCharClass_Whitespace:
+        {
+            // \t, \n, \v, \f, \r are contiguous.
+            const __m128i controls = _mm_and_si128( _mm_cmpgt_epi8( chunk, _mm_set1_epi8( '\t' - 1 ) ),
+                                                    _mm_cmplt_epi8( chunk, _mm_set1_epi8( '\r' + 1 ) ) );
+            return _mm_movemask_epi8( _mm_or_si128( controls, _mm_cmpeq_epi8( chunk, _mm_set1_epi8( ' ' ) ) ) );
+        }
+        case LexerCharClass_Identifier:
+        {
+            const __m128i lower = _mm_or_si128( chunk, _mm_set1_epi8( 0x20 ) );
+            const __m128i letters = _mm_and_si128( _mm_cmpgt_epi8( lower, _mm_set1_epi8( 'a' - 1 ) ),
+                                                   _mm_cmplt_epi8( lower, _mm_set1_epi8( 'z' + 1 ) ) );
+            const __m128i underscore = _mm_cmpeq_epi8( chunk, _mm_set1_epi8( '_' ) );
+            return _mm_movemask_epi8( _mm_or_si128( _mm_or_si128( letters, digits ), underscore ) );
+        }
+        case LexerCharClass_Digit:
+        {
+            return _mm_movemask_epi8( digits );
+        }
+        case LexerCharClass_LineContent:
+        {
+            const __m128i terminator = _mm_cmpeq_epi8( chunk, _mm_setzero_si128() );
+            return ~_mm_movemask_epi8( _mm_or_si128( end_of_line, terminator ) ) & 0xffff;
+        }
+        case LexerCharClass_BlockComment:
+        {
+            const __m128i terminator = _mm_cmpeq_epi8( chunk, _mm_setzero_si128() );
+            return ~_mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( chunk, _mm_set1_epi8( '*' ) ), terminator ) ) & 0xffff;
+        }
+    }
+    return 0;
+#else
+    uint32_t mask = 0;
+    out_end_of_line_mask = 0;
+    for ( uint32_t i = 0; i < k_lexer_block_size; ++i ) {
+        const char c = block[ i ];
+        const uint32_t bit = 1u << i;
+
+        out_end_of_line_mask |= is_end_of_line( c ) ? bit : 0;
+
+        bool in_class = false;
+        switch ( char_class ) {
+            case LexerCharClass_Whitespace:     in_class = is_whitespace( c ); break;
+            case LexerCharClass_Identifier:     in_class = is_alpha( c ) || is_number( c ) || ( c == '_' ); break;
+            case LexerCharClass_Digit:          in_class = is_number( c ); break;
+            case LexerCharClass_LineContent:    in_class = !is_end_of_line( c ) && !is_end_of_text( c ); break;
+            case LexerCharClass_BlockComment:   in_class = ( c != '*' ) && !is_end_of_text( c ); break;
+        }
+        mask |= in_class ? bit : 0;
+    }
+    return mask;
+#endif // IDRA_LEXER_SSE2
+}
+
+static uint32_t lexer_count_bits( uint32_t mask ) {
+    mask = mask - ( ( mask >> 1 ) & 0x55555555 );
+    mask = ( mask & 0x33333333 ) + ( ( mask >> 2 ) & 0x33333333 );
+    return ( ( ( mask + ( mask >> 4 ) ) & 0x0f0f0f0f ) * 0x01010101 ) >> 24;
+}
+
+//
+// Returns the first character after the run of char_class starting at text,
+// adding the end of lines found to out_lines if present.
+// Blocks never cross a page, so reading past the terminator is safe, and the
+// terminator itself is never part of a run.
+template <LexerCharClass char_class>
+static char* lexer_scan_run( char* text, uint32_t* out_lines ) {
+    uint32_t end_of_line_mask;
+
+    // Most runs are short: try an unaligned block first, if it does not cross a page.
+    if ( ( (uintptr_t)text & ( k_lexer_page_size - 1 ) ) <= k_lexer_page_size - k_lexer_block_size ) {
+        const uint32_t stop_mask = ~lexer_classify_block<char_class>( text, end_of_line_mask ) & 0xffff;
+
+        if ( stop_mask ) {
+            const uint32_t stop = idra::trailing_zeros_u32( stop_mask );
+            if ( out_lines ) {
+                *out_lines += lexer_count_bits( end_of_line_mask & ( ( 1u << stop ) - 1 ) );
+            }
+            return text + stop;
+        }
+    }
+
+    // Continue with aligned blocks.
+    // Bytes before text are considered part of the run and their end of lines are ignored.
+    const uint32_t misalignment = (uint32_t)( (uintptr_t)text & ( k_lexer_block_size - 1 ) );
+    const char* block = text - misalignment;
+    uint32_t skip_mask = ( 1u << misalignment ) - 1;
+
+    for ( ;; ) {
+        const uint32_t run_mask = lexer_classify_block<char_class>( block, end_of_line_mask ) | skip_mask;
+        const uint32_t stop_mask = ~run_mask & 0xffff;
+
+        end_of_line_mask &= ~skip_mask;
+
+        if ( stop_mask ) {
+            const uint32_t stop = idra::trailing_zeros_u32( stop_mask );
+            if ( out_lines ) {
+                *out_lines += lexer_count_bits( end_of_line_mask & ( ( 1u << stop ) - 1 ) );
+            }
+            return (char*)block + stop;
+        }
+
+        if ( out_lines ) {
+            *out_lines += lexer_count_bits( end_of_line_mask );
+        }
+
+        skip_mask = 0;
+        block += k_lexer_block_size;
+    }
+}
+
 //
 // Lexer ////////////////////////////////////////////////////////////////////////
 
@@ -200,9 +352,7 @@ void lexer_next_token( Lexer* lexer, Token& token ) {
             if ( is_alpha( c ) ) {
                 token.type = Token::Token_Identifier;
 
-                while ( is_alpha( lexer->position[0] ) || is_number( lexer->position[0] ) || (lexer->position[0] == '_') ) {
-                    ++lexer->position;
-                }
+                lexer->position = lexer_scan_run<LexerCharClass_Identifier>( lexer->position, nullptr );
 
                 token.text.size = lexer->position - token.text.data;
             } // Numbers: handle also negative ones!
@@ -245,16 +395,11 @@ void lexer_parse_number( Lexer* lexer ) {
     // 3. Decimal part (until the point)
     int32_t decimal_part = 0;
     if ( *lexer->position > '0' && *lexer->position <= '9' ) {
-        decimal_part = (*lexer->position - '0');
-        ++lexer->position;
-
-        while ( *lexer->position != '.' && is_number( *lexer->position ) ) {
+        const char* digits_end = lexer_scan_run<LexerCharClass_Digit>( lexer->position, nullptr );
 
+        for ( ; lexer->position != digits_end; ++lexer->position ) {
             decimal_part = (decimal_part * 10) + (*lexer->position - '0');
-
-            ++lexer->position;
         }
-
     }
     // 4. Fractional part
     int32_t fractional_part = 0;
@@ -263,12 +408,11 @@ void lexer_parse_number( Lexer* lexer ) {
     if ( *lexer->position == '.' ) {
         ++lexer->position;
 
-        while ( is_number( *lexer->position ) ) {
+        const char* digits_end = lexer_scan_run<LexerCharClass_Digit>( lexer->position, nullptr );
 
+        for ( ; lexer->position != digits_end; ++lexer->position ) {
             fractional_part = (fractional_part * 10) + (*lexer->position - '0');
             fractional_divisor *= 10;
-
-            ++lexer->position;
         }
     }
 
@@ -289,30 +433,23 @@ void lexer_skip_whitespace( Lexer* lexer ) {
     for ( ;; ) {
         // Check if it is a pure whitespace first.
         if ( is_whitespace( lexer->position[0] ) ) {
-            // Handle change of line
-            if ( is_end_of_line( lexer->position[0] ) )
-                ++lexer->line;
-
-            // Advance to next character
-            ++lexer->position;
+            // Skip the whole run, counting the lines.
+            lexer->position = lexer_scan_run<LexerCharClass_Whitespace>( lexer->position, &lexer->line );
 
         } // Check for single line comments ("//")
         else if ( (lexer->position[0] == '/') && (lexer->position[1] == '/') ) {
-            lexer->position += 2;
-            while ( lexer->position[0] && !is_end_of_line( lexer->position[0] ) ) {
-                ++lexer->position;
-            }
+            lexer->position = lexer_scan_run<LexerCharClass_LineContent>( lexer->position + 2, nullptr );
         } // Check for c-style comments
         else if ( (lexer->position[0] == '/') && (lexer->position[1] == '*') ) {
             lexer->position += 2;
 
-            // Advance until the string is closed. Remember to check if line is changed.
-            while ( !((lexer->position[0] == '*') && (lexer->position[1] == '/')) ) {
-                // Handle change of line
-                if ( is_end_of_line( lexer->position[0] ) )
-                    ++lexer->line;
+            // Advance until the comment is closed, counting the lines.
+            for ( ;; ) {
+                lexer->position = lexer_scan_run<LexerCharClass_BlockComment>( lexer->position, &lexer->line );
+
+                if ( !lexer->position[0] || lexer->position[1] == '/' )
+                    break;
 
-                // Advance to next character
                 ++lexer->position;
             }
 
@@ -454,26 +591,7 @@ void lexer_goto_line( Lexer* lexer, i32 line ) {
 void lexer_next_line( Lexer* lexer ) {
 
     // Arrive until just before the end of the line
-    while ( !is_end_of_line( lexer->position[ 0 ] ) && !is_end_of_text( lexer->position[ 0 ] ) ) {
-        ++lexer->position;
-
-        //// Handle different End of Line formats
-        //if ( *lexer->position == '\r' ) {
-        //    ++lexer->position;
-        //    if ( *lexer->position == '\n' )
-        //        ++lexer->position;
-
-        //    ++lexer->line;
-        //    ++lexer->position;
-
-        //    return;
-        //} else if ( *lexer->position == '\n' ) {
-        //    ++lexer->line;
-        //    ++lexer->position;
-
-        //    return;
-        //}
-    }
+    lexer->position = lexer_scan_run<LexerCharClass_LineContent>( lexer->position, nullptr );
 
     // Advance further if \r is present
     if ( *lexer->position == '\r' ) {
@@ -1,7 +1,7 @@
 #pragma once
 
 //
-// Hydra Lexer v0.02
+// Hydra Lexer v0.03
 //
 //      Source code     : https://www.github.com/jorenjoestar/
 //
@@ -10,6 +10,7 @@
 //
 // Revision history //////////////////////
 //
+//      0.03  (2026/10/17): + SSE2 scanning of whitespace, comment, identifier and number runs. + DataBuffer grows instead of dropping entries.
 //      0.02  (2021/06/10): + Updated to new HydraNext framework.
 //      0.01  (2021/02/03): + Initial tracking of version. + Added lexer_goto_line and lexer_next_line. + Added possibility to use lexer without data_buffer.
 
@@ -24,6 +25,7 @@ static const uint32_t               k_invalid_entry = 0xffffffff;
 
 //
 // DataBuffer class used to store data from the lexer. Used mostly for numbers.
+// Entries and data storage double when full.
 struct DataBuffer {
 
     struct Entry {
@@ -32,37 +32,31 @@ static void output_visual_studio( char* log_buffer_ ) {
 }
 #endif
 
-void variadic_print_format( cstring format, va_list arguments ) {
-
-    // Define a thread local buffer to print stuff.
-    static thread_local char log_buffer[ k_string_buffer_size ];
-
-    // Calculate the length of the string
-    //va_list arguments_copy;
-    //va_copy( arguments_copy, arguments );
-    //// Add +1 for null termination
-    //int argument_length = vsnprintf( NULL, 0, format, arguments_copy ) + 1;
-    //va_end( arguments_copy );
+// Define a thread local buffer to print stuff.
+static thread_local char log_buffer[ k_string_buffer_size ];
 
+static void log_output( char* log_buffer_ ) {
+    output_console( log_buffer_ );
 #if defined(_MSC_VER)
-    int len = vsnprintf( log_buffer, k_string_buffer_size, format, arguments );
-#else
-    int len = vsnprintf( log_buffer, k_string_buffer_size, format, arguments );
-#endif
-
-    log_buffer[ len ] = '\0';
-
-    output_console( log_buffer );
-#if defined(_MSC_VER)
-    output_visual_studio( log_buffer );
+    output_visual_studio( log_buffer_ );
 #endif // _MSC_VER
 
     for ( u32 i = 0; i < callbacks.size; ++i ) {
         PrintCallback callback = callbacks[ i ];
-        callback( log_buffer );
+        callback( log_buffer_ );
     }
 }
 
+void variadic_print_format( cstring format, va_list arguments ) {
+
+    FormatOutput output;
+    output.init( log_buffer, k_string_buffer_size );
+    format_printf( output, format, arguments );
+    output.terminate();
+
+    log_output( log_buffer );
+}
+
 void LogService::print_format( cstring format, ... ) {
     va_list args;
     va_start( args, format );
@@ -80,6 +74,18 @@ void LogService::log( LogLevel level, cstring format, ... ) {
     }
 }
 
+void LogService::log_args( LogLevel level, const FormatPattern& pattern, const FormatArg* args ) {
+
+    if ( level >= min_log_level ) {
+        FormatOutput output;
+        output.init( log_buffer, k_string_buffer_size );
+        format_write( output, pattern, args );
+        output.terminate();
+
+        log_output( log_buffer );
+    }
+}
+
 void LogService::log_set_min_level( LogLevel level ) {
     min_log_level = level;
 }
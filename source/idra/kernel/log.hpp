@@ -5,7 +5,7 @@
 
 #pragma once
 
-#include "platform.hpp"
+#include "kernel/format.hpp"
 
 namespace idra {
 
@@ -35,6 +35,12 @@ struct LogService {
     void                        log( LogLevel level, cstring format, ... );
     void                        print_format( cstring format, ... );
 
+    // "{}" formatting, see format.hpp. Formats directly in the log buffer.
+    template <typename... Args>
+    void                        log_format( LogLevel level, FormatStringFor<Args...> format, const Args&... args );
+
+    void                        log_args( LogLevel level, const FormatPattern& pattern, const FormatArg* args );
+
     void                        log_set_min_level( LogLevel level );
 
     // Callback 
@@ -47,6 +53,14 @@ struct LogService {
 
 extern LogService*              g_log;
 
+template <typename... Args>
+inline void LogService::log_format( LogLevel level, FormatStringFor<Args...> format, const Args&... args ) {
+    if ( level >= min_log_level ) {
+        const FormatArg format_args[ sizeof...( Args ) + 1 ] = { FormatArg( args )... };
+        log_args( level, format, format_args );
+    }
+}
+
 
 // Helper macros //////////////////////////////////////////////////////////
 
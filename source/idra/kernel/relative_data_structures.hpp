@@ -1,6 +1,8 @@
 #pragma once
 
 #include "kernel/string_view.hpp"
+#include "kernel/allocator.hpp"
+#include "kernel/hash_map.hpp"
 
 namespace idra {
 
@@ -62,6 +64,39 @@ struct RelativeString : public RelativeArray<char> {
 
 
 
+// RelativeFlatHashMap ////////////////////////////////////////////////
+//
+// Open addressing hash map living entirely inside a blob, queryable
+// straight from mapped memory without deserialization.
+// Like asset loaders path maps, keys are stored as 64 bits hashes:
+// the key itself is not kept. Hash 0 marks an empty slot.
+// Capacity is a power of two at least twice the size, so linear probing
+// always finds an empty slot.
+template <typename V>
+struct RelativeHashSlot {
+    u64                     hash;
+    V                       value;
+}; // struct RelativeHashSlot
+
+template <typename K, typename V>
+struct RelativeFlatHashMap {
+
+    const V*                get( const K& key ) const;
+    const V*                get_hashed( u64 hash ) const;
+
+    static u64              fix_hash( u64 hash )                { return hash ? hash : 1; }
+    static u32              calculate_capacity( u32 num_elements );
+
+#if defined IDRA_BLOB_WRITE
+    void                    insert( const K& key, const V& value );
+    void                    insert_hashed( u64 hash, const V& value );
+#endif // IDRA_BLOB_WRITE
+
+    u32                     size;
+    RelativeArray<RelativeHashSlot<V>> slots;
+}; // struct RelativeFlatHashMap
+
+
 // Implementations/////////////////////////////////////////////////////////
 
 // RelativePointer ////////////////////////////////////////////////////////
@@ -148,5 +183,66 @@ inline void RelativeArray<T>::set_empty() {
     data.set_null();
 }
 #endif // IDRA_BLOB_WRITE
+
+// RelativeFlatHashMap ////////////////////////////////////////////////////
+template<typename K, typename V>
+inline const V* RelativeFlatHashMap<K, V>::get( const K& key ) const {
+    return get_hashed( hash_calculate( key ) );
+}
+
+template<typename K, typename V>
+inline const V* RelativeFlatHashMap<K, V>::get_hashed( u64 hash ) const {
+    if ( slots.size == 0 ) {
+        return nullptr;
+    }
+
+    hash = fix_hash( hash );
+    const u32 mask = slots.size - 1;
+    const RelativeHashSlot<V>* slot_data = slots.get();
+
+    for ( u32 index = ( u32 )hash & mask; ; index = ( index + 1 ) & mask ) {
+        const RelativeHashSlot<V>& slot = slot_data[ index ];
+        if ( slot.hash == hash ) {
+            return &slot.value;
+        }
+        if ( slot.hash == 0 ) {
+            return nullptr;
+        }
+    }
+}
+
+template<typename K, typename V>
+inline u32 RelativeFlatHashMap<K, V>::calculate_capacity( u32 num_elements ) {
+    u32 capacity = 1;
+    while ( capacity < num_elements * 2 ) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+#if defined IDRA_BLOB_WRITE
+template<typename K, typename V>
+inline void RelativeFlatHashMap<K, V>::insert( const K& key, const V& value ) {
+    insert_hashed( hash_calculate( key ), value );
+}
+
+template<typename K, typename V>
+inline void RelativeFlatHashMap<K, V>::insert_hashed( u64 hash, const V& value ) {
+    hash = fix_hash( hash );
+    const u32 mask = slots.size - 1;
+    RelativeHashSlot<V>* slot_data = slots.get();
+
+    for ( u32 index = ( u32 )hash & mask; ; index = ( index + 1 ) & mask ) {
+        RelativeHashSlot<V>& slot = slot_data[ index ];
+        // Overwrite duplicated keys.
+        if ( slot.hash == 0 || slot.hash == hash ) {
+            size += slot.hash == 0 ? 1 : 0;
+            slot.hash = hash;
+            slot.value = value;
+            return;
+        }
+    }
+}
+#endif // IDRA_BLOB_WRITE
 	
 } // namespace idra
\ No newline at end of file
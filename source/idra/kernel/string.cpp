@@ -66,19 +66,38 @@ void StringBuffer::append_f( const char* format, ... ) {
         return;
     }
 
-    // TODO: safer version!
+    FormatOutput output;
+    output.init( &data[ current_size ], buffer_size - current_size );
+
     va_list args;
     va_start( args, format );
-#if defined(_MSC_VER)
-    int written_chars = vsnprintf_s( &data[ current_size ], buffer_size - current_size, _TRUNCATE, format, args );
-#else
-    int written_chars = vsnprintf( &data[ current_size ], buffer_size - current_size, format, args );
-#endif
-
-    current_size += written_chars > 0 ? written_chars : 0;
+    format_printf( output, format, args );
     va_end( args );
 
-    if ( written_chars < 0 ) {
+    output.terminate();
+    current_size += output.size;
+
+    if ( output.truncated ) {
+        iassert_overflow();
+        ilog_error( "New string too big for current buffer! Please allocate more size.\n" );
+    }
+}
+
+void StringBuffer::append_args( const FormatPattern& pattern, const FormatArg* args ) {
+    if ( current_size >= buffer_size ) {
+        iassert_overflow();
+        ilog_error( "Buffer full! Please allocate more size.\n" );
+        return;
+    }
+
+    FormatOutput output;
+    output.init( &data[ current_size ], buffer_size - current_size );
+    format_write( output, pattern, args );
+    output.terminate();
+
+    current_size += output.size;
+
+    if ( output.truncated ) {
         iassert_overflow();
         ilog_error( "New string too big for current buffer! Please allocate more size.\n" );
     }
@@ -136,26 +155,23 @@ StringView StringBuffer::append_use( cstring string ) {
 StringView StringBuffer::append_use_f( const char* format, ... ) {
     u32 cached_offset = this->current_size;
 
-    StringView string_span { nullptr, 0 };
-    // TODO: safer version!
-    // TODO: do not copy paste!
     if ( current_size >= buffer_size ) {
         iassert_overflow();
         ilog_error( "Buffer full! Please allocate more size.\n" );
-        return string_span;
+        return { nullptr, 0 };
     }
 
+    FormatOutput output;
+    output.init( &data[ current_size ], buffer_size - current_size );
+
     va_list args;
     va_start( args, format );
-#if defined(_MSC_VER)
-    int written_chars = vsnprintf_s( &data[ current_size ], buffer_size - current_size, _TRUNCATE, format, args );
-#else
-    int written_chars = vsnprintf( &data[ current_size ], buffer_size - current_size, format, args );
-#endif
-    current_size += written_chars > 0 ? written_chars : 0;
+    format_printf( output, format, args );
     va_end( args );
 
-    if ( written_chars < 0 ) {
+    current_size += output.size;
+
+    if ( output.truncated ) {
         ilog_warn( "New string too big for current buffer! Please allocate more size.\n" );
     }
 
@@ -164,9 +180,32 @@ StringView StringBuffer::append_use_f( const char* format, ... ) {
     data[ current_size ] = 0;
     ++current_size;
 
-    //return this->data + cached_offset;
-    string_span = { this->data + cached_offset, current_size - cached_offset - 1 };
-    return string_span;
+    return { this->data + cached_offset, current_size - cached_offset - 1 };
+}
+
+StringView StringBuffer::append_use_args( const FormatPattern& pattern, const FormatArg* args ) {
+    u32 cached_offset = this->current_size;
+
+    if ( current_size >= buffer_size ) {
+        iassert_overflow();
+        ilog_error( "Buffer full! Please allocate more size.\n" );
+        return { nullptr, 0 };
+    }
+
+    FormatOutput output;
+    output.init( &data[ current_size ], buffer_size - current_size );
+    format_write( output, pattern, args );
+
+    current_size += output.size;
+
+    if ( output.truncated ) {
+        ilog_warn( "New string too big for current buffer! Please allocate more size.\n" );
+    }
+
+    data[ current_size ] = 0;
+    ++current_size;
+
+    return { this->data + cached_offset, current_size - cached_offset - 1 };
 }
 
 StringView StringBuffer::append_use( StringView text ) {
@@ -242,7 +281,7 @@ void StringArray::init( u32 size, Allocator* allocator_ ) {
     string_to_index->init( allocator, 8 );
     string_to_index->set_default_value( u32_max );
 
-    string_indices = ( Array<u32>* )allocated_memory + sizeof( FlatHashMap<u64, u32> );
+    string_indices = ( Array<u32>* )( allocated_memory + sizeof( FlatHashMap<u64, u32> ) );
     string_indices->init( allocator, 8 );
 
     data = allocated_memory + sizeof( FlatHashMap<u64, u32> ) + sizeof( Array<u32> );
@@ -279,10 +318,15 @@ cstring StringArray::intern( cstring string ) {
         return data + string_index;
     }
 
+    if ( current_size + length + 1 > buffer_size ) {
+        ilog_error( "StringArray full, cannot add string %s\n", string );
+        return nullptr;
+    }
+
     string_index = current_size;
     // Increase current buffer with new interned string
     current_size += ( u32 )length + 1; // null termination
-    strcpy( data + string_index, string );
+    memcpy( data + string_index, string, length + 1 );
 
     // Update hash map
     string_to_index->insert( hashed_string, string_index );
@@ -5,7 +5,7 @@
 
 #pragma once
 
-#include "kernel/string_view.hpp"
+#include "kernel/format.hpp"
 
 namespace idra {
 
@@ -33,12 +33,16 @@ namespace idra {
         void                        append_m( void* memory, sizet size );       // Memory version of append.
         void                        append( const StringBuffer& other_buffer );
         void                        append_f( const char* format, ... );        // Formatted version of append.
+        template <typename... Args>
+        void                        append_format( FormatStringFor<Args...> format, const Args&... args );    // "{}" formatting, see format.hpp.
         void                        close_current_string();
 
         // 
         // Append and returns a pointer to the start of the null-terminated string.
         StringView                  append_use( cstring string );
         StringView                  append_use_f( const char* format, ... );
+        template <typename... Args>
+        StringView                  append_use_format( FormatStringFor<Args...> format, const Args&... args );
         StringView                  append_use( StringView text );
 
         // Append a substring of the passed string.
@@ -55,6 +59,10 @@ namespace idra {
 
         void                        clear();
 
+        // Non template part of the format methods.
+        void                        append_args( const FormatPattern& pattern, const FormatArg* args );
+        StringView                  append_use_args( const FormatPattern& pattern, const FormatArg* args );
+
         char*                       data            = nullptr;
         u32                         buffer_size     = 1024;
         u32                         current_size    = 0;
@@ -87,5 +95,19 @@ namespace idra {
 
     }; // struct StringArray
 
+    // Implementation /////////////////////////////////////////////////////
+
+    template <typename... Args>
+    inline void StringBuffer::append_format( FormatStringFor<Args...> format, const Args&... args ) {
+        const FormatArg format_args[ sizeof...( Args ) + 1 ] = { FormatArg( args )... };
+        append_args( format, format_args );
+    }
+
+    template <typename... Args>
+    inline StringView StringBuffer::append_use_format( FormatStringFor<Args...> format, const Args&... args ) {
+        const FormatArg format_args[ sizeof...( Args ) + 1 ] = { FormatArg( args )... };
+        return append_use_args( format, format_args );
+    }
+
 
 } // namespace idra
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "kernel/string_id.hpp"
+
+#if defined (IDRA_STRING_ID_DEBUG)
+
+#include "kernel/assert.hpp"
+#include "kernel/log.hpp"
+
+#include <mutex>
+
+namespace idra {
+
+// Fixed size registry with linear probing, no allocator needed to use it
+// from static initializers. Names are copied, full registry stops adding.
+static const u32                k_string_id_registry_size = 8192;
+static const u32                k_string_id_names_size = ikilo( 512 );
+
+struct StringIdRegistry {
+
+    u64                         hashes[ k_string_id_registry_size ];
+    u32                         name_offsets[ k_string_id_registry_size ];
+    u32                         name_lengths[ k_string_id_registry_size ];
+
+    char                        names[ k_string_id_names_size ];
+    u32                         names_size      = 0;
+
+    std::mutex                  mutex;
+
+}; // struct StringIdRegistry
+
+static StringIdRegistry         s_string_id_registry;
+
+// Hash 0 marks an empty slot.
+static u32 string_id_find_slot( u64 hash ) {
+    u32 slot = ( u32 )hash & ( k_string_id_registry_size - 1 );
+    for ( u32 i = 0; i < k_string_id_registry_size; ++i ) {
+        const u64 slot_hash = s_string_id_registry.hashes[ slot ];
+        if ( slot_hash == hash || slot_hash == 0 ) {
+            return slot;
+        }
+        slot = ( slot + 1 ) & ( k_string_id_registry_size - 1 );
+    }
+    return u32_max;
+}
+
+void string_id_register( StringId id, StringView name ) {
+    if ( !id.is_valid() ) {
+        return;
+    }
+
+    StringIdRegistry& registry = s_string_id_registry;
+    std::lock_guard<std::mutex> lock( registry.mutex );
+
+    const u32 slot = string_id_find_slot( id.hash );
+    if ( slot == u32_max || registry.hashes[ slot ] == id.hash ) {
+        return;
+    }
+
+    if ( registry.names_size + name.size > k_string_id_names_size ) {
+        return;
+    }
+
+    memcpy( registry.names + registry.names_size, name.data, name.size );
+    registry.hashes[ slot ] = id.hash;
+    registry.name_offsets[ slot ] = registry.names_size;
+    registry.name_lengths[ slot ] = ( u32 )name.size;
+    registry.names_size += ( u32 )name.size;
+}
+
+StringView string_id_get_name( StringId id ) {
+    StringIdRegistry& registry = s_string_id_registry;
+    std::lock_guard<std::mutex> lock( registry.mutex );
+
+    const u32 slot = string_id_find_slot( id.hash );
+    if ( slot == u32_max || registry.hashes[ slot ] != id.hash ) {
+        return { "", 0 };
+    }
+
+    return { registry.names + registry.name_offsets[ slot ], registry.name_lengths[ slot ] };
+}
+
+void string_id_check( StringId id, StringView name ) {
+    const StringId name_id( name );
+    if ( name_id != id ) {
+        ilog_error( "StringId 0x%llx does not match name %.*s\n", id.hash, ( int )name.size, name.data );
+        iassert( false );
+    }
+}
+
+} // namespace idra
+
+#endif // IDRA_STRING_ID_DEBUG
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#pragma once
+
+#include "kernel/string_view.hpp"
+
+#include "external/wyhash.h"
+
+// Keep the id to name registry in debug builds, for logging and inspection.
+#if defined(_DEBUG) && !defined(IDRA_STRING_ID_DEBUG)
+#define IDRA_STRING_ID_DEBUG
+#endif // _DEBUG
+
+namespace idra {
+
+    // Constexpr hash /////////////////////////////////////////////////////
+    //
+    // Same result as hash_calculate( StringView ), that is wyhash with the
+    // default secret, but usable in constant expressions.
+    //
+
+    constexpr u64                   hash_constexpr_read( cstring p, u32 count ) {
+        u64 value = 0;
+        for ( u32 i = 0; i < count; ++i ) {
+            value |= ( u64 )( u8 )p[ i ] << ( i * 8 );
+        }
+        return value;
+    }
+
+    constexpr u64                   hash_constexpr_read3( cstring p, sizet k ) {
+        return ( ( u64 )( u8 )p[ 0 ] << 16 ) | ( ( u64 )( u8 )p[ k >> 1 ] << 8 ) | ( u64 )( u8 )p[ k - 1 ];
+    }
+
+    // 64x64 to 128 bit multiply, folding like wyhash _wymix.
+    constexpr u64                   hash_constexpr_mix( u64 a, u64 b ) {
+        const u64 ha = a >> 32, hb = b >> 32, la = ( u32 )a, lb = ( u32 )b;
+        const u64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+        const u64 t = rl + ( rm0 << 32 );
+        u64 c = t < rl;
+        const u64 lo = t + ( rm1 << 32 );
+        c += lo < t;
+        const u64 hi = rh + ( rm0 >> 32 ) + ( rm1 >> 32 ) + c;
+        return lo ^ hi;
+    }
+
+    constexpr u64                   hash_calculate_constexpr( cstring p, sizet length, u64 seed = 0 ) {
+        constexpr u64 secret[ 4 ] = { 0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull };
+
+        seed ^= secret[ 0 ];
+        u64 a = 0, b = 0;
+
+        if ( length <= 16 ) {
+            if ( length >= 4 ) {
+                a = ( hash_constexpr_read( p, 4 ) << 32 ) | hash_constexpr_read( p + ( ( length >> 3 ) << 2 ), 4 );
+                b = ( hash_constexpr_read( p + length - 4, 4 ) << 32 ) | hash_constexpr_read( p + length - 4 - ( ( length >> 3 ) << 2 ), 4 );
+            } else if ( length > 0 ) {
+                a = hash_constexpr_read3( p, length );
+            }
+        } else {
+            sizet i = length;
+            if ( i > 48 ) {
+                u64 see1 = seed, see2 = seed;
+                do {
+                    seed = hash_constexpr_mix( hash_constexpr_read( p, 8 ) ^ secret[ 1 ], hash_constexpr_read( p + 8, 8 ) ^ seed );
+                    see1 = hash_constexpr_mix( hash_constexpr_read( p + 16, 8 ) ^ secret[ 2 ], hash_constexpr_read( p + 24, 8 ) ^ see1 );
+                    see2 = hash_constexpr_mix( hash_constexpr_read( p + 32, 8 ) ^ secret[ 3 ], hash_constexpr_read( p + 40, 8 ) ^ see2 );
+                    p += 48;
+                    i -= 48;
+                } while ( i > 48 );
+                seed ^= see1 ^ see2;
+            }
+            while ( i > 16 ) {
+                seed = hash_constexpr_mix( hash_constexpr_read( p, 8 ) ^ secret[ 1 ], hash_constexpr_read( p + 8, 8 ) ^ seed );
+                i -= 16;
+                p += 16;
+            }
+            a = hash_constexpr_read( p + i - 16, 8 );
+            b = hash_constexpr_read( p + i - 8, 8 );
+        }
+
+        return hash_constexpr_mix( secret[ 1 ] ^ length, hash_constexpr_mix( a ^ secret[ 1 ], b ^ seed ) );
+    }
+
+    static_assert( hash_calculate_constexpr( "", 0 ) == 0x42bc986dc5eec4d3ull, "Constexpr hash differs from wyhash." );
+    static_assert( hash_calculate_constexpr( "../data/ui.bui", 14 ) == 0x9eb7caa63c103084ull, "Constexpr hash differs from wyhash." );
+
+    // StringId ///////////////////////////////////////////////////////////
+    //
+    // Hashed name, bit identical to hash_calculate( StringView ) so it can
+    // be used with existing maps and blobs.
+    // Built at compile time from literals, StringId( "../data/ui.bui" ),
+    // or at runtime from a StringView (char buffers included).
+    //
+    struct StringId {
+
+        constexpr                   StringId() = default;
+
+        template <sizet N>
+        explicit consteval          StringId( const char ( &text )[ N ] ) : hash( hash_calculate_constexpr( text, N - 1 ) ) {}
+
+        explicit                    StringId( StringView text );
+
+        static constexpr StringId   from_hash( u64 hash )               { StringId id; id.hash = hash; return id; }
+
+        constexpr bool              is_valid() const                    { return hash != 0; }
+
+        constexpr bool              operator==( const StringId& other ) const   { return hash == other.hash; }
+        constexpr bool              operator!=( const StringId& other ) const   { return hash != other.hash; }
+
+        u64                         hash    = 0;
+
+    }; // struct StringId
+
+    // Reverse lookup, only with IDRA_STRING_ID_DEBUG: returns "" otherwise or when unknown.
+    void                            string_id_register( StringId id, StringView name );
+    StringView                      string_id_get_name( StringId id );
+
+    // Registers the name and checks that the id was built from it.
+    void                            string_id_check( StringId id, StringView name );
+
+    // Implementation /////////////////////////////////////////////////////
+
+    inline StringId::StringId( StringView text ) : hash( wyhash( text.data, text.size, 0, _wyp ) ) {
+#if defined (IDRA_STRING_ID_DEBUG)
+        string_id_register( *this, text );
+#endif // IDRA_STRING_ID_DEBUG
+    }
+
+#if !defined (IDRA_STRING_ID_DEBUG)
+    inline void string_id_register( StringId, StringView ) {}
+    inline StringView string_id_get_name( StringId ) { return { "", 0 }; }
+    inline void string_id_check( StringId, StringView ) {}
+#endif // IDRA_STRING_ID_DEBUG
+
+} // namespace idra
@@ -0,0 +1,224 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "kernel/string_interner.hpp"
+#include "kernel/allocator.hpp"
+#include "kernel/hash_map.hpp"
+#include "kernel/memory.hpp"
+#include "kernel/assert.hpp"
+#include "kernel/log.hpp"
+#include "kernel/numerics.hpp"
+
+#include <new>
+
+namespace idra {
+
+static const u32 k_chunk_header_size = sizeof( char* );
+
+// Slot layout: high 32 bits of the hash, then id + 1 so zero marks an empty slot.
+static inline u64 slot_pack( u64 hash, u32 id ) {
+    return ( hash & 0xFFFFFFFF00000000ull ) | ( u64 )( id + 1 );
+}
+
+// StringInterner /////////////////////////////////////////////////////////
+void StringInterner::init( Allocator* allocator_, u32 initial_capacity, u32 chunk_size_ ) {
+
+    allocator = allocator_;
+    chunk_size = chunk_size_;
+
+    chunk = nullptr;
+    chunk_offset = chunk_capacity = 0;
+
+    for ( u32 i = 0; i < k_max_pages; ++i ) {
+        pages[ i ].store( nullptr, std::memory_order_relaxed );
+    }
+    count.store( 0, std::memory_order_relaxed );
+
+    // Keep the table at most half full.
+    u32 capacity = 16;
+    while ( capacity < initial_capacity * 2 ) {
+        capacity *= 2;
+    }
+    table.store( table_create( capacity ), std::memory_order_release );
+}
+
+void StringInterner::shutdown() {
+
+    Table* current_table = table.load( std::memory_order_acquire );
+    while ( current_table ) {
+        Table* previous = current_table->previous;
+        ifree( current_table, allocator );
+        current_table = previous;
+    }
+    table.store( nullptr, std::memory_order_relaxed );
+
+    for ( u32 i = 0; i < k_max_pages; ++i ) {
+        Entry* page = pages[ i ].load( std::memory_order_relaxed );
+        if ( page ) {
+            ifree( page, allocator );
+            pages[ i ].store( nullptr, std::memory_order_relaxed );
+        }
+    }
+
+    while ( chunk ) {
+        char* previous = *( char** )chunk;
+        ifree( chunk, allocator );
+        chunk = previous;
+    }
+
+    count.store( 0, std::memory_order_relaxed );
+}
+
+u32 StringInterner::intern( StringView string ) {
+
+    const u64 hash = hash_calculate( string, 0 );
+
+    // Most calls find an existing string, without locking.
+    u32 id = find_hashed( string, hash );
+    if ( id != k_invalid_id ) {
+        return id;
+    }
+
+    std::lock_guard<std::mutex> lock( mutex );
+
+    // Another thread could have added it in the meantime.
+    id = find_hashed( string, hash );
+    if ( id != k_invalid_id ) {
+        return id;
+    }
+
+    id = count.load( std::memory_order_relaxed );
+    const u32 page_index = id >> k_page_shift;
+    if ( page_index >= k_max_pages ) {
+        ilog_error( "StringInterner is full, %u strings.\n", id );
+        return k_invalid_id;
+    }
+
+    Entry* page = pages[ page_index ].load( std::memory_order_relaxed );
+    if ( !page ) {
+        page = ( Entry* )ialloc( sizeof( Entry ) * k_page_size, allocator );
+        pages[ page_index ].store( page, std::memory_order_release );
+    }
+
+    char* data = chunk_allocate( ( u32 )string.size + 1 );
+    memcpy( data, string.data, string.size );
+    data[ string.size ] = 0;
+
+    Entry& entry = page[ id & ( k_page_size - 1 ) ];
+    entry.data = data;
+    entry.length = ( u32 )string.size;
+    entry.hash = hash;
+
+    count.store( id + 1, std::memory_order_release );
+
+    // Grow before publishing, so the current table never gets more than half full.
+    Table* current_table = table.load( std::memory_order_relaxed );
+    if ( ( id + 1 ) * 2 > current_table->mask + 1 ) {
+        Table* new_table = table_create( ( current_table->mask + 1 ) * 2 );
+        new_table->previous = current_table;
+
+        for ( u32 i = 0; i < id; ++i ) {
+            table_insert( new_table, get_entry( i ).hash, i );
+        }
+
+        table.store( new_table, std::memory_order_release );
+        current_table = new_table;
+    }
+
+    // Publishing the slot makes the entry visible to lock free readers.
+    table_insert( current_table, hash, id );
+
+    return id;
+}
+
+u32 StringInterner::find( StringView string ) const {
+    return find_hashed( string, hash_calculate( string, 0 ) );
+}
+
+StringView StringInterner::get( u32 id ) const {
+    if ( id >= get_count() ) {
+        return { nullptr, 0 };
+    }
+
+    const Entry& entry = get_entry( id );
+    return { entry.data, entry.length };
+}
+
+u32 StringInterner::find_hashed( StringView string, u64 hash ) const {
+
+    const Table* current_table = table.load( std::memory_order_acquire );
+    const u64 tag = hash & 0xFFFFFFFF00000000ull;
+
+    u32 index = ( u32 )hash & current_table->mask;
+    for ( ;; ) {
+        const u64 slot = current_table->slots[ index ].load( std::memory_order_acquire );
+        if ( slot == 0 ) {
+            return k_invalid_id;
+        }
+
+        if ( ( slot & 0xFFFFFFFF00000000ull ) == tag ) {
+            const u32 id = ( u32 )slot - 1;
+            const Entry& entry = get_entry( id );
+            if ( entry.length == string.size && memcmp( entry.data, string.data, string.size ) == 0 ) {
+                return id;
+            }
+        }
+
+        index = ( index + 1 ) & current_table->mask;
+    }
+}
+
+const StringInterner::Entry& StringInterner::get_entry( u32 id ) const {
+    const Entry* page = pages[ id >> k_page_shift ].load( std::memory_order_acquire );
+    return page[ id & ( k_page_size - 1 ) ];
+}
+
+void StringInterner::table_insert( Table* insert_table, u64 hash, u32 id ) {
+
+    u32 index = ( u32 )hash & insert_table->mask;
+    while ( insert_table->slots[ index ].load( std::memory_order_relaxed ) != 0 ) {
+        index = ( index + 1 ) & insert_table->mask;
+    }
+
+    insert_table->slots[ index ].store( slot_pack( hash, id ), std::memory_order_release );
+}
+
+StringInterner::Table* StringInterner::table_create( u32 capacity ) {
+
+    iassert( ( capacity & ( capacity - 1 ) ) == 0 );
+
+    char* memory = ( char* )ialloc( sizeof( Table ) + sizeof( std::atomic<u64> ) * capacity, allocator );
+    Table* new_table = ( Table* )memory;
+    new_table->slots = ( std::atomic<u64>* )( memory + sizeof( Table ) );
+    new_table->mask = capacity - 1;
+    new_table->previous = nullptr;
+
+    for ( u32 i = 0; i < capacity; ++i ) {
+        new ( new_table->slots + i ) std::atomic<u64>( 0 );
+    }
+
+    return new_table;
+}
+
+char* StringInterner::chunk_allocate( u32 size ) {
+
+    if ( chunk_offset + size > chunk_capacity ) {
+        // Strings bigger than a chunk get their own.
+        const u32 capacity = idra::max( chunk_size, size + k_chunk_header_size );
+
+        char* new_chunk = ( char* )ialloc( capacity, allocator );
+        *( char** )new_chunk = chunk;
+
+        chunk = new_chunk;
+        chunk_offset = k_chunk_header_size;
+        chunk_capacity = capacity;
+    }
+
+    char* data = chunk + chunk_offset;
+    chunk_offset += size;
+    return data;
+}
+
+} // namespace idra
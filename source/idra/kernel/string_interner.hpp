@@ -0,0 +1,81 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#pragma once
+
+#include "kernel/string_view.hpp"
+
+#include <atomic>
+#include <mutex>
+
+namespace idra {
+
+    struct Allocator;
+
+    // StringInterner /////////////////////////////////////////////////////
+    //
+    // Stores each distinct string once and gives it a dense u32 id.
+    // - Strings live in chunks that are never moved, so views stay valid
+    //   until shutdown. They are null terminated.
+    // - find and get are lock free and can be called from any thread.
+    // - intern takes a lock only when adding a new string.
+    // The hash table doubles when half full. Old tables are kept until
+    // shutdown, because readers can still be probing them.
+    //
+    struct StringInterner {
+
+        static constexpr u32        k_invalid_id = u32_max;
+
+        void                        init( Allocator* allocator, u32 initial_capacity, u32 chunk_size = ikilo( 16 ) );
+        void                        shutdown();
+
+        // Returns the id of string, adding it when not present.
+        u32                         intern( StringView string );
+        // Returns the id of string, k_invalid_id when not present.
+        u32                         find( StringView string ) const;
+
+        StringView                  get( u32 id ) const;
+        u32                         get_count() const           { return count.load( std::memory_order_acquire ); }
+
+        struct Entry {
+            cstring                 data;
+            u32                     length;
+            u64                     hash;
+        }; // struct Entry
+
+        // Open addressing table, slots pack the high bits of the hash and id + 1. Zero is empty.
+        struct Table {
+            std::atomic<u64>*       slots;
+            u32                     mask;
+            Table*                  previous;
+        }; // struct Table
+
+        static constexpr u32        k_page_shift = 10;
+        static constexpr u32        k_page_size = 1 << k_page_shift;
+        static constexpr u32        k_max_pages = 1024;
+
+        u32                         find_hashed( StringView string, u64 hash ) const;
+        const Entry&                get_entry( u32 id ) const;
+
+        void                        table_insert( Table* table, u64 hash, u32 id );
+        Table*                      table_create( u32 capacity );
+        char*                       chunk_allocate( u32 size );
+
+        std::atomic<Table*>         table;
+        std::atomic<Entry*>         pages[ k_max_pages ];
+        std::atomic<u32>            count;
+
+        // Written only while holding mutex.
+        char*                       chunk           = nullptr;  // First bytes point to the previous chunk.
+        u32                         chunk_offset    = 0;
+        u32                         chunk_capacity  = 0;
+        u32                         chunk_size      = 0;
+
+        std::mutex                  mutex;
+        Allocator*                  allocator       = nullptr;
+
+    }; // struct StringInterner
+
+} // namespace idra
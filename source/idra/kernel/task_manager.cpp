@@ -1,83 +1,75 @@
 #include "kernel/task_manager.hpp"
 
-// Note: commenting this will lock the task manager in shutdown method.
-// #define TASK_MANAGER_LOG
-
 namespace idra {
 
 void TaskManager::run_task( i32 thread_id ) {
-    while ( true ) {
 
-#if defined(TASK_MANAGER_LOG)
-        CRB_DBG( "Waiting\n" );
-#endif // TASK_MANAGER_LOG
+    u32 round = 0;
+    while ( true ) {
 
+        i32 tasks_count = 0;
         {
             auto lck = std::unique_lock<std::mutex>( tasks_mtx );
-            tasks_available_cv.wait( lck, [ this ]() {
-                return tasks_available.load();
+            tasks_available_cv.wait( lck, [ this, round ]() {
+                return !active.load() || tasks_round != round;
                                      } );
-        }
 
-#if defined(TASK_MANAGER_LOG)
-        CRB_DBG( "Waking up\n" );
-#endif // TASK_MANAGER_LOG
+            if ( !active.load() ) {
+                break;
+            }
 
-        int next_task = next_task_indices.fetch_add( 1 );
-        while ( next_task < task_queue.size() ) {
-            Task& t = task_queue[ next_task ];
+            // A worker waking after the round completed sees no tasks.
+            round = tasks_round;
+            tasks_count = round_tasks_count;
+            ++working_threads;
+        }
 
-#if defined(TASK_MANAGER_LOG)
-        //CRB_DBG( "Executing task %d\n", next_task );
-#endif // TASK_MANAGER_LOG
+        if ( tasks_count ) {
+            int next_task = next_task_indices.fetch_add( 1 );
+            while ( next_task < tasks_count ) {
+                Task& t = task_queue[ next_task ];
 
-            t.fn( t.data );
+                t.fn( t.data, thread_id );
 
-            next_task = next_task_indices.fetch_add( 1 );
-            tasks_completed_count.fetch_add( 1 );
+                tasks_completed_count.fetch_add( 1 );
+                next_task = next_task_indices.fetch_add( 1 );
+            }
         }
 
-        tasks_completed_cv.notify_one();
-
-        if ( active.load() ) {
-            // NOTE(marco): only set this when the task manager is active, otherwise the shutdown method
-            // won't work, as the threads that get woken up will see this as false and go back to wait
-            auto lck = std::unique_lock<std::mutex>( tasks_mtx );
-            tasks_available.store( false );
-        } else {
-#if defined(TASK_MANAGER_LOG)
-            CRB_DBG( "Stopping thread\n" );
-#endif // TASK_MANAGER_LOG
-
-            break;
+        {
+            // Under the lock, so the notification can't be missed by wait_for_completion.
+            std::lock_guard<std::mutex> lck( tasks_mtx );
+            --working_threads;
         }
+
+        tasks_completed_cv.notify_one();
     }
 }
 
-void TaskManager::init() {
-    // NOTE(marco): leave room for main thread, physics thread and audio thread
-    const int num_threads = std::thread::hardware_concurrency() - 3;
+void TaskManager::init( u32 num_threads ) {
 
-    for ( int i = 0; i < num_threads; ++i ) {
-        thread_pool.push_back(
-            std::thread( &TaskManager::run_task, this, i )
-        );
+    if ( num_threads == 0 ) {
+        // NOTE(marco): leave room for main thread, physics thread and audio thread
+        const u32 hardware_threads = std::thread::hardware_concurrency();
+        num_threads = hardware_threads > 4 ? hardware_threads - 3 : 1;
     }
 
     {
         std::lock_guard<std::mutex> lck( tasks_mtx );
         active.store( true );
     }
+
+    for ( u32 i = 0; i < num_threads; ++i ) {
+        thread_pool.push_back(
+            std::thread( &TaskManager::run_task, this, ( i32 )i )
+        );
+    }
 }
 
 void TaskManager::shutdown() {
-#if defined(TASK_MANAGER_LOG)
-    CRB_DBG( "Shutting down\n" );
-#endif
 
     {
         std::lock_guard<std::mutex> lck( tasks_mtx );
-        tasks_available.store( true );
         active.store( false );
     }
 
@@ -105,39 +97,28 @@ i32 TaskManager::add_task( Callback& fn, void* data ) {
 }
 
 void TaskManager::start_tasks() {
-    tasks_completed_count = 0;
-    next_task_indices = 0;
     {
         std::lock_guard<std::mutex> lck( tasks_mtx );
-        tasks_available.store( true );
+        tasks_completed_count = 0;
+        next_task_indices = 0;
+        round_tasks_count = (i32)task_queue.size();
+        ++tasks_round;
     }
 
     tasks_available_cv.notify_all();
 }
 
 void TaskManager::wait_for_completion() {
-    int s = task_queue.size();
-
-#if defined(TASK_MANAGER_LOG)
-    CRB_DBG( "Wait for completion\n" );
-#endif
+    int s = (int)task_queue.size();
 
-    {
-        auto lck = std::unique_lock<std::mutex>( tasks_mtx );
-
-        tasks_completed_cv.wait( lck, [ this, s ]() {
-            return tasks_completed_count >= s;
-                                 } );
-    }
+    auto lck = std::unique_lock<std::mutex>( tasks_mtx );
 
-#if defined(TASK_MANAGER_LOG)
-    CRB_DBG( "Completed\n" );
-#endif
+    tasks_completed_cv.wait( lck, [ this, s ]() {
+        return tasks_completed_count >= s && working_threads == 0;
+                             } );
 
-    {
-        std::lock_guard<std::mutex> lck( tasks_mtx );
-        task_queue.clear();
-    }
+    task_queue.clear();
+    round_tasks_count = 0;
 }
     
 } // namespace idra
@@ -4,14 +4,19 @@
 #include <thread>
 #include <atomic>
 #include <future>
+#include <functional>
 
 #include "kernel/platform.hpp"
 
 namespace idra {
 
+// Runs rounds of tasks on a persistent pool of worker threads.
+// Tasks are added and started from one thread, that waits for their completion
+// before adding the next round. Callbacks receive the id of the worker running them,
+// in [0, num_threads), to index per thread resources like command pools.
 struct TaskManager {
 	
-    using Callback = std::function<void( void* data )>;
+    using Callback = std::function<void( void* data, i32 thread_id )>;
 
     struct Task {
         i32                 id;
@@ -19,7 +24,8 @@ struct TaskManager {
         Callback            fn;
     };
 
-    void                    init();
+    // Zero threads leaves room for the main, physics and audio threads.
+    void                    init( u32 num_threads = 0 );
     void                    shutdown();
 
     void                    run_task( i32 thread_id );
@@ -29,7 +35,6 @@ struct TaskManager {
     void                    wait_for_completion();
 
     std::mutex              tasks_mtx;
-    std::atomic_bool        tasks_available;
     std::condition_variable tasks_available_cv;
 
     std::condition_variable tasks_completed_cv;
@@ -39,6 +44,12 @@ struct TaskManager {
     std::atomic_int         tasks_completed_count;
     std::atomic_int         next_task_indices;
 
+    // Guarded by tasks_mtx. Workers join a round when its index changes, and the
+    // queue is cleared only once no worker is running, so it is never read while modified.
+    u32                     tasks_round         = 0;
+    i32                     round_tasks_count   = 0;
+    i32                     working_threads     = 0;
+
     std::vector<Task>       task_queue;
     std::vector<std::thread> thread_pool;
 };
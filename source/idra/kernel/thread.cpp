@@ -117,10 +117,10 @@ void set_thread_name( std::thread& thread, StringView name ) {
     BookmarkAllocator* allocator = g_memory->get_thread_allocator();
     const sizet marker = allocator->get_marker();
 
-    char16_t* string_buffer = ( char16_t* )ialloc( name.size * sizeof( char16_t ), allocator );
+    char16_t* string_buffer = ( char16_t* )ialloc( ( name.size + 1 ) * sizeof( char16_t ), allocator );
 
-    utf8_to_utf16( name.data, string_buffer );
-    string_buffer[ name.size ] = 0;
+    const ptrdiff_t length = utf8_to_utf16( name, string_buffer );
+    string_buffer[ length > 0 ? length : 0 ] = 0;
 
     HRESULT r;
     r = SetThreadDescription( thread.native_handle(), ( wchar_t* )string_buffer );
@@ -0,0 +1,299 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "kernel/utf.hpp"
+#include "kernel/bit.hpp"
+#include "kernel/cpu_features.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define IDRA_UTF_SSE2
+#endif // __SSE2__ || _M_X64
+
+namespace idra {
+
+// Returns the code point and its length in bytes, -1 on ill formed sequences.
+static inline i32 utf8_decode_sequence( const u8* bytes, sizet remaining, u32& length ) {
+    const u32 lead = bytes[ 0 ];
+    length = 1;
+
+    if ( lead < 0x80 ) {
+        return ( i32 )lead;
+    }
+
+    const u32 sequence_length = utf8_sequence_length( ( char )lead );
+    if ( sequence_length == 0 || sequence_length > remaining ) {
+        return -1;
+    }
+
+    // Second byte range depends on the lead, to exclude overlongs, surrogates and values past U+10FFFF.
+    u32 second_min = 0x80, second_max = 0xBF;
+    switch ( lead ) {
+        case 0xE0: second_min = 0xA0; break;
+        case 0xED: second_max = 0x9F; break;
+        case 0xF0: second_min = 0x90; break;
+        case 0xF4: second_max = 0x8F; break;
+        default: break;
+    }
+
+    const u32 second = bytes[ 1 ];
+    if ( second < second_min || second > second_max ) {
+        return -1;
+    }
+
+    if ( sequence_length == 2 ) {
+        length = 2;
+        return ( i32 )( ( ( lead & 0x1F ) << 6 ) | ( second & 0x3F ) );
+    }
+
+    const u32 third = bytes[ 2 ];
+    if ( ( third & 0xC0 ) != 0x80 ) {
+        return -1;
+    }
+
+    if ( sequence_length == 3 ) {
+        length = 3;
+        return ( i32 )( ( ( lead & 0x0F ) << 12 ) | ( ( second & 0x3F ) << 6 ) | ( third & 0x3F ) );
+    }
+
+    const u32 fourth = bytes[ 3 ];
+    if ( ( fourth & 0xC0 ) != 0x80 ) {
+        return -1;
+    }
+
+    length = 4;
+    return ( i32 )( ( ( lead & 0x07 ) << 18 ) | ( ( second & 0x3F ) << 12 ) | ( ( third & 0x3F ) << 6 ) | ( fourth & 0x3F ) );
+}
+
+// Decodes non ASCII sequences, up to the next ASCII byte when stop_at_ascii is set.
+// A null out only counts the code units. Returns false on invalid input.
+template <typename CodeUnit>
+static inline bool utf8_decode_run( const u8* bytes, sizet size, sizet& position, CodeUnit* out, ptrdiff_t& written, bool stop_at_ascii ) {
+    do {
+        u32 length;
+        const i32 code_point = utf8_decode_sequence( bytes + position, size - position, length );
+        if ( code_point < 0 ) {
+            return false;
+        }
+        position += length;
+
+        if constexpr ( sizeof( CodeUnit ) == 2 ) {
+            if ( code_point > 0xFFFF ) {
+                if ( out ) {
+                    const u32 offset = ( u32 )code_point - 0x10000;
+                    out[ written ] = ( CodeUnit )( 0xD800 + ( offset >> 10 ) );
+                    out[ written + 1 ] = ( CodeUnit )( 0xDC00 + ( offset & 0x3FF ) );
+                }
+                written += 2;
+                continue;
+            }
+        }
+
+        if ( out ) {
+            out[ written ] = ( CodeUnit )code_point;
+        }
+        ++written;
+    } while ( position < size && ( !stop_at_ascii || bytes[ position ] >= 0x80 ) );
+
+    return true;
+}
+
+// Transcoding loops, one per instruction set. CodeUnit selects the output encoding.
+// In the vector loops each input byte produces at most one code unit, so storing
+// a whole block at out + written never goes past the size of the input.
+#if defined (IDRA_UTF_SSE2)
+template <typename CodeUnit>
+static ptrdiff_t utf8_transcode_sse2( StringView text, CodeUnit* out ) {
+    const u8* bytes = ( const u8* )text.data;
+    const sizet size = text.size;
+
+    sizet position = 0;
+    ptrdiff_t written = 0;
+
+    while ( position < size ) {
+        while ( position + 16 <= size ) {
+            const __m128i block = _mm_loadu_si128( ( const __m128i* )( bytes + position ) );
+            const u32 non_ascii_mask = ( u32 )_mm_movemask_epi8( block );
+
+            if ( out ) {
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i low = _mm_unpacklo_epi8( block, zero );
+                const __m128i high = _mm_unpackhi_epi8( block, zero );
+                CodeUnit* destination = out + written;
+
+                if constexpr ( sizeof( CodeUnit ) == 2 ) {
+                    _mm_storeu_si128( ( __m128i* )destination, low );
+                    _mm_storeu_si128( ( __m128i* )( destination + 8 ), high );
+                } else {
+                    _mm_storeu_si128( ( __m128i* )destination, _mm_unpacklo_epi16( low, zero ) );
+                    _mm_storeu_si128( ( __m128i* )( destination + 4 ), _mm_unpackhi_epi16( low, zero ) );
+                    _mm_storeu_si128( ( __m128i* )( destination + 8 ), _mm_unpacklo_epi16( high, zero ) );
+                    _mm_storeu_si128( ( __m128i* )( destination + 12 ), _mm_unpackhi_epi16( high, zero ) );
+                }
+            }
+
+            const u32 ascii_count = non_ascii_mask ? trailing_zeros_u32( non_ascii_mask ) : 16;
+            position += ascii_count;
+            written += ascii_count;
+
+            if ( non_ascii_mask ) {
+                break;
+            }
+        }
+
+        if ( position < size && !utf8_decode_run( bytes, size, position, out, written, true ) ) {
+            return -1;
+        }
+    }
+
+    return written;
+}
+
+template <typename CodeUnit>
+IDRA_TARGET_AVX2 static ptrdiff_t utf8_transcode_avx2( StringView text, CodeUnit* out ) {
+    const u8* bytes = ( const u8* )text.data;
+    const sizet size = text.size;
+
+    sizet position = 0;
+    ptrdiff_t written = 0;
+
+    while ( position < size ) {
+        while ( position + 32 <= size ) {
+            const __m256i block = _mm256_loadu_si256( ( const __m256i* )( bytes + position ) );
+            const u32 non_ascii_mask = ( u32 )_mm256_movemask_epi8( block );
+
+            if ( out ) {
+                const __m128i low = _mm256_castsi256_si128( block );
+                const __m128i high = _mm256_extracti128_si256( block, 1 );
+                CodeUnit* destination = out + written;
+
+                // Widen from registers, reloading the input after the stores measured slower.
+                if constexpr ( sizeof( CodeUnit ) == 2 ) {
+                    _mm256_storeu_si256( ( __m256i* )destination, _mm256_cvtepu8_epi16( low ) );
+                    _mm256_storeu_si256( ( __m256i* )( destination + 16 ), _mm256_cvtepu8_epi16( high ) );
+                } else {
+                    _mm256_storeu_si256( ( __m256i* )destination, _mm256_cvtepu8_epi32( low ) );
+                    _mm256_storeu_si256( ( __m256i* )( destination + 8 ), _mm256_cvtepu8_epi32( _mm_srli_si128( low, 8 ) ) );
+                    _mm256_storeu_si256( ( __m256i* )( destination + 16 ), _mm256_cvtepu8_epi32( high ) );
+                    _mm256_storeu_si256( ( __m256i* )( destination + 24 ), _mm256_cvtepu8_epi32( _mm_srli_si128( high, 8 ) ) );
+                }
+            }
+
+            const u32 ascii_count = non_ascii_mask ? _tzcnt_u32( non_ascii_mask ) : 32;
+            position += ascii_count;
+            written += ascii_count;
+
+            if ( non_ascii_mask ) {
+                break;
+            }
+        }
+
+        if ( position >= size ) {
+            break;
+        }
+
+        // Tail shorter than a block, or a non ASCII sequence.
+        if ( !utf8_decode_run( bytes, size, position, out, written, position + 32 <= size ) ) {
+            return -1;
+        }
+    }
+
+    return written;
+}
+#endif // IDRA_UTF_SSE2
+
+template <typename CodeUnit>
+static ptrdiff_t utf8_transcode_scalar( StringView text, CodeUnit* out ) {
+    sizet position = 0;
+    ptrdiff_t written = 0;
+
+    if ( text.size && !utf8_decode_run( ( const u8* )text.data, text.size, position, out, written, false ) ) {
+        return -1;
+    }
+    return written;
+}
+
+// Dispatch ///////////////////////////////////////////////////////////////
+struct UtfDispatch {
+    ptrdiff_t                       ( *to_utf32 )( StringView, char32_t* );
+    ptrdiff_t                       ( *to_utf16 )( StringView, char16_t* );
+    Utf8Kernel::Enum                kernel;
+}; // struct UtfDispatch
+
+static bool utf_dispatch_select( Utf8Kernel::Enum kernel, UtfDispatch& dispatch ) {
+#if defined (IDRA_UTF_SSE2)
+    const bool avx2 = cpu_features_get().avx2 && cpu_features_get().bmi1;
+    if ( kernel == Utf8Kernel::Auto ) {
+        kernel = avx2 ? Utf8Kernel::AVX2 : Utf8Kernel::SSE2;
+    }
+
+    switch ( kernel ) {
+        case Utf8Kernel::AVX2:
+            if ( !avx2 ) {
+                return false;
+            }
+            dispatch = { utf8_transcode_avx2<char32_t>, utf8_transcode_avx2<char16_t>, kernel };
+            return true;
+        case Utf8Kernel::SSE2:
+            dispatch = { utf8_transcode_sse2<char32_t>, utf8_transcode_sse2<char16_t>, kernel };
+            return true;
+        default:
+            break;
+    }
+#else
+    if ( kernel == Utf8Kernel::Auto ) {
+        kernel = Utf8Kernel::Scalar;
+    }
+#endif // IDRA_UTF_SSE2
+
+    if ( kernel != Utf8Kernel::Scalar ) {
+        return false;
+    }
+    dispatch = { utf8_transcode_scalar<char32_t>, utf8_transcode_scalar<char16_t>, kernel };
+    return true;
+}
+
+// Resolved on first use, so calls from static initializers are safe.
+static UtfDispatch& utf_dispatch() {
+    static UtfDispatch s_dispatch = []() {
+        UtfDispatch dispatch;
+        utf_dispatch_select( Utf8Kernel::Auto, dispatch );
+        return dispatch;
+    }();
+    return s_dispatch;
+}
+
+bool utf8_set_kernel( Utf8Kernel::Enum kernel ) {
+    return utf_dispatch_select( kernel, utf_dispatch() );
+}
+
+Utf8Kernel::Enum utf8_get_kernel() {
+    return utf_dispatch().kernel;
+}
+
+bool utf8_validate( StringView text ) {
+    return utf_dispatch().to_utf32( text, nullptr ) >= 0;
+}
+
+ptrdiff_t utf8_count_code_points( StringView text ) {
+    return utf_dispatch().to_utf32( text, nullptr );
+}
+
+ptrdiff_t utf8_to_utf32( StringView text, char32_t* out ) {
+    return utf_dispatch().to_utf32( text, out );
+}
+
+ptrdiff_t utf8_to_utf16( StringView text, char16_t* out ) {
+    return utf_dispatch().to_utf16( text, out );
+}
+
+i32 utf8_decode( StringView text, u32& position ) {
+    u32 length;
+    const i32 code_point = utf8_decode_sequence( ( const u8* )text.data + position, text.size - position, length );
+    position += length;
+    return code_point;
+}
+
+} // namespace idra
@@ -9,70 +9,70 @@
 
 namespace idra {
 
-namespace detail {
-    constexpr bool utf8_trail_byte( char const in, char32_t& out ) noexcept {
-        if ( in < 0x80 || 0xBF < in )
-            return false;
+    // UTF8 ///////////////////////////////////////////////////////////////
+    //
+    // Validating transcoders, following the well formed sequences of the
+    // Unicode standard (table 3-7): overlong encodings, surrogates and code
+    // points above U+10FFFF are rejected.
+    // Runs of ASCII are processed 16 bytes at a time with SSE2, or 32 with
+    // AVX2 when the CPU has it, the rest is decoded one code point at a time.
+    //
+    // Conversions return the number of code units written, or -1 on
+    // invalid input. Passing a null output only calculates the size.
+    //
 
-        out = ( out << 6 ) | ( in & 0x3F );
-        return true;
-    }
+    bool                            utf8_validate( StringView text );
+    // Number of code points, -1 on invalid input.
+    ptrdiff_t                       utf8_count_code_points( StringView text );
 
-    // Returns number of trailing bytes.
-    // -1 on illegal header bytes.
-    constexpr int utf8_header_byte( char const in, char32_t& out ) noexcept {
-        if ( in < 0x80 ) {  // ASCII
-            out = in;
-            return 0;
-        }
-        if ( in < 0xC0 ) {  // not a header
-            return -1;
+    // Output must hold text.size code points.
+    ptrdiff_t                       utf8_to_utf32( StringView text, char32_t* out );
+    // Output must hold text.size code units.
+    ptrdiff_t                       utf8_to_utf16( StringView text, char16_t* out );
+
+    // Transcoder variants. Auto picks the fastest one the CPU supports.
+    namespace Utf8Kernel {
+        enum Enum {
+            Auto, Scalar, SSE2, AVX2, Count
+        };
+
+        static const char* s_value_names[] = {
+            "Auto", "Scalar", "SSE2", "AVX2", "Count"
+        };
+
+        static const char* ToString( Enum e ) {
+            return ( ( u32 )e < Enum::Count ? s_value_names[ ( int )e ] : "unsupported" );
         }
-        if ( in < 0xE0 ) {
-            out = in & 0x1F;
+    } // namespace Utf8Kernel
+
+    // Forces a transcoder variant, for tests and benchmarks. Returns false, keeping
+    // the current one, if the variant is not built or the CPU does not support it.
+    // Not thread safe: no other thread must be transcoding.
+    bool                            utf8_set_kernel( Utf8Kernel::Enum kernel );
+    Utf8Kernel::Enum                utf8_get_kernel();
+
+    // Bytes in the sequence starting with lead, 0 for continuation or invalid bytes.
+    constexpr u32                   utf8_sequence_length( char lead );
+    // Decodes the code point at text[ position ], advancing position.
+    // Invalid sequences return -1 and advance by one byte.
+    i32                             utf8_decode( StringView text, u32& position );
+
+    // Implementation /////////////////////////////////////////////////////
+    constexpr u32 utf8_sequence_length( char lead ) {
+        const u8 byte = ( u8 )lead;
+        if ( byte < 0x80 ) {
             return 1;
         }
-        if ( in < 0xF0 ) {
-            out = in & 0x0F;
+        if ( byte < 0xC2 ) {
+            return 0;
+        }
+        if ( byte < 0xE0 ) {
             return 2;
         }
-        if ( in < 0xF8 ) {
-            out = in & 0x7;
+        if ( byte < 0xF0 ) {
             return 3;
         }
-        return -1;
+        return byte < 0xF5 ? 4 : 0;
     }
-}  // namespace detail
-
-// UTF8 -> UTF16 converter ////////////////////////////////////////////////
-constexpr ptrdiff_t utf8_to_utf16( StringView u8in,
-                                   char16_t* u16out ) noexcept {
-    ptrdiff_t outstr_size = 0;
-    for ( u32 i = 0; i < u8in.constexpr_size(); ++i ) {
-        char32_t code_point = 0;
-        const i32 byte_cnt = detail::utf8_header_byte( u8in[i], code_point);
 
-        if ( byte_cnt < 0 || byte_cnt > u8in.constexpr_size() )
-            return false;
-
-        for ( int j = 0; j < byte_cnt; ++j )
-            if ( !detail::utf8_trail_byte( u8in[i + j], code_point) )
-                return -1;
-
-        if ( code_point < 0xFFFF ) {
-            if ( u16out )
-                *u16out++ = static_cast< char16_t >( code_point );
-            ++outstr_size;
-        } else {
-            if ( u16out ) {
-                code_point -= 0x10000;
-                *u16out++ = static_cast< char16_t >( ( code_point >> 10 ) + 0xD800 );
-                *u16out++ = static_cast< char16_t >( ( code_point & 0x3FF ) + 0xDC00 );
-            }
-            outstr_size += 2;
-        }
-    }
-    return outstr_size;
-}
-	
 } // namespace idra
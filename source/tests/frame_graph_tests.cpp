@@ -0,0 +1,223 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "graphics/frame_graph.hpp"
+
+#include "kernel/allocator.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace idra;
+
+static MallocAllocator s_allocator;
+
+static void empty_execute( CommandBuffer* gpu_commands, void* user_data ) {
+}
+
+static TextureCreation transient_creation( StringView name, u16 width = 256, TextureFormat::Enum format = TextureFormat::R8G8B8A8_UNORM ) {
+    return { .width = width, .height = width, .depth = 1, .array_layer_count = 1, .mip_level_count = 1,
+             .flags = TextureFlags::RenderTarget_mask, .format = format, .type = TextureType::Texture2D, .debug_name = name };
+}
+
+// Only plan() runs, so the graph needs no GPU device.
+struct FrameGraphTest : public ::testing::Test {
+
+    void SetUp() override {
+        graph.init( &s_allocator, nullptr );
+    }
+
+    void TearDown() override {
+        graph.clear();
+        graph.shutdown();
+    }
+
+    // Barriers planned before a pass.
+    Span<const FrameGraph::Barrier> pass_barriers( u32 pass ) const {
+        const FrameGraph::Pass& p = graph.passes[ pass ];
+        return Span<const FrameGraph::Barrier>( graph.barriers.data + p.first_barrier, p.barrier_count );
+    }
+
+    const FrameGraph::Barrier* find_barrier( u32 pass, FrameGraphResource resource ) const {
+        for ( const FrameGraph::Barrier& barrier : pass_barriers( pass ) ) {
+            if ( barrier.resource == resource ) {
+                return &barrier;
+            }
+        }
+        return nullptr;
+    }
+
+    FrameGraph graph;
+};
+
+// a -> b -> c -> output: a and c have disjoint lifetimes and share memory.
+TEST_F( FrameGraphTest, AliasesDisjointLifetimes ) {
+    const FrameGraphResource a = graph.create_texture( transient_creation( "a" ) );
+    const FrameGraphResource b = graph.create_texture( transient_creation( "b" ) );
+    const FrameGraphResource c = graph.create_texture( transient_creation( "c" ) );
+    const FrameGraphResource output = graph.import_texture( { 1, 1 }, "output", ResourceState::ShaderResource );
+
+    const u32 pass_a = graph.add_pass( "a", empty_execute, nullptr );
+    graph.write( pass_a, a, ResourceState::RenderTarget );
+    const u32 pass_b = graph.add_pass( "b", empty_execute, nullptr );
+    graph.read( pass_b, a, ResourceState::ShaderResource );
+    graph.write( pass_b, b, ResourceState::RenderTarget );
+    const u32 pass_c = graph.add_pass( "c", empty_execute, nullptr );
+    graph.read( pass_c, b, ResourceState::ShaderResource );
+    graph.write( pass_c, c, ResourceState::RenderTarget );
+    const u32 pass_output = graph.add_pass( "output", empty_execute, nullptr );
+    graph.read( pass_output, c, ResourceState::ShaderResource );
+    graph.write( pass_output, output, ResourceState::RenderTarget );
+
+    graph.plan();
+
+    EXPECT_EQ( graph.resources[ a ].first_pass, pass_a );
+    EXPECT_EQ( graph.resources[ a ].last_pass, pass_b );
+    EXPECT_EQ( graph.resources[ c ].first_pass, pass_c );
+    EXPECT_EQ( graph.resources[ c ].last_pass, pass_output );
+
+    EXPECT_EQ( graph.resources[ a ].alias, k_invalid_frame_graph_index );
+    EXPECT_EQ( graph.resources[ b ].alias, k_invalid_frame_graph_index );
+    EXPECT_EQ( graph.resources[ c ].alias, a );
+    EXPECT_TRUE( graph.resources[ a ].discard );
+    EXPECT_FALSE( graph.resources[ b ].discard );
+    EXPECT_TRUE( graph.resources[ c ].discard );
+
+    // Textures sharing memory drop their content at their first use only.
+    const FrameGraph::Barrier* barrier = find_barrier( pass_a, a );
+    ASSERT_NE( barrier, nullptr );
+    EXPECT_EQ( barrier->state, ResourceState::RenderTarget );
+    EXPECT_TRUE( barrier->discard );
+    EXPECT_FALSE( barrier->hazard );
+
+    barrier = find_barrier( pass_b, a );
+    ASSERT_NE( barrier, nullptr );
+    EXPECT_EQ( barrier->state, ResourceState::ShaderResource );
+    EXPECT_FALSE( barrier->discard );
+    EXPECT_TRUE( barrier->hazard );
+
+    barrier = find_barrier( pass_b, b );
+    ASSERT_NE( barrier, nullptr );
+    EXPECT_FALSE( barrier->discard );
+
+    barrier = find_barrier( pass_c, c );
+    ASSERT_NE( barrier, nullptr );
+    EXPECT_TRUE( barrier->discard );
+
+    // The imported output goes to its final state after the last pass.
+    ASSERT_EQ( graph.barriers.size - graph.first_final_barrier, 1u );
+    EXPECT_EQ( graph.barriers[ graph.first_final_barrier ].resource, output );
+    EXPECT_EQ( graph.barriers[ graph.first_final_barrier ].state, ResourceState::ShaderResource );
+}
+
+TEST_F( FrameGraphTest, OverlappingLifetimesAreNotAliased ) {
+    const FrameGraphResource a = graph.create_texture( transient_creation( "a" ) );
+    const FrameGraphResource b = graph.create_texture( transient_creation( "b" ) );
+    const FrameGraphResource output = graph.import_texture( { 1, 1 }, "output" );
+
+    const u32 pass_a = graph.add_pass( "a", empty_execute, nullptr );
+    graph.write( pass_a, a, ResourceState::RenderTarget );
+    const u32 pass_b = graph.add_pass( "b", empty_execute, nullptr );
+    graph.write( pass_b, b, ResourceState::RenderTarget );
+    const u32 pass_output = graph.add_pass( "output", empty_execute, nullptr );
+    graph.read( pass_output, a, ResourceState::ShaderResource );
+    graph.read( pass_output, b, ResourceState::ShaderResource );
+    graph.write( pass_output, output, ResourceState::RenderTarget );
+
+    graph.plan();
+
+    EXPECT_EQ( graph.resources[ a ].alias, k_invalid_frame_graph_index );
+    EXPECT_EQ( graph.resources[ b ].alias, k_invalid_frame_graph_index );
+    EXPECT_FALSE( find_barrier( pass_a, a )->discard );
+    EXPECT_FALSE( find_barrier( pass_b, b )->discard );
+}
+
+TEST_F( FrameGraphTest, IncompatibleTexturesAreNotAliased ) {
+    // b is bigger than a: it owns the memory, and c has another format.
+    const FrameGraphResource a = graph.create_texture( transient_creation( "a", 128 ) );
+    const FrameGraphResource b = graph.create_texture( transient_creation( "b", 256 ) );
+    const FrameGraphResource c = graph.create_texture( transient_creation( "c", 256, TextureFormat::R16G16B16A16_FLOAT ) );
+    const FrameGraphResource output = graph.import_texture( { 1, 1 }, "output" );
+
+    u32 pass = graph.add_pass( "a", empty_execute, nullptr );
+    graph.write( pass, a, ResourceState::RenderTarget );
+    pass = graph.add_pass( "b", empty_execute, nullptr );
+    graph.read( pass, a, ResourceState::ShaderResource );
+    graph.write( pass, b, ResourceState::RenderTarget );
+    pass = graph.add_pass( "c", empty_execute, nullptr );
+    graph.read( pass, b, ResourceState::ShaderResource );
+    graph.write( pass, c, ResourceState::RenderTarget );
+    pass = graph.add_pass( "output", empty_execute, nullptr );
+    graph.read( pass, c, ResourceState::ShaderResource );
+    graph.write( pass, output, ResourceState::RenderTarget );
+
+    graph.plan();
+
+    // a lives in passes 0-1 and c in 2-3, but c does not fit in the memory of a.
+    EXPECT_EQ( graph.resources[ a ].alias, k_invalid_frame_graph_index );
+    EXPECT_EQ( graph.resources[ b ].alias, k_invalid_frame_graph_index );
+    EXPECT_EQ( graph.resources[ c ].alias, k_invalid_frame_graph_index );
+}
+
+TEST_F( FrameGraphTest, CullsUnusedPasses ) {
+    const FrameGraphResource a = graph.create_texture( transient_creation( "a" ) );
+    const FrameGraphResource unused = graph.create_texture( transient_creation( "unused" ) );
+    const FrameGraphResource output = graph.create_texture( transient_creation( "output" ) );
+    graph.mark_output( output );
+
+    // The producer of a is only read by the culled pass, so it is culled too.
+    const u32 pass_a = graph.add_pass( "a", empty_execute, nullptr );
+    graph.write( pass_a, a, ResourceState::RenderTarget );
+    const u32 pass_unused = graph.add_pass( "unused", empty_execute, nullptr );
+    graph.read( pass_unused, a, ResourceState::ShaderResource );
+    graph.write( pass_unused, unused, ResourceState::RenderTarget );
+    const u32 pass_output = graph.add_pass( "output", empty_execute, nullptr );
+    graph.write( pass_output, output, ResourceState::RenderTarget );
+
+    graph.plan();
+
+    EXPECT_TRUE( graph.passes[ pass_a ].culled );
+    EXPECT_TRUE( graph.passes[ pass_unused ].culled );
+    EXPECT_FALSE( graph.passes[ pass_output ].culled );
+    EXPECT_EQ( graph.passes[ pass_a ].barrier_count, 0u );
+    EXPECT_EQ( graph.resources[ a ].first_pass, k_invalid_frame_graph_index );
+    EXPECT_EQ( graph.resources[ output ].first_pass, pass_output );
+}
+
+TEST_F( FrameGraphTest, SameStateAccessesHaveHazards ) {
+    const FrameGraphResource buffer = graph.import_buffer( { 1, 1 }, "buffer" );
+    const FrameGraphResource texture = graph.import_texture( { 2, 1 }, "texture" );
+
+    // Two compute passes writing the same resources, then one reading them.
+    const u32 first = graph.add_pass( "first", empty_execute, nullptr );
+    graph.write( first, buffer, ResourceState::UnorderedAccess );
+    graph.write( first, texture, ResourceState::UnorderedAccess );
+    const u32 second = graph.add_pass( "second", empty_execute, nullptr );
+    graph.write( second, buffer, ResourceState::UnorderedAccess );
+    graph.write( second, texture, ResourceState::UnorderedAccess );
+    const u32 third = graph.add_pass( "third", empty_execute, nullptr );
+    graph.read( third, buffer, ResourceState::UnorderedAccess );
+    graph.read( third, texture, ResourceState::UnorderedAccess );
+    graph.read( third, texture, ResourceState::UnorderedAccess );
+    const u32 fourth = graph.add_pass( "fourth", empty_execute, nullptr );
+    graph.read( fourth, texture, ResourceState::UnorderedAccess );
+
+    graph.plan();
+
+    EXPECT_FALSE( find_barrier( first, buffer )->hazard );
+    EXPECT_FALSE( find_barrier( first, texture )->hazard );
+    EXPECT_TRUE( find_barrier( second, buffer )->hazard );
+    EXPECT_TRUE( find_barrier( second, texture )->hazard );
+    EXPECT_TRUE( find_barrier( third, buffer )->hazard );
+
+    // A texture read twice by a pass has one barrier.
+    EXPECT_EQ( graph.passes[ third ].barrier_count, 2u );
+    EXPECT_TRUE( find_barrier( third, texture )->hazard );
+
+    // Read after read needs no dependency.
+    EXPECT_FALSE( find_barrier( fourth, texture )->hazard );
+
+    // Imported resources without a final state have no final barrier.
+    EXPECT_EQ( graph.first_final_barrier, graph.barriers.size );
+}
@@ -0,0 +1,253 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "gpu/staging_ring.hpp"
+
+#include "kernel/allocator.hpp"
+
+#include "gtest/gtest.h"
+
+#include <random>
+#include <vector>
+
+using namespace idra;
+
+static MallocAllocator s_allocator;
+
+TEST( StagingRing, AlignmentSkip ) {
+    StagingRing ring;
+    ring.init( &s_allocator, 256 );
+
+    u32 offset = 0, allocated = 0;
+    ASSERT_TRUE( ring.allocate( 10, 1, 1, &offset, &allocated ) );
+    EXPECT_EQ( offset, 0u );
+    EXPECT_EQ( allocated, 10u );
+
+    // The 6 bytes skipped to align are used until the batch retires.
+    ASSERT_TRUE( ring.allocate( 10, 1, 16, &offset, &allocated ) );
+    EXPECT_EQ( offset, 16u );
+    EXPECT_EQ( allocated, 10u );
+    EXPECT_EQ( ring.used, 26u );
+
+    ring.close_batch( 1 );
+    ring.retire( 1 );
+    EXPECT_EQ( ring.used, 0u );
+
+    ring.shutdown();
+}
+
+TEST( StagingRing, GranularitySplitting ) {
+    StagingRing ring;
+    ring.init( &s_allocator, 256 );
+
+    // Only whole multiples of the granularity are returned for a partial allocation.
+    u32 offset = 0, allocated = 0;
+    ASSERT_TRUE( ring.allocate( 1000, 96, 16, &offset, &allocated ) );
+    EXPECT_EQ( offset, 0u );
+    EXPECT_EQ( allocated, 192u );
+
+    // 64 bytes are left, less than the granularity.
+    EXPECT_FALSE( ring.allocate( 808, 96, 16, &offset, &allocated ) );
+    EXPECT_EQ( ring.used, 192u );
+
+    // A request smaller than the granularity needs only its size.
+    ASSERT_TRUE( ring.allocate( 48, 96, 16, &offset, &allocated ) );
+    EXPECT_EQ( offset, 192u );
+    EXPECT_EQ( allocated, 48u );
+
+    // The rest of the upload continues once the memory retires.
+    ring.close_batch( 1 );
+    ring.retire( 1 );
+    ASSERT_TRUE( ring.allocate( 808, 96, 16, &offset, &allocated ) );
+    EXPECT_EQ( offset, 0u );
+    EXPECT_EQ( allocated, 192u );
+
+    ring.shutdown();
+}
+
+TEST( StagingRing, Wrap ) {
+    StagingRing ring;
+    ring.init( &s_allocator, 256 );
+
+    u32 offset = 0, allocated = 0;
+    ASSERT_TRUE( ring.allocate( 100, 1, 16, &offset, &allocated ) );
+    ring.close_batch( 1 );
+    ASSERT_TRUE( ring.allocate( 100, 1, 16, &offset, &allocated ) );
+    EXPECT_EQ( offset, 112u );
+    ring.close_batch( 2 );
+
+    ring.retire( 1 );
+    EXPECT_EQ( ring.tail, 100u );
+
+    // 32 aligned bytes are free at the end of the ring, less than the granularity:
+    // the allocation wraps, skipping the 44 bytes after the head.
+    ASSERT_TRUE( ring.allocate( 80, 80, 16, &offset, &allocated ) );
+    EXPECT_EQ( offset, 0u );
+    EXPECT_EQ( allocated, 80u );
+    EXPECT_EQ( ring.used, 12u + 100u + 44u + 80u );
+
+    // The head can't pass the tail.
+    EXPECT_FALSE( ring.allocate( 32, 32, 16, &offset, &allocated ) );
+
+    ring.close_batch( 3 );
+    ring.retire( 2 );
+    EXPECT_EQ( ring.used, 44u + 80u );
+    ring.retire( 3 );
+    EXPECT_EQ( ring.used, 0u );
+
+    ring.shutdown();
+}
+
+TEST( StagingRing, RetirementOrdering ) {
+    StagingRing ring;
+    ring.init( &s_allocator, 1024 );
+
+    u32 offset = 0, allocated = 0;
+    for ( u32 i = 0; i < 4; ++i ) {
+        ASSERT_TRUE( ring.allocate( 128, 1, 1, &offset, &allocated ) );
+        ring.close_batch( i + 1 );
+    }
+
+    // Closing without allocations adds no batch.
+    ring.close_batch( 5 );
+    EXPECT_EQ( ring.batches.size, 4u );
+
+    ring.retire( 0 );
+    EXPECT_EQ( ring.used, 512u );
+
+    // Batches retire in order, up to the completed value.
+    ring.retire( 2 );
+    EXPECT_EQ( ring.batches.size, 2u );
+    EXPECT_EQ( ring.batches[ 0 ].timeline_value, 3u );
+    EXPECT_EQ( ring.tail, 256u );
+    EXPECT_EQ( ring.used, 256u );
+
+    ring.retire( 4 );
+    EXPECT_EQ( ring.batches.size, 0u );
+    EXPECT_EQ( ring.used, 0u );
+
+    ring.shutdown();
+}
+
+// Frames of random uploads, with the GPU completing them a few frames later.
+// Live allocations must never overlap, and the ring must drain completely.
+TEST( StagingRing, Simulation ) {
+    static const u32 k_ring_size = 64 * 1024;
+    static const u32 k_frames_in_flight = 3;
+
+    StagingRing ring;
+    ring.init( &s_allocator, k_ring_size );
+
+    struct Range {
+        u64 timeline_value;
+        u32 offset;
+        u32 size;
+    };
+    std::vector<Range> live;
+    std::vector<u32> pending_uploads;
+
+    std::mt19937 rng( 1234 );
+    for ( u64 frame = 1; frame <= 20000; ++frame ) {
+
+        const u64 completed = frame > k_frames_in_flight ? frame - k_frames_in_flight : 0;
+        ring.retire( completed );
+        std::erase_if( live, [ completed ]( const Range& r ) { return r.timeline_value <= completed; } );
+
+        for ( u32 u = rng() % 4; u > 0; --u ) {
+            pending_uploads.push_back( 1 + rng() % ( k_ring_size / 2 ) );
+        }
+
+        // Uploads are staged in order, a partial one blocks the following ones.
+        while ( !pending_uploads.empty() ) {
+            u32& remaining = pending_uploads.front();
+            const u32 granularity = ( rng() % 2 ) ? 1 : 256;
+            const u32 alignment = 1u << ( rng() % 5 );
+
+            u32 offset = 0, allocated = 0;
+            if ( !ring.allocate( remaining, granularity, alignment, &offset, &allocated ) ) {
+                break;
+            }
+
+            ASSERT_EQ( offset % alignment, 0u );
+            ASSERT_LE( offset + allocated, k_ring_size );
+            ASSERT_GT( allocated, 0u );
+            ASSERT_TRUE( allocated == remaining || allocated % granularity == 0 );
+            for ( const Range& r : live ) {
+                ASSERT_FALSE( offset < r.offset + r.size && r.offset < offset + allocated );
+            }
+            live.push_back( { frame, offset, allocated } );
+
+            remaining -= allocated;
+            if ( remaining ) {
+                break;
+            }
+            pending_uploads.erase( pending_uploads.begin() );
+        }
+
+        ring.close_batch( frame );
+        ASSERT_LE( ring.used, k_ring_size );
+    }
+
+    ring.retire( u64_max );
+    EXPECT_EQ( ring.used, 0u );
+    EXPECT_EQ( ring.batches.size, 0u );
+
+    ring.shutdown();
+}
+
+TEST( StagingCopyBatcher, ConsecutiveCopiesShareACommand ) {
+    StagingCopyBatcher batcher;
+    batcher.init( &s_allocator, 2 );
+
+    EXPECT_EQ( batcher.add( 1, 0, 64 ), 0u );
+    EXPECT_EQ( batcher.add( 1, 64, 64 ), 0u );
+    // The batch is full.
+    EXPECT_EQ( batcher.add( 1, 128, 64 ), ( u32 )StagingCopyBatcher::Flush );
+    // Another buffer starts a new command.
+    EXPECT_EQ( batcher.add( 2, 0, 64 ), ( u32 )StagingCopyBatcher::Flush );
+
+    batcher.shutdown();
+}
+
+TEST( StagingCopyBatcher, OverlapInOpenBatch ) {
+    StagingCopyBatcher batcher;
+    batcher.init( &s_allocator, 32 );
+
+    EXPECT_EQ( batcher.add( 1, 0, 64 ), 0u );
+    EXPECT_EQ( batcher.add( 1, 32, 64 ), ( u32 )( StagingCopyBatcher::Flush | StagingCopyBatcher::Barrier ) );
+
+    batcher.shutdown();
+}
+
+TEST( StagingCopyBatcher, OverlapAcrossCommands ) {
+    StagingCopyBatcher batcher;
+    batcher.init( &s_allocator, 32 );
+
+    // X, Y, then X again overlapping its first copy: the flush caused by Y must
+    // not hide the write after write on X.
+    EXPECT_EQ( batcher.add( 1, 0, 64 ), 0u );
+    EXPECT_EQ( batcher.add( 2, 0, 64 ), ( u32 )StagingCopyBatcher::Flush );
+    EXPECT_EQ( batcher.add( 1, 16, 16 ), ( u32 )( StagingCopyBatcher::Flush | StagingCopyBatcher::Barrier ) );
+
+    // The barrier ordered the previous writes to X, only the new range is tracked.
+    EXPECT_EQ( batcher.add( 1, 48, 16 ), 0u );
+    EXPECT_EQ( batcher.add( 1, 16, 8 ), ( u32 )( StagingCopyBatcher::Flush | StagingCopyBatcher::Barrier ) );
+
+    // Y is still tracked.
+    EXPECT_EQ( batcher.add( 2, 60, 8 ), ( u32 )( StagingCopyBatcher::Flush | StagingCopyBatcher::Barrier ) );
+
+    // Overlaps across a full batch are found too.
+    batcher.reset();
+    batcher.max_batched_copies = 1;
+    EXPECT_EQ( batcher.add( 1, 0, 64 ), 0u );
+    EXPECT_EQ( batcher.add( 1, 64, 64 ), ( u32 )StagingCopyBatcher::Flush );
+    EXPECT_EQ( batcher.add( 1, 0, 1 ), ( u32 )( StagingCopyBatcher::Flush | StagingCopyBatcher::Barrier ) );
+
+    // A new pass forgets the ranges of the previous one.
+    batcher.reset();
+    EXPECT_EQ( batcher.add( 1, 0, 64 ), 0u );
+
+    batcher.shutdown();
+}
@@ -0,0 +1,391 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "kernel/utf.hpp"
+#include "kernel/time.hpp"
+
+#include "gtest/gtest.h"
+
+#include <random>
+#include <vector>
+
+using namespace idra;
+
+// Reference decoder, one byte at a time, written straight from table 3-7 of
+// the Unicode standard. Returns false on ill formed input.
+static bool reference_decode( const u8* bytes, sizet size, std::vector<char32_t>& code_points ) {
+    code_points.clear();
+
+    sizet i = 0;
+    while ( i < size ) {
+        const u32 b0 = bytes[ i ];
+        if ( b0 <= 0x7F ) {
+            code_points.push_back( b0 );
+            i += 1;
+            continue;
+        }
+
+        u32 length = 0, second_min = 0x80, second_max = 0xBF, code_point = 0;
+        if ( b0 >= 0xC2 && b0 <= 0xDF ) {
+            length = 2;
+            code_point = b0 & 0x1F;
+        } else if ( b0 >= 0xE0 && b0 <= 0xEF ) {
+            length = 3;
+            code_point = b0 & 0x0F;
+            second_min = b0 == 0xE0 ? 0xA0 : 0x80;
+            second_max = b0 == 0xED ? 0x9F : 0xBF;
+        } else if ( b0 >= 0xF0 && b0 <= 0xF4 ) {
+            length = 4;
+            code_point = b0 & 0x07;
+            second_min = b0 == 0xF0 ? 0x90 : 0x80;
+            second_max = b0 == 0xF4 ? 0x8F : 0xBF;
+        } else {
+            return false;
+        }
+
+        if ( i + length > size ) {
+            return false;
+        }
+
+        for ( u32 j = 1; j < length; ++j ) {
+            const u32 b = bytes[ i + j ];
+            const u32 min = j == 1 ? second_min : 0x80;
+            const u32 max = j == 1 ? second_max : 0xBF;
+            if ( b < min || b > max ) {
+                return false;
+            }
+            code_point = ( code_point << 6 ) | ( b & 0x3F );
+        }
+
+        code_points.push_back( code_point );
+        i += length;
+    }
+
+    return true;
+}
+
+static void reference_to_utf16( const std::vector<char32_t>& code_points, std::vector<char16_t>& code_units ) {
+    code_units.clear();
+    for ( char32_t c : code_points ) {
+        if ( c > 0xFFFF ) {
+            code_units.push_back( ( char16_t )( 0xD800 + ( ( c - 0x10000 ) >> 10 ) ) );
+            code_units.push_back( ( char16_t )( 0xDC00 + ( ( c - 0x10000 ) & 0x3FF ) ) );
+        } else {
+            code_units.push_back( ( char16_t )c );
+        }
+    }
+}
+
+static u32 encode_utf8( char32_t c, u8* out ) {
+    if ( c < 0x80 ) {
+        out[ 0 ] = ( u8 )c;
+        return 1;
+    }
+    if ( c < 0x800 ) {
+        out[ 0 ] = ( u8 )( 0xC0 | ( c >> 6 ) );
+        out[ 1 ] = ( u8 )( 0x80 | ( c & 0x3F ) );
+        return 2;
+    }
+    if ( c < 0x10000 ) {
+        out[ 0 ] = ( u8 )( 0xE0 | ( c >> 12 ) );
+        out[ 1 ] = ( u8 )( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+        out[ 2 ] = ( u8 )( 0x80 | ( c & 0x3F ) );
+        return 3;
+    }
+    out[ 0 ] = ( u8 )( 0xF0 | ( c >> 18 ) );
+    out[ 1 ] = ( u8 )( 0x80 | ( ( c >> 12 ) & 0x3F ) );
+    out[ 2 ] = ( u8 )( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+    out[ 3 ] = ( u8 )( 0x80 | ( c & 0x3F ) );
+    return 4;
+}
+
+//
+// Runs every entry point on the input and compares it with the reference.
+struct UtfChecker {
+
+    bool check( const u8* bytes, sizet size ) {
+        const StringView text( ( cstring )bytes, size );
+        const bool valid = reference_decode( bytes, size, expected32 );
+
+        if ( utf8_validate( text ) != valid ) {
+            return false;
+        }
+
+        const ptrdiff_t count = utf8_count_code_points( text );
+        if ( valid ? count != ( ptrdiff_t )expected32.size() : count != -1 ) {
+            return false;
+        }
+
+        out32.assign( size + 1, 0 );
+        const ptrdiff_t written32 = utf8_to_utf32( text, out32.data() );
+        if ( !valid ) {
+            if ( written32 != -1 ) {
+                return false;
+            }
+        } else if ( written32 != ( ptrdiff_t )expected32.size() || memcmp( out32.data(), expected32.data(), written32 * sizeof( char32_t ) ) != 0 ) {
+            return false;
+        }
+
+        out16.assign( size + 1, 0 );
+        const ptrdiff_t written16 = utf8_to_utf16( text, out16.data() );
+        if ( !valid ) {
+            return written16 == -1;
+        }
+
+        reference_to_utf16( expected32, expected16 );
+        if ( written16 != ( ptrdiff_t )expected16.size() || memcmp( out16.data(), expected16.data(), written16 * sizeof( char16_t ) ) != 0 ) {
+            return false;
+        }
+
+        // Single code point decoder, used by text rendering.
+        u32 position = 0;
+        for ( char32_t expected : expected32 ) {
+            if ( utf8_decode( text, position ) != ( i32 )expected ) {
+                return false;
+            }
+        }
+        return position == size;
+    }
+
+    std::vector<char32_t>   expected32;
+    std::vector<char16_t>   expected16;
+    std::vector<char32_t>   out32;
+    std::vector<char16_t>   out16;
+
+}; // struct UtfChecker
+
+// Transcoder tests run once per variant, skipping those the CPU does not support.
+struct Utf8Kernels : public ::testing::TestWithParam<Utf8Kernel::Enum> {
+
+    void SetUp() override {
+        if ( !utf8_set_kernel( GetParam() ) ) {
+            GTEST_SKIP() << Utf8Kernel::ToString( GetParam() ) << " kernel not available";
+        }
+    }
+
+    void TearDown() override {
+        utf8_set_kernel( Utf8Kernel::Auto );
+    }
+}; // struct Utf8Kernels
+
+INSTANTIATE_TEST_SUITE_P( Variants, Utf8Kernels,
+                          ::testing::Values( Utf8Kernel::Scalar, Utf8Kernel::SSE2, Utf8Kernel::AVX2 ),
+                          []( const ::testing::TestParamInfo<Utf8Kernel::Enum>& info ) { return std::string( Utf8Kernel::ToString( info.param ) ); } );
+
+TEST( Utf8, KernelOverride ) {
+    EXPECT_TRUE( utf8_set_kernel( Utf8Kernel::Scalar ) );
+    EXPECT_EQ( utf8_get_kernel(), Utf8Kernel::Scalar );
+    EXPECT_FALSE( utf8_set_kernel( Utf8Kernel::Count ) );
+    EXPECT_EQ( utf8_get_kernel(), Utf8Kernel::Scalar );
+
+    EXPECT_TRUE( utf8_set_kernel( Utf8Kernel::Auto ) );
+    EXPECT_NE( utf8_get_kernel(), Utf8Kernel::Auto );
+}
+
+TEST( Utf8, SequenceLength ) {
+    EXPECT_EQ( utf8_sequence_length( 'a' ), 1u );
+    EXPECT_EQ( utf8_sequence_length( ( char )0x80 ), 0u );
+    EXPECT_EQ( utf8_sequence_length( ( char )0xC1 ), 0u );
+    EXPECT_EQ( utf8_sequence_length( ( char )0xC2 ), 2u );
+    EXPECT_EQ( utf8_sequence_length( ( char )0xE0 ), 3u );
+    EXPECT_EQ( utf8_sequence_length( ( char )0xF4 ), 4u );
+    EXPECT_EQ( utf8_sequence_length( ( char )0xF5 ), 0u );
+}
+
+TEST_P( Utf8Kernels, KnownSequences ) {
+    UtfChecker checker;
+
+    // Boundaries of each length, overlongs, surrogates and past U+10FFFF.
+    const char* valid[] = { "", "a", "\xC2\x80", "\xDF\xBF", "\xE0\xA0\x80", "\xED\x9F\xBF", "\xEE\x80\x80",
+                            "\xEF\xBF\xBF", "\xF0\x90\x80\x80", "\xF4\x8F\xBF\xBF", "h\xC3\xA9llo w\xC3\xB6rld" };
+    const char* invalid[] = { "\x80", "\xC0\x80", "\xC1\xBF", "\xE0\x9F\xBF", "\xED\xA0\x80", "\xF0\x8F\xBF\xBF",
+                              "\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xFF", "\xC2", "\xE1\x80", "\xF1\x80\x80" };
+
+    for ( const char* text : valid ) {
+        EXPECT_TRUE( utf8_validate( text ) ) << "input " << text;
+        EXPECT_TRUE( checker.check( ( const u8* )text, strlen( text ) ) ) << "input " << text;
+    }
+    for ( const char* text : invalid ) {
+        EXPECT_FALSE( utf8_validate( text ) ) << "input " << text;
+        EXPECT_TRUE( checker.check( ( const u8* )text, strlen( text ) ) ) << "input " << text;
+    }
+}
+
+TEST( Utf8, DecodeAdvancesOneByteOnError ) {
+    const StringView text( "\xE0\x80z" );
+    u32 position = 0;
+    EXPECT_EQ( utf8_decode( text, position ), -1 );
+    EXPECT_EQ( position, 1u );
+    EXPECT_EQ( utf8_decode( text, position ), -1 );
+    EXPECT_EQ( position, 2u );
+    EXPECT_EQ( utf8_decode( text, position ), 'z' );
+    EXPECT_EQ( position, 3u );
+}
+
+// Every sequence of one to three bytes.
+TEST_P( Utf8Kernels, ExhaustiveUpToThreeBytes ) {
+    UtfChecker checker;
+    u8 bytes[ 3 ];
+
+    for ( u32 value = 0; value < ( 1u << 24 ); ++value ) {
+        bytes[ 0 ] = ( u8 )( value >> 16 );
+        bytes[ 1 ] = ( u8 )( value >> 8 );
+        bytes[ 2 ] = ( u8 )value;
+
+        if ( value < 256 ) {
+            ASSERT_TRUE( checker.check( bytes + 2, 1 ) ) << "byte " << value;
+        }
+        if ( value < 65536 ) {
+            ASSERT_TRUE( checker.check( bytes + 1, 2 ) ) << "bytes " << value;
+        }
+        ASSERT_TRUE( checker.check( bytes, 3 ) ) << "bytes " << value;
+    }
+}
+
+// Four byte sequences: all lead and second bytes, with the trailing bytes
+// at the edges of the continuation range and just outside it.
+TEST_P( Utf8Kernels, FourByteSweep ) {
+    UtfChecker checker;
+    const u8 trailing[] = { 0x00, 0x41, 0x7F, 0x80, 0x81, 0x9F, 0xA0, 0xBE, 0xBF, 0xC0, 0xF4, 0xFF };
+    u8 bytes[ 4 ];
+
+    for ( u32 lead = 0; lead < 256; ++lead ) {
+        for ( u32 second = 0; second < 256; ++second ) {
+            for ( u8 third : trailing ) {
+                for ( u8 fourth : trailing ) {
+                    bytes[ 0 ] = ( u8 )lead;
+                    bytes[ 1 ] = ( u8 )second;
+                    bytes[ 2 ] = third;
+                    bytes[ 3 ] = fourth;
+                    ASSERT_TRUE( checker.check( bytes, 4 ) ) << "lead " << lead << " second " << second;
+                }
+            }
+        }
+    }
+}
+
+// Every scalar value, placed at all offsets of a vector block inside ASCII
+// runs, so the SIMD paths enter and leave the scalar decoder everywhere.
+TEST_P( Utf8Kernels, AllCodePointsInsideAsciiRuns ) {
+    UtfChecker checker;
+    u8 bytes[ 80 ];
+
+    for ( char32_t c = 0; c <= 0x10FFFF; ++c ) {
+        if ( c >= 0xD800 && c <= 0xDFFF ) {
+            continue;
+        }
+
+        const u32 offset = c % 33;
+        memset( bytes, 'x', sizeof( bytes ) );
+        const u32 length = encode_utf8( c, bytes + offset );
+        ASSERT_TRUE( checker.check( bytes, offset + length + 40 ) ) << "code point " << ( u32 )c;
+    }
+}
+
+// Random mixes of ASCII runs, valid sequences and random bytes.
+TEST_P( Utf8Kernels, Fuzz ) {
+    UtfChecker checker;
+    std::mt19937 random( 1234 );
+    std::vector<u8> bytes;
+
+    for ( u32 iteration = 0; iteration < 20000; ++iteration ) {
+        bytes.clear();
+        const u32 pieces = random() % 16;
+        const bool corrupt = ( iteration & 1 ) != 0;
+
+        for ( u32 i = 0; i < pieces; ++i ) {
+            switch ( random() % 3 ) {
+                case 0:
+                {
+                    const u32 run = random() % 70;
+                    for ( u32 j = 0; j < run; ++j ) {
+                        bytes.push_back( ( u8 )( 0x20 + random() % 0x5F ) );
+                    }
+                    break;
+                }
+                case 1:
+                {
+                    char32_t c = random() % 0x110000;
+                    if ( c >= 0xD800 && c <= 0xDFFF ) {
+                        c = 0xFFFD;
+                    }
+                    u8 sequence[ 4 ];
+                    const u32 length = encode_utf8( c, sequence );
+                    bytes.insert( bytes.end(), sequence, sequence + length );
+                    break;
+                }
+                default:
+                {
+                    if ( corrupt ) {
+                        bytes.push_back( ( u8 )random() );
+                    }
+                    break;
+                }
+            }
+        }
+
+        ASSERT_TRUE( checker.check( bytes.data(), bytes.size() ) ) << "iteration " << iteration;
+    }
+}
+
+// Throughput, run with --gtest_also_run_disabled_tests.
+TEST_P( Utf8Kernels, DISABLED_Benchmark ) {
+    static const sizet k_size = 5 * 1024 * 1024;
+    static const u32 k_iterations = 20;
+
+    std::vector<u8> ascii( k_size );
+    std::vector<u8> mixed;
+    mixed.reserve( k_size + 4 );
+
+    std::mt19937 random( 42 );
+    for ( sizet i = 0; i < k_size; ++i ) {
+        ascii[ i ] = ( u8 )( 0x20 + random() % 0x5F );
+    }
+    // Mostly ASCII text with an accented letter or symbol every few words.
+    while ( mixed.size() < k_size ) {
+        const char32_t c = ( random() % 8 ) ? ( char32_t )( 0x20 + random() % 0x5F ) : ( char32_t )( 0xA0 + random() % 0x2000 );
+        u8 sequence[ 4 ];
+        const u32 length = encode_utf8( c, sequence );
+        mixed.insert( mixed.end(), sequence, sequence + length );
+    }
+
+    std::vector<char32_t> out32( k_size );
+    std::vector<char16_t> out16( k_size );
+
+    struct Input {
+        cstring             name;
+        StringView          text;
+    };
+    const Input inputs[] = { { "ascii", StringView( ( cstring )ascii.data(), ascii.size() ) },
+                             { "mixed", StringView( ( cstring )mixed.data(), mixed.size() ) } };
+
+    g_time->init();
+
+    for ( const Input& input : inputs ) {
+        const TimeTick validate_start = g_time->now();
+        for ( u32 i = 0; i < k_iterations; ++i ) {
+            ASSERT_TRUE( utf8_validate( input.text ) );
+        }
+        const f64 validate_seconds = g_time->convert_seconds( g_time->delta( g_time->now(), validate_start ) );
+
+        const TimeTick utf32_start = g_time->now();
+        for ( u32 i = 0; i < k_iterations; ++i ) {
+            ASSERT_GT( utf8_to_utf32( input.text, out32.data() ), 0 );
+        }
+        const f64 utf32_seconds = g_time->convert_seconds( g_time->delta( g_time->now(), utf32_start ) );
+
+        const TimeTick utf16_start = g_time->now();
+        for ( u32 i = 0; i < k_iterations; ++i ) {
+            ASSERT_GT( utf8_to_utf16( input.text, out16.data() ), 0 );
+        }
+        const f64 utf16_seconds = g_time->convert_seconds( g_time->delta( g_time->now(), utf16_start ) );
+
+        const f64 gigabytes = ( f64 )input.text.size * k_iterations / 1e9;
+        printf( "%s %s: validate %.2f GB/s, utf32 %.2f GB/s, utf16 %.2f GB/s\n", Utf8Kernel::ToString( GetParam() ), input.name,
+                gigabytes / validate_seconds, gigabytes / utf32_seconds, gigabytes / utf16_seconds );
+    }
+
+    g_time->shutdown();
+}
@@ -4,6 +4,7 @@
  */
 
 #include "asset_compiler.hpp"
+#include "hfx_compiler.hpp"
 #include <stdio.h>
 
 #include "kernel/array.hpp"
@@ -14,6 +15,7 @@
 #include "kernel/memory.hpp"
 #include "kernel/string.hpp"
 #include "kernel/utf.hpp"
+#include "kernel/json.hpp"
 
 #include <filesystem>
 #include <cstdlib>
@@ -25,8 +27,6 @@
 #define STB_TRUETYPE_IMPLEMENTATION
 #include "external/stb_truetype.h"
 
-#include "external/json.hpp"
-
 namespace idra {
 
 // Forward declarations ///////////////////////////////////////////////////
@@ -83,7 +83,7 @@ void asset_compiler_main( StringView source_folder, StringView destination_folde
             cstring subpath = relative_path + source_folder.size + 1; // + 1 for the separator
 
             names_buffer.clear();
-            StringView path_name = names_buffer.append_use_f( "%s/%s", destination_folder.data, subpath );
+            StringView path_name = names_buffer.append_use_format( "{}/{}", destination_folder, subpath );
             if ( !fs_directory_exists( path_name ) ) {
 
                 fs_directory_create( path_name );
@@ -138,14 +138,14 @@ void asset_compiler_main( StringView source_folder, StringView destination_folde
 
                 names_buffer.clear();
 
-                StringView source_path = names_buffer.append_use_f( "%s/%s%s", source_parent_path, filename, extension );
+                StringView source_path = names_buffer.append_use_format( "{}/{}{}", source_parent_path, filename, extension );
 
                 switch ( extension[ 1 ] ) {
 
                     case 'a':
                     {
                         if ( extension[ 2 ] == 't' && extension[ 3 ] == 'j' ) {
-                            StringView destination_path = names_buffer.append_use_f( "%s%s/%s.bhat", destination_folder.data, subpath, filename );
+                            StringView destination_path = names_buffer.append_use_format( "{}{}/{}.bhat", destination_folder, subpath, filename );
                             ilog( "Compiling %s into %s\n", source_path.data, destination_path.data );
 
                             compile_atlas( allocator, source_path, destination_path );
@@ -167,14 +167,15 @@ void asset_compiler_main( StringView source_folder, StringView destination_folde
                         // HFX files
                         if ( extension[ 2 ] == 'f' && extension[ 3 ] == 'x' ) {
 
-                            StringView destination_path = names_buffer.append_use_f( "%s/%s.bhfx", destination_folder.data, subpath );
-                            ilog( "Compiling %s into %s\n", source_parent_path, destination_path.data );
+                            StringView destination_path = names_buffer.append_use_format( "{}{}/{}.bhfx", destination_folder, subpath, filename );
+                            StringView shader_folder = names_buffer.append_use_format( "{}/shaders", source_folder );
+                            ilog( "Compiling %s into %s\n", source_path.data, destination_path.data );
 
-                            //hfx::hfx_compile( source_name, destination_name, hfx::CompileOptions_VulkanStandard, "..//source//generated" );
+                            hfx_compile( allocator, source_path, destination_path, shader_folder );
 
                         } else if ( extension[ 2 ] == 'a' && extension[ 3 ] == 'j' ) {
 
-                            StringView destination_path = names_buffer.append_use_f( "%s%s/%s.bha", destination_folder.data, subpath, filename );
+                            StringView destination_path = names_buffer.append_use_format( "{}{}/{}.bha", destination_folder, subpath, filename );
                             ilog( "Compiling %s into %s\n", source_path.data, destination_path.data );
 
                             compile_animations( allocator, source_path, destination_path );
@@ -182,7 +183,7 @@ void asset_compiler_main( StringView source_folder, StringView destination_folde
                         } else if ( extension[ 2 ] == 'i' && extension[ 3 ] == 'j' ) {
 
                             names_buffer.clear();
-                            StringView destination_path = names_buffer.append_use_f( "%s/%s.bhi", destination_folder.data, subpath );
+                            StringView destination_path = names_buffer.append_use_format( "{}/{}.bhi", destination_folder, subpath );
                             ilog( "Compiling %s into %s\n", source_parent_path, destination_path.data );
 
                             //compile_input( &allocator, source_relative_path, destination_path );
@@ -197,7 +198,7 @@ void asset_compiler_main( StringView source_folder, StringView destination_folde
                         if ( is_png || is_pgm ) {
 
                             // Just copy the filename with extension as well for now.
-                            StringView destination_path = names_buffer.append_use_f( "%s%s/%s%s", destination_folder.data, subpath, filename, extension );
+                            StringView destination_path = names_buffer.append_use_format( "{}{}/{}{}", destination_folder, subpath, filename, extension );
 
                             ilog( "Compiling %s into %s\n", source_path.data, destination_path.data );
                             compile_texture( allocator, source_path, destination_path );
@@ -211,7 +212,7 @@ void asset_compiler_main( StringView source_folder, StringView destination_folde
                         if ( extension[ 2 ] == 'a' && extension[ 3 ] == 'w' ) {
 
                             // Just copy the filename with extension as well for now.
-                            StringView destination_path = names_buffer.append_use_f( "%s%s/%s%s", destination_folder.data, subpath, filename, extension );
+                            StringView destination_path = names_buffer.append_use_format( "{}{}/{}{}", destination_folder, subpath, filename, extension );
 
                             ilog( "Compiling %s into %s\n", source_path.data, destination_path.data );
                             compile_texture( allocator, source_path, destination_path );
@@ -224,7 +225,7 @@ void asset_compiler_main( StringView source_folder, StringView destination_folde
                     {
                         if ( extension[ 2 ] == 'i' && extension[ 3 ] == 'j' ) {
 
-                            StringView destination_path = names_buffer.append_use_f( "%s%s/%s.bui", destination_folder.data, subpath, filename );
+                            StringView destination_path = names_buffer.append_use_format( "{}{}/{}.bui", destination_folder, subpath, filename );
                             ilog( "Compiling %s into %s\n", source_path.data, destination_path.data );
 
                             compile_ui( allocator, source_path, destination_path );
@@ -263,8 +264,6 @@ void sanitize_path( char* path, sizet size ) {
 // Compilation methods
 void compile_animations( BookmarkAllocator* allocator, StringView source, StringView destination ) {
 
-    using json = nlohmann::json;
-
     u64 marker = allocator->get_marker();
 
     Span<char> file_data = file_read_allocate( source, allocator );
@@ -272,72 +271,79 @@ void compile_animations( BookmarkAllocator* allocator, StringView source, String
         ilog_error( "Could not read file %s\n", source.data );
     }
 
-    json parsed_json = json::parse( file_data.data );
+    JsonReader json_reader;
+    if ( !json_reader.init( allocator, StringView( file_data.data, file_data.size ) ) ) {
+        ilog_error( "Error parsing file %s\n", source.data );
+        allocator->free_marker( marker );
+        return;
+    }
+
+    const JsonValue json_data = json_reader.get_root();
 
-    std::string name_str;
-    parsed_json[ "texture" ].get_to( name_str );
+    StringBuffer string_buffer;
+    string_buffer.init( 1024, allocator );
+    // Null terminated copy of the texture name
+    StringView name_str = string_buffer.append_use( json_data.get_string( "texture" ) );
 
     // Name null or not valid
-    if ( name_str.size() < 4 ) {
-        ilog_error( "Invalid texture name %s\n", name_str.c_str() );
+    if ( name_str.size < 4 ) {
+        ilog_error( "Invalid texture name %s\n", name_str.data );
         return;
     }
 
     i32 comp, width, height;
-    i32 image_load_result = stbi_info( name_str.c_str(), &width, &height, &comp );
+    i32 image_load_result = stbi_info( name_str.data, &width, &height, &comp );
     if ( !image_load_result ) {
-        ilog_error( "Error loading texture %s\n", name_str.c_str() );
+        ilog_error( "Error loading texture %s\n", name_str.data );
         return;
     }
 
-    // Calculate total size of memory blob
-    sizet blob_size = sizeof( SpriteAnimationBlueprint ) + 16;
+    const JsonValue animation_array = json_data.get( "animations" );
+    const u32 num_animations = animation_array.get_size();
 
-    json animation_array = parsed_json[ "animations" ];
-    const u32 num_animations = ( u32 )animation_array.size();
-    blob_size += sizeof( SpriteAnimationCreation ) * num_animations;
-
-    // Create memory blob
+    // Create memory blob, sized with an initial estimate as it grows if needed.
+    MallocAllocator mallocator;
     BlobWriter writer;
     SpriteAnimationBlueprint* blueprint = writer.write<SpriteAnimationBlueprint>(
-        allocator, SpriteAnimationBlueprint::k_version, blob_size );
+        &mallocator, SpriteAnimationBlueprint::k_version, sizeof( SpriteAnimationCreation ) * num_animations );
 
     writer.reserve_and_set( blueprint->animations, num_animations );
+    // Reserve can move blob memory.
+    blueprint = writer.get_blob<SpriteAnimationBlueprint>();
 
-    for ( u32 i = 0; i < num_animations; ++i ) {
-        json animation = animation_array[ i ];
+    u32 i = 0;
+    for ( JsonValue animation = animation_array.first(); animation.is_valid(); animation = animation.next(), ++i ) {
         SpriteAnimationCreation& ac = blueprint->animations[ i ];
 
         ac.texture_width = width;
         ac.texture_height = height;
-        ac.offset_x = animation.value( "start_x", 0 );
-        ac.offset_y = animation.value( "start_y", 0 );
-        ac.frame_width = animation.value( "width", 1 );
-        ac.frame_height = animation.value( "height", 1 );
-        ac.num_frames = animation.value( "num_frames", 1 );
-        ac.columns = animation.value( "columns", 1 );
-        ac.fps = animation.value( "fps", 8 );
-        ac.looping = animation.value( "looping", false );
-        ac.invert = animation.value( "invert", false );
+        ac.offset_x = animation.get_i32( "start_x", 0 );
+        ac.offset_y = animation.get_i32( "start_y", 0 );
+        ac.frame_width = animation.get_i32( "width", 1 );
+        ac.frame_height = animation.get_i32( "height", 1 );
+        ac.num_frames = animation.get_i32( "num_frames", 1 );
+        ac.columns = animation.get_i32( "columns", 1 );
+        ac.fps = animation.get_i32( "fps", 8 );
+        ac.looping = animation.get_bool( "looping", false );
+        ac.invert = animation.get_bool( "invert", false );
         // TODO: frame table backed
         ac.frame_table_ = {};
     }
 
     // Write to file
-    const u32 blueprint_size = writer.reserved_offset;
+    Span<char> blob = writer.finalize( true );
 
     FileHandle f = file_open_for_write( destination );
-    fwrite( ( const void* )blueprint, blueprint_size, 1, f );
+    fwrite( ( const void* )blob.data, blob.size, 1, f );
     file_close( f );
 
+    writer.shutdown();
+
     allocator->free_marker( marker );
 }
 
 void compile_atlas( BookmarkAllocator* allocator, StringView source, StringView destination ) {
 
-    // Read json file
-    using json = nlohmann::json;
-
     sizet current_allocator_marker = allocator->get_marker();
 
     StringBuffer string_buffer;
@@ -346,57 +352,68 @@ void compile_atlas( BookmarkAllocator* allocator, StringView source, StringView
     Span<char> file_data = file_read_allocate( source, allocator );
 
     if ( file_data.data ) {
-        json json_data = json::parse( file_data.data );
+        // Read json file
+        JsonReader json_reader;
+        if ( !json_reader.init( allocator, StringView( file_data.data, file_data.size ) ) ) {
+            ilog_error( "Error parsing file %s\n", source.data );
+            allocator->free_marker( current_allocator_marker );
+            return;
+        }
 
-        json texture_name = json_data[ "texture" ];
-        std::string name_string;
+        const JsonValue json_data = json_reader.get_root();
+        const JsonValue texture_name = json_data.get( "texture" );
 
         if ( !texture_name.is_string() ) {
             ilog_error( "Error no texture specified in atlas %s", source.data );
             return;
         }
 
-        texture_name.get_to( name_string );
-        ilog_debug( "Atlas %s references texture %s\n", source.data, name_string.c_str() );
+        // Null terminated copy of the texture name
+        StringView name_string = string_buffer.append_use( texture_name.as_string() );
+        ilog_debug( "Atlas %s references texture %s\n", source.data, name_string.data );
 
         // Build dependencies
         // TODO:
-        //build_texture( name_string.c_str() );
+        //build_texture( name_string.data );
 
         i32 comp, width, height;
-        i32 image_load_result = stbi_info( name_string.c_str(), &width, &height, &comp );
+        i32 image_load_result = stbi_info( name_string.data, &width, &height, &comp );
         if ( !image_load_result ) {
-            ilog_error( "Error loading texture %s", name_string.c_str() );
+            ilog_error( "Error loading texture %s", name_string.data );
             return;
         }
 
-        json regions = json_data[ "regions" ];
+        const JsonValue regions = json_data.get( "regions" );
 
         // Build atlas
+        MallocAllocator mallocator;
         BlobWriter writer;
-        AtlasBlueprint* atlas_blueprint = writer.write<AtlasBlueprint>( allocator, AtlasBlueprint::k_version, 1000 );
+        AtlasBlueprint* atlas_blueprint = writer.write<AtlasBlueprint>( &mallocator, AtlasBlueprint::k_version, 1024 );
 
         if ( regions.is_array() ) {
-            const sizet region_count = regions.size();
+            const u32 region_count = regions.get_size();
             writer.reserve_and_set( atlas_blueprint->entries, region_count );
+            atlas_blueprint = writer.get_blob<AtlasBlueprint>();
             writer.reserve_and_set( atlas_blueprint->entry_names, region_count );
+            atlas_blueprint = writer.get_blob<AtlasBlueprint>();
+            writer.reserve_and_set( atlas_blueprint->entry_name_to_index, region_count );
 
-            std::string region_name_string;
+            u32 i = 0;
+            for ( JsonValue region = regions.first(); region.is_valid(); region = region.next(), ++i ) {
+                // Reserving names can move blob memory.
+                atlas_blueprint = writer.get_blob<AtlasBlueprint>();
 
-            for ( sizet i = 0; i < region_count; ++i ) {
-                json region = regions[ i ];
                 AtlasEntry& entry = atlas_blueprint->entries[ i ];
 
-                entry.uv_offset_x = region.value( "x", 0.0f ) / width;
-                entry.uv_offset_y = region.value( "y", 0.0f ) / height;
-                entry.uv_width = region.value( "width", 0.0f ) / width;
-                entry.uv_height = region.value( "height", 0.0f ) / height;
+                entry.uv_offset_x = region.get_f32( "x", 0.0f ) / width;
+                entry.uv_offset_y = region.get_f32( "y", 0.0f ) / height;
+                entry.uv_width = region.get_f32( "width", 0.0f ) / width;
+                entry.uv_height = region.get_f32( "height", 0.0f ) / height;
 
-                json region_name = region[ "name" ];
+                const JsonValue region_name = region.get( "name" );
                 if ( region_name.is_string() ) {
-                    region_name.get_to( region_name_string );
-
-                    StringView name_string_view{ region_name_string.c_str(), region_name_string.length() };
+                    StringView name_string_view = region_name.as_string();
+                    atlas_blueprint->entry_name_to_index.insert( name_string_view, ( u32 )i );
                     writer.reserve_and_set( atlas_blueprint->entry_names[ i ], name_string_view );
                 } else {
                     static cstring no_name_entry = "no_name_entry";
@@ -410,21 +427,24 @@ void compile_atlas( BookmarkAllocator* allocator, StringView source, StringView
         // Write texture name with different extension (.bin)
         char* name_cur = string_buffer.current();
         // TODO: get extension
-        string_buffer.append_m( (void*)name_string.c_str(), name_string.length() - 3 );
+        string_buffer.append_m( (void*)name_string.data, name_string.size - 3 );
         string_buffer.append_f( "bin" );
         string_buffer.close_current_string();
-        StringView name_string_view{ name_cur, name_string.length() };
+        StringView name_string_view{ name_cur, name_string.size };
 #else
-        StringView name_string_view{ name_string.c_str(), name_string.length() };
+        StringView name_string_view = name_string;
 #endif // IDRA_USE_COMPRESSED_TEXTURES
+        atlas_blueprint = writer.get_blob<AtlasBlueprint>();
         writer.reserve_and_set( atlas_blueprint->texture_name, name_string_view );
 
         // Write to file
-        const u32 blueprint_size = writer.reserved_offset;
+        Span<char> blob = writer.finalize( true );
 
         FileHandle f = file_open_for_write( destination );
-        fwrite( ( const void* )atlas_blueprint, blueprint_size, 1, f );
+        fwrite( ( const void* )blob.data, blob.size, 1, f );
         file_close( f );
+
+        writer.shutdown();
     }
 
     // Free memory
@@ -465,7 +485,7 @@ void compile_texture( BookmarkAllocator* allocator, StringView source, StringVie
     }
 
     const sizet texture_size = width * height * components;
-    const sizet blob_size = texture_size + sizeof( TextureBlueprint ) + destination.size;
+    const sizet blob_size = texture_size + destination.size + 1 + k_blob_alignment;
     MallocAllocator mallocator;
     // Build atlas
     BlobWriter writer;
@@ -480,16 +500,20 @@ void compile_texture( BookmarkAllocator* allocator, StringView source, StringVie
     // Write name
     writer.reserve_and_set( blueprint->name, destination );
 
-    // Write actual texture memory
-    writer.reserve_and_set( blueprint->texture_data, texture_size );
+    // Write actual texture memory, aligned for direct GPU upload.
+    blueprint = writer.get_blob<TextureBlueprint>();
+    writer.reserve_and_set( blueprint->texture_data, texture_size, k_blob_alignment );
+    blueprint = writer.get_blob<TextureBlueprint>();
     memcpy( blueprint->texture_data.get(), texture_memory, texture_size );
 
-    const u32 blueprint_size = writer.reserved_offset;
+    Span<char> blob = writer.finalize( true );
 
     FileHandle f = file_open_for_write( destination );
-    fwrite( ( const void* )blueprint, blueprint_size, 1, f );
+    fwrite( ( const void* )blob.data, blob.size, 1, f );
     file_close( f );
 
+    writer.shutdown();
+
 #else
     // If they differ, build the file.
 
@@ -508,9 +532,6 @@ void compile_texture( BookmarkAllocator* allocator, StringView source, StringVie
 
 void compile_ui( BookmarkAllocator* allocator, StringView source, StringView destination ) {
 
-    // Read json file
-    using json = nlohmann::json;
-
     sizet current_allocator_marker = allocator->get_marker();
 
     StringBuffer string_buffer;
@@ -519,59 +540,69 @@ void compile_ui( BookmarkAllocator* allocator, StringView source, StringView des
     Span<char> file_data = file_read_allocate( source, allocator );
 
     if ( file_data.data ) {
-        json json_data = json::parse( file_data.data );
+        // Read json file
+        JsonReader json_reader;
+        if ( !json_reader.init( allocator, StringView( file_data.data, file_data.size ) ) ) {
+            ilog_error( "Error parsing file %s\n", source.data );
+            allocator->free_marker( current_allocator_marker );
+            return;
+        }
 
-        json texture_name = json_data[ "texture" ];
-        std::string name_string;
+        const JsonValue json_data = json_reader.get_root();
+        const JsonValue texture_name = json_data.get( "texture" );
 
         if ( !texture_name.is_string() ) {
             ilog_error( "Error no texture specified in atlas %s", source.data );
             return;
         }
 
-        texture_name.get_to( name_string );
-        ilog_debug( "Atlas %s references texture %s\n", source.data, name_string.c_str() );
+        // Null terminated copy of the texture name
+        StringView name_string = string_buffer.append_use( texture_name.as_string() );
+        ilog_debug( "Atlas %s references texture %s\n", source.data, name_string.data );
 
         // Build dependencies
         // TODO:
-        //build_texture( name_string.c_str() );
+        //build_texture( name_string.data );
 
         i32 comp, width, height;
         auto a = g_memory->get_current_allocator();
-        i32 image_load_result = stbi_info( name_string.c_str(), &width, &height, &comp );
+        i32 image_load_result = stbi_info( name_string.data, &width, &height, &comp );
         if ( !image_load_result ) {
-            ilog_error( "Error loading texture %s", name_string.c_str() );
+            ilog_error( "Error loading texture %s", name_string.data );
             return;
         }
 
-        json text_frame = json_data[ "text_frame" ];
+        const JsonValue text_frame = json_data.get( "text_frame" );
 
         // Build atlas
+        MallocAllocator mallocator;
         BlobWriter writer;
-        UIBlueprint* blueprint = writer.write<UIBlueprint>( allocator, UIBlueprint::k_version, 1000 );
+        UIBlueprint* blueprint = writer.write<UIBlueprint>( &mallocator, UIBlueprint::k_version, 1024 );
 
         if ( text_frame.is_array() ) {
-            const sizet region_count = text_frame.size();
+            const u32 region_count = text_frame.get_size();
             writer.reserve_and_set( blueprint->entry_names, region_count );
+            blueprint = writer.get_blob<UIBlueprint>();
+            writer.reserve_and_set( blueprint->entry_name_to_index, region_count );
 
-            std::string region_name_string;
+            u32 i = 0;
+            for ( JsonValue region = text_frame.first(); region.is_valid(); region = region.next(), ++i ) {
+                // Reserving names can move blob memory.
+                blueprint = writer.get_blob<UIBlueprint>();
 
-            for ( sizet i = 0; i < region_count; ++i ) {
-                json region = text_frame[ i ];
                 UITextFrameEntry& entry = blueprint->text_frame_elements[ i ];
 
-                entry.uv_offset_x = region.value( "x", 0.0f ) / width;
-                entry.uv_offset_y = region.value( "y", 0.0f ) / height;
-                entry.uv_width = region.value( "width", 0.0f ) / width;
-                entry.uv_height = region.value( "height", 0.0f ) / height;
-                entry.position_offset_x = region.value( "offset_x", 0.0f );
-                entry.position_offset_y = region.value( "offset_y", 0.0f );
+                entry.uv_offset_x = region.get_f32( "x", 0.0f ) / width;
+                entry.uv_offset_y = region.get_f32( "y", 0.0f ) / height;
+                entry.uv_width = region.get_f32( "width", 0.0f ) / width;
+                entry.uv_height = region.get_f32( "height", 0.0f ) / height;
+                entry.position_offset_x = region.get_f32( "offset_x", 0.0f );
+                entry.position_offset_y = region.get_f32( "offset_y", 0.0f );
 
-                json region_name = region[ "name" ];
+                const JsonValue region_name = region.get( "name" );
                 if ( region_name.is_string() ) {
-                    region_name.get_to( region_name_string );
-
-                    StringView name_string_view{ region_name_string.c_str(), region_name_string.length() };
+                    StringView name_string_view = region_name.as_string();
+                    blueprint->entry_name_to_index.insert( name_string_view, ( u32 )i );
                     writer.reserve_and_set( blueprint->entry_names[ i ], name_string_view );
                 } else {
                     static cstring no_name_entry = "no_name_entry";
@@ -582,15 +613,18 @@ void compile_ui( BookmarkAllocator* allocator, StringView source, StringView des
             }
         }
 
-        StringView name_string_view{ name_string.c_str(), name_string.length() };
+        StringView name_string_view = name_string;
+        blueprint = writer.get_blob<UIBlueprint>();
         writer.reserve_and_set( blueprint->texture_name, name_string_view );
 
         // Write to file
-        const u32 blueprint_size = writer.reserved_offset;
+        Span<char> blob = writer.finalize( true );
 
         FileHandle f = file_open_for_write( destination );
-        fwrite( ( const void* )blueprint, blueprint_size, 1, f );
+        fwrite( ( const void* )blob.data, blob.size, 1, f );
         file_close( f );
+
+        writer.shutdown();
     }
 
     // Free memory
@@ -0,0 +1,740 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "hfx_compiler.hpp"
+
+#include "kernel/allocator.hpp"
+#include "kernel/array.hpp"
+#include "kernel/blob.hpp"
+#include "kernel/file.hpp"
+#include "kernel/lexer.hpp"
+#include "kernel/log.hpp"
+#include "kernel/numerics.hpp"
+#include "kernel/string.hpp"
+
+#include "graphics/graphics_blueprints.hpp"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace idra {
+
+// Effect description, views point into the source text ///////////////////
+
+namespace HfxStage {
+    enum Enum {
+        Vertex, Fragment, Compute, Count
+    };
+
+    static cstring s_defines[] = { "VERTEX", "FRAGMENT", "COMPUTE" };
+    static cstring s_extensions[] = { "vert", "frag", "comp" };
+} // namespace HfxStage
+
+struct HfxCodeBlock {
+    StringView                      name;
+    StringView                      code;
+    u32                             line;           // Of the opening brace, 1 based.
+}; // struct HfxCodeBlock
+
+struct HfxVertexLayout {
+    StringView                      name;
+    VertexStream                    streams[ k_max_vertex_streams ];
+    VertexAttribute                 attributes[ k_max_vertex_attributes ];
+    u32                             num_streams;
+    u32                             num_attributes;
+}; // struct HfxVertexLayout
+
+struct HfxRenderState {
+    StringView                      name;
+    PipelineRenderState             state;
+}; // struct HfxRenderState
+
+struct HfxPass {
+    StringView                      name;
+    StringView                      code_blocks[ HfxStage::Count ];
+    StringView                      render_state;
+    StringView                      vertex_layout;
+    u16                             dispatch_size[ 3 ];
+}; // struct HfxPass
+
+struct HfxParser {
+    Lexer                           lexer;
+    StringView                      path;
+
+    StringView                      name;
+    Array<HfxCodeBlock>             code_blocks;
+    Array<HfxVertexLayout>          vertex_layouts;
+    Array<HfxRenderState>           render_states;
+    Array<HfxPass>                  passes;
+}; // struct HfxParser
+
+// Parsing ////////////////////////////////////////////////////////////////
+static bool equals( StringView text, cstring keyword ) {
+    return lexer_expect_keyword( text, ( u32 )strlen( keyword ), keyword );
+}
+
+static bool equals_no_case( StringView text, cstring name ) {
+    const sizet length = strlen( name );
+    if ( text.size != length ) {
+        return false;
+    }
+    for ( sizet i = 0; i < length; ++i ) {
+        if ( tolower( text.data[ i ] ) != tolower( name[ i ] ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void parse_error( HfxParser& parser, const Token& token, cstring message ) {
+    // Report only the first error, the following ones are consequences.
+    if ( !parser.lexer.error ) {
+        ilog_error( "%s(%u): %s, found '%.*s'\n", parser.path.data, token.line + 1, message,
+                    ( int )token.text.size, token.text.data );
+    }
+    parser.lexer.error = true;
+}
+
+static bool expect( HfxParser& parser, Token& token, Token::Type type, cstring message ) {
+    lexer_next_token( &parser.lexer, token );
+    if ( token.type != type ) {
+        parse_error( parser, token, message );
+        return false;
+    }
+    return true;
+}
+
+static u32 expect_u32( HfxParser& parser, Token& token ) {
+    if ( !expect( parser, token, Token::Token_Number, "Expected a number" ) ) {
+        return 0;
+    }
+    // Token text is followed by a separator, so strtoul stops at its end.
+    return ( u32 )strtoul( token.text.data, nullptr, 10 );
+}
+
+// Skip a block, the opening brace is already read.
+static void skip_block( HfxParser& parser ) {
+    Token token;
+    u32 depth = 1;
+    while ( depth && !parser.lexer.error ) {
+        lexer_next_token( &parser.lexer, token );
+
+        if ( token.type == Token::Token_OpenBrace ) {
+            ++depth;
+        } else if ( token.type == Token::Token_CloseBrace ) {
+            --depth;
+        } else if ( token.type == Token::Token_EndOfStream ) {
+            parse_error( parser, token, "Unterminated block" );
+        }
+    }
+}
+
+static void parse_vertex_layout( HfxParser& parser ) {
+    Token token;
+    HfxVertexLayout layout{};
+    if ( !expect( parser, token, Token::Token_Identifier, "Expected vertex layout name" ) ) {
+        return;
+    }
+    layout.name = token.text;
+
+    if ( !expect( parser, token, Token::Token_OpenBrace, "Expected '{'" ) ) {
+        return;
+    }
+
+    while ( !parser.lexer.error ) {
+        lexer_next_token( &parser.lexer, token );
+
+        if ( token.type == Token::Token_CloseBrace ) {
+            break;
+        }
+
+        if ( equals( token.text, "binding" ) ) {
+            if ( layout.num_streams == k_max_vertex_streams ) {
+                parse_error( parser, token, "Too many vertex bindings" );
+                return;
+            }
+
+            // binding <index> <stride> <vertex|instance>
+            VertexStream& stream = layout.streams[ layout.num_streams++ ];
+            stream.binding = ( u16 )expect_u32( parser, token );
+            stream.stride = ( u16 )expect_u32( parser, token );
+
+            if ( expect( parser, token, Token::Token_Identifier, "Expected 'vertex' or 'instance'" ) ) {
+                if ( equals( token.text, "vertex" ) ) {
+                    stream.input_rate = VertexInputRate::PerVertex;
+                } else if ( equals( token.text, "instance" ) ) {
+                    stream.input_rate = VertexInputRate::PerInstance;
+                } else {
+                    parse_error( parser, token, "Expected 'vertex' or 'instance'" );
+                }
+            }
+        } else if ( equals( token.text, "attribute" ) ) {
+            if ( layout.num_attributes == k_max_vertex_attributes ) {
+                parse_error( parser, token, "Too many vertex attributes" );
+                return;
+            }
+
+            // attribute <format> <name> <binding> <location> <offset>
+            VertexAttribute& attribute = layout.attributes[ layout.num_attributes++ ];
+            if ( expect( parser, token, Token::Token_Identifier, "Expected attribute format" ) ) {
+                attribute.format = VertexComponentFormat::Count;
+                for ( u32 f = 0; f < VertexComponentFormat::Count; ++f ) {
+                    if ( equals_no_case( token.text, VertexComponentFormat::s_value_names[ f ] ) ) {
+                        attribute.format = ( VertexComponentFormat::Enum )f;
+                        break;
+                    }
+                }
+
+                if ( attribute.format == VertexComponentFormat::Count ) {
+                    parse_error( parser, token, "Unknown attribute format" );
+                }
+            }
+
+            expect( parser, token, Token::Token_Identifier, "Expected attribute name" );
+            attribute.binding = ( u16 )expect_u32( parser, token );
+            attribute.location = ( u16 )expect_u32( parser, token );
+            attribute.offset = expect_u32( parser, token );
+        } else {
+            parse_error( parser, token, "Expected 'binding' or 'attribute'" );
+        }
+    }
+
+    parser.vertex_layouts.push( layout );
+}
+
+static void parse_layout( HfxParser& parser ) {
+    Token token;
+    if ( !expect( parser, token, Token::Token_OpenBrace, "Expected '{'" ) ) {
+        return;
+    }
+
+    while ( !parser.lexer.error ) {
+        lexer_next_token( &parser.lexer, token );
+
+        if ( token.type == Token::Token_CloseBrace ) {
+            break;
+        }
+
+        if ( equals( token.text, "list" ) ) {
+            // Descriptor set layouts come from the reflection of the stages,
+            // resource lists are only documentation.
+            if ( expect( parser, token, Token::Token_Identifier, "Expected list name" ) &&
+                 expect( parser, token, Token::Token_OpenBrace, "Expected '{'" ) ) {
+                skip_block( parser );
+            }
+        } else if ( equals( token.text, "vertex" ) ) {
+            parse_vertex_layout( parser );
+        } else {
+            parse_error( parser, token, "Expected 'list' or 'vertex'" );
+        }
+    }
+}
+
+static void parse_render_state( HfxParser& parser, PipelineRenderState& state ) {
+    Token token;
+    while ( !parser.lexer.error ) {
+        lexer_next_token( &parser.lexer, token );
+
+        if ( token.type == Token::Token_CloseBrace ) {
+            break;
+        }
+
+        if ( token.type != Token::Token_Identifier ) {
+            parse_error( parser, token, "Expected render state" );
+            return;
+        }
+
+        const StringView key = token.text;
+        if ( !expect( parser, token, Token::Token_Identifier, "Expected render state value" ) ) {
+            return;
+        }
+        const StringView value = token.text;
+
+        if ( equals( key, "Cull" ) ) {
+            if ( equals( value, "None" ) ) {
+                state.rasterization.cull_mode = CullMode::None;
+            } else if ( equals( value, "Front" ) ) {
+                state.rasterization.cull_mode = CullMode::Front;
+            } else if ( equals( value, "Back" ) ) {
+                state.rasterization.cull_mode = CullMode::Back;
+            } else {
+                parse_error( parser, token, "Expected None, Front or Back" );
+            }
+        } else if ( equals( key, "ZTest" ) ) {
+            static cstring s_comparisons[] = { "Never", "Less", "Equal", "LEqual", "Greater", "NotEqual", "GEqual", "Always" };
+
+            u32 comparison = 0;
+            while ( comparison < ArrayLength( s_comparisons ) && !equals( value, s_comparisons[ comparison ] ) ) {
+                ++comparison;
+            }
+
+            if ( comparison == ArrayLength( s_comparisons ) ) {
+                parse_error( parser, token, "Expected Never, Less, Equal, LEqual, Greater, NotEqual, GEqual or Always" );
+            }
+
+            state.depth_stencil.depth_comparison = ( ComparisonFunction::Enum )comparison;
+            state.depth_stencil.depth_enable = 1;
+        } else if ( equals( key, "ZWrite" ) ) {
+            if ( equals( value, "On" ) ) {
+                state.depth_stencil.depth_write_enable = 1;
+                state.depth_stencil.depth_enable = 1;
+            } else if ( equals( value, "Off" ) ) {
+                state.depth_stencil.depth_write_enable = 0;
+            } else {
+                parse_error( parser, token, "Expected On or Off" );
+            }
+        } else if ( equals( key, "BlendMode" ) ) {
+            if ( equals( value, "Off" ) ) {
+                state.blend.blend_disabled = 1;
+            } else if ( equals( value, "Alpha" ) ) {
+                state.blend.blend_disabled = 0;
+                state.blend.source_color = Blend::SrcAlpha;
+                state.blend.destination_color = Blend::InvSrcAlpha;
+                state.blend.color_operation = BlendOperation::Add;
+                // Target alpha accumulates the coverage of both layers.
+                state.blend.separate_blend = 1;
+                state.blend.source_alpha = Blend::One;
+                state.blend.destination_alpha = Blend::InvSrcAlpha;
+                state.blend.alpha_operation = BlendOperation::Add;
+            } else if ( equals( value, "Additive" ) ) {
+                state.blend.blend_disabled = 0;
+                state.blend.source_color = Blend::One;
+                state.blend.destination_color = Blend::One;
+                state.blend.color_operation = BlendOperation::Add;
+                state.blend.separate_blend = 0;
+                state.blend.source_alpha = Blend::One;
+                state.blend.destination_alpha = Blend::One;
+                state.blend.alpha_operation = BlendOperation::Add;
+            } else {
+                parse_error( parser, token, "Expected Off, Alpha or Additive" );
+            }
+        } else {
+            parse_error( parser, token, "Unknown render state, expected Cull, ZTest, ZWrite or BlendMode" );
+        }
+    }
+}
+
+static void parse_render_states( HfxParser& parser ) {
+    Token token;
+    if ( !expect( parser, token, Token::Token_OpenBrace, "Expected '{'" ) ) {
+        return;
+    }
+
+    while ( !parser.lexer.error ) {
+        lexer_next_token( &parser.lexer, token );
+
+        if ( token.type == Token::Token_CloseBrace ) {
+            break;
+        }
+
+        if ( !equals( token.text, "state" ) ) {
+            parse_error( parser, token, "Expected 'state'" );
+            return;
+        }
+
+        HfxRenderState render_state{};
+        if ( !expect( parser, token, Token::Token_Identifier, "Expected state name" ) ) {
+            return;
+        }
+        render_state.name = token.text;
+        // Unlike the gpu defaults, effects are not blended unless asked.
+        render_state.state.blend.blend_disabled = 1;
+
+        if ( expect( parser, token, Token::Token_OpenBrace, "Expected '{'" ) ) {
+            parse_render_state( parser, render_state.state );
+        }
+
+        parser.render_states.push( render_state );
+    }
+}
+
+static void parse_code_block( HfxParser& parser ) {
+    Token token;
+    HfxCodeBlock code_block{};
+    if ( !expect( parser, token, Token::Token_Identifier, "Expected glsl block name" ) ) {
+        return;
+    }
+    code_block.name = token.text;
+
+    if ( !expect( parser, token, Token::Token_OpenBrace, "Expected '{'" ) ) {
+        return;
+    }
+    code_block.line = token.line + 1;
+
+    // Tokenize the code only to find the matching brace, comments and strings
+    // are skipped by the lexer.
+    cstring code_start = parser.lexer.position;
+    u32 depth = 1;
+    while ( depth && !parser.lexer.error ) {
+        lexer_next_token( &parser.lexer, token );
+
+        if ( token.type == Token::Token_OpenBrace ) {
+            ++depth;
+        } else if ( token.type == Token::Token_CloseBrace ) {
+            --depth;
+        } else if ( token.type == Token::Token_EndOfStream ) {
+            parse_error( parser, token, "Unterminated glsl block" );
+            return;
+        }
+    }
+
+    code_block.code = StringView( code_start, token.text.data - code_start );
+    parser.code_blocks.push( code_block );
+}
+
+static void parse_pass( HfxParser& parser ) {
+    Token token;
+    HfxPass pass{};
+    if ( !expect( parser, token, Token::Token_Identifier, "Expected pass name" ) ) {
+        return;
+    }
+    pass.name = token.text;
+
+    if ( !expect( parser, token, Token::Token_OpenBrace, "Expected '{'" ) ) {
+        return;
+    }
+
+    while ( !parser.lexer.error ) {
+        lexer_next_token( &parser.lexer, token );
+
+        if ( token.type == Token::Token_CloseBrace ) {
+            break;
+        }
+
+        const Token key = token;
+        if ( key.type != Token::Token_Identifier || !expect( parser, token, Token::Token_Equals, "Expected '='" ) ) {
+            parse_error( parser, key, "Expected pass property" );
+            return;
+        }
+
+        if ( equals( key.text, "dispatch" ) ) {
+            // dispatch = x, y, z
+            pass.dispatch_size[ 0 ] = ( u16 )expect_u32( parser, token );
+            expect( parser, token, Token::Token_Comma, "Expected ','" );
+            pass.dispatch_size[ 1 ] = ( u16 )expect_u32( parser, token );
+            expect( parser, token, Token::Token_Comma, "Expected ','" );
+            pass.dispatch_size[ 2 ] = ( u16 )expect_u32( parser, token );
+            continue;
+        }
+
+        if ( !expect( parser, token, Token::Token_Identifier, "Expected name" ) ) {
+            return;
+        }
+
+        if ( equals( key.text, "vertex" ) ) {
+            pass.code_blocks[ HfxStage::Vertex ] = token.text;
+        } else if ( equals( key.text, "fragment" ) ) {
+            pass.code_blocks[ HfxStage::Fragment ] = token.text;
+        } else if ( equals( key.text, "compute" ) ) {
+            pass.code_blocks[ HfxStage::Compute ] = token.text;
+        } else if ( equals( key.text, "render_states" ) ) {
+            pass.render_state = token.text;
+        } else if ( equals( key.text, "vertex_layout" ) ) {
+            pass.vertex_layout = token.text;
+        } else if ( equals( key.text, "resources" ) ) {
+            // Layouts are reflected, see parse_layout.
+        } else {
+            parse_error( parser, key, "Unknown pass property" );
+        }
+    }
+
+    parser.passes.push( pass );
+}
+
+static void parse_effect( HfxParser& parser ) {
+    Token token;
+    lexer_next_token( &parser.lexer, token );
+    if ( !equals( token.text, "shader" ) ) {
+        parse_error( parser, token, "Expected 'shader'" );
+        return;
+    }
+
+    if ( !expect( parser, token, Token::Token_Identifier, "Expected effect name" ) ) {
+        return;
+    }
+    parser.name = token.text;
+
+    if ( !expect( parser, token, Token::Token_OpenBrace, "Expected '{'" ) ) {
+        return;
+    }
+
+    while ( !parser.lexer.error ) {
+        lexer_next_token( &parser.lexer, token );
+
+        if ( token.type == Token::Token_CloseBrace ) {
+            break;
+        }
+
+        if ( equals( token.text, "layout" ) ) {
+            parse_layout( parser );
+        } else if ( equals( token.text, "render_states" ) ) {
+            parse_render_states( parser );
+        } else if ( equals( token.text, "glsl" ) ) {
+            parse_code_block( parser );
+        } else if ( equals( token.text, "pass" ) ) {
+            parse_pass( parser );
+        } else {
+            parse_error( parser, token, "Expected layout, render_states, glsl or pass" );
+        }
+    }
+}
+
+// Returns the index of the element named name, or u32_max.
+template <typename T>
+static u32 find_named( const Array<T>& elements, StringView name ) {
+    for ( u32 i = 0; i < elements.size; ++i ) {
+        if ( elements[ i ].name.size == name.size && memcmp( elements[ i ].name.data, name.data, name.size ) == 0 ) {
+            return i;
+        }
+    }
+    return u32_max;
+}
+
+// Passes referencing missing names are errors, unused declarations are not.
+static bool validate_passes( const HfxParser& parser ) {
+    bool valid = true;
+
+    for ( u32 p = 0; p < parser.passes.size; ++p ) {
+        const HfxPass& pass = parser.passes[ p ];
+
+        const bool compute = pass.code_blocks[ HfxStage::Compute ].size;
+        const bool graphics = pass.code_blocks[ HfxStage::Vertex ].size && pass.code_blocks[ HfxStage::Fragment ].size;
+        if ( compute == graphics ) {
+            ilog_error( "%s: pass %.*s needs either a compute block or both vertex and fragment blocks\n",
+                        parser.path.data, ( int )pass.name.size, pass.name.data );
+            valid = false;
+        }
+
+        for ( u32 s = 0; s < HfxStage::Count; ++s ) {
+            const StringView block = pass.code_blocks[ s ];
+            if ( block.size && find_named( parser.code_blocks, block ) == u32_max ) {
+                ilog_error( "%s: pass %.*s uses missing glsl block %.*s\n", parser.path.data,
+                            ( int )pass.name.size, pass.name.data, ( int )block.size, block.data );
+                valid = false;
+            }
+        }
+
+        if ( pass.render_state.size && find_named( parser.render_states, pass.render_state ) == u32_max ) {
+            ilog_error( "%s: pass %.*s uses missing render state %.*s\n", parser.path.data,
+                        ( int )pass.name.size, pass.name.data, ( int )pass.render_state.size, pass.render_state.data );
+            valid = false;
+        }
+
+        if ( pass.vertex_layout.size && find_named( parser.vertex_layouts, pass.vertex_layout ) == u32_max ) {
+            ilog_error( "%s: pass %.*s uses missing vertex layout %.*s\n", parser.path.data,
+                        ( int )pass.name.size, pass.name.data, ( int )pass.vertex_layout.size, pass.vertex_layout.data );
+            valid = false;
+        }
+    }
+
+    return valid;
+}
+
+// Code generation ////////////////////////////////////////////////////////
+
+// Write the stage only if it changed, the shader hot reload watches these files.
+static bool write_stage_source( BookmarkAllocator* allocator, StringView path, const StringBuffer& code ) {
+    const sizet marker = allocator->get_marker();
+
+    bool changed = true;
+    if ( fs_file_exists( path ) ) {
+        Span<char> previous = file_read_allocate( path, allocator );
+        changed = previous.size != code.current_size || memcmp( previous.data, code.data, code.current_size ) != 0;
+    }
+
+    allocator->free_marker( marker );
+
+    if ( !changed ) {
+        return true;
+    }
+
+    FileHandle f = file_open_for_write( path );
+    if ( !f ) {
+        ilog_error( "Could not write generated shader %s\n", path.data );
+        return false;
+    }
+
+    fwrite( code.data, code.current_size, 1, f );
+    file_close( f );
+    return true;
+}
+
+static void generate_stage_source( const HfxCodeBlock& block, HfxStage::Enum stage,
+                                   StringView effect_path, StringBuffer& code ) {
+    code.clear();
+    code.append_format( "// Generated from {}, glsl {}. Do not edit.\n", effect_path, block.name );
+    code.append_format( "#define {}\n", HfxStage::s_defines[ stage ] );
+    // Errors point to the effect, the brace line ends where the code starts.
+    code.append_format( "#line {} \"{}\"\n", block.line, effect_path );
+
+    static const StringView k_pragma_include( "#pragma include" );
+
+    StringView remaining = block.code;
+    for ( sizet i = 0; i + k_pragma_include.size <= remaining.size; ) {
+        if ( memcmp( remaining.data + i, k_pragma_include.data, k_pragma_include.size ) == 0 ) {
+            code.append( StringView( remaining.data, i ) );
+            code.append( "#include" );
+            remaining = StringView( remaining.data + i + k_pragma_include.size, remaining.size - i - k_pragma_include.size );
+            i = 0;
+        } else {
+            ++i;
+        }
+    }
+    code.append( remaining );
+    code.append( "\n" );
+}
+
+// Compilation ////////////////////////////////////////////////////////////
+bool hfx_compile( BookmarkAllocator* allocator, StringView source, StringView destination, StringView shader_folder ) {
+
+    // Generated stages are referenced relative to the shader folder.
+    if ( source.size <= shader_folder.size + 1 || memcmp( source.data, shader_folder.data, shader_folder.size ) != 0 ) {
+        ilog_error( "Effect %s is not in the shader folder %s\n", source.data, shader_folder.data );
+        return false;
+    }
+
+    const sizet marker = allocator->get_marker();
+
+    Span<char> file_data = file_read_allocate( source, allocator );
+    if ( !file_data.data ) {
+        allocator->free_marker( marker );
+        return false;
+    }
+
+    HfxParser parser{};
+    parser.path = source;
+    parser.code_blocks.init( allocator, 16 );
+    parser.vertex_layouts.init( allocator, 4 );
+    parser.render_states.init( allocator, 8 );
+    parser.passes.init( allocator, 8 );
+
+    lexer_init( &parser.lexer, file_data.data, nullptr );
+    parse_effect( parser );
+
+    if ( parser.lexer.error || !validate_passes( parser ) ) {
+        allocator->free_marker( marker );
+        return false;
+    }
+
+    // Source path without the shader folder and the extension.
+    const StringView relative_source( source.data + shader_folder.size + 1, source.size - shader_folder.size - 1 );
+    const char* extension = strrchr( relative_source.data, '.' );
+    const StringView relative_name( relative_source.data, extension ? extension - relative_source.data : relative_source.size );
+
+    StringBuffer names;
+    names.init( ikilo( 4 ), allocator );
+
+    // One buffer for all the stages, sized for the biggest block and the header.
+    sizet max_code_size = 0;
+    for ( u32 i = 0; i < parser.code_blocks.size; ++i ) {
+        max_code_size = idra::max( max_code_size, parser.code_blocks[ i ].code.size );
+    }
+    StringBuffer code;
+    code.init( max_code_size + ikilo( 1 ), allocator );
+
+    MallocAllocator mallocator;
+    BlobWriter writer;
+    PipelineBlueprint* blueprint = writer.write<PipelineBlueprint>( &mallocator, PipelineBlueprint::k_version, ikilo( 4 ) );
+
+    writer.reserve_and_set( blueprint->name, parser.name );
+    blueprint = writer.get_blob<PipelineBlueprint>();
+    writer.reserve_and_set( blueprint->render_states, parser.render_states.size );
+    blueprint = writer.get_blob<PipelineBlueprint>();
+    writer.reserve_and_set( blueprint->vertex_inputs, parser.vertex_layouts.size );
+    blueprint = writer.get_blob<PipelineBlueprint>();
+    writer.reserve_and_set( blueprint->passes, parser.passes.size );
+    blueprint = writer.get_blob<PipelineBlueprint>();
+
+    for ( u32 i = 0; i < parser.render_states.size; ++i ) {
+        blueprint->render_states[ i ] = parser.render_states[ i ].state;
+    }
+
+    for ( u32 i = 0; i < parser.vertex_layouts.size; ++i ) {
+        const HfxVertexLayout& layout = parser.vertex_layouts[ i ];
+
+        writer.reserve_and_set( blueprint->vertex_inputs[ i ].streams, layout.num_streams );
+        blueprint = writer.get_blob<PipelineBlueprint>();
+        writer.reserve_and_set( blueprint->vertex_inputs[ i ].attributes, layout.num_attributes );
+        blueprint = writer.get_blob<PipelineBlueprint>();
+
+        PipelineVertexInput& vertex_input = blueprint->vertex_inputs[ i ];
+        for ( u32 s = 0; s < layout.num_streams; ++s ) {
+            vertex_input.streams[ s ] = layout.streams[ s ];
+        }
+        for ( u32 a = 0; a < layout.num_attributes; ++a ) {
+            vertex_input.attributes[ a ] = layout.attributes[ a ];
+        }
+    }
+
+    bool success = true;
+    for ( u32 p = 0; p < parser.passes.size && success; ++p ) {
+        const HfxPass& pass = parser.passes[ p ];
+
+        names.clear();
+        StringView paths[ 2 ];
+        u32 num_paths = 0;
+
+        for ( u32 s = 0; s < HfxStage::Count; ++s ) {
+            if ( !pass.code_blocks[ s ].size ) {
+                continue;
+            }
+
+            const HfxCodeBlock& block = parser.code_blocks[ find_named( parser.code_blocks, pass.code_blocks[ s ] ) ];
+
+            paths[ num_paths++ ] = names.append_use_format( "{}.{}.{}", relative_name, block.name, HfxStage::s_extensions[ s ] );
+            StringView stage_path = names.append_use_format( "{}/{}", shader_folder, paths[ num_paths - 1 ] );
+
+            generate_stage_source( block, ( HfxStage::Enum )s, relative_source, code );
+            success = success && write_stage_source( allocator, stage_path, code );
+        }
+
+        const ShaderStage::Enum stage = pass.code_blocks[ HfxStage::Compute ].size ? ShaderStage::Compute : ShaderStage::Vertex;
+        const StringView shader_name = names.append_use_format( "{}.{}", relative_name, pass.name );
+
+        writer.reserve_and_set( blueprint->passes[ p ].name, pass.name );
+        blueprint = writer.get_blob<PipelineBlueprint>();
+        writer.reserve_and_set( blueprint->passes[ p ].shader_name, shader_name );
+        blueprint = writer.get_blob<PipelineBlueprint>();
+        for ( u32 s = 0; s < num_paths; ++s ) {
+            writer.reserve_and_set( blueprint->passes[ p ].paths[ s ], paths[ s ] );
+            blueprint = writer.get_blob<PipelineBlueprint>();
+        }
+
+        PipelinePass& pipeline_pass = blueprint->passes[ p ];
+        pipeline_pass.stage = stage;
+        pipeline_pass.program_key = ShaderPackBlueprint::calculate_key( {}, {}, { paths, num_paths }, stage );
+
+        const u32 render_state = pass.render_state.size ? find_named( parser.render_states, pass.render_state ) : u32_max;
+        const u32 vertex_input = pass.vertex_layout.size ? find_named( parser.vertex_layouts, pass.vertex_layout ) : u32_max;
+        pipeline_pass.render_state = render_state == u32_max ? PipelinePass::k_no_index : render_state;
+        pipeline_pass.vertex_input = vertex_input == u32_max ? PipelinePass::k_no_index : vertex_input;
+
+        for ( u32 i = 0; i < 3; ++i ) {
+            pipeline_pass.dispatch_size[ i ] = pass.dispatch_size[ i ];
+        }
+    }
+
+    if ( success ) {
+        Span<char> blob = writer.finalize( true );
+
+        FileHandle f = file_open_for_write( destination );
+        if ( f ) {
+            fwrite( ( const void* )blob.data, blob.size, 1, f );
+            file_close( f );
+        } else {
+            ilog_error( "Could not write %s\n", destination.data );
+            success = false;
+        }
+    }
+
+    writer.shutdown();
+
+    allocator->free_marker( marker );
+
+    return success;
+}
+
+} // namespace idra
@@ -0,0 +1,29 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#pragma once
+
+#include "kernel/string_view.hpp"
+
+namespace idra {
+
+struct BookmarkAllocator;
+
+//
+// HFX effects: glsl code blocks, render states, vertex layouts and the passes
+// combining them, compiled into a PipelineBlueprint.
+//
+// Code blocks used by a pass are written next to the source, one file per
+// stage named <effect>.<block>.<vert|frag|comp>, with the VERTEX, FRAGMENT or
+// COMPUTE define and '#pragma include' turned into '#include'. They are then
+// compiled, or packed by shader_compiler_cli, like any other shader, so the
+// source must be inside shader_folder. Files are rewritten only when their
+// content changes, not to trigger a shader reload at every compilation.
+//
+// Returns false and logs the line on syntax errors.
+bool                    hfx_compile( BookmarkAllocator* allocator, StringView source,
+                                     StringView destination, StringView shader_folder );
+
+} // namespace idra
@@ -4,6 +4,8 @@
  */
 
 #include "shader_compiler.hpp"
+#include "shader_preprocessor.hpp"
+#include "spirv_cache.hpp"
 #include <stdio.h>
 
 #include "kernel/allocator.hpp"
@@ -16,13 +18,19 @@
 #include "kernel/lexer.hpp"
 #include "kernel/numerics.hpp"
 #include "kernel/time.hpp"
+#include "kernel/task_manager.hpp"
 
 // glsl
 #include "glslang/Public/ShaderLang.h"
 #include "glslang/SPIRV/GlslangToSpv.h"
+#include "glslang/build_info.h"
+#include "spirv-tools/optimizer.hpp"
 
 #include <string>
 
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace idra {
@@ -166,29 +174,144 @@ static EShLanguage  shader_stage_to_sh_language( ShaderStage::Enum stage );
 static void         dump_shader_code( StringBuffer& temp_string_buffer, 
                                       cstring code, cstring name );
 
-static u64          shader_concatenate( StringView path, StringBuffer& shader_code );
 static void         log_lines_around_error( cstring code, cstring shader_code );
+static u64          shader_cache_key( StringView source_code, ShaderStage::Enum stage );
 
-static char s_shader_folder_path[ 512 ];
 MallocAllocator s_mallocator;
 
-void shader_compiler_init( StringView shader_folder_path ) {
-    glslang::InitializeProcess();
+static ShaderFileCache s_file_cache;
+
+// Concatenated source of the current compilation, one per thread and reused.
+struct ShaderCompilerThreadData {
+    ~ShaderCompilerThreadData() {
+        if ( shader_code.data ) {
+            shader_code.shutdown();
+        }
+    }
+
+    StringBuffer        shader_code;
+}; // struct ShaderCompilerThreadData
+
+static thread_local ShaderCompilerThreadData s_thread_data;
+
+static SpirvCache s_spirv_cache;
+static const sizet k_spirv_cache_max_size = imega( 64 );
+
+static ShaderCompilerOptions s_options = shader_compiler_default_options();
+
+//
+// Only modules compiled in this run, cache hits are already optimized.
+struct ShaderOptimizerStatistics {
+    std::atomic<u32>    modules{ 0 };
+    std::atomic<u64>    input_bytes{ 0 };
+    std::atomic<u64>    output_bytes{ 0 };
+    std::atomic<u64>    optimize_us{ 0 };
+}; // struct ShaderOptimizerStatistics
+
+static ShaderOptimizerStatistics s_optimizer_statistics;
 
-    // Cache shader folder path
-    strcpy( s_shader_folder_path, shader_folder_path.data );
+// Workers of shader_compiler_compile_many, created once. Batches run one at a time,
+// as task rounds are started and waited on by a single thread.
+static TaskManager  s_compile_task_manager;
+static std::mutex   s_compile_many_mutex;
+
+void shader_compiler_init( StringView shader_folder_path, StringView cache_folder_path ) {
+    glslang::InitializeProcess();
 
     g_log->init( &s_mallocator );
     g_time->init();
+
+    // Paths are resolved against the absolute shader folder, so compilation does not depend on the current directory.
+    s_file_cache.init( shader_folder_path, &s_mallocator );
+
+    if ( cache_folder_path.size ) {
+        s_spirv_cache.init( cache_folder_path, k_spirv_cache_max_size, &s_mallocator );
+    }
+
+    // The calling thread only waits for the batch, all hardware threads compile.
+    s_compile_task_manager.init( idra::max( std::thread::hardware_concurrency(), 1u ) );
 }
 
 void shader_compiler_shutdown() {
+    s_compile_task_manager.shutdown();
+
     glslang::FinalizeProcess();
 
+    shader_compiler_log_statistics();
+    s_spirv_cache.shutdown();
+    s_file_cache.shutdown();
+
     g_log->shutdown();
     g_time->shutdown();
 }
 
+void shader_compiler_log_statistics() {
+    s_spirv_cache.log_statistics();
+
+    const u32 modules = s_optimizer_statistics.modules;
+    if ( modules ) {
+        const u64 input_bytes = s_optimizer_statistics.input_bytes;
+        const u64 output_bytes = s_optimizer_statistics.output_bytes;
+
+        ilog( "Shader optimizer: %u modules, %.1f KB before and %.1f KB after (%.1f%%), %.1f ms.\n", modules,
+              input_bytes / 1024.0, output_bytes / 1024.0, input_bytes ? 100.0 * output_bytes / input_bytes : 0.0,
+              s_optimizer_statistics.optimize_us / 1000.0 );
+    }
+}
+
+ShaderCompilerOptions shader_compiler_default_options() {
+#if defined (IDRA_SHADER_DEBUG_INFO)
+    return { ShaderOptimization::None, false, true };
+#else
+    return { ShaderOptimization::Performance, true, false };
+#endif // IDRA_SHADER_DEBUG_INFO
+}
+
+void shader_compiler_set_options( const ShaderCompilerOptions& options ) {
+    s_options = options;
+}
+
+// Run the SPIRV-Tools passes selected by the options, the module is untouched on failure.
+static void optimize_spirv( std::vector<unsigned int>& spirv ) {
+
+    if ( s_options.optimization == ShaderOptimization::None && !s_options.strip_debug_info ) {
+        return;
+    }
+
+    const TimeTick start_time = g_time->now();
+
+    spvtools::Optimizer optimizer( SPV_ENV_VULKAN_1_3 );
+    optimizer.SetMessageConsumer( []( spv_message_level_t level, const char* source, const spv_position_t& position, const char* message ) {
+        if ( level <= SPV_MSG_ERROR ) {
+            ilog_error( "Shader optimizer error at word %u: %s\n", ( u32 )position.index, message );
+        }
+    } );
+
+    if ( s_options.optimization == ShaderOptimization::Performance ) {
+        optimizer.RegisterPerformancePasses();
+    } else if ( s_options.optimization == ShaderOptimization::Size ) {
+        optimizer.RegisterSizePasses();
+    }
+
+    if ( s_options.strip_debug_info ) {
+        optimizer.RegisterPass( spvtools::CreateStripDebugInfoPass() );
+        optimizer.RegisterPass( spvtools::CreateStripNonSemanticInfoPass() );
+    }
+
+    std::vector<unsigned int> optimized_spirv;
+    if ( !optimizer.Run( spirv.data(), spirv.size(), &optimized_spirv ) ) {
+        ilog_warn( "Shader optimizer failed, using the unoptimized module.\n" );
+        return;
+    }
+
+    ++s_optimizer_statistics.modules;
+    s_optimizer_statistics.input_bytes += spirv.size() * sizeof( u32 );
+    s_optimizer_statistics.output_bytes += optimized_spirv.size() * sizeof( u32 );
+    s_optimizer_statistics.optimize_us += ( u64 )g_time->convert_microseconds( g_time->delta( g_time->now(), start_time ) );
+
+    spirv.swap( optimized_spirv );
+}
+
 void shader_compiler_add_log_callback( PrintCallback callback ) {
     g_log->add_callback( callback );
 }
@@ -198,7 +321,14 @@ void shader_compiler_remove_log_callback( PrintCallback callback ) {
 }
 
 void shader_compiler_compile( StringView source_code, ShaderStage::Enum stage, std::vector<unsigned int>& spirv ) {
+
+    const u64 cache_key = shader_cache_key( source_code, stage );
+    if ( s_spirv_cache.load( cache_key, spirv ) ) {
+        return;
+    }
+
     ilog( "Shader compiler compiling...\n\n" );
+    const TimeTick start_time = g_time->now();
 
     const EShLanguage sh_language = shader_stage_to_sh_language( stage );
     glslang::TShader shader( sh_language );
@@ -241,27 +371,37 @@ void shader_compiler_compile( StringView source_code, ShaderStage::Enum stage, s
     }
 
     if ( !( parsing_error || linking_error ) ) {
-        glslang::GlslangToSpv( *program.getIntermediate( sh_language ), spirv );
-    }
-}
+        glslang::SpvOptions spv_options;
+        spv_options.generateDebugInfo = s_options.generate_debug_info;
+        // Optimizations are done after, to record the module size before them.
+        spv_options.disableOptimizer = true;
 
+        glslang::GlslangToSpv( *program.getIntermediate( sh_language ), spirv, &spv_options );
 
-static u64 shader_concatenate( StringView path, StringBuffer& shader_code ) {
-    
-    MallocAllocator mallocator;
+        optimize_spirv( spirv );
 
-    Span<char> buffer_span = file_read_allocate( path, &mallocator );
-    if ( buffer_span.size == 0 ) {
-        ilog_error( "Error opening file %s\n", path.data );
-        return 0;
+        const f64 compile_ms = g_time->convert_milliseconds( g_time->delta( g_time->now(), start_time ) );
+        s_spirv_cache.store( cache_key, spirv, ( f32 )compile_ms );
     }
+}
 
-    shader_code.append_m( buffer_span.data, buffer_span.size );
-
-    u64 hashed_memory = hash_bytes( buffer_span.data, buffer_span.size );
-    return hashed_memory;
+// The concatenated source already contains defines and includes, add everything
+// else that changes the generated SPIR-V.
+static u64 shader_cache_key( StringView source_code, ShaderStage::Enum stage ) {
+    const u64 settings[] = {
+        ( u64 )stage,
+        ( u64 )glslang::EShTargetClientVersion::EShTargetVulkan_1_3,
+        ( u64 )glslang::EShTargetLanguageVersion::EShTargetSpv_1_3,
+        450,
+        ( ( u64 )s_options.optimization << 16 ) | ( ( u64 )s_options.strip_debug_info << 8 ) | ( u64 )s_options.generate_debug_info,
+        ( ( u64 )GLSLANG_VERSION_MAJOR << 32 ) | ( ( u64 )GLSLANG_VERSION_MINOR << 16 ) | ( u64 )GLSLANG_VERSION_PATCH
+    };
+
+    const u64 settings_hash = hash_bytes( ( void* )settings, sizeof( settings ) );
+    return hash_bytes( ( void* )source_code.data, source_code.size, settings_hash );
 }
 
+
 void dump_shader_code( StringBuffer& temp_string_buffer, cstring code, cstring name ) {
     //ilog( "Error in creation of shader %s, stage %s. Writing shader:\n", name, to_stage_defines( stage ) );
 
@@ -294,52 +434,76 @@ void dump_shader_code( StringBuffer& temp_string_buffer, cstring code, cstring n
 void shader_compiler_compile_from_file( const ShaderCompilationInfo& creation, std::vector<unsigned int>& spirv ) {
     ilog( "Shader compiler compiling file %s!\n", creation.source_path.data );
 
-    // Change directory to shader directory
-    Directory current_directory;
-    fs_directory_current( &current_directory );
+    StringBuffer& shader_code = s_thread_data.shader_code;
+    shader_code_reserve( shader_code, ikilo( 64 ), &s_mallocator );
+    shader_code.clear();
 
-    fs_directory_change( s_shader_folder_path );
-
-    MallocAllocator mallocator;
-    StringBuffer shader_code;
-    shader_code.init( ikilo( 800 ), &mallocator );
-
-    shader_code.append_f( "#version 460\n" );
+    // Named #line directives, so errors report the original file and line.
+    shader_code.append_f( "#version 460\n#extension GL_GOOGLE_cpp_style_line_directive : require\n" );
 
     // Append defines
     for ( u32 i = 0; i < ( u32 )creation.defines.size; ++i ) {
+        shader_code_reserve( shader_code, creation.defines[ i ].size + 16, &s_mallocator );
         shader_code.append_f( "#define %s\n", creation.defines[ i ].data );
     }
 
-    // Append include code
-    for ( u32 i = 0; i < ( u32 )creation.include_paths.size; ++i ) {
-        shader_concatenate( creation.include_paths[ i ], shader_code );
+    if ( creation.dependencies ) {
+        creation.dependencies->clear();
+    }
+
+    if ( !shader_preprocess( s_file_cache, creation.include_paths, creation.source_path, shader_code, creation.dependencies ) ) {
+        spirv.clear();
+        return;
     }
 
-    u64 shader_file_hash = shader_concatenate( creation.source_path, shader_code );
     // Add the null terminator at the end of the concatenated file.
     shader_code.data[ shader_code.current_size ] = 0;
 
     shader_compiler_compile( StringView(shader_code.data, shader_code.current_size), creation.stage, spirv );
 
     if ( spirv.size() == 0 ) {
-
-        StringBuffer error_report;
-        error_report.init( ikilo( 800 ), &mallocator );
-
         // TODO:
         //dump_shader_code( error_report, shader_code.data, creation.source_path.data );
     }
     else {
         ilog( "Compilation successful!\n" );
     }
+}
+
+void shader_compiler_compile_many( Span<const ShaderCompilationInfo> infos, Span<std::vector<unsigned int>> spirv ) {
+    iassert( infos.size == spirv.size );
+
+    const u32 count = ( u32 )infos.size;
+    if ( count == 0 ) {
+        return;
+    }
+
+    // One task per shader, data is the index of the compilation.
+    TaskManager::Callback compile_task = [ & ]( void* data, i32 thread_id ) {
+        const u32 i = ( u32 )( uintptr_t )data;
+
+        // glslang keeps its pools per thread, initialize is reference counted.
+        glslang::InitializeProcess();
+        shader_compiler_compile_from_file( infos[ i ], spirv[ i ] );
+        glslang::FinalizeProcess();
+    };
+
+    std::lock_guard<std::mutex> lock( s_compile_many_mutex );
 
-    free( ( char* )shader_code.data );
+    for ( u32 i = 0; i < count; ++i ) {
+        s_compile_task_manager.add_task( compile_task, ( void* )( uintptr_t )i );
+    }
 
-    fs_directory_change( current_directory.path );
+    s_compile_task_manager.start_tasks();
+    s_compile_task_manager.wait_for_completion();
 }
 
 
+u64 shader_compiler_file_hash( StringView path ) {
+    ShaderFileCache::File file;
+    return s_file_cache.get( path, file ) != StringInterner::k_invalid_id ? file.content_hash : 0;
+}
+
 // ShaderStage to SHLanguage
 EShLanguage shader_stage_to_sh_language( ShaderStage::Enum stage ) {
     switch ( stage ) {
@@ -384,10 +548,27 @@ EShLanguage shader_stage_to_sh_language( ShaderStage::Enum stage ) {
 
 void log_lines_around_error( cstring code, cstring shader_code ) {
     const char* error_string = strstr( code, "ERROR" );
+    if ( !error_string ) {
+        return;
+    }
     // Error format is: ERROR: filename:(line)
     error_string = strstr( error_string, ":" );
     ++error_string;
+    while ( *error_string == ' ' ) {
+        ++error_string;
+    }
+    cstring filename = error_string;
     error_string = strstr( error_string, ":" );
+    if ( !error_string ) {
+        return;
+    }
+
+    // Filenames come from #line directives, show the lines of the original file.
+    ShaderFileCache::File file;
+    if ( s_file_cache.find( StringView( filename, error_string - filename ), file ) ) {
+        shader_code = file.data;
+    }
+
     ++error_string;
     i32 error_line = atoi( error_string );
 
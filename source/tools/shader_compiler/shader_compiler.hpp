@@ -35,23 +35,66 @@
 // TODO: glslang uses vectors to store the result of SpirV compilation
 #include <vector>
 
+// Debug builds keep source level debug info and skip the optimizer, so shader
+// debuggers can show the GLSL. Define it to keep the debug info in other builds.
+#if defined(_DEBUG) && !defined(IDRA_SHADER_DEBUG_INFO)
+#define IDRA_SHADER_DEBUG_INFO
+#endif // _DEBUG
+
 namespace idra {
 
+namespace ShaderOptimization {
+    enum Enum {
+        None, Performance, Size, Count
+    };
+} // namespace ShaderOptimization
+
+// Post processing of the SPIR-V generated by glslang, part of the cache key.
+struct ShaderCompilerOptions {
+    ShaderOptimization::Enum optimization;
+    bool strip_debug_info;          // Debug and reflection only instructions.
+    bool generate_debug_info;       // Source and line informations.
+};
+
+// A file read by a compilation, path relative to the shader folder.
+struct ShaderFileDependency {
+    StringView path;
+    u64 content_hash;
+};
+
 struct ShaderCompilationInfo {
     Span<const StringView> defines;
-    Span<const StringView> include_paths;
+    Span<const StringView> include_paths;     // Included before the source.
     StringView source_path;
     ShaderStage::Enum stage;
+    // Optional, receives the source and all its transitive includes.
+    std::vector<ShaderFileDependency>* dependencies = nullptr;
 };
 
 // Per process (not needed per thread) init/shutdown
-IDRA_SC_EXPORT void shader_compiler_init( StringView shader_folder_path );
+// Compiled SPIR-V is cached in cache_folder_path, an empty path disables the cache.
+IDRA_SC_EXPORT void shader_compiler_init( StringView shader_folder_path, StringView cache_folder_path );
 IDRA_SC_EXPORT void shader_compiler_shutdown();
 
+// Log SPIR-V cache hit rate and time saved, and module size before and after optimization.
+IDRA_SC_EXPORT void shader_compiler_log_statistics();
+
+// Defaults depend on IDRA_SHADER_DEBUG_INFO. Set before compiling, not while compilations are running.
+IDRA_SC_EXPORT ShaderCompilerOptions shader_compiler_default_options();
+IDRA_SC_EXPORT void shader_compiler_set_options( const ShaderCompilerOptions& options );
+
 IDRA_SC_EXPORT void shader_compiler_add_log_callback( PrintCallback callback );
 IDRA_SC_EXPORT void shader_compiler_remove_log_callback( PrintCallback callback );
 
 IDRA_SC_EXPORT void shader_compiler_compile( StringView source_code, ShaderStage::Enum stage, std::vector<unsigned int>& spirv );
+// Paths are relative to the shader folder, thread safe.
 IDRA_SC_EXPORT void shader_compiler_compile_from_file( const ShaderCompilationInfo& creation, std::vector<unsigned int>& spirv );
+// Compile on the compiler worker threads, spirv[ i ] is the result of infos[ i ] and is empty on errors.
+// Thread safe, concurrent batches run one after the other.
+IDRA_SC_EXPORT void shader_compiler_compile_many( Span<const ShaderCompilationInfo> infos, Span<std::vector<unsigned int>> spirv );
+
+// Content hash of a file in the shader folder, read again if changed on disk. 0 if missing.
+// Compare with ShaderFileDependency::content_hash to find shaders to recompile.
+IDRA_SC_EXPORT u64 shader_compiler_file_hash( StringView path );
 
 } // namespace idra
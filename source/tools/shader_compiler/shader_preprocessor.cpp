@@ -0,0 +1,471 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "shader_preprocessor.hpp"
+
+#include "kernel/allocator.hpp"
+#include "kernel/hash_map.hpp"
+#include "kernel/lexer.hpp"
+#include "kernel/log.hpp"
+#include "kernel/memory.hpp"
+#include "kernel/numerics.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace idra {
+
+static const u32            k_max_include_depth = 32;
+
+// Line parsing helpers ///////////////////////////////////////////////////
+//
+// Lines are [begin, end) without the new line.
+struct ShaderLine {
+    cstring                 begin;
+    cstring                 end;
+}; // struct ShaderLine
+
+static bool next_line( cstring& position, cstring text_end, ShaderLine& line ) {
+    if ( position >= text_end ) {
+        return false;
+    }
+
+    line.begin = position;
+    cstring new_line = ( cstring )memchr( position, '\n', text_end - position );
+    line.end = new_line ? new_line : text_end;
+    position = new_line ? new_line + 1 : text_end;
+    return true;
+}
+
+static cstring skip_whitespace( cstring position, cstring end ) {
+    while ( position < end && is_whitespace( *position ) ) {
+        ++position;
+    }
+    return position;
+}
+
+static bool is_identifier_char( char c ) {
+    return is_alpha( c ) || is_number( c ) || c == '_';
+}
+
+static StringView read_identifier( cstring& position, cstring end ) {
+    position = skip_whitespace( position, end );
+    cstring start = position;
+    while ( position < end && is_identifier_char( *position ) ) {
+        ++position;
+    }
+    return StringView( start, position - start );
+}
+
+static bool equals( StringView a, cstring b ) {
+    const sizet length = strlen( b );
+    return a.size == length && strncmp( a.data, b, length ) == 0;
+}
+
+static bool equals( StringView a, StringView b ) {
+    return a.size == b.size && strncmp( a.data, b.data, a.size ) == 0;
+}
+
+// Returns the directive name of lines starting with #, empty otherwise.
+// position is moved after the name.
+static StringView read_directive( const ShaderLine& line, cstring& position ) {
+    position = skip_whitespace( line.begin, line.end );
+    if ( position == line.end || *position != '#' ) {
+        return StringView();
+    }
+    ++position;
+    return read_identifier( position, line.end );
+}
+
+static bool is_blank_line( const ShaderLine& line ) {
+    cstring position = skip_whitespace( line.begin, line.end );
+    return position == line.end || ( line.end - position >= 2 && position[ 0 ] == '/' && position[ 1 ] == '/' );
+}
+
+// Files with #pragma once, or whose content is all inside #ifndef X / #define X ... #endif
+// with no #else or #elif for the guard.
+static bool detect_include_once( cstring data, sizet size ) {
+
+    StringView guard_name;
+    bool guard_possible = true;
+    bool guard_closed = false;
+    bool expect_define = false;
+    bool first_line = true;
+    u32 depth = 0;
+
+    cstring position = data;
+    ShaderLine line;
+    while ( next_line( position, data + size, line ) ) {
+        if ( is_blank_line( line ) ) {
+            continue;
+        }
+
+        cstring cursor;
+        const StringView directive = read_directive( line, cursor );
+
+        if ( equals( directive, "pragma" ) && equals( read_identifier( cursor, line.end ), "once" ) ) {
+            return true;
+        }
+
+        // Anything after the closing #endif, or before the #ifndef, leaves code outside the guard.
+        if ( guard_closed || ( first_line && !equals( directive, "ifndef" ) ) ) {
+            guard_possible = false;
+        }
+
+        if ( first_line ) {
+            first_line = false;
+            if ( guard_possible ) {
+                guard_name = read_identifier( cursor, line.end );
+                expect_define = true;
+                depth = 1;
+            }
+            continue;
+        }
+
+        if ( expect_define ) {
+            expect_define = false;
+            if ( !equals( directive, "define" ) || !equals( read_identifier( cursor, line.end ), guard_name ) ) {
+                guard_possible = false;
+            }
+            continue;
+        }
+
+        if ( equals( directive, "if" ) || equals( directive, "ifdef" ) || equals( directive, "ifndef" ) ) {
+            ++depth;
+        } else if ( ( equals( directive, "else" ) || equals( directive, "elif" ) ) && depth == 1 ) {
+            // The other branch of the guard is seen when the file is included again.
+            guard_possible = false;
+        } else if ( equals( directive, "endif" ) && depth > 0 ) {
+            --depth;
+            guard_closed = depth == 0;
+        }
+    }
+
+    return guard_possible && guard_closed && guard_name.size;
+}
+
+// Collapse "." and ".." components and use forward slashes. Returns the length.
+static u32 normalize_path( char* path ) {
+    char* components[ 64 ];
+    u32 num_components = 0;
+
+    for ( char* c = path; *c; ++c ) {
+        if ( *c == '\\' ) {
+            *c = '/';
+        }
+    }
+
+    char* cursor = path;
+    while ( *cursor ) {
+        char* component = cursor;
+        while ( *cursor && *cursor != '/' ) {
+            ++cursor;
+        }
+        const sizet length = cursor - component;
+        if ( *cursor ) {
+            *cursor++ = 0;
+        }
+
+        if ( length == 0 || ( length == 1 && component[ 0 ] == '.' ) ) {
+            continue;
+        }
+
+        if ( length == 2 && component[ 0 ] == '.' && component[ 1 ] == '.' && num_components &&
+             strcmp( components[ num_components - 1 ], ".." ) != 0 ) {
+            --num_components;
+            continue;
+        }
+
+        if ( num_components < ArraySize( components ) ) {
+            components[ num_components++ ] = component;
+        }
+    }
+
+    // Components point inside path and only move left, so the copy is safe.
+    u32 length = 0;
+    for ( u32 i = 0; i < num_components; ++i ) {
+        if ( i ) {
+            path[ length++ ] = '/';
+        }
+        const sizet component_length = strlen( components[ i ] );
+        memmove( path + length, components[ i ], component_length );
+        length += ( u32 )component_length;
+    }
+    path[ length ] = 0;
+    return length;
+}
+
+void shader_code_reserve( StringBuffer& shader_code, sizet size, Allocator* allocator ) {
+    const sizet required_size = shader_code.current_size + size + 1;
+    if ( shader_code.data && required_size <= shader_code.buffer_size ) {
+        return;
+    }
+
+    const sizet new_size = idra::max( required_size, ( sizet )shader_code.buffer_size * 2 );
+    char* new_data = ( char* )ialloc( new_size + 1, allocator );
+    if ( shader_code.data ) {
+        memcpy( new_data, shader_code.data, shader_code.current_size );
+        ifree( shader_code.data, shader_code.allocator );
+    }
+
+    shader_code.data = new_data;
+    shader_code.buffer_size = ( u32 )new_size;
+    shader_code.allocator = allocator;
+}
+
+// ShaderFileCache ////////////////////////////////////////////////////////
+void ShaderFileCache::init( StringView folder, Allocator* allocator_ ) {
+    allocator = allocator_;
+
+    paths.init( allocator, 64 );
+    files.init( allocator, 64 );
+    retired_data.init( allocator, 16 );
+
+    if ( fs_file_resolve_to_full_path( folder.data, folder_path, k_max_path ) == 0 ) {
+        strcpy( folder_path, folder.data );
+    }
+}
+
+void ShaderFileCache::shutdown() {
+    for ( u32 i = 0; i < files.size; ++i ) {
+        if ( files[ i ].data ) {
+            ifree( ( char* )files[ i ].data, allocator );
+        }
+    }
+    for ( u32 i = 0; i < retired_data.size; ++i ) {
+        ifree( retired_data[ i ], allocator );
+    }
+
+    files.shutdown();
+    retired_data.shutdown();
+    paths.shutdown();
+}
+
+u32 ShaderFileCache::get( StringView path, File& out_file ) {
+
+    char full_path[ k_max_path ];
+    snprintf( full_path, k_max_path, "%s/%.*s", folder_path, ( int )path.size, path.data );
+
+    const FileTime last_write_time = fs_file_exists( full_path ) ? fs_file_last_write_time( full_path ) : 0;
+    if ( last_write_time == 0 ) {
+        return StringInterner::k_invalid_id;
+    }
+
+    std::lock_guard<std::mutex> lock( mutex );
+
+    const u32 id = paths.intern( path );
+    if ( id == StringInterner::k_invalid_id ) {
+        return id;
+    }
+
+    while ( files.size <= id ) {
+        files.push( {} );
+    }
+
+    File& file = files[ id ];
+    if ( file.data && file.last_write_time == last_write_time ) {
+        out_file = file;
+        return id;
+    }
+
+    Span<char> file_data = file_read_allocate( full_path, allocator );
+    if ( !file_data.data ) {
+        return StringInterner::k_invalid_id;
+    }
+
+    if ( file.data ) {
+        retired_data.push( ( char* )file.data );
+    }
+
+    file.data = file_data.data;
+    file.size = strlen( file_data.data );
+    file.content_hash = hash_bytes( file_data.data, file.size );
+    file.last_write_time = last_write_time;
+    file.include_once = detect_include_once( file.data, file.size );
+
+    out_file = file;
+    return id;
+}
+
+bool ShaderFileCache::find( StringView path, File& out_file ) {
+    std::lock_guard<std::mutex> lock( mutex );
+
+    const u32 id = paths.find( path );
+    if ( id == StringInterner::k_invalid_id || id >= files.size || !files[ id ].data ) {
+        return false;
+    }
+
+    out_file = files[ id ];
+    return true;
+}
+
+// Preprocessor ///////////////////////////////////////////////////////////
+struct ShaderPreprocessor {
+
+    ShaderFileCache*        cache;
+    StringBuffer*           output;
+    std::vector<ShaderFileDependency>* dependencies;
+
+    Array<u32>              expanded_files;     // Path ids of files expanded at least once.
+}; // struct ShaderPreprocessor
+
+static void append_text( ShaderPreprocessor& preprocessor, cstring text, sizet size ) {
+    if ( size ) {
+        shader_code_reserve( *preprocessor.output, size, preprocessor.output->allocator );
+        preprocessor.output->append_m( ( void* )text, size );
+    }
+}
+
+static void append_line_directive( ShaderPreprocessor& preprocessor, u32 line, StringView path ) {
+    shader_code_reserve( *preprocessor.output, path.size + 32, preprocessor.output->allocator );
+    preprocessor.output->append_f( "#line %u \"%s\"\n", line, path.data );
+}
+
+static bool array_contains( const Array<u32>& array, u32 value ) {
+    for ( u32 i = 0; i < array.size; ++i ) {
+        if ( array[ i ] == value ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool preprocess_file( ShaderPreprocessor& preprocessor, u32 path_id, const ShaderFileCache::File& file, u32 depth );
+
+// Search next to the including file first, then from the root folder.
+static bool preprocess_include( ShaderPreprocessor& preprocessor, StringView including_path, StringView name, u32 depth ) {
+
+    char path[ k_max_path ];
+    ShaderFileCache::File file;
+    u32 path_id = StringInterner::k_invalid_id;
+
+    cstring last_separator = nullptr;
+    for ( sizet i = 0; i < including_path.size; ++i ) {
+        if ( including_path.data[ i ] == '/' ) {
+            last_separator = including_path.data + i;
+        }
+    }
+
+    if ( last_separator ) {
+        snprintf( path, k_max_path, "%.*s/%.*s", ( int )( last_separator - including_path.data ), including_path.data,
+                  ( int )name.size, name.data );
+        const u32 length = normalize_path( path );
+        path_id = preprocessor.cache->get( StringView( path, length ), file );
+    }
+
+    if ( path_id == StringInterner::k_invalid_id ) {
+        snprintf( path, k_max_path, "%.*s", ( int )name.size, name.data );
+        const u32 length = normalize_path( path );
+        path_id = preprocessor.cache->get( StringView( path, length ), file );
+    }
+
+    if ( path_id == StringInterner::k_invalid_id ) {
+        if ( including_path.size ) {
+            ilog_error( "Cannot find include %.*s, included from %s\n", ( int )name.size, name.data, including_path.data );
+        } else {
+            ilog_error( "Cannot find shader file %.*s\n", ( int )name.size, name.data );
+        }
+        return false;
+    }
+
+    return preprocess_file( preprocessor, path_id, file, depth );
+}
+
+static bool preprocess_file( ShaderPreprocessor& preprocessor, u32 path_id, const ShaderFileCache::File& file, u32 depth ) {
+
+    const StringView path = preprocessor.cache->get_path( path_id );
+
+    if ( depth > k_max_include_depth ) {
+        ilog_error( "Includes nested too deep in %s, recursive include?\n", path.data );
+        return false;
+    }
+
+    const bool already_expanded = array_contains( preprocessor.expanded_files, path_id );
+    if ( !already_expanded ) {
+        preprocessor.expanded_files.push( path_id );
+
+        if ( preprocessor.dependencies ) {
+            preprocessor.dependencies->push_back( { path, file.content_hash } );
+        }
+    } else if ( file.include_once ) {
+        return true;
+    }
+
+    append_line_directive( preprocessor, 1, path );
+
+    const cstring text_end = file.data + file.size;
+    cstring position = file.data;
+    cstring copy_start = file.data;
+    u32 line_number = 0;
+
+    ShaderLine line;
+    while ( next_line( position, text_end, line ) ) {
+        ++line_number;
+
+        cstring cursor;
+        const StringView directive = read_directive( line, cursor );
+        if ( directive.size == 0 ) {
+            continue;
+        }
+
+        const bool is_include = equals( directive, "include" );
+        const bool is_pragma_once = equals( directive, "pragma" ) && equals( read_identifier( cursor, line.end ), "once" );
+        if ( !is_include && !is_pragma_once ) {
+            continue;
+        }
+
+        // Copy everything up to this line, then replace the directive.
+        append_text( preprocessor, copy_start, line.begin - copy_start );
+        copy_start = position;
+
+        if ( is_pragma_once ) {
+            append_text( preprocessor, "\n", 1 );
+            continue;
+        }
+
+        cursor = skip_whitespace( cursor, line.end );
+        const char closing = ( cursor < line.end && *cursor == '<' ) ? '>' : '"';
+        cstring name_end = cursor < line.end ? ( cstring )memchr( cursor + 1, closing, line.end - cursor - 1 ) : nullptr;
+        if ( cursor == line.end || ( *cursor != '"' && *cursor != '<' ) || !name_end ) {
+            ilog_error( "%s(%u): malformed #include\n", path.data, line_number );
+            return false;
+        }
+
+        const StringView name( cursor + 1, name_end - cursor - 1 );
+        if ( !preprocess_include( preprocessor, path, name, depth + 1 ) ) {
+            return false;
+        }
+
+        append_line_directive( preprocessor, line_number + 1, path );
+    }
+
+    append_text( preprocessor, copy_start, text_end - copy_start );
+
+    // Next file could start on the last line otherwise.
+    if ( file.size && file.data[ file.size - 1 ] != '\n' ) {
+        append_text( preprocessor, "\n", 1 );
+    }
+
+    return true;
+}
+
+bool shader_preprocess( ShaderFileCache& cache, Span<const StringView> forced_includes, StringView source_path,
+                        StringBuffer& output, std::vector<ShaderFileDependency>* dependencies ) {
+
+    ShaderPreprocessor preprocessor{ &cache, &output, dependencies };
+    preprocessor.expanded_files.init( cache.allocator, 16 );
+
+    bool success = true;
+    for ( u32 i = 0; i < forced_includes.size && success; ++i ) {
+        success = preprocess_include( preprocessor, StringView(), forced_includes[ i ], 0 );
+    }
+
+    success = success && preprocess_include( preprocessor, StringView(), source_path, 0 );
+
+    preprocessor.expanded_files.shutdown();
+    return success;
+}
+
+} // namespace idra
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#pragma once
+
+#include "kernel/array.hpp"
+#include "kernel/file.hpp"
+#include "kernel/string.hpp"
+#include "kernel/string_interner.hpp"
+
+#include "shader_compiler.hpp"
+
+#include <mutex>
+#include <vector>
+
+namespace idra {
+
+struct Allocator;
+
+//
+// Shader sources and includes, read once and shared by all compilations.
+// A file is read again when its last write time changes, the content hash
+// tells if a compiled shader used the current version. Thread safe.
+//
+struct ShaderFileCache {
+
+    struct File {
+        cstring             data            = nullptr;  // Null terminated.
+        sizet               size            = 0;
+        u64                 content_hash    = 0;
+        FileTime            last_write_time = 0;
+        bool                include_once    = false;    // #pragma once or include guard.
+    }; // struct File
+
+    void                    init( StringView folder, Allocator* allocator );
+    void                    shutdown();
+
+    // Path relative to the folder, returns the interned path id or
+    // StringInterner::k_invalid_id when the file cannot be read.
+    u32                     get( StringView path, File& out_file );
+    // Only files already read, does not touch the disk.
+    bool                    find( StringView path, File& out_file );
+
+    StringView              get_path( u32 id ) const    { return paths.get( id ); }
+
+    StringInterner          paths;
+    Array<File>             files;          // Indexed by path id.
+    Array<char*>            retired_data;   // Previous contents, other threads could still be reading them.
+
+    char                    folder_path[ k_max_path ];
+    Allocator*              allocator       = nullptr;
+    std::mutex              mutex;
+
+}; // struct ShaderFileCache
+
+// Append the expanded forced includes and source to output.
+// #include "file" and #include <file> are searched next to the including
+// file first, then in the cache folder. Files with #pragma once or an include
+// guard are expanded once, every file is preceded by a #line directive with
+// its name so errors point to the original line.
+// Dependencies receives every file read, with its content hash.
+bool                        shader_preprocess( ShaderFileCache& cache, Span<const StringView> forced_includes,
+                                               StringView source_path, StringBuffer& output,
+                                               std::vector<ShaderFileDependency>* dependencies );
+
+// Grow the buffer keeping its content, so that size more bytes and the terminator fit.
+void                        shader_code_reserve( StringBuffer& shader_code, sizet size, Allocator* allocator );
+
+} // namespace idra
@@ -0,0 +1,320 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#include "spirv_cache.hpp"
+
+#include "kernel/allocator.hpp"
+#include "kernel/memory.hpp"
+#include "kernel/log.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace idra {
+
+static const u32        k_spirv_cache_magic = 0x43565053;         // 'SPVC'
+static const u32        k_spirv_cache_index_magic = 0x58445053;   // 'SPDX'
+static const u32        k_spirv_cache_version = 1;
+
+//
+//
+struct SpirvCacheFileHeader {
+    u32                 magic;
+    u32                 version;
+    u64                 key;
+    u64                 checksum;
+    u32                 num_words;
+    f32                 compile_ms;
+}; // struct SpirvCacheFileHeader
+
+//
+//
+struct SpirvCacheIndexHeader {
+    u32                 magic;
+    u32                 version;
+    u64                 use_counter;
+    u32                 num_entries;
+    u32                 padding;
+}; // struct SpirvCacheIndexHeader
+
+// SpirvCache /////////////////////////////////////////////////////////////
+void SpirvCache::init( StringView folder, sizet max_size_, Allocator* allocator ) {
+
+    max_size = max_size_;
+    total_size = 0;
+    use_counter = 0;
+    statistics = {};
+    index_dirty = false;
+
+    if ( !fs_directory_exists( folder ) ) {
+        fs_directory_create( folder );
+    }
+
+    // Keep the absolute path, entries stay valid if the current directory changes.
+    enabled = fs_file_resolve_to_full_path( folder.data, folder_path, k_max_path ) != 0;
+    if ( !enabled ) {
+        ilog_warn( "Shader cache disabled, cannot use folder %s\n", folder.data );
+        return;
+    }
+
+    entries.init( allocator, 64 );
+    key_to_entry.init( allocator, 64 );
+    key_to_entry.set_default_value( u32_max );
+
+    load_index();
+}
+
+void SpirvCache::shutdown() {
+
+    // Containers are allocated only when the cache is enabled.
+    if ( !enabled ) {
+        return;
+    }
+
+    if ( index_dirty ) {
+        save_index();
+    }
+
+    entries.shutdown();
+    key_to_entry.shutdown();
+    enabled = false;
+}
+
+bool SpirvCache::load( u64 key, std::vector<u32>& spirv ) {
+
+    if ( !enabled ) {
+        return false;
+    }
+
+    char path[ k_max_path ];
+    entry_path( key, path );
+
+    // Entries missing from the index are still valid, for example after a crash before saving it.
+    MallocAllocator mallocator;
+    Span<char> file_data = fs_file_exists( path ) ? file_read_allocate( path, &mallocator ) : Span<char>( nullptr, 0 );
+
+    const SpirvCacheFileHeader* header = ( const SpirvCacheFileHeader* )file_data.data;
+    const u32* words = ( const u32* )( file_data.data + sizeof( SpirvCacheFileHeader ) );
+
+    bool valid = file_data.size >= sizeof( SpirvCacheFileHeader );
+    valid = valid && header->magic == k_spirv_cache_magic && header->version == k_spirv_cache_version && header->key == key;
+    valid = valid && file_data.size == sizeof( SpirvCacheFileHeader ) + header->num_words * sizeof( u32 );
+    valid = valid && header->checksum == hash_bytes( ( void* )words, header->num_words * sizeof( u32 ) );
+
+    f32 compile_ms = 0.f;
+    if ( valid ) {
+        spirv.assign( words, words + header->num_words );
+        compile_ms = header->compile_ms;
+    }
+
+    if ( file_data.data ) {
+        ifree( file_data.data, &mallocator );
+    }
+
+    std::lock_guard<std::mutex> lock( mutex );
+
+    u32 entry_index = key_to_entry.get( key );
+    if ( !valid ) {
+        ++statistics.misses;
+
+        // Corrupted or stale entries are removed and compiled again.
+        if ( file_data.size ) {
+            fs_file_delete( path );
+        }
+        if ( entry_index != u32_max ) {
+            remove_entry( entry_index );
+            index_dirty = true;
+        }
+        return false;
+    }
+
+    if ( entry_index == u32_max ) {
+        entry_index = entries.size;
+        entries.push( { key, 0, ( u32 )file_data.size, compile_ms } );
+        key_to_entry.insert( key, entry_index );
+        total_size += file_data.size;
+    }
+
+    entries[ entry_index ].last_use = ++use_counter;
+    index_dirty = true;
+
+    ++statistics.hits;
+    statistics.saved_ms += compile_ms;
+
+    return true;
+}
+
+void SpirvCache::store( u64 key, const std::vector<u32>& spirv, f32 compile_ms ) {
+
+    if ( !enabled || spirv.empty() ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( mutex );
+
+    statistics.compile_ms += compile_ms;
+
+    // Another thread compiled the same code.
+    const u32 existing_index = key_to_entry.get( key );
+    if ( existing_index != u32_max ) {
+        entries[ existing_index ].last_use = ++use_counter;
+        return;
+    }
+
+    SpirvCacheFileHeader header;
+    header.magic = k_spirv_cache_magic;
+    header.version = k_spirv_cache_version;
+    header.key = key;
+    header.num_words = ( u32 )spirv.size();
+    header.checksum = hash_bytes( ( void* )spirv.data(), spirv.size() * sizeof( u32 ) );
+    header.compile_ms = compile_ms;
+
+    const sizet file_size = sizeof( SpirvCacheFileHeader ) + spirv.size() * sizeof( u32 );
+    evict( file_size );
+
+    char path[ k_max_path ];
+    entry_path( key, path );
+
+    char temporary_path[ k_max_path ];
+    snprintf( temporary_path, k_max_path, "%s.tmp", path );
+
+    FileHandle file = file_open_for_write( temporary_path );
+    if ( !file ) {
+        ilog_warn( "Shader cache cannot write %s\n", temporary_path );
+        return;
+    }
+
+    const sizet written = file_write( file, { ( cstring )&header, sizeof( SpirvCacheFileHeader ) } ) +
+                          file_write( file, { ( cstring )spirv.data(), spirv.size() * sizeof( u32 ) } );
+    file_close( file );
+
+    if ( written != file_size || !fs_file_rename( temporary_path, path ) ) {
+        ilog_warn( "Shader cache cannot write %s\n", path );
+        fs_file_delete( temporary_path );
+        return;
+    }
+
+    key_to_entry.insert( key, entries.size );
+    entries.push( { key, ++use_counter, ( u32 )file_size, compile_ms } );
+    total_size += file_size;
+    index_dirty = true;
+}
+
+void SpirvCache::log_statistics() {
+
+    if ( !enabled ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( mutex );
+
+    const u32 requests = statistics.hits + statistics.misses;
+    const f64 hit_rate = requests ? 100.0 * statistics.hits / requests : 0.0;
+
+    ilog( "Shader cache: %u hits, %u misses (%.1f%% hit rate), saved %.1f ms, spent %.1f ms compiling.\n",
+          statistics.hits, statistics.misses, hit_rate, statistics.saved_ms, statistics.compile_ms );
+    ilog( "Shader cache: %u entries, %.1f of %.1f KB, %u evictions.\n",
+          entries.size, total_size / 1024.0, max_size / 1024.0, statistics.evictions );
+}
+
+void SpirvCache::entry_path( u64 key, char* out_path ) const {
+    snprintf( out_path, k_max_path, "%s/%016llx.spv", folder_path, ( unsigned long long )key );
+}
+
+void SpirvCache::remove_entry( u32 index ) {
+
+    const Entry& entry = entries[ index ];
+    key_to_entry.remove( entry.key );
+    total_size -= entry.size;
+
+    // Fix the index of the entry moved in its place.
+    entries.delete_swap( index );
+    if ( index < entries.size ) {
+        key_to_entry.insert( entries[ index ].key, index );
+    }
+}
+
+void SpirvCache::evict( sizet needed_size ) {
+
+    while ( entries.size && total_size + needed_size > max_size ) {
+
+        // Least recently used, linear search as evictions are rare and entries few.
+        u32 oldest_index = 0;
+        for ( u32 i = 1; i < entries.size; ++i ) {
+            if ( entries[ i ].last_use < entries[ oldest_index ].last_use ) {
+                oldest_index = i;
+            }
+        }
+
+        char path[ k_max_path ];
+        entry_path( entries[ oldest_index ].key, path );
+        fs_file_delete( path );
+
+        remove_entry( oldest_index );
+        ++statistics.evictions;
+        index_dirty = true;
+    }
+}
+
+void SpirvCache::save_index() {
+
+    char path[ k_max_path ], temporary_path[ k_max_path ];
+    snprintf( path, k_max_path, "%s/index.bin", folder_path );
+    snprintf( temporary_path, k_max_path, "%s/index.bin.tmp", folder_path );
+
+    FileHandle file = file_open_for_write( temporary_path );
+    if ( !file ) {
+        return;
+    }
+
+    SpirvCacheIndexHeader header{ k_spirv_cache_index_magic, k_spirv_cache_version, use_counter, entries.size, 0 };
+    file_write( file, { ( cstring )&header, sizeof( SpirvCacheIndexHeader ) } );
+    file_write( file, { ( cstring )entries.data, entries.size * sizeof( Entry ) } );
+    file_close( file );
+
+    fs_file_rename( temporary_path, path );
+    index_dirty = false;
+}
+
+void SpirvCache::load_index() {
+
+    char path[ k_max_path ];
+    snprintf( path, k_max_path, "%s/index.bin", folder_path );
+
+    if ( !fs_file_exists( path ) ) {
+        return;
+    }
+
+    MallocAllocator mallocator;
+    Span<char> file_data = file_read_allocate( path, &mallocator );
+    if ( file_data.size < sizeof( SpirvCacheIndexHeader ) ) {
+        if ( file_data.data ) {
+            ifree( file_data.data, &mallocator );
+        }
+        return;
+    }
+
+    const SpirvCacheIndexHeader* header = ( const SpirvCacheIndexHeader* )file_data.data;
+    const bool valid = header->magic == k_spirv_cache_index_magic && header->version == k_spirv_cache_version &&
+                       file_data.size == sizeof( SpirvCacheIndexHeader ) + header->num_entries * sizeof( Entry );
+
+    if ( valid ) {
+        use_counter = header->use_counter;
+
+        const Entry* file_entries = ( const Entry* )( file_data.data + sizeof( SpirvCacheIndexHeader ) );
+        for ( u32 i = 0; i < header->num_entries; ++i ) {
+            key_to_entry.insert( file_entries[ i ].key, entries.size );
+            entries.push( file_entries[ i ] );
+            total_size += file_entries[ i ].size;
+        }
+    }
+
+    ifree( file_data.data, &mallocator );
+
+    // Budget could have changed since the last run.
+    evict( 0 );
+}
+
+} // namespace idra
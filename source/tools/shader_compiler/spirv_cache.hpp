@@ -0,0 +1,77 @@
+/*
+ * Copyright 2024 Gabriel Sassone. All rights reserved.
+ * License: https://github.com/JorenJoestar/Idra/blob/main/LICENSE
+ */
+
+#pragma once
+
+#include "kernel/array.hpp"
+#include "kernel/hash_map.hpp"
+#include "kernel/file.hpp"
+
+#include <mutex>
+#include <vector>
+
+namespace idra {
+
+struct Allocator;
+
+//
+// Content addressed cache of compiled SPIR-V, one file per entry.
+// The key is computed by the caller from everything that changes the output:
+// the preprocessed source (defines and includes included), stage, target
+// environment and compiler version.
+// Files are written to a temporary name and renamed, so a crash never leaves
+// a partial entry. An index with the last use of each entry is kept in the
+// same folder, entries are evicted least recently used first when the total
+// size goes past the budget. Thread safe.
+//
+struct SpirvCache {
+
+    void                    init( StringView folder, sizet max_size, Allocator* allocator );
+    void                    shutdown();
+
+    // Returns true and fills spirv on a hit.
+    bool                    load( u64 key, std::vector<u32>& spirv );
+    // Store a compilation result, compile_ms is used to report the time saved by hits.
+    void                    store( u64 key, const std::vector<u32>& spirv, f32 compile_ms );
+
+    void                    log_statistics();
+
+    struct Entry {
+        u64                 key;
+        u64                 last_use;
+        u32                 size;           // Bytes on disk.
+        f32                 compile_ms;
+    }; // struct Entry
+
+    struct Statistics {
+        u32                 hits            = 0;
+        u32                 misses          = 0;
+        u32                 evictions       = 0;
+        f64                 saved_ms        = 0;    // Compile time of the entries loaded.
+        f64                 compile_ms      = 0;    // Compile time of the entries stored.
+    }; // struct Statistics
+
+    void                    entry_path( u64 key, char* out_path ) const;
+    void                    remove_entry( u32 index );
+    void                    evict( sizet needed_size );
+    void                    save_index();
+    void                    load_index();
+
+    Array<Entry>            entries;
+    FlatHashMap<u64, u32>   key_to_entry;
+
+    char                    folder_path[ k_max_path ];
+    sizet                   max_size        = 0;
+    sizet                   total_size      = 0;
+    u64                     use_counter     = 0;    // Monotonic, persisted, orders entries by last use.
+
+    Statistics              statistics;
+    std::mutex              mutex;
+    bool                    enabled         = false;
+    bool                    index_dirty     = false;
+
+}; // struct SpirvCache
+
+} // namespace idra
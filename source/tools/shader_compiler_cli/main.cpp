@@ -6,9 +6,464 @@
 #include "shader_compiler.hpp"
 #include <stdio.h>
 
+#include "kernel/allocator.hpp"
+#include "kernel/blob.hpp"
+#include "kernel/file.hpp"
+#include "kernel/json.hpp"
 #include "kernel/log.hpp"
+#include "kernel/memory.hpp"
+#include "kernel/string_interner.hpp"
+#include "kernel/time.hpp"
 
-int main(int argc, char** argv) {
-	ilog("Shader compiler CLI hello world!\n");
-	return 0;
+#include "gpu/spirv_parser.hpp"
+
+#include "graphics/graphics_blueprints.hpp"
+
+#include <filesystem>
+#include <vector>
+
+//
+// Offline shader builder: compiles all the programs of a manifest, with all
+// the variants of their permutations, and writes them in a single shader pack
+// loaded by ShaderAssetLoader::load_shader_pack.
+//
+// Usage: shader_compiler_cli <shader folder> <manifest> <output pack> [cache folder]
+//
+// Manifest is a json file with the programs, paths are relative to the shader
+// folder and defines, includes and paths must be the same passed at runtime to
+// the ShaderAssetLoader, as they are the key of a program in the pack:
+//
+// { "programs": [
+//     { "name": "debug_line_draw", "vertex": "debug_line_cpu.vert", "fragment": "debug_line.frag" },
+//     { "name": "sky_lut", "compute": "atmospheric_scattering/sky_lut.comp",
+//       "defines": [ "MULTISCATAPPROX_ENABLED" ], "includes": [ "platform.h" ] },
+//     { "name": "ocean", "vertex": "ocean.vert", "fragment": "ocean.frag",
+//       "options": [ { "name": "FOAM" }, { "name": "QUALITY", "values": [ "QUALITY_LOW", "QUALITY_HIGH" ] } ] }
+// ] }
+//
+// Programs with options are declared at runtime with declare_*_permutations,
+// every combination of the options is compiled.
+//
+
+namespace idra {
+
+// Same limits of ShaderPermutations and ShaderAssetCreation.
+static const u32 k_max_options = 16;
+static const u32 k_max_values = 64;
+static const u32 k_max_includes = 8;
+
+static const u32 k_max_variants_per_program = 1024;
+
+//
+//
+struct PackProgram {
+
+    StringView          name;
+    StringView          defines[ k_max_options ];
+    StringView          includes[ k_max_includes ];
+    StringView          paths[ 2 ];
+
+    u32                 num_defines;
+    u32                 num_includes;
+    u32                 num_stages;
+    ShaderStage::Enum   stage;
+
+    u32                 first_compilation;      // Index of the first stage compilation.
+    u64                 key;
+
+}; // struct PackProgram
+
+//
+//
+struct PackOption {
+
+    StringView          name;
+    StringView          values[ k_max_values ];
+    u32                 num_values;             // 0 for bool options.
+    u32                 bit_offset;
+
+}; // struct PackOption
+
+static bool read_strings( const JsonValue& array, StringInterner& strings, StringView* out_strings, u32 max_strings,
+                          u32& out_count, StringView program_name ) {
+    out_count = 0;
+    if ( !array.is_valid() ) {
+        return true;
+    }
+
+    for ( JsonValue value = array.first(); value.is_valid(); value = value.next() ) {
+        if ( out_count == max_strings ) {
+            ilog_error( "Program %s: more than %u strings in a list\n", program_name.data, max_strings );
+            return false;
+        }
+        // Interned strings are null terminated, the json source is not.
+        out_strings[ out_count++ ] = strings.get( strings.intern( value.as_string() ) );
+    }
+    return true;
+}
+
+static void add_program( std::vector<PackProgram>& programs, PackProgram& program ) {
+
+    program.key = ShaderPackBlueprint::calculate_key( { program.defines, program.num_defines },
+                                                      { program.includes, program.num_includes },
+                                                      { program.paths, program.num_stages }, program.stage );
+
+    for ( const PackProgram& other : programs ) {
+        if ( other.key == program.key ) {
+            ilog_warn( "Program %s is the same as %s, skipping it\n", program.name.data, other.name.data );
+            return;
+        }
+    }
+
+    programs.push_back( program );
+}
+
+// Same defines and names of ShaderAssetLoader::create_variant, for every key of the options.
+static bool add_permutations( std::vector<PackProgram>& programs, PackProgram& program, const JsonValue& options_json,
+                              StringInterner& strings ) {
+
+    PackOption options[ k_max_options ];
+    u32 num_options = 0;
+    u32 bit_offset = 0;
+    u32 num_variants = 1;
+
+    for ( JsonValue option_json = options_json.first(); option_json.is_valid(); option_json = option_json.next() ) {
+        if ( num_options == k_max_options ) {
+            ilog_error( "Program %s has more than %u options\n", program.name.data, k_max_options );
+            return false;
+        }
+
+        PackOption& option = options[ num_options++ ];
+        option.name = strings.get( strings.intern( option_json.get_string( "name" ) ) );
+        if ( !read_strings( option_json.get( "values" ), strings, option.values, k_max_values,
+                            option.num_values, program.name ) ) {
+            return false;
+        }
+
+        if ( option.num_values == 1 ) {
+            ilog_error( "Program %s: option %s has a single value\n", program.name.data, option.name.data );
+            return false;
+        }
+
+        u32 bit_count = 1;
+        while ( option.num_values > ( 1u << bit_count ) ) {
+            ++bit_count;
+        }
+        option.bit_offset = bit_offset;
+        bit_offset += bit_count;
+
+        num_variants *= option.num_values ? option.num_values : 2;
+        if ( num_variants > k_max_variants_per_program ) {
+            ilog_error( "Program %s has more than %u variants\n", program.name.data, k_max_variants_per_program );
+            return false;
+        }
+    }
+
+    const StringView base_name = program.name;
+
+    // Counts through the values of every option, the first one changing fastest.
+    u32 values[ k_max_options ] = {};
+    for ( u32 v = 0; v < num_variants; ++v ) {
+        u64 key = 0;
+        program.num_defines = 0;
+        for ( u32 o = 0; o < num_options; ++o ) {
+            const PackOption& option = options[ o ];
+            key |= ( u64 )values[ o ] << option.bit_offset;
+
+            if ( option.num_values == 0 ) {
+                if ( values[ o ] ) {
+                    program.defines[ program.num_defines++ ] = option.name;
+                }
+            }
+            else {
+                program.defines[ program.num_defines++ ] = option.values[ values[ o ] ];
+            }
+        }
+
+        char variant_name[ 256 ];
+        snprintf( variant_name, ArraySize( variant_name ), "%s#%llx", base_name.data, ( unsigned long long )key );
+        program.name = strings.get( strings.intern( variant_name ) );
+
+        add_program( programs, program );
+
+        for ( u32 o = 0; o < num_options; ++o ) {
+            const u32 option_values = options[ o ].num_values ? options[ o ].num_values : 2;
+            if ( ++values[ o ] < option_values ) {
+                break;
+            }
+            values[ o ] = 0;
+        }
+    }
+
+    return true;
+}
+
+static bool read_manifest( StringView path, StringInterner& strings, std::vector<PackProgram>& programs ) {
+
+    MallocAllocator mallocator;
+    Span<char> file_data = file_read_allocate( path, &mallocator );
+    if ( !file_data.data ) {
+        ilog_error( "Cannot read manifest %s\n", path.data );
+        return false;
+    }
+
+    JsonReader json_reader;
+    bool valid = json_reader.init( &mallocator, StringView( file_data.data, file_data.size ) );
+
+    const JsonValue programs_json = valid ? json_reader.get_root().get( "programs" ) : JsonValue{};
+    valid = valid && programs_json.is_array();
+
+    for ( JsonValue program_json = programs_json.first(); valid && program_json.is_valid(); program_json = program_json.next() ) {
+        PackProgram program{};
+        program.name = strings.get( strings.intern( program_json.get_string( "name" ) ) );
+
+        const StringView compute_path = program_json.get_string( "compute" );
+        if ( compute_path.size ) {
+            program.stage = ShaderStage::Compute;
+            program.num_stages = 1;
+            program.paths[ 0 ] = strings.get( strings.intern( compute_path ) );
+        }
+        else {
+            program.stage = ShaderStage::Vertex;
+            program.num_stages = 2;
+            program.paths[ 0 ] = strings.get( strings.intern( program_json.get_string( "vertex" ) ) );
+            program.paths[ 1 ] = strings.get( strings.intern( program_json.get_string( "fragment" ) ) );
+        }
+
+        if ( !program.name.size || !program.paths[ 0 ].size || ( program.num_stages == 2 && !program.paths[ 1 ].size ) ) {
+            ilog_error( "Manifest %s: programs need a name and a compute, or a vertex and a fragment, path\n", path.data );
+            valid = false;
+            break;
+        }
+
+        valid = read_strings( program_json.get( "includes" ), strings, program.includes, ( u32 )ArraySize( program.includes ),
+                              program.num_includes, program.name );
+
+        // Permutations have no defines other than their options.
+        const JsonValue options_json = program_json.get( "options" );
+        if ( valid && options_json.is_array() ) {
+            valid = add_permutations( programs, program, options_json, strings );
+            continue;
+        }
+
+        valid = valid && read_strings( program_json.get( "defines" ), strings, program.defines, ( u32 )ArraySize( program.defines ),
+                                       program.num_defines, program.name );
+        if ( valid ) {
+            add_program( programs, program );
+        }
+    }
+
+    if ( !valid ) {
+        ilog_error( "Error reading manifest %s\n", path.data );
+    }
+
+    json_reader.shutdown();
+    ifree( file_data.data, &mallocator );
+
+    return valid;
+}
+
+// Stage sources not used by any program are not in the pack, and would be
+// compiled at runtime if used.
+static void check_unused_sources( StringView shader_folder, const std::vector<PackProgram>& programs ) {
+
+    const std::filesystem::path folder( shader_folder.data );
+    for ( const std::filesystem::directory_entry& entry : std::filesystem::recursive_directory_iterator( folder ) ) {
+        const std::filesystem::path& extension = entry.path().extension();
+        if ( !entry.is_regular_file() || ( extension != ".vert" && extension != ".frag" && extension != ".comp" ) ) {
+            continue;
+        }
+
+        const std::string relative_path = entry.path().lexically_relative( folder ).generic_string();
+
+        bool used = false;
+        for ( sizet p = 0; p < programs.size() && !used; ++p ) {
+            for ( u32 s = 0; s < programs[ p ].num_stages && !used; ++s ) {
+                used = programs[ p ].paths[ s ].size == relative_path.size() &&
+                       strncmp( programs[ p ].paths[ s ].data, relative_path.c_str(), relative_path.size() ) == 0;
+            }
+        }
+
+        if ( !used ) {
+            ilog_warn( "Shader %s is not used by any program of the manifest\n", relative_path.c_str() );
+        }
+    }
+}
+
+static bool write_pack( StringView path, const std::vector<PackProgram>& programs,
+                        const std::vector<std::vector<unsigned int>>& spirv,
+                        const std::vector<std::vector<ShaderFileDependency>>& dependencies ) {
+
+    const u32 num_programs = ( u32 )programs.size();
+
+    // Initial estimate, the blob grows when needed.
+    sizet spirv_size = 0;
+    for ( const std::vector<unsigned int>& words : spirv ) {
+        spirv_size += words.size() * sizeof( u32 );
+    }
+
+    MallocAllocator mallocator;
+    BlobWriter writer;
+    writer.write<ShaderPackBlueprint>( &mallocator, ShaderPackBlueprint::k_version,
+                                       spirv_size + num_programs * ( sizeof( ShaderPackProgram ) + sizeof( spirv::ParseResult ) ) );
+
+    writer.reserve_and_set( writer.get_blob<ShaderPackBlueprint>()->programs, num_programs );
+    writer.reserve_and_set( writer.get_blob<ShaderPackBlueprint>()->key_to_program, num_programs );
+
+    // Reserves can move the blob memory, so programs are always accessed through it.
+    auto pack_program = [ &writer ]( u32 index ) -> ShaderPackProgram& {
+        return writer.get_blob<ShaderPackBlueprint>()->programs[ index ];
+    };
+
+    for ( u32 p = 0; p < num_programs; ++p ) {
+        const PackProgram& program = programs[ p ];
+
+        pack_program( p ).key = program.key;
+        pack_program( p ).stage = program.stage;
+        pack_program( p ).num_stages = program.num_stages;
+        writer.reserve_and_set( pack_program( p ).name, program.name );
+
+        spirv::ParseResult parse_result = {};
+        bool reflected = true;
+
+        for ( u32 s = 0; s < program.num_stages; ++s ) {
+            const std::vector<unsigned int>& words = spirv[ program.first_compilation + s ];
+
+            writer.reserve_and_set( pack_program( p ).spirv[ s ], ( u32 )words.size() );
+            memcpy( pack_program( p ).spirv[ s ].get(), words.data(), words.size() * sizeof( u32 ) );
+
+            reflected = reflected && spirv::parse_binary( words.data(), words.size() * sizeof( u32 ), &parse_result );
+        }
+
+        if ( reflected ) {
+            writer.reserve_and_set( pack_program( p ).reflection, 1 );
+            memcpy( pack_program( p ).reflection.get(), &parse_result, sizeof( spirv::ParseResult ) );
+        }
+        else {
+            ilog_warn( "Cannot reflect program %s, it will need explicit descriptor set layouts\n", program.name.data );
+        }
+
+        // Union of the files read by the stages.
+        std::vector<ShaderFileDependency> program_dependencies;
+        for ( u32 s = 0; s < program.num_stages; ++s ) {
+            for ( const ShaderFileDependency& file : dependencies[ program.first_compilation + s ] ) {
+                bool found = false;
+                for ( const ShaderFileDependency& other : program_dependencies ) {
+                    found = found || ( other.path.size == file.path.size && strncmp( other.path.data, file.path.data, file.path.size ) == 0 );
+                }
+                if ( !found ) {
+                    program_dependencies.push_back( file );
+                }
+            }
+        }
+
+        writer.reserve_and_set( pack_program( p ).dependencies, ( u32 )program_dependencies.size() );
+        for ( u32 d = 0; d < program_dependencies.size(); ++d ) {
+            pack_program( p ).dependencies[ d ].content_hash = program_dependencies[ d ].content_hash;
+            writer.reserve_and_set( pack_program( p ).dependencies[ d ].path, program_dependencies[ d ].path );
+        }
+
+        writer.get_blob<ShaderPackBlueprint>()->key_to_program.insert_hashed( program.key, p );
+    }
+
+    Span<char> blob = writer.finalize( true );
+
+    FileHandle file = file_open_for_write( path );
+    const bool written = file && file_write( file, { blob.data, blob.size } ) == blob.size;
+    if ( file ) {
+        file_close( file );
+    }
+
+    if ( written ) {
+        ilog( "Shader pack %s: %u programs, %.1f KB\n", path.data, num_programs, blob.size / 1024.0 );
+    }
+    else {
+        ilog_error( "Cannot write shader pack %s\n", path.data );
+    }
+
+    writer.shutdown();
+    return written;
+}
+
+static bool build_shader_pack( StringView shader_folder, StringView manifest_path, StringView pack_path ) {
+
+    MallocAllocator mallocator;
+    StringInterner strings;
+    strings.init( &mallocator, 256 );
+
+    std::vector<PackProgram> programs;
+    bool success = read_manifest( manifest_path, strings, programs );
+
+    if ( success ) {
+        check_unused_sources( shader_folder, programs );
+
+        // One compilation per stage, stages of a program are subsequent.
+        std::vector<ShaderCompilationInfo> infos;
+        for ( PackProgram& program : programs ) {
+            program.first_compilation = ( u32 )infos.size();
+            for ( u32 s = 0; s < program.num_stages; ++s ) {
+                const ShaderStage::Enum stage = program.num_stages == 2 && s == 1 ? ShaderStage::Fragment : program.stage;
+                infos.push_back( { .defines = { program.defines, program.num_defines },
+                                   .include_paths = { program.includes, program.num_includes },
+                                   .source_path = program.paths[ s ], .stage = stage } );
+            }
+        }
+
+        std::vector<std::vector<unsigned int>> spirv( infos.size() );
+        std::vector<std::vector<ShaderFileDependency>> dependencies( infos.size() );
+        for ( sizet i = 0; i < infos.size(); ++i ) {
+            infos[ i ].dependencies = &dependencies[ i ];
+        }
+
+        ilog( "Compiling %u programs, %u stages\n", ( u32 )programs.size(), ( u32 )infos.size() );
+        shader_compiler_compile_many( Span<const ShaderCompilationInfo>( infos.data(), infos.size() ),
+                                      Span<std::vector<unsigned int>>( spirv.data(), spirv.size() ) );
+
+        // A pack with missing programs would silently compile them at runtime.
+        for ( const PackProgram& program : programs ) {
+            for ( u32 s = 0; s < program.num_stages; ++s ) {
+                if ( spirv[ program.first_compilation + s ].empty() ) {
+                    ilog_error( "Error compiling program %s, stage %s\n", program.name.data, program.paths[ s ].data );
+                    success = false;
+                }
+            }
+        }
+
+        success = success && write_pack( pack_path, programs, spirv, dependencies );
+    }
+
+    strings.shutdown();
+    return success;
+}
+
+} // namespace idra
+
+int main( int argc, char** argv ) {
+
+    using namespace idra;
+
+    if ( argc < 4 ) {
+        printf( "Usage: shader_compiler_cli <shader folder> <manifest> <output pack> [cache folder]\n" );
+        return 1;
+    }
+
+    g_memory->init( imega( 2 ), imega( 1 ) );
+    g_time->init();
+    g_log->init( g_memory->get_resident_allocator() );
+
+    const TimeTick start_time = g_time->now();
+
+    shader_compiler_init( argv[ 1 ], argc > 4 ? argv[ 4 ] : "" );
+
+    const bool success = build_shader_pack( argv[ 1 ], argv[ 2 ], argv[ 3 ] );
+
+    shader_compiler_shutdown();
+
+    ilog( "Shader pack built in %.1f ms\n", g_time->convert_milliseconds( g_time->delta( g_time->now(), start_time ) ) );
+
+    g_log->shutdown();
+    g_time->shutdown();
+    g_memory->shutdown();
+
+    return success ? 0 : 1;
 }